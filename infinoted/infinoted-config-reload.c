@@ -24,6 +24,7 @@
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-filesystem-account-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/inf-config.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -73,6 +74,7 @@ infinoted_config_reload(InfinotedRun* run,
   InfdStorage* storage;
   InfdFilesystemStorage* filesystem_storage;
   InfdFilesystemAccountStorage* filesystem_account_storage;
+  InfCommunicationManager* communication_manager;
   gchar* root_directory;
   gboolean result;
 
@@ -86,6 +88,13 @@ infinoted_config_reload(InfinotedRun* run,
   startup = infinoted_startup_new(NULL, NULL, error);
   if(!startup) return FALSE;
 
+  if(!inf_async_operation_set_io_pool_size(startup->options->storage_threads,
+                                           error))
+  {
+    infinoted_startup_free(startup);
+    return FALSE;
+  }
+
   /* Acquire DH params if necessary (if security policy changed from
    * no-tls to one of allow-tls or require-tls). */
   dh_params = run->dh_params;
@@ -131,6 +140,8 @@ infinoted_config_reload(InfinotedRun* run,
       "io", run->io,
       "local-address", addr,
       "local-port", startup->options->port,
+      "backlog", startup->options->listen_backlog,
+      "accept-batch-size", startup->options->accept_batch_size,
       NULL
     );
     inf_ip_address_free(addr);
@@ -146,6 +157,8 @@ infinoted_config_reload(InfinotedRun* run,
       "io", run->io,
       "local-address", NULL,
       "local-port", startup->options->port,
+      "backlog", startup->options->listen_backlog,
+      "accept-batch-size", startup->options->accept_batch_size,
       NULL
     );
 
@@ -282,6 +295,13 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp6);
 
+      g_object_set(
+        G_OBJECT(run->xmpp6),
+        "tls-offload", TRUE,
+        "session-ticket-lifetime", startup->options->session_ticket_lifetime,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp6));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -305,6 +325,13 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp4);
 
+      g_object_set(
+        G_OBJECT(run->xmpp4),
+        "tls-offload", TRUE,
+        "session-ticket-lifetime", startup->options->session_ticket_lifetime,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp4));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -327,6 +354,7 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp6),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "session-ticket-lifetime", startup->options->session_ticket_lifetime,
         NULL
       );
     }
@@ -337,11 +365,52 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp4),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "session-ticket-lifetime", startup->options->session_ticket_lifetime,
         NULL
       );
     }
+
+    /* The listen backlog only takes effect when the servers are re-created,
+     * but the accept batch size can be changed directly. */
+    if(run->xmpp6 != NULL)
+    {
+      g_object_get(G_OBJECT(run->xmpp6), "tcp-server", &tcp6, NULL);
+      g_object_set(
+        G_OBJECT(tcp6),
+        "accept-batch-size", startup->options->accept_batch_size,
+        NULL
+      );
+      g_object_unref(tcp6);
+      tcp6 = NULL;
+    }
+
+    if(run->xmpp4 != NULL)
+    {
+      g_object_get(G_OBJECT(run->xmpp4), "tcp-server", &tcp4, NULL);
+      g_object_set(
+        G_OBJECT(tcp4),
+        "accept-batch-size", startup->options->accept_batch_size,
+        NULL
+      );
+      g_object_unref(tcp4);
+      tcp4 = NULL;
+    }
   }
 
+  g_object_get(
+    G_OBJECT(run->directory),
+    "communication-manager", &communication_manager,
+    NULL
+  );
+
+  g_object_set(
+    G_OBJECT(inf_communication_manager_get_registry(communication_manager)),
+    "coalesce-time", startup->options->coalesce_time,
+    NULL
+  );
+
+  g_object_unref(communication_manager);
+
   /* Now, re-initialize plugins. This is a bit tricky, because it can fail,
    * and because we need to unload the previous plugins first.
    *
@@ -92,6 +92,27 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
     'p',
     N_("The TCP port number to listen on."),
     N_("PORT")
+  }, {
+    "listen-backlog",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, listen_backlog),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Maximum number of incoming connections that the operating system "
+       "queues before they are accepted by the server. [Default=128]"),
+    N_("NUM")
+  }, {
+    "accept-batch-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, accept_batch_size),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Maximum number of incoming connections to accept at once before "
+       "handling traffic of existing connections again. Set to 0 for no "
+       "limit. [Default=64]"),
+    N_("NUM")
   }, {
     "security-policy",
     INFINOTED_PARAMETER_STRING,
@@ -131,6 +152,39 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "the configuration file (one section for each plugin), or with the "
        "--plugin-parameter option. [Default=note-text]"),
     N_("PLUGIN-NAME")
+  }, {
+    "coalesce-time",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, coalesce_time),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Time in milliseconds to wait for more messages to the same client "
+       "before sending a message, so that messages sent in quick succession "
+       "can be sent together. Set to 0 to send all messages immediately. "
+       "[Default=2]"),
+    N_("MSECS")
+  }, {
+    "session-ticket-lifetime",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, session_ticket_lifetime),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Time in seconds during which clients can resume a previous TLS "
+       "session when reconnecting, without a full handshake. Set to 0 to "
+       "disable TLS session resumption. [Default=3600]"),
+    N_("SECONDS")
+  }, {
+    "storage-threads",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, storage_threads),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Maximum number of threads which read directory listings and ACLs "
+       "from the storage at the same time. [Default=4]"),
+    N_("NUM")
   }, {
     "password",
     INFINOTED_PARAMETER_STRING,
@@ -962,12 +1016,17 @@ infinoted_options_new(const gchar* const* config_files,
   options->create_key = FALSE;
   options->create_certificate = FALSE;
   options->port = inf_protocol_get_default_port();
+  options->listen_backlog = 128;
+  options->accept_batch_size = 64;
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
   options->plugins = g_malloc(2 * sizeof(gchar*));
   options->plugins[0] = g_strdup("note-text");
   options->plugins[1] = NULL;
+  options->coalesce_time = 2;
+  options->session_ticket_lifetime = 3600;
+  options->storage_threads = 4;
   options->password = NULL;
   options->password_len = 0;
 #ifdef LIBINFINITY_HAVE_PAM
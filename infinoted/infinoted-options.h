@@ -39,10 +39,15 @@ struct _InfinotedOptions {
   gboolean create_key;
   gboolean create_certificate;
   guint port;
+  guint listen_backlog;
+  guint accept_batch_size;
   InfXmppConnectionSecurityPolicy security_policy;
   gchar* root_directory;
 
   gchar** plugins;
+  guint coalesce_time;
+  guint session_ticket_lifetime;
+  guint storage_threads;
 
   gchar* password;
   gsize password_len;
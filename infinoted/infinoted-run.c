@@ -27,6 +27,7 @@
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 #include <libinfinity/common/inf-xmpp-manager.h>
+#include <libinfinity/common/inf-async-operation.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-config.h>
@@ -55,6 +56,13 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   run->io = inf_standalone_io_new();
 
+  g_object_set(
+    G_OBJECT(inf_communication_manager_get_registry(communication_manager)),
+    "io", run->io,
+    "coalesce-time", startup->options->coalesce_time,
+    NULL
+  );
+
   run->directory = infd_directory_new(
     INF_IO(run->io),
     INFD_STORAGE(storage),
@@ -163,6 +171,8 @@ infinoted_run_create_server(InfinotedRun* run,
       "io", INF_IO(run->io),
       "local-address", address,
       "local-port", startup->options->port,
+      "backlog", startup->options->listen_backlog,
+      "accept-batch-size", startup->options->accept_batch_size,
       NULL
     )
   );
@@ -183,6 +193,17 @@ infinoted_run_create_server(InfinotedRun* run,
     startup->sasl_context ? "PLAIN" : NULL
   );
 
+  /* Don't let many clients connecting at the same time, such as after a
+   * network outage, block the sessions of clients that are connected. */
+  g_object_set(G_OBJECT(xmpp), "tls-offload", TRUE, NULL);
+
+  /* Let reconnecting clients skip the full handshake */
+  g_object_set(
+    G_OBJECT(xmpp),
+    "session-ticket-lifetime", startup->options->session_ticket_lifetime,
+    NULL
+  );
+
   infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -223,6 +244,12 @@ infinoted_run_new(InfinotedStartup* startup,
   InfinotedRun* run;
   GError* local_error;
 
+  if(!inf_async_operation_set_io_pool_size(startup->options->storage_threads,
+                                           error))
+  {
+    return NULL;
+  }
+
   run = g_slice_new(InfinotedRun);
   run->startup = startup;
   run->dh_params = NULL;
@@ -43,6 +43,7 @@ struct _InfinotedPluginAutosaveSessionInfo {
   InfBrowserIter iter;
   InfSessionProxy* proxy;
   InfIoTimeout* timeout;
+  InfdStorageRequest* request;
 };
 
 static void
@@ -112,19 +113,105 @@ infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
 }
 
 static void
-infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+infinoted_plugin_autosave_run_hook(InfinotedPluginAutosaveSessionInfo* info)
 {
   InfdDirectory* directory;
-  InfBrowserIter* iter;
   GError* error;
   gchar* path;
-  InfSession* session;
-  InfBuffer* buffer;
   gchar* root_directory;
   gchar* argv[4];
 
   directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
-  iter = &info->iter;
+  error = NULL;
+
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  g_object_get(
+    G_OBJECT(infd_directory_get_storage(directory)),
+    "root-directory",
+    &root_directory,
+    NULL
+  );
+
+  argv[0] = info->plugin->hook;
+  argv[1] = root_directory;
+  argv[2] = path;
+  argv[3] = NULL;
+
+  if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                    NULL, NULL, NULL, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("Could not execute autosave hook: \"%s\""),
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_free(path);
+  g_free(root_directory);
+}
+
+static void
+infinoted_plugin_autosave_failed(InfinotedPluginAutosaveSessionInfo* info,
+                                 const GError* error)
+{
+  InfdDirectory* directory;
+  gchar* path;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(info->plugin->manager),
+    _("Failed to auto-save session \"%s\": %s\n\n"
+      "Will retry in %u seconds."),
+    path,
+    error->message,
+    info->plugin->interval
+  );
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_autosave_saved_func(InfdStorage* storage,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  InfSession* session;
+
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+  info->request = NULL;
+
+  if(error != NULL)
+  {
+    infinoted_plugin_autosave_failed(info, error);
+
+    /* This restarts the timeout, unless the buffer has been modified again
+     * in the meanwhile, in which case it is running already. */
+    g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+    inf_buffer_set_modified(inf_session_get_buffer(session), TRUE);
+    g_object_unref(session);
+  }
+  else if(info->plugin->hook != NULL)
+  {
+    infinoted_plugin_autosave_run_hook(info);
+  }
+}
+
+static void
+infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  GError* error;
+  InfSession* session;
+  InfBuffer* buffer;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
   error = NULL;
 
   if(info->timeout != NULL)
@@ -133,6 +220,13 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
     info->timeout = NULL;
   }
 
+  /* A save that is still in progress is superseded by this one */
+  if(info->request != NULL)
+  {
+    infd_storage_request_cancel(info->request);
+    info->request = NULL;
+  }
+
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
 
@@ -142,63 +236,30 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
     info
   );
 
-  if(infd_directory_iter_save_session(directory, iter, &error) == FALSE)
-  {
-    path = inf_browser_get_path(INF_BROWSER(directory), iter);
-
-    infinoted_log_warning(
-      infinoted_plugin_manager_get_log(info->plugin->manager),
-      _("Failed to auto-save session \"%s\": %s\n\n"
-        "Will retry in %u seconds."),
-      path,
-      error->message,
-      info->plugin->interval
-    );
+  /* The session is written in the background, so that the server keeps
+   * serving the session while the disk is busy. */
+  info->request = infd_directory_iter_save_session_async(
+    directory,
+    &info->iter,
+    infinoted_plugin_autosave_saved_func,
+    info,
+    &error
+  );
 
-    g_free(path);
+  if(info->request == NULL)
+  {
+    infinoted_plugin_autosave_failed(info, error);
     g_error_free(error);
-    error = NULL;
 
     infinoted_plugin_autosave_start(info);
   }
   else
   {
+    /* The session has been serialized at this point, so changes made while
+     * it is being written mark the buffer as modified again. */
     /* TODO: Remove this as soon as directory itself unsets modified flag
      * on session_write */
     inf_buffer_set_modified(INF_BUFFER(buffer), FALSE);
-
-    if(info->plugin->hook != NULL)
-    {
-      path = inf_browser_get_path(INF_BROWSER(directory), iter);
-
-      g_object_get(
-        G_OBJECT(infd_directory_get_storage(directory)),
-        "root-directory",
-        &root_directory,
-        NULL
-      );
-
-      argv[0] = info->plugin->hook;
-      argv[1] = root_directory;
-      argv[2] = path;
-      argv[3] = NULL;
-
-      if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
-                        NULL, NULL, NULL, &error))
-      {
-        infinoted_log_warning(
-          infinoted_plugin_manager_get_log(info->plugin->manager),
-          _("Could not execute autosave hook: \"%s\""),
-          error->message
-        );
-
-        g_error_free(error);
-        error = NULL;
-      }
-
-      g_free(path);
-      g_free(root_directory);
-    }
   }
   
   inf_signal_handlers_unblock_by_func(
@@ -269,6 +330,7 @@ infinoted_plugin_autosave_session_added(const InfBrowserIter* iter,
   info->iter = *iter;
   info->proxy = proxy;
   info->timeout = NULL;
+  info->request = NULL;
   g_object_ref(proxy);
 
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
@@ -304,6 +366,13 @@ infinoted_plugin_autosave_session_removed(const InfBrowserIter* iter,
   if(info->timeout != NULL)
     infinoted_plugin_autosave_stop(info);
 
+  /* The session is still written, but the result is no longer reported */
+  if(info->request != NULL)
+  {
+    infd_storage_request_cancel(info->request);
+    info->request = NULL;
+  }
+
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
 
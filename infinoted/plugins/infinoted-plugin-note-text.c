@@ -29,9 +29,44 @@
 typedef struct _InfinotedPluginNoteText InfinotedPluginNoteText;
 struct _InfinotedPluginNoteText {
   InfinotedPluginManager* manager;
+  gint format_flags;
+  gboolean journal;
+  guint journal_size;
+
+  InfdNotePlugin note_plugin;
   const InfdNotePlugin* plugin;
 };
 
+static GQuark
+infinoted_plugin_note_text_journal_quark(void)
+{
+  return g_quark_from_static_string("infinoted-plugin-note-text-journal");
+}
+
+/* Starts recording changes of a session whose buffer matches what is stored
+ * at path. The journal lives as long as the session. */
+static void
+infinoted_plugin_note_text_start_journal(InfdStorage* storage,
+                                         InfSession* session,
+                                         const gchar* path)
+{
+  InfTextFilesystemJournal* journal;
+
+  journal = inf_text_filesystem_journal_new(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session))
+  );
+
+  g_object_set_qdata_full(
+    G_OBJECT(session),
+    infinoted_plugin_note_text_journal_quark(),
+    journal,
+    (GDestroyNotify)inf_text_filesystem_journal_free
+  );
+}
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -69,6 +104,7 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
                                         gpointer user_data,
                                         GError** error)
 {
+  InfinotedPluginNoteText* plugin;
   InfUserTable* user_table;
   InfTextBuffer* buffer;
   gboolean result;
@@ -76,6 +112,7 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
 
+  plugin = (InfinotedPluginNoteText*)user_data;
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
 
@@ -107,6 +144,15 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
   g_object_unref(user_table);
   g_object_unref(buffer);
 
+  if(plugin->journal)
+  {
+    infinoted_plugin_note_text_start_journal(
+      storage,
+      INF_SESSION(session),
+      path
+    );
+  }
+
   return INF_SESSION(session);
 }
 
@@ -117,11 +163,78 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          gpointer user_data,
                                          GError** error)
 {
-  return inf_text_filesystem_format_write(
+  InfinotedPluginNoteText* plugin;
+  InfTextFilesystemJournal* journal;
+  gboolean result;
+
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  journal = g_object_get_qdata(
+    G_OBJECT(session),
+    infinoted_plugin_note_text_journal_quark()
+  );
+
+  if(journal != NULL)
+  {
+    /* All changes are on disk already, unless the journal could not be
+     * written. Only rewrite the whole document when the journal has grown
+     * too large, to keep loading it fast. */
+    if(inf_text_filesystem_journal_get_size(journal) <
+       (guint64)plugin->journal_size * 1024 &&
+       inf_text_filesystem_journal_check(journal, NULL))
+    {
+      return TRUE;
+    }
+
+    return inf_text_filesystem_journal_checkpoint(
+      journal,
+      plugin->format_flags,
+      error
+    );
+  }
+
+  result = inf_text_filesystem_format_write_with_flags(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    plugin->format_flags,
+    error
+  );
+
+  /* This is the first time the session is stored, for example after it has
+   * been created or synchronized to the server. */
+  if(result == TRUE && plugin->journal)
+    infinoted_plugin_note_text_start_journal(storage, session, path);
+
+  return result;
+}
+
+static InfdStorageRequest*
+infinoted_plugin_note_text_session_write_async(InfdStorage* storage,
+                                               InfIo* io,
+                                               InfSession* session,
+                                               const gchar* path,
+                                               gpointer plugin_data,
+                                               InfdStorageFinishedFunc func,
+                                               gpointer user_data,
+                                               GError** error)
+{
+  InfinotedPluginNoteText* plugin;
+  plugin = (InfinotedPluginNoteText*)plugin_data;
+
+  /* Journaled sessions are written with session_write */
+  g_assert(plugin->journal == FALSE);
+
+  return inf_text_filesystem_format_write_async(
     INFD_FILESYSTEM_STORAGE(storage),
+    io,
     path,
     inf_session_get_user_table(session),
     INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    plugin->format_flags,
+    func,
+    user_data,
     error
   );
 }
@@ -132,7 +245,8 @@ const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  infinoted_plugin_note_text_session_write_async
 };
 
 /* Infinoted plugin glue */
@@ -143,6 +257,11 @@ infinoted_plugin_note_text_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginNoteText*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->format_flags = 0;
+  plugin->journal = FALSE;
+  plugin->journal_size = 1024;
+  plugin->note_plugin = INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->note_plugin.user_data = plugin;
   plugin->plugin = NULL;
 }
 
@@ -158,9 +277,15 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  /* The journal records changes as they are made, so the full document
+   * only needs to be written at a checkpoint, which has to happen in step
+   * with the journal. */
+  if(plugin->journal)
+    plugin->note_plugin.session_write_async = NULL;
+
   result = infd_directory_add_plugin(
     infinoted_plugin_manager_get_directory(manager),
-    &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN
+    &plugin->note_plugin
   );
 
   if(result != TRUE)
@@ -176,7 +301,7 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
-  plugin->plugin = &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->plugin = &plugin->note_plugin;
   return TRUE;
 }
 
@@ -202,8 +327,74 @@ infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
   }
 }
 
-static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
+static const GFlagsValue INFINOTED_PLUGIN_NOTE_TEXT_FORMAT_FLAGS[] = {
   {
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    "INF_TEXT_FILESYSTEM_FORMAT_BINARY",
+    "binary"
+  }, {
+    INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+    "INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED",
+    "compressed"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
+static gboolean
+infinoted_plugin_note_text_convert_format_flags(gpointer in,
+                                                gpointer out,
+                                                GError** error)
+{
+  return infinoted_parameter_convert_flags(
+    in,
+    out,
+    INFINOTED_PLUGIN_NOTE_TEXT_FORMAT_FLAGS,
+    error
+  );
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
+  { "format",
+    INFINOTED_PARAMETER_STRING_LIST,
+    0,
+    offsetof(InfinotedPluginNoteText, format_flags),
+    infinoted_plugin_note_text_convert_format_flags,
+    0,
+    N_("How to store text documents in the root directory. Without flags, "
+       "documents are stored as XML. With \"binary\", a compact binary "
+       "format is used instead, and \"compressed\" additionally compresses "
+       "the text of binary documents. Documents in either format are read "
+       "back regardless of this setting, and are converted when they are "
+       "saved the next time."),
+    N_("binary;compressed")
+  }, {
+    "journal",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, journal),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to record every change to a text document in a journal "
+       "next to the document in the root directory. Saving a document then "
+       "only requires to write the journal, and the document itself is "
+       "only rewritten when the journal has grown larger than "
+       "\"journal-size\". The journal is applied when the document is "
+       "loaded again, also after the server crashed."),
+    NULL
+  }, {
+    "journal-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteText, journal_size),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Size of the journal of a document, in kilobytes, above which the "
+       "document is rewritten completely when it is saved. [Default: 1024]"),
+    N_("KILOBYTES")
+  }, {
     NULL,
     0,
     0,
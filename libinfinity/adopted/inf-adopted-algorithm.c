@@ -67,6 +67,7 @@
  * dynamically as O(active users^2). */
 
 #include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/adopted/inf-adopted-request-private.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -77,16 +78,31 @@ struct _InfAdoptedAlgorithmLocalUser {
   gboolean can_redo;
 };
 
+/* Key for the per-execution translation memo. The vector is owned by the
+ * request stored as the value. */
+typedef struct _InfAdoptedAlgorithmMemoKey InfAdoptedAlgorithmMemoKey;
+struct _InfAdoptedAlgorithmMemoKey {
+  guint user_id;
+  InfAdoptedStateVector* vector;
+};
+
 typedef struct _InfAdoptedAlgorithmPrivate InfAdoptedAlgorithmPrivate;
 struct _InfAdoptedAlgorithmPrivate {
   /* request log policy */
   guint max_total_log_size;
+  guint max_cache_size;
 
   InfAdoptedStateVector* current;
   InfAdoptedStateVector* buffer_modified_time;
 
   InfAdoptedRequest* execute_request;
 
+  /* Translations done while executing execute_request, including those that
+   * cannot go into the request log caches. */
+  gboolean memoize_translations;
+  GHashTable* memo;
+  guint transform_count;
+
   InfUserTable* user_table;
   InfBuffer* buffer;
 
@@ -108,7 +124,11 @@ enum {
   
   /* read/only */
   PROP_CURRENT_STATE,
-  PROP_BUFFER_MODIFIED_STATE
+  PROP_BUFFER_MODIFIED_STATE,
+
+  /* read/write */
+  PROP_MAX_CACHE_SIZE,
+  PROP_MEMOIZE_TRANSLATIONS
 };
 
 enum {
@@ -129,78 +149,6 @@ static guint algorithm_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedAlgorithm, inf_adopted_algorithm, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedAlgorithm))
 
-/* Returns a new state vector v so that both first and second are causally
- * before v and so that there is no other state vector with the same property
- * that is causally before v. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
-                                             InfAdoptedStateVector* first,
-                                             InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MAX(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  g_assert(inf_adopted_state_vector_causally_before(first, result));
-  g_assert(inf_adopted_state_vector_causally_before(second, result));
-  return result;
-}
-
-/* Returns a new state vector v so that v is both causally before first and
- * second and so that there is no other state vector with the same property
- * so that v is causally before that vector. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-/* TODO: A version modifying first instead of returning a new result,
- * use in inf_adopted_algorithm_cleanup(). */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
-                                               InfAdoptedStateVector* first,
-                                               InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MIN(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  return result;
-}
-
 /* Checks whether the given request can be undone (or redone if it is an
  * undo request). In general, a user can perform an undo when
  * there is a request to undo in the request log. However, if there are too
@@ -353,6 +301,8 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
   log = inf_adopted_user_get_request_log(user);
   time = inf_adopted_user_get_vector(user);
 
+  inf_adopted_request_log_set_max_cache_size(log, priv->max_cache_size);
+
   inf_adopted_state_vector_set(
     priv->current,
     inf_user_get_id(INF_USER(user)),
@@ -570,6 +520,77 @@ inf_adopted_algorithm_update_local_user_times(InfAdoptedAlgorithm* algorithm)
   }
 }
 
+static guint
+inf_adopted_algorithm_memo_key_hash(gconstpointer key)
+{
+  const InfAdoptedAlgorithmMemoKey* memo_key;
+  memo_key = (const InfAdoptedAlgorithmMemoKey*)key;
+
+  return inf_adopted_state_vector_hash(memo_key->vector) * 31 +
+    memo_key->user_id;
+}
+
+static gboolean
+inf_adopted_algorithm_memo_key_equal(gconstpointer first,
+                                     gconstpointer second)
+{
+  const InfAdoptedAlgorithmMemoKey* first_key;
+  const InfAdoptedAlgorithmMemoKey* second_key;
+
+  first_key = (const InfAdoptedAlgorithmMemoKey*)first;
+  second_key = (const InfAdoptedAlgorithmMemoKey*)second;
+
+  if(first_key->user_id != second_key->user_id)
+    return FALSE;
+
+  return inf_adopted_state_vector_compare(
+    first_key->vector,
+    second_key->vector
+  ) == 0;
+}
+
+static void
+inf_adopted_algorithm_memo_key_free(gpointer key)
+{
+  g_slice_free(InfAdoptedAlgorithmMemoKey, key);
+}
+
+static InfAdoptedRequest*
+inf_adopted_algorithm_memo_lookup(InfAdoptedAlgorithm* algorithm,
+                                  guint user_id,
+                                  InfAdoptedStateVector* vector)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmMemoKey key;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  if(!priv->memoize_translations || priv->execute_request == NULL)
+    return NULL;
+
+  key.user_id = user_id;
+  key.vector = vector;
+  return g_hash_table_lookup(priv->memo, &key);
+}
+
+static void
+inf_adopted_algorithm_memo_insert(InfAdoptedAlgorithm* algorithm,
+                                  InfAdoptedRequest* request)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmMemoKey* key;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  if(!priv->memoize_translations || priv->execute_request == NULL)
+    return;
+
+  key = g_slice_new(InfAdoptedAlgorithmMemoKey);
+  key->user_id = inf_adopted_request_get_user_id(request);
+  key->vector = inf_adopted_request_get_vector(request);
+
+  g_object_ref(request);
+  g_hash_table_replace(priv->memo, key, request);
+}
+
 /* We can cache requests if:
  * a) they are reversible. If they are not, they will be made reversible
  * later (see inf_adopted_algorithm_execute_request), but the algorithm relies
@@ -640,8 +661,7 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
   concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
   if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
   {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
+    lcs = inf_adopted_state_vector_least_common_successor(
       inf_adopted_request_get_vector(request),
       inf_adopted_request_get_vector(against)
     );
@@ -686,6 +706,8 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
     lcs_against
   );
 
+  INF_ADOPTED_ALGORITHM_PRIVATE(algorithm)->transform_count++;
+
   if(lcs_request != NULL)
     g_object_unref(lcs_request);
   if(lcs_against != NULL)
@@ -753,11 +775,28 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
       if(associated != NULL &&
          inf_adopted_request_get_index(associated) < to_n)
       {
-        next_req = inf_adopted_request_fold(
-          cur_req,
-          user_id,
-          inf_adopted_request_get_index(associated) - from_n + 1
-        );
+        /* Requests made on the way that are neither cached nor memoized
+         * are not seen by anybody else, so there is no need to copy them
+         * for every step. */
+        if(cur_req != request && _inf_adopted_request_is_exclusive(cur_req))
+        {
+          _inf_adopted_request_fold_in_place(
+            cur_req,
+            user_id,
+            inf_adopted_request_get_index(associated) - from_n + 1
+          );
+
+          next_req = cur_req;
+          g_object_ref(next_req);
+        }
+        else
+        {
+          next_req = inf_adopted_request_fold(
+            cur_req,
+            user_id,
+            inf_adopted_request_get_index(associated) - from_n + 1
+          );
+        }
 
         break;
       }
@@ -827,10 +866,23 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
 
       if(associated_index != G_MAXUINT && associated_index <= to_n)
       {
-        next_req = inf_adopted_request_mirror(
-          cur_req,
-          associated_index - from_n
-        );
+        if(cur_req != request && _inf_adopted_request_is_exclusive(cur_req))
+        {
+          _inf_adopted_request_mirror_in_place(
+            cur_req,
+            associated_index - from_n
+          );
+
+          next_req = cur_req;
+          g_object_ref(next_req);
+        }
+        else
+        {
+          next_req = inf_adopted_request_mirror(
+            cur_req,
+            associated_index - from_n
+          );
+        }
       }
     }
 
@@ -1034,8 +1086,18 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
   priv->max_total_log_size = 2048;
+  priv->max_cache_size = G_MAXUINT;
   priv->execute_request = NULL;
 
+  priv->memoize_translations = FALSE;
+  priv->memo = g_hash_table_new_full(
+    inf_adopted_algorithm_memo_key_hash,
+    inf_adopted_algorithm_memo_key_equal,
+    inf_adopted_algorithm_memo_key_free,
+    g_object_unref
+  );
+  priv->transform_count = 0;
+
   priv->current = inf_adopted_state_vector_new();
   priv->buffer_modified_time = NULL;
   priv->user_table = NULL;
@@ -1168,6 +1230,7 @@ inf_adopted_algorithm_finalize(GObject* object)
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
   inf_adopted_state_vector_free(priv->current);
+  g_hash_table_destroy(priv->memo);
 
   G_OBJECT_CLASS(inf_adopted_algorithm_parent_class)->finalize(object);
 }
@@ -1180,6 +1243,7 @@ inf_adopted_algorithm_set_property(GObject* object,
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
@@ -1229,6 +1293,23 @@ inf_adopted_algorithm_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_MAX_CACHE_SIZE:
+    priv->max_cache_size = g_value_get_uint(value);
+
+    for(user = priv->users_begin; user != priv->users_end; ++user)
+    {
+      inf_adopted_request_log_set_max_cache_size(
+        inf_adopted_user_get_request_log(*user),
+        priv->max_cache_size
+      );
+    }
+
+    break;
+  case PROP_MEMOIZE_TRANSLATIONS:
+    /* Must not be toggled while a request is being translated */
+    g_assert(priv->execute_request == NULL);
+    priv->memoize_translations = g_value_get_boolean(value);
+    break;
   case PROP_CURRENT_STATE:
   case PROP_BUFFER_MODIFIED_STATE:
     /* read/only */
@@ -1261,6 +1342,12 @@ inf_adopted_algorithm_get_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     g_value_set_uint(value, priv->max_total_log_size);
     break;
+  case PROP_MAX_CACHE_SIZE:
+    g_value_set_uint(value, priv->max_cache_size);
+    break;
+  case PROP_MEMOIZE_TRANSLATIONS:
+    g_value_set_boolean(value, priv->memoize_translations);
+    break;
   case PROP_CURRENT_STATE:
     g_value_set_boxed(value, priv->current);
     break;
@@ -1356,6 +1443,33 @@ inf_adopted_algorithm_class_init(InfAdoptedAlgorithmClass* algorithm_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_CACHE_SIZE,
+    g_param_spec_uint(
+      "max-cache-size",
+      "Maximum cache size",
+      "The maximum number of translated requests to cache per user",
+      0,
+      G_MAXUINT,
+      G_MAXUINT,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MEMOIZE_TRANSLATIONS,
+    g_param_spec_boolean(
+      "memoize-translations",
+      "Memoize translations",
+      "Whether to remember all intermediate translations while executing "
+      "a request, including those that cannot be cached in the request logs",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CURRENT_STATE,
@@ -1614,6 +1728,29 @@ inf_adopted_algorithm_get_execute_request(InfAdoptedAlgorithm* algorithm)
   return INF_ADOPTED_ALGORITHM_PRIVATE(algorithm)->execute_request;
 }
 
+/**
+ * inf_adopted_algorithm_get_transform_count:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ *
+ * Returns the number of operational transformations that were performed to
+ * translate the request currently being executed, or, if no request is
+ * being executed, the most recently executed request. Inside a handler of
+ * the #InfAdoptedAlgorithm::end-execute-request signal this is the cost of
+ * the request the signal is emitted for.
+ *
+ * Translations found in the request log caches, or, if the
+ * #InfAdoptedAlgorithm:memoize-translations property is set, in the
+ * translations already done for the same request, do not count.
+ *
+ * Returns: The number of transformations done for the last request.
+ */
+guint
+inf_adopted_algorithm_get_transform_count(InfAdoptedAlgorithm* algorithm)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), 0);
+  return INF_ADOPTED_ALGORITHM_PRIVATE(algorithm)->transform_count;
+}
+
 /**
  * inf_adopted_algorithm_generate_request:
  * @algorithm: A #InfAdoptedAlgorithm.
@@ -1739,10 +1876,13 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
   );
 
   /* If the request affects the buffer, then it might have been cached
-   * earlier. */
+   * earlier, or translated already while executing the current request. */
   if(inf_adopted_request_affects_buffer(request))
   {
-    result = inf_adopted_request_log_lookup_cached_request(log, to);
+    result = inf_adopted_algorithm_memo_lookup(algorithm, user_id, to);
+    if(result == NULL)
+      result = inf_adopted_request_log_lookup_cached_request(log, to);
+
     if(result != NULL)
     {
       g_object_ref(result);
@@ -1766,6 +1906,10 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
 
   if(inf_adopted_algorithm_can_cache(result))
     inf_adopted_request_log_add_cached_request(log, result);
+
+  /* The memo is dropped before the executed request is added to the log,
+   * so it may also hold requests that are not reversible yet. */
+  inf_adopted_algorithm_memo_insert(algorithm, result);
   return result;
 }
 
@@ -1868,6 +2012,7 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   /* not re-entrant */
   g_return_val_if_fail(priv->execute_request == NULL, FALSE);
   priv->execute_request = request;
+  priv->transform_count = 0;
 
   inf_adopted_request_set_execute_time(request, g_get_real_time());
 
@@ -1984,6 +2129,8 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
 
     if(local_error != NULL)
     {
+      g_hash_table_remove_all(priv->memo);
+
       inf_signal_handlers_unblock_by_func(
         G_OBJECT(priv->buffer),
         G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
@@ -2013,6 +2160,9 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     g_object_ref(request);
   }
 
+  /* Memoized translations are only valid until the request log changes */
+  g_hash_table_remove_all(priv->memo);
+
   inf_adopted_algorithm_log_request(
     algorithm,
     user,
@@ -2061,7 +2211,6 @@ void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedStateVector* temp;
   InfAdoptedStateVector* lcp;
   InfAdoptedUser** user;
   InfAdoptedRequestLog* log;
@@ -2107,14 +2256,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
   {
     if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
     {
-      temp = inf_adopted_algorithm_least_common_predecessor(
-        algorithm,
-        lcp,
-        inf_adopted_user_get_vector(*user)
-      );
-
-      inf_adopted_state_vector_free(lcp);
-      lcp = temp;
+      inf_adopted_state_vector_min(lcp, inf_adopted_user_get_vector(*user));
     }
   }
 
@@ -2257,4 +2399,56 @@ inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
   }
 }
 
+/**
+ * inf_adopted_algorithm_get_cache_stats:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @hits: (out) (allow-none): Location to store the number of cache hits,
+ * or %NULL.
+ * @misses: (out) (allow-none): Location to store the number of cache misses,
+ * or %NULL.
+ * @evictions: (out) (allow-none): Location to store the number of requests
+ * dropped from the cache because it was full, or %NULL.
+ *
+ * Returns the sum of the request cache statistics of all users' request
+ * logs, see inf_adopted_request_log_get_cache_stats(). The size of the
+ * caches can be limited with the #InfAdoptedAlgorithm:max-cache-size
+ * property.
+ **/
+void
+inf_adopted_algorithm_get_cache_stats(InfAdoptedAlgorithm* algorithm,
+                                      guint* hits,
+                                      guint* misses,
+                                      guint* evictions)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
+  guint log_hits, log_misses, log_evictions;
+  guint total_hits, total_misses, total_evictions;
+
+  g_return_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm));
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  total_hits = 0;
+  total_misses = 0;
+  total_evictions = 0;
+
+  for(user = priv->users_begin; user != priv->users_end; ++user)
+  {
+    inf_adopted_request_log_get_cache_stats(
+      inf_adopted_user_get_request_log(*user),
+      &log_hits,
+      &log_misses,
+      &log_evictions
+    );
+
+    total_hits += log_hits;
+    total_misses += log_misses;
+    total_evictions += log_evictions;
+  }
+
+  if(hits != NULL) *hits = total_hits;
+  if(misses != NULL) *misses = total_misses;
+  if(evictions != NULL) *evictions = total_evictions;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -126,6 +126,9 @@ inf_adopted_algorithm_get_current(InfAdoptedAlgorithm* algorithm);
 InfAdoptedRequest*
 inf_adopted_algorithm_get_execute_request(InfAdoptedAlgorithm* algorithm);
 
+guint
+inf_adopted_algorithm_get_transform_count(InfAdoptedAlgorithm* algorithm);
+
 InfAdoptedRequest*
 inf_adopted_algorithm_generate_request(InfAdoptedAlgorithm* algorithm,
                                        InfAdoptedRequestType type,
@@ -154,6 +157,12 @@ gboolean
 inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user);
 
+void
+inf_adopted_algorithm_get_cache_stats(InfAdoptedAlgorithm* algorithm,
+                                      guint* hits,
+                                      guint* misses,
+                                      guint* evictions);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_ALGORITHM_H__ */
@@ -43,9 +43,19 @@
 typedef struct _InfAdoptedRequestLogCleanupCacheData
   InfAdoptedRequestLogCleanupCacheData;
 struct _InfAdoptedRequestLogCleanupCacheData {
-  guint user_id;
   guint up_to;
-  GSList* requests_to_remove;
+  GSList* buckets_to_remove;
+};
+
+/* A translated request in the cache. Entries are found by their state
+ * vector via a hash table, kept in least-recently-used order for eviction,
+ * and grouped into buckets by the component of the log's user so that
+ * cleanup does not need to look at the other entries. */
+typedef struct _InfAdoptedRequestLogCacheEntry InfAdoptedRequestLogCacheEntry;
+struct _InfAdoptedRequestLogCacheEntry {
+  InfAdoptedRequest* request;
+  guint n; /* component of the log's user in the request's vector */
+  GList lru_link; /* data points to the entry itself */
 };
 
 typedef struct _InfAdoptedRequestLogEntry InfAdoptedRequestLogEntry;
@@ -64,7 +74,14 @@ typedef struct _InfAdoptedRequestLogPrivate InfAdoptedRequestLogPrivate;
 struct _InfAdoptedRequestLogPrivate {
   guint user_id;
   InfAdoptedRequestLogEntry* entries;
-  GTree* cache;
+
+  GHashTable* cache; /* InfAdoptedStateVector* -> entry */
+  GTree* cache_buckets; /* n -> GSList* of entries */
+  GQueue cache_lru; /* most recently used first */
+  guint max_cache_size;
+  guint cache_hits;
+  guint cache_misses;
+  guint cache_evictions;
 
   InfAdoptedRequestLogEntry* next_undo;
   InfAdoptedRequestLogEntry* next_redo;
@@ -85,7 +102,10 @@ enum {
   PROP_END,
 
   PROP_NEXT_UNDO,
-  PROP_NEXT_REDO
+  PROP_NEXT_REDO,
+
+  /* read/write */
+  PROP_MAX_CACHE_SIZE
 };
 
 enum {
@@ -159,35 +179,123 @@ inf_adopted_request_log_verify_related(InfAdoptedRequestLog* log)
  * Transformation cache
  */
 
+static gboolean
+inf_adopted_request_log_cache_key_equal(gconstpointer a,
+                                        gconstpointer b)
+{
+  return inf_adopted_state_vector_compare(
+    (const InfAdoptedStateVector*)a,
+    (const InfAdoptedStateVector*)b
+  ) == 0;
+}
+
 static int
-inf_adopted_request_log_cache_key_cmp(gconstpointer a,
-                                      gconstpointer b,
-                                      gpointer user_data)
+inf_adopted_request_log_cache_bucket_cmp(gconstpointer a,
+                                         gconstpointer b)
 {
-  InfAdoptedRequestLog* log;
-  InfAdoptedRequestLogPrivate* priv;
-  const InfAdoptedStateVector* key_a;
-  const InfAdoptedStateVector* key_b;
   guint n_a, n_b;
 
-  key_a = (const InfAdoptedStateVector*)a;
-  key_b = (const InfAdoptedStateVector*)b;
-
-  log = (InfAdoptedRequestLog*)user_data;
-  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-
-  /* Primary, order by component of user ID -- this makes cleanup very
-   * efficient. */
-  n_a = inf_adopted_state_vector_get(key_a, priv->user_id);
-  n_b = inf_adopted_state_vector_get(key_b, priv->user_id);
+  n_a = GPOINTER_TO_UINT(a);
+  n_b = GPOINTER_TO_UINT(b);
 
   if(n_a < n_b)
     return -1;
   if(n_a > n_b)
     return 1;
+  return 0;
+}
 
-  /* If user ID component is equal, go by other components. */
-  return inf_adopted_state_vector_compare(key_a, key_b);
+/* Frees entry without touching the bucket it is in */
+static void
+inf_adopted_request_log_cache_entry_free(InfAdoptedRequestLog* log,
+                                         InfAdoptedRequestLogCacheEntry* entry)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  g_hash_table_remove(
+    priv->cache,
+    inf_adopted_request_get_vector(entry->request)
+  );
+
+  g_queue_unlink(&priv->cache_lru, &entry->lru_link);
+  g_object_unref(entry->request);
+  g_slice_free(InfAdoptedRequestLogCacheEntry, entry);
+}
+
+static void
+inf_adopted_request_log_cache_evict(InfAdoptedRequestLog* log,
+                                    InfAdoptedRequestLogCacheEntry* entry)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  gpointer key;
+  GSList* bucket;
+
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  key = GUINT_TO_POINTER(entry->n);
+  bucket = g_tree_lookup(priv->cache_buckets, key);
+  bucket = g_slist_remove(bucket, entry);
+
+  if(bucket == NULL)
+    g_tree_remove(priv->cache_buckets, key);
+  else
+    g_tree_insert(priv->cache_buckets, key, bucket);
+
+  inf_adopted_request_log_cache_entry_free(log, entry);
+  ++priv->cache_evictions;
+}
+
+static void
+inf_adopted_request_log_cache_shrink(InfAdoptedRequestLog* log)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  while(g_queue_get_length(&priv->cache_lru) > priv->max_cache_size)
+  {
+    inf_adopted_request_log_cache_evict(
+      log,
+      (InfAdoptedRequestLogCacheEntry*)g_queue_peek_tail(&priv->cache_lru)
+    );
+  }
+}
+
+static gboolean
+inf_adopted_request_log_cache_clear_foreach_func(gpointer key,
+                                                 gpointer value,
+                                                 gpointer user_data)
+{
+  g_slist_free((GSList*)value);
+  return FALSE;
+}
+
+static void
+inf_adopted_request_log_cache_clear(InfAdoptedRequestLog* log)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
+
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  while(!g_queue_is_empty(&priv->cache_lru))
+  {
+    entry = (InfAdoptedRequestLogCacheEntry*)g_queue_peek_head(
+      &priv->cache_lru
+    );
+
+    inf_adopted_request_log_cache_entry_free(log, entry);
+  }
+
+  g_tree_foreach(
+    priv->cache_buckets,
+    inf_adopted_request_log_cache_clear_foreach_func,
+    NULL
+  );
+
+  g_tree_destroy(priv->cache_buckets);
+  priv->cache_buckets =
+    g_tree_new(inf_adopted_request_log_cache_bucket_cmp);
 }
 
 static gboolean
@@ -195,26 +303,21 @@ inf_adopted_request_log_remove_requests_cache_foreach_func(gpointer key,
                                                            gpointer value,
                                                            gpointer user_data)
 {
-  InfAdoptedStateVector* vector;
   InfAdoptedRequestLogCleanupCacheData* data;
-
-  vector = (InfAdoptedStateVector*)key;
   data = (InfAdoptedRequestLogCleanupCacheData*)user_data;
 
   /* Remove all requests which are a cached translation of one of the requests
    * that have been removed, i.e. have a user component smaller than up_to. */
-  if(inf_adopted_state_vector_get(vector, data->user_id) < data->up_to)
+  if(GPOINTER_TO_UINT(key) < data->up_to)
   {
-    data->requests_to_remove =
-      g_slist_prepend(data->requests_to_remove, vector);
+    data->buckets_to_remove = g_slist_prepend(data->buckets_to_remove, key);
     return FALSE;
   }
   else
   {
-    /* Stop traversal. The tree is traversed in sorted order, and the primary
-     * sort criteria of the tree is the vector component of the user. So if
-     * we have reached this point, all other elements in the tree will have
-     * a higher user component and are not scheduled for removal. */
+    /* Stop traversal. The buckets are traversed in order of the vector
+     * component of the user, so all remaining buckets have a higher user
+     * component and are not scheduled for removal. */
     return TRUE;
   }
 }
@@ -296,7 +399,20 @@ inf_adopted_request_log_init(InfAdoptedRequestLog* log)
 
   priv->alloc = INF_ADOPTED_REQUEST_LOG_INC;
   priv->entries = g_malloc(priv->alloc * sizeof(InfAdoptedRequestLogEntry));
-  priv->cache = NULL;
+
+  priv->cache = g_hash_table_new(
+    (GHashFunc)inf_adopted_state_vector_hash,
+    inf_adopted_request_log_cache_key_equal
+  );
+
+  priv->cache_buckets =
+    g_tree_new(inf_adopted_request_log_cache_bucket_cmp);
+  g_queue_init(&priv->cache_lru);
+  priv->max_cache_size = G_MAXUINT;
+  priv->cache_hits = 0;
+  priv->cache_misses = 0;
+  priv->cache_evictions = 0;
+
   priv->begin = 0;
   priv->end = 0;
   priv->offset = 0;
@@ -315,11 +431,7 @@ inf_adopted_request_log_dispose(GObject* object)
   log = INF_ADOPTED_REQUEST_LOG(object);
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  if(priv->cache != NULL)
-  {
-    g_tree_destroy(priv->cache);
-    priv->cache = NULL;
-  }
+  inf_adopted_request_log_cache_clear(log);
 
   for(i = priv->offset; i < priv->offset + (priv->end - priv->begin); ++ i)
     g_object_unref(G_OBJECT(priv->entries[i].request));
@@ -341,6 +453,8 @@ inf_adopted_request_log_finalize(GObject* object)
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
   g_free(priv->entries);
+  g_hash_table_destroy(priv->cache);
+  g_tree_destroy(priv->cache_buckets);
 
   G_OBJECT_CLASS(inf_adopted_request_log_parent_class)->finalize(object);
 }
@@ -369,6 +483,9 @@ inf_adopted_request_log_set_property(GObject* object,
     priv->begin = g_value_get_uint(value);
     priv->end = priv->begin;
     break;
+  case PROP_MAX_CACHE_SIZE:
+    inf_adopted_request_log_set_max_cache_size(log, g_value_get_uint(value));
+    break;
   case PROP_END:
   case PROP_NEXT_UNDO:
   case PROP_NEXT_REDO:
@@ -415,6 +532,9 @@ inf_adopted_request_log_get_property(GObject* object,
     else
       g_value_set_object(value, NULL);
 
+    break;
+  case PROP_MAX_CACHE_SIZE:
+    g_value_set_uint(value, priv->max_cache_size);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -706,6 +826,20 @@ inf_adopted_request_log_class_init(
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_CACHE_SIZE,
+    g_param_spec_uint(
+      "max-cache-size",
+      "Maximum cache size",
+      "The maximum number of translated requests to keep in the cache",
+      0,
+      G_MAXUINT,
+      G_MAXUINT,
+      G_PARAM_READWRITE
+    )
+  );
+
   /**
    * InfAdoptedRequestLog::add-request:
    * @log: The #InfAdoptedRequestLog to which a new request is added.
@@ -946,6 +1080,8 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
   InfAdoptedRequestLogCleanupCacheData data;
   guint i;
   GSList* item;
+  GSList* bucket;
+  GSList* entry_item;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
 
@@ -989,23 +1125,33 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
   priv->begin = up_to;
   g_object_notify(G_OBJECT(log), "begin");
 
-  if(priv->cache != NULL)
+  data.up_to = up_to;
+  data.buckets_to_remove = NULL;
+
+  g_tree_foreach(
+    priv->cache_buckets,
+    inf_adopted_request_log_remove_requests_cache_foreach_func,
+    &data
+  );
+
+  for(item = data.buckets_to_remove; item != NULL; item = item->next)
   {
-    data.user_id = priv->user_id;
-    data.up_to = up_to;
-    data.requests_to_remove = NULL;
-
-    g_tree_foreach(
-      priv->cache,
-      inf_adopted_request_log_remove_requests_cache_foreach_func,
-      &data
-    );
-    
-    for(item = data.requests_to_remove; item != NULL; item = item->next)
-      g_tree_remove(priv->cache, (InfAdoptedStateVector*)item->data);
-    g_slist_free(data.requests_to_remove);
+    bucket = g_tree_lookup(priv->cache_buckets, item->data);
+    g_tree_remove(priv->cache_buckets, item->data);
+
+    for(entry_item = bucket; entry_item != NULL; entry_item = entry_item->next)
+    {
+      inf_adopted_request_log_cache_entry_free(
+        log,
+        (InfAdoptedRequestLogCacheEntry*)entry_item->data
+      );
+    }
+
+    g_slist_free(bucket);
   }
 
+  g_slist_free(data.buckets_to_remove);
+
   inf_adopted_request_log_verify_related(log);
   g_object_thaw_notify(G_OBJECT(log));
 }
@@ -1324,7 +1470,8 @@ inf_adopted_request_log_lower_related(InfAdoptedRequestLog* log,
  *
  * The data structure of the cache is optimized for quick lookup of entries
  * by the state vector and cleaning up entries in an efficient manner also
- * when the cache has grown very big.
+ * when the cache has grown very big. The number of requests in the cache
+ * can be limited with inf_adopted_request_log_set_max_cache_size().
  *
  * The request cache is mainly used by #InfAdoptedAlgorithm to efficiently
  * handle big transformations.
@@ -1338,6 +1485,9 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
 {
   InfAdoptedRequestLogPrivate* priv;
   InfAdoptedStateVector* vector;
+  InfAdoptedRequestLogCacheEntry* entry;
+  gpointer key;
+  GSList* bucket;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
   g_return_if_fail(INF_ADOPTED_IS_REQUEST(request));
@@ -1346,25 +1496,27 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
   g_return_if_fail(inf_adopted_request_get_user_id(request) == priv->user_id);
 
   vector = inf_adopted_request_get_vector(request);
+  g_return_if_fail(g_hash_table_lookup(priv->cache, vector) == NULL);
 
-  if(priv->cache == NULL)
-  {
-    priv->cache = g_tree_new_full(
-      inf_adopted_request_log_cache_key_cmp,
-      log,
-      NULL,
-      g_object_unref
-    );
-  }
-
-  g_return_if_fail(g_tree_lookup(priv->cache, vector) == NULL);
+  if(priv->max_cache_size == 0)
+    return;
 
-  g_tree_insert(priv->cache, vector, request);
+  entry = g_slice_new(InfAdoptedRequestLogCacheEntry);
+  entry->request = request;
+  entry->n = inf_adopted_state_vector_get(vector, priv->user_id);
+  entry->lru_link.data = entry;
+  entry->lru_link.prev = NULL;
+  entry->lru_link.next = NULL;
   g_object_ref(request);
 
-  /* Implement lookup_cached_request */
-  /* Use this implementation in InfAdoptedAlgorithm */
-  /* Make the performance tests */
+  g_hash_table_insert(priv->cache, vector, entry);
+  g_queue_push_head_link(&priv->cache_lru, &entry->lru_link);
+
+  key = GUINT_TO_POINTER(entry->n);
+  bucket = g_tree_lookup(priv->cache_buckets, key);
+  g_tree_insert(priv->cache_buckets, key, g_slist_prepend(bucket, entry));
+
+  inf_adopted_request_log_cache_shrink(log);
 }
 
 /**
@@ -1386,14 +1538,100 @@ inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec)
 {
   InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), NULL);
   g_return_val_if_fail(vec != NULL, NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  if(priv->cache == NULL) return NULL;
+  entry = g_hash_table_lookup(priv->cache, vec);
+
+  if(entry == NULL)
+  {
+    ++priv->cache_misses;
+    return NULL;
+  }
+
+  ++priv->cache_hits;
+
+  g_queue_unlink(&priv->cache_lru, &entry->lru_link);
+  g_queue_push_head_link(&priv->cache_lru, &entry->lru_link);
+  return entry->request;
+}
+
+/**
+ * inf_adopted_request_log_set_max_cache_size:
+ * @log: A #InfAdoptedRequestLog.
+ * @max_cache_size: The maximum number of requests in the cache.
+ *
+ * Limits the number of translated requests kept in the request cache of
+ * @log, see inf_adopted_request_log_add_cached_request(). If the cache
+ * grows beyond this size, the least recently used requests are dropped
+ * from it. %G_MAXUINT means the cache size is not limited, and 0 disables
+ * the cache.
+ */
+void
+inf_adopted_request_log_set_max_cache_size(InfAdoptedRequestLog* log,
+                                           guint max_cache_size)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  if(priv->max_cache_size != max_cache_size)
+  {
+    priv->max_cache_size = max_cache_size;
+    inf_adopted_request_log_cache_shrink(log);
+    g_object_notify(G_OBJECT(log), "max-cache-size");
+  }
+}
+
+/**
+ * inf_adopted_request_log_get_max_cache_size:
+ * @log: A #InfAdoptedRequestLog.
+ *
+ * Returns the maximum number of requests in the request cache of @log, as
+ * set by inf_adopted_request_log_set_max_cache_size().
+ *
+ * Returns: The maximum size of the request cache.
+ */
+guint
+inf_adopted_request_log_get_max_cache_size(InfAdoptedRequestLog* log)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), 0);
+  return INF_ADOPTED_REQUEST_LOG_PRIVATE(log)->max_cache_size;
+}
+
+/**
+ * inf_adopted_request_log_get_cache_stats:
+ * @log: A #InfAdoptedRequestLog.
+ * @hits: (out) (allow-none): Location to store the number of cache hits,
+ * or %NULL.
+ * @misses: (out) (allow-none): Location to store the number of cache misses,
+ * or %NULL.
+ * @evictions: (out) (allow-none): Location to store the number of requests
+ * dropped from the cache because it was full, or %NULL.
+ *
+ * Returns statistics about the request cache of @log since the log was
+ * created. Requests that are removed from the cache because the
+ * corresponding requests are removed from the log are not counted as
+ * evictions.
+ */
+void
+inf_adopted_request_log_get_cache_stats(InfAdoptedRequestLog* log,
+                                        guint* hits,
+                                        guint* misses,
+                                        guint* evictions)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  return INF_ADOPTED_REQUEST(g_tree_lookup(priv->cache, vec));
+  if(hits != NULL) *hits = priv->cache_hits;
+  if(misses != NULL) *misses = priv->cache_misses;
+  if(evictions != NULL) *evictions = priv->cache_evictions;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -0,0 +1,43 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_ADOPTED_REQUEST_PRIVATE_H__
+#define __INF_ADOPTED_REQUEST_PRIVATE_H__
+
+#include <libinfinity/adopted/inf-adopted-request.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+gboolean
+_inf_adopted_request_is_exclusive(InfAdoptedRequest* request);
+
+void
+_inf_adopted_request_fold_in_place(InfAdoptedRequest* request,
+                                   guint into,
+                                   guint by);
+
+void
+_inf_adopted_request_mirror_in_place(InfAdoptedRequest* request,
+                                     guint by);
+
+G_END_DECLS
+
+#endif /* __INF_ADOPTED_REQUEST_PRIVATE_H__ */
@@ -36,6 +36,7 @@
  */
 
 #include <libinfinity/adopted/inf-adopted-request.h>
+#include <libinfinity/adopted/inf-adopted-request-private.h>
 #include <libinfinity/inf-define-enum.h>
 
 static const GEnumValue inf_adopted_request_type_values[] = {
@@ -82,7 +83,7 @@ enum {
   PROP_EXECUTED
 };
 
-#define INF_ADOPTED_REQUEST_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_REQUEST, InfAdoptedRequestPrivate))
+#define INF_ADOPTED_REQUEST_GET_PRIVATE(obj) ((InfAdoptedRequestPrivate*)inf_adopted_request_get_instance_private(obj))
 #define INF_ADOPTED_REQUEST_PRIVATE(obj)     ((InfAdoptedRequestPrivate*)(obj)->priv)
 
 INF_DEFINE_ENUM_TYPE(InfAdoptedRequestType, inf_adopted_request_type, inf_adopted_request_type_values)
@@ -310,6 +311,37 @@ inf_adopted_request_class_init(InfAdoptedRequestClass* request_class)
   );
 }
 
+/* Requests are created very often during transformation, so we bypass the
+ * property machinery of g_object_new() here and set the members directly.
+ * This takes ownership of vector and operation. Every request still costs
+ * a GObject instance and a state vector; there is no pool or boxed
+ * variant, since requests are public GObjects. Instead, the algorithm
+ * reuses intermediate requests while translating, see
+ * _inf_adopted_request_fold_in_place(). */
+static InfAdoptedRequest*
+inf_adopted_request_new_take(InfAdoptedRequestType type,
+                             InfAdoptedStateVector* vector,
+                             guint user_id,
+                             InfAdoptedOperation* operation,
+                             gint64 received,
+                             gint64 executed)
+{
+  InfAdoptedRequest* request;
+  InfAdoptedRequestPrivate* priv;
+
+  request = INF_ADOPTED_REQUEST(g_object_new(INF_ADOPTED_TYPE_REQUEST, NULL));
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  priv->type = type;
+  priv->vector = vector;
+  priv->user_id = user_id;
+  priv->operation = operation;
+  priv->received = received;
+  priv->executed = executed;
+
+  return request;
+}
+
 /**
  * inf_adopted_request_new_do: (constructor)
  * @vector: The vector time at which the request was made.
@@ -327,23 +359,20 @@ inf_adopted_request_new_do(InfAdoptedStateVector* vector,
                            InfAdoptedOperation* operation,
                            gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_DO,
-    "vector", vector,
-    "user-id", user_id,
-    "operation", operation,
-    "received", received,
-    NULL
-  );
+  g_object_ref(operation);
 
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    operation,
+    received,
+    0
+  );
 }
 
 /**
@@ -364,21 +393,17 @@ inf_adopted_request_new_undo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_UNDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_UNDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -399,21 +424,17 @@ inf_adopted_request_new_redo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-  
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_REDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_REDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -428,39 +449,21 @@ InfAdoptedRequest*
 inf_adopted_request_copy(InfAdoptedRequest* request)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
-  GObject* object;
-  
+
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "operation", priv->operation,
-      "received", priv->received,
-      NULL
-    );
-  }
-  else
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "received", priv->received,
-      NULL
-    );
-  }
+  if(priv->operation != NULL)
+    g_object_ref(priv->operation);
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
-  new_priv->executed = priv->executed;
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_take(
+    priv->type,
+    inf_adopted_state_vector_copy(priv->vector),
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -700,10 +703,8 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   InfAdoptedRequestPrivate* against_priv;
   InfAdoptedRequestPrivate* request_lcs_priv;
   InfAdoptedRequestPrivate* against_lcs_priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(against), NULL);
@@ -794,19 +795,14 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(request_priv->vector);
   inf_adopted_state_vector_add(new_vector, against_priv->user_id, 1);
 
-  new_request = inf_adopted_request_new_do(
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     request_priv->user_id,
     new_operation,
-    request_priv->received
+    request_priv->received,
+    request_priv->executed
   );
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = request_priv->executed;
-
-  g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
 }
 
 /**
@@ -832,10 +828,8 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
                            guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(by % 2 == 1, NULL);
@@ -851,19 +845,14 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, priv->user_id, by);
 
-  new_request = inf_adopted_request_new_do(
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     priv->user_id,
     new_operation,
-    priv->received
+    priv->received,
+    priv->executed
   );
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
-
-  g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
 }
 
 /**
@@ -889,9 +878,7 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
                          guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(into != 0, NULL);
@@ -903,39 +890,17 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, into, by);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "operation", priv->operation,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-  else
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
+  if(priv->operation != NULL)
+    g_object_ref(priv->operation);
 
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
+  return inf_adopted_request_new_take(
+    priv->type,
+    new_vector,
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -980,4 +945,52 @@ inf_adopted_request_affects_buffer(InfAdoptedRequest* request)
   }
 }
 
+/* Returns whether request is referenced only by the caller, so that it
+ * can be changed with the functions below without anybody noticing. */
+gboolean
+_inf_adopted_request_is_exclusive(InfAdoptedRequest* request)
+{
+  return g_atomic_int_get(&G_OBJECT(request)->ref_count) == 1;
+}
+
+/* Like inf_adopted_request_fold(), but changes request itself instead of
+ * making a folded copy. */
+void
+_inf_adopted_request_fold_in_place(InfAdoptedRequest* request,
+                                   guint into,
+                                   guint by)
+{
+  InfAdoptedRequestPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  g_assert(_inf_adopted_request_is_exclusive(request));
+  g_assert(into != 0 && into != priv->user_id);
+  g_assert(by % 2 == 0);
+
+  inf_adopted_state_vector_add(priv->vector, into, by);
+}
+
+/* Like inf_adopted_request_mirror(), but changes request itself instead of
+ * making a mirrored copy. */
+void
+_inf_adopted_request_mirror_in_place(InfAdoptedRequest* request,
+                                     guint by)
+{
+  InfAdoptedRequestPrivate* priv;
+  InfAdoptedOperation* new_operation;
+
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  g_assert(_inf_adopted_request_is_exclusive(request));
+  g_assert(by % 2 == 1);
+  g_assert(priv->type == INF_ADOPTED_REQUEST_DO);
+  g_assert(inf_adopted_operation_is_reversible(priv->operation));
+
+  new_operation = inf_adopted_operation_revert(priv->operation);
+  g_object_unref(priv->operation);
+  priv->operation = new_operation;
+
+  inf_adopted_state_vector_add(priv->vector, priv->user_id, by);
+}
+
 /* vim:set et sw=2 ts=2: */
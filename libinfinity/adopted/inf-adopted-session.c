@@ -54,6 +54,16 @@ struct _InfAdoptedSessionToXmlSyncForeachData {
   xmlNodePtr parent_xml;
 };
 
+typedef struct _InfAdoptedSessionSyncIter InfAdoptedSessionSyncIter;
+struct _InfAdoptedSessionSyncIter {
+  gpointer parent_iter; /* NULL when exhausted */
+
+  /* Requests are immutable, so keeping references to them is enough to
+   * take a snapshot of the request logs. */
+  GPtrArray* requests;
+  guint pos;
+};
+
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
 struct _InfAdoptedSessionLocalUser {
   InfAdoptedUser* user;
@@ -1069,6 +1079,131 @@ inf_adopted_session_to_xml_sync(InfSession* session,
   );
 }
 
+static void
+inf_adopted_session_sync_iter_new_foreach_user_func(InfUser* user,
+                                                    gpointer user_data)
+{
+  InfAdoptedRequestLog* log;
+  GPtrArray* requests;
+  guint i;
+  guint end;
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  requests = (GPtrArray*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  end = inf_adopted_request_log_get_end(log);
+
+  for(i = inf_adopted_request_log_get_begin(log); i < end; ++ i)
+  {
+    g_ptr_array_add(
+      requests,
+      g_object_ref(inf_adopted_request_log_get_request(log, i))
+    );
+  }
+}
+
+static gpointer
+inf_adopted_session_sync_iter_new(InfSession* session,
+                                  guint* n_messages)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionSyncIter* iter;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(priv->algorithm != NULL);
+
+  iter = g_slice_new(InfAdoptedSessionSyncIter);
+
+  iter->parent_iter =
+    INF_SESSION_CLASS(inf_adopted_session_parent_class)->sync_iter_new(
+      session,
+      n_messages
+    );
+
+  iter->requests = g_ptr_array_new();
+  iter->pos = 0;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    inf_adopted_session_sync_iter_new_foreach_user_func,
+    iter->requests
+  );
+
+  *n_messages += iter->requests->len;
+  return iter;
+}
+
+static xmlNodePtr
+inf_adopted_session_sync_iter_next(InfSession* session,
+                                   gpointer iter_)
+{
+  InfAdoptedSessionSyncIter* iter;
+  InfSessionClass* parent_class;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  xmlNodePtr xml;
+
+  iter = (InfAdoptedSessionSyncIter*)iter_;
+  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
+
+  if(iter->parent_iter != NULL)
+  {
+    xml = parent_class->sync_iter_next(session, iter->parent_iter);
+    if(xml != NULL) return xml;
+
+    parent_class->sync_iter_free(session, iter->parent_iter);
+    iter->parent_iter = NULL;
+  }
+
+  if(iter->pos == iter->requests->len)
+    return NULL;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  /* Drop the reference as soon as the request has been serialized */
+  request = g_ptr_array_index(iter->requests, iter->pos);
+  g_ptr_array_index(iter->requests, iter->pos) = NULL;
+  ++ iter->pos;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"sync-request");
+  session_class->request_to_xml(
+    INF_ADOPTED_SESSION(session),
+    xml,
+    request,
+    NULL,
+    TRUE
+  );
+
+  g_object_unref(request);
+  return xml;
+}
+
+static void
+inf_adopted_session_sync_iter_free(InfSession* session,
+                                   gpointer iter_)
+{
+  InfAdoptedSessionSyncIter* iter;
+  guint i;
+
+  iter = (InfAdoptedSessionSyncIter*)iter_;
+
+  if(iter->parent_iter != NULL)
+  {
+    INF_SESSION_CLASS(inf_adopted_session_parent_class)->sync_iter_free(
+      session,
+      iter->parent_iter
+    );
+  }
+
+  for(i = iter->pos; i < iter->requests->len; ++ i)
+    g_object_unref(g_ptr_array_index(iter->requests, i));
+
+  g_ptr_array_free(iter->requests, TRUE);
+  g_slice_free(InfAdoptedSessionSyncIter, iter);
+}
+
 static gboolean
 inf_adopted_session_process_xml_sync(InfSession* session,
                                      InfXmlConnection* connection,
@@ -1548,6 +1683,9 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   object_class->get_property = inf_adopted_session_get_property;
 
   session_class->to_xml_sync = inf_adopted_session_to_xml_sync;
+  session_class->sync_iter_new = inf_adopted_session_sync_iter_new;
+  session_class->sync_iter_next = inf_adopted_session_sync_iter_next;
+  session_class->sync_iter_free = inf_adopted_session_sync_iter_free;
   session_class->process_xml_sync = inf_adopted_session_process_xml_sync;
   session_class->process_xml_run = inf_adopted_session_process_xml_run;
   session_class->get_xml_user_props = inf_adopted_session_get_xml_user_props;
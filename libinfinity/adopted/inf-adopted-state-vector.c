@@ -56,12 +56,55 @@ struct _InfAdoptedStateVectorForeachData {
   gpointer user_data;
 };
 
+/* Number of components that are stored inline in the state vector itself.
+ * Most sessions have only a handful of users, in which case state vectors
+ * do not need a separate heap allocation. */
+#define INF_ADOPTED_STATE_VECTOR_INLINE_SIZE 4
+
 struct _InfAdoptedStateVector {
   gsize size;
   gsize max_size;
+  /* Cached result of inf_adopted_state_vector_hash(), or 0 if it has not
+   * been computed since the vector was last changed */
+  guint hash;
   InfAdoptedStateVectorComponent* data;
+  InfAdoptedStateVectorComponent inline_data[
+    INF_ADOPTED_STATE_VECTOR_INLINE_SIZE
+  ];
 };
 
+/* Makes sure vec has room for at least size components */
+static void
+inf_adopted_state_vector_reserve(InfAdoptedStateVector* vec,
+                                 gsize size)
+{
+  gsize new_size;
+
+  if(vec->max_size >= size)
+    return;
+
+  new_size = MAX(vec->max_size * 2, size);
+
+  if(vec->data == vec->inline_data)
+  {
+    vec->data = g_malloc(new_size * sizeof(InfAdoptedStateVectorComponent));
+    memcpy(
+      vec->data,
+      vec->inline_data,
+      vec->size * sizeof(InfAdoptedStateVectorComponent)
+    );
+  }
+  else
+  {
+    vec->data = g_realloc(
+      vec->data,
+      new_size * sizeof(InfAdoptedStateVectorComponent)
+    );
+  }
+
+  vec->max_size = new_size;
+}
+
 static gsize
 inf_adopted_state_vector_find_insert_pos(const InfAdoptedStateVector* vec,
                                          guint id)
@@ -118,12 +161,7 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
 {
   InfAdoptedStateVectorComponent* comp;
 
-  if(vec->max_size <= vec->size)
-  {
-    vec->max_size += 5;
-    vec->data = g_realloc(vec->data,
-                vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-  }
+  inf_adopted_state_vector_reserve(vec, vec->size + 1);
 
   comp = vec->data + insert_pos;
   if(insert_pos < vec->size)
@@ -140,6 +178,7 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
   ++vec->size;
   comp->id = id;
   comp->n = value;
+  vec->hash = 0;
 
   return comp;
 }
@@ -171,8 +210,9 @@ inf_adopted_state_vector_new(void)
 
   vec = g_slice_new(InfAdoptedStateVector);
   vec->size = 0;
-  vec->max_size = 0;
-  vec->data = NULL;
+  vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+  vec->hash = 0;
+  vec->data = vec->inline_data;
 
   return vec;
 }
@@ -194,20 +234,23 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec)
 
   new_vec = g_slice_new(InfAdoptedStateVector);
   new_vec->size = vec->size;
-  new_vec->max_size = vec->max_size;
+  new_vec->hash = vec->hash;
 
-  if(new_vec->max_size == 0)
+  if(vec->size <= INF_ADOPTED_STATE_VECTOR_INLINE_SIZE)
   {
-    new_vec->data = NULL;
+    new_vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+    new_vec->data = new_vec->inline_data;
   }
   else
   {
+    new_vec->max_size = vec->size;
     new_vec->data =
       g_malloc(new_vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-    memcpy(new_vec->data, vec->data,
-           new_vec->size * sizeof(InfAdoptedStateVectorComponent));
   }
 
+  memcpy(new_vec->data, vec->data,
+         new_vec->size * sizeof(InfAdoptedStateVectorComponent));
+
   return new_vec;
 }
 
@@ -223,7 +266,8 @@ inf_adopted_state_vector_free(InfAdoptedStateVector* vec)
 {
   g_return_if_fail(vec != NULL);
 
-  g_free(vec->data);
+  if(vec->data != vec->inline_data)
+    g_free(vec->data);
   g_slice_free(InfAdoptedStateVector, vec);
 }
 
@@ -272,9 +316,14 @@ inf_adopted_state_vector_set(InfAdoptedStateVector* vec,
 
   pos = inf_adopted_state_vector_find_insert_pos(vec, id);
   if(pos < vec->size && vec->data[pos].id == id)
+  {
     vec->data[pos].n = value;
+    vec->hash = 0;
+  }
   else
+  {
     inf_adopted_state_vector_insert(vec, id, value, pos);
+  }
 }
 
 /**
@@ -309,6 +358,7 @@ inf_adopted_state_vector_add(InfAdoptedStateVector* vec,
     g_assert(value > 0 || comp->n >= (guint)-value);
 
     comp->n += value;
+    vec->hash = 0;
   }
 }
 
@@ -431,6 +481,46 @@ inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
   }
 }
 
+/**
+ * inf_adopted_state_vector_hash:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Computes a hash value for @vec, so that state vectors can be used as keys
+ * in a #GHashTable. Vectors that compare equal with
+ * inf_adopted_state_vector_compare() have the same hash value. The value is
+ * remembered until @vec is changed, so hashing the same vector again is
+ * cheap.
+ *
+ * Returns: A hash value for @vec.
+ **/
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec)
+{
+  gsize pos;
+  guint hash;
+
+  g_return_val_if_fail(vec != NULL, 0);
+
+  if(vec->hash != 0)
+    return vec->hash;
+
+  hash = 5381;
+  for(pos = 0; pos < vec->size; ++pos)
+  {
+    /* Components with value 0 are equivalent to missing ones */
+    if(vec->data[pos].n > 0)
+    {
+      hash = (hash * 33) ^ vec->data[pos].id;
+      hash = (hash * 33) ^ vec->data[pos].n;
+    }
+  }
+
+  /* This only caches a value derived from the vector's content, so vec is
+   * still logically const. */
+  ((InfAdoptedStateVector*)vec)->hash = hash;
+  return hash;
+}
+
 /**
  * inf_adopted_state_vector_causally_before:
  * @first: A #InfAdoptedStateVector.
@@ -635,25 +725,231 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second)
 {
-  gsize n;
-  guint first_sum;
-  guint second_sum;
+  gsize first_pos;
+  gsize second_pos;
+  InfAdoptedStateVectorComponent* first_comp;
+  InfAdoptedStateVectorComponent* second_comp;
+  guint diff;
 
-  g_return_val_if_fail(
-    inf_adopted_state_vector_causally_before(first, second) == TRUE,
-    0
-  );
+  g_return_val_if_fail(first != NULL, 0);
+  g_return_val_if_fail(second != NULL, 0);
+
+  /* Walk both vectors at once. Every component of second contributes its
+   * difference to the corresponding component of first, which must not be
+   * greater (causally_before). */
+  first_pos = 0;
+  diff = 0;
+
+  for(second_pos = 0; second_pos < second->size; ++second_pos)
+  {
+    second_comp = second->data + second_pos;
+
+    while(first_pos < first->size &&
+          first->data[first_pos].id < second_comp->id)
+    {
+      /* Component not contained in second, thus 0 */
+      g_return_val_if_fail(first->data[first_pos].n == 0, 0);
+      ++first_pos;
+    }
+
+    if(first_pos < first->size &&
+       first->data[first_pos].id == second_comp->id)
+    {
+      first_comp = first->data + first_pos;
+      g_return_val_if_fail(first_comp->n <= second_comp->n, 0);
+
+      diff += second_comp->n - first_comp->n;
+      ++first_pos;
+    }
+    else
+    {
+      diff += second_comp->n;
+    }
+  }
 
-  first_sum = 0;
-  second_sum = 0;
+  for(; first_pos < first->size; ++first_pos)
+    g_return_val_if_fail(first->data[first_pos].n == 0, 0);
+
+  return diff;
+}
+
+/**
+ * inf_adopted_state_vector_max:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the maximum of itself and the
+ * corresponding component of @other. This runs in time linear in the number
+ * of components of both vectors.
+ **/
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  gsize vec_pos;
+  gsize other_pos;
+  gsize size;
+  gsize pos;
+  InfAdoptedStateVectorComponent* vec_comp;
+  const InfAdoptedStateVectorComponent* other_comp;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+  g_return_if_fail(vec != other);
+
+  /* Count the components of the result first, so that we can merge from
+   * the back without overwriting components that are still needed. */
+  size = vec->size;
+  vec_pos = 0;
+  for(other_pos = 0; other_pos < other->size; ++other_pos)
+  {
+    other_comp = other->data + other_pos;
+    while(vec_pos < vec->size && vec->data[vec_pos].id < other_comp->id)
+      ++vec_pos;
+    if(vec_pos == vec->size || vec->data[vec_pos].id != other_comp->id)
+      ++size;
+  }
+
+  inf_adopted_state_vector_reserve(vec, size);
+
+  vec_pos = vec->size;
+  other_pos = other->size;
+  pos = size;
+
+  while(other_pos > 0)
+  {
+    other_comp = other->data + other_pos - 1;
+    vec_comp = vec->data + pos - 1;
+
+    if(vec_pos > 0 && vec->data[vec_pos - 1].id > other_comp->id)
+    {
+      *vec_comp = vec->data[vec_pos - 1];
+      --vec_pos;
+    }
+    else if(vec_pos > 0 && vec->data[vec_pos - 1].id == other_comp->id)
+    {
+      vec_comp->id = other_comp->id;
+      vec_comp->n = MAX(vec->data[vec_pos - 1].n, other_comp->n);
+      --vec_pos;
+      --other_pos;
+    }
+    else
+    {
+      *vec_comp = *other_comp;
+      --other_pos;
+    }
+
+    --pos;
+  }
+
+  /* The remaining components of vec are already in place */
+  g_assert(pos == vec_pos);
+  vec->size = size;
+  vec->hash = 0;
+}
+
+/**
+ * inf_adopted_state_vector_min:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the minimum of itself and the
+ * corresponding component of @other. This runs in time linear in the number
+ * of components of both vectors.
+ **/
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  gsize vec_pos;
+  gsize other_pos;
+  gsize pos;
+  InfAdoptedStateVectorComponent* vec_comp;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+
+  other_pos = 0;
+  pos = 0;
+
+  /* The result cannot have more components than vec, so we can write it
+   * in place. Components that drop to zero are removed. */
+  for(vec_pos = 0; vec_pos < vec->size; ++vec_pos)
+  {
+    vec_comp = vec->data + vec_pos;
+
+    while(other_pos < other->size && other->data[other_pos].id < vec_comp->id)
+      ++other_pos;
+
+    if(other_pos < other->size && other->data[other_pos].id == vec_comp->id)
+    {
+      if(other->data[other_pos].n > 0 && vec_comp->n > 0)
+      {
+        vec->data[pos].id = vec_comp->id;
+        vec->data[pos].n = MIN(vec_comp->n, other->data[other_pos].n);
+        ++pos;
+      }
+
+      ++other_pos;
+    }
+  }
+
+  vec->size = pos;
+  vec->hash = 0;
+}
+
+/**
+ * inf_adopted_state_vector_least_common_successor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector v so that both @first and @second are causally
+ * before v and so that there is no other state vector with the same property
+ * that is causally before v. This is the component-wise maximum of @first
+ * and @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  InfAdoptedStateVector* result;
+
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
+
+  result = inf_adopted_state_vector_copy((InfAdoptedStateVector*)first);
+  inf_adopted_state_vector_max(result, second);
+  return result;
+}
+
+/**
+ * inf_adopted_state_vector_least_common_predecessor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector v so that v is causally before both @first and
+ * @second and so that there is no other state vector with the same property
+ * that v is causally before. This is the component-wise minimum of @first
+ * and @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  InfAdoptedStateVector* result;
 
-  for(n = 0; n < first->size; ++ n)
-    first_sum += first->data[n].n;
-  for(n = 0; n < second->size; ++ n)
-    second_sum += second->data[n].n;
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
 
-  g_assert(second_sum >= first_sum);
-  return second_sum - first_sum;
+  result = inf_adopted_state_vector_copy((InfAdoptedStateVector*)first);
+  inf_adopted_state_vector_min(result, second);
+  return result;
 }
 
 /**
@@ -932,6 +1228,7 @@ inf_adopted_state_vector_from_string_diff(const gchar* str,
       if(vec_comp->id == orig_comp->id)
       {
         vec_comp->n += orig_comp->n;
+        vec->hash = 0;
         ++vec_pos;
       }
       else
@@ -101,6 +101,9 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second);
 
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec);
+
 gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second);
@@ -115,6 +118,24 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second);
 
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
 gchar*
 inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec);
 
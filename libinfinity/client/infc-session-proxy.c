@@ -1058,6 +1058,11 @@ infc_session_proxy_session_proxy_join_user(InfSessionProxy* proxy,
     xml
   );
 
+  inf_communication_group_flush(
+    INF_COMMUNICATION_GROUP(priv->subscription_group),
+    priv->connection
+  );
+
   return INF_REQUEST(request);
 }
 
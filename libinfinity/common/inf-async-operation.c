@@ -35,7 +35,8 @@
 struct _InfAsyncOperation {
   InfIo* io;
   InfIoDispatch* dispatch;
-  GThread* thread;
+  GThread* thread; /* NULL if running in the shared thread pool */
+  gboolean running;
   GMutex mutex;
 
   InfAsyncOperationRunFunc run_func;
@@ -46,6 +47,27 @@ struct _InfAsyncOperation {
   GDestroyNotify run_notify;
 };
 
+typedef struct _InfAsyncOperationPool InfAsyncOperationPool;
+struct _InfAsyncOperationPool {
+  GThreadPool* pool;
+  guint size; /* 0 for the default size */
+  guint default_size; /* 0 for the number of processors */
+};
+
+/* Number of operations blocking on I/O that run at the same time unless
+ * changed with inf_async_operation_set_io_pool_size(). This does not depend
+ * on the number of processors, since the threads mostly wait. */
+#define INF_ASYNC_OPERATION_IO_POOL_SIZE 4
+
+/* The pools are never freed, and their threads are shared with other
+ * non-exclusive pools of the process. Short CPU-bound operations and
+ * operations that block on I/O use separate pools, so that a slow disk
+ * does not hold up TLS handshakes and vice versa. */
+static InfAsyncOperationPool inf_async_operation_cpu_pool = { NULL, 0, 0 };
+static InfAsyncOperationPool inf_async_operation_io_pool =
+  { NULL, 0, INF_ASYNC_OPERATION_IO_POOL_SIZE };
+G_LOCK_DEFINE_STATIC(inf_async_operation_pool);
+
 static void
 inf_async_operation_dispatch(gpointer data)
 {
@@ -64,18 +86,21 @@ inf_async_operation_dispatch(gpointer data)
 
   op->run_data = NULL;
   op->run_notify = NULL;
-  op->thread = NULL;
+  op->running = FALSE;
   g_mutex_clear(&op->mutex);
 
+  if(op->thread != NULL)
+  {
+    g_thread_unref(op->thread);
+    op->thread = NULL;
+  }
+
   inf_async_operation_free(op);
 }
 
-static gpointer
-inf_async_operation_thread_start(gpointer data)
+static void
+inf_async_operation_run(InfAsyncOperation* op)
 {
-  InfAsyncOperation* op;
-  op = (InfAsyncOperation*)data;
-
   op->run_func(&op->run_data, &op->run_notify, op->user_data);
 
   g_mutex_lock(&op->mutex);
@@ -99,13 +124,113 @@ inf_async_operation_thread_start(gpointer data)
 
     g_mutex_unlock(&op->mutex);
     g_mutex_clear(&op->mutex);
-    g_thread_unref(op->thread);
+    if(op->thread != NULL) g_thread_unref(op->thread);
     g_slice_free(InfAsyncOperation, op);
   }
+}
 
+static gpointer
+inf_async_operation_thread_start(gpointer data)
+{
+  inf_async_operation_run((InfAsyncOperation*)data);
   return NULL;
 }
 
+static void
+inf_async_operation_pool_func(gpointer data,
+                              gpointer user_data)
+{
+  inf_async_operation_run((InfAsyncOperation*)data);
+}
+
+static gint
+inf_async_operation_get_max_threads(InfAsyncOperationPool* pool)
+{
+  if(pool->size != 0)
+    return pool->size;
+  if(pool->default_size != 0)
+    return pool->default_size;
+  return g_get_num_processors();
+}
+
+static GThreadPool*
+inf_async_operation_get_pool(InfAsyncOperationPool* pool,
+                             GError** error)
+{
+  GThreadPool* result;
+
+  G_LOCK(inf_async_operation_pool);
+  if(pool->pool == NULL)
+  {
+    pool->pool = g_thread_pool_new(
+      inf_async_operation_pool_func,
+      NULL,
+      inf_async_operation_get_max_threads(pool),
+      FALSE,
+      error
+    );
+  }
+
+  result = pool->pool;
+  G_UNLOCK(inf_async_operation_pool);
+
+  return result;
+}
+
+static gboolean
+inf_async_operation_push(InfAsyncOperation* op,
+                         InfAsyncOperationPool* pool,
+                         GError** error)
+{
+  GThreadPool* thread_pool;
+
+  thread_pool = inf_async_operation_get_pool(pool, error);
+  if(thread_pool == NULL)
+  {
+    inf_async_operation_free(op);
+    return FALSE;
+  }
+
+  g_mutex_init(&op->mutex);
+  g_mutex_lock(&op->mutex);
+
+  if(!g_thread_pool_push(thread_pool, op, error))
+  {
+    g_mutex_unlock(&op->mutex);
+    g_mutex_clear(&op->mutex);
+    inf_async_operation_free(op);
+    return FALSE;
+  }
+
+  op->running = TRUE;
+  g_mutex_unlock(&op->mutex);
+  return TRUE;
+}
+
+static gboolean
+inf_async_operation_set_size(InfAsyncOperationPool* pool,
+                             guint n_threads,
+                             GError** error)
+{
+  gboolean result;
+
+  G_LOCK(inf_async_operation_pool);
+  pool->size = n_threads;
+
+  result = TRUE;
+  if(pool->pool != NULL)
+  {
+    result = g_thread_pool_set_max_threads(
+      pool->pool,
+      inf_async_operation_get_max_threads(pool),
+      error
+    );
+  }
+
+  G_UNLOCK(inf_async_operation_pool);
+  return result;
+}
+
 static void
 inf_async_operation_io_unref_func(gpointer user_data,
                                   GObject* where_the_object_was)
@@ -170,6 +295,7 @@ inf_async_operation_new(InfIo* io,
   op->io = io;
   op->dispatch = NULL;
   op->thread = NULL;
+  op->running = FALSE;
 
   op->run_func = run_func;
   op->done_func = done_func;
@@ -204,7 +330,7 @@ inf_async_operation_start(InfAsyncOperation* op,
                           GError** error)
 {
   g_return_val_if_fail(op != NULL, FALSE);
-  g_return_val_if_fail(op->thread == NULL, FALSE);
+  g_return_val_if_fail(op->running == FALSE, FALSE);
 
   g_mutex_init(&op->mutex);
   g_mutex_lock(&op->mutex);
@@ -224,10 +350,129 @@ inf_async_operation_start(InfAsyncOperation* op,
     return FALSE;
   }
 
+  op->running = TRUE;
   g_mutex_unlock(&op->mutex);
   return TRUE;
 }
 
+/**
+ * inf_async_operation_start_pooled:
+ * @op: (transfer full): A #InfAsyncOperation.
+ * @error: Location to store error information, if any.
+ *
+ * Starts the operation given in @op, like inf_async_operation_start().
+ * However, instead of creating a new thread for the operation, it is run in
+ * a thread pool shared by all pooled operations, which by default runs as
+ * many operations at the same time as there are processors, see
+ * inf_async_operation_set_pool_size(). This is meant for short, CPU-bound
+ * operations of which many can be started in a short time, such as TLS
+ * handshakes. Operations that block on I/O should use
+ * inf_async_operation_start_io(), and operations that run for a very long
+ * time should use inf_async_operation_start() instead.
+ *
+ * If the operation cannot be started, @error is set and %FALSE is returned.
+ * In that case, the operation must not be used anymore since it will be
+ * automatically freed.
+ *
+ * Returns: %TRUE on success or %FALSE if the operation could not be started.
+ */
+gboolean
+inf_async_operation_start_pooled(InfAsyncOperation* op,
+                                 GError** error)
+{
+  g_return_val_if_fail(op != NULL, FALSE);
+  g_return_val_if_fail(op->running == FALSE, FALSE);
+
+  return inf_async_operation_push(op, &inf_async_operation_cpu_pool, error);
+}
+
+/**
+ * inf_async_operation_start_io:
+ * @op: (transfer full): A #InfAsyncOperation.
+ * @error: Location to store error information, if any.
+ *
+ * Starts the operation given in @op, like inf_async_operation_start_pooled().
+ * The operation is run in a separate thread pool for operations that spend
+ * most of their time waiting for blocking I/O, such as reading or writing
+ * files. By default, this pool runs four operations at the same time, see
+ * inf_async_operation_set_io_pool_size(). Operations queue up when all
+ * threads are busy, so a slow or unresponsive file system does not lead to
+ * an unbounded number of threads.
+ *
+ * If the operation cannot be started, @error is set and %FALSE is returned.
+ * In that case, the operation must not be used anymore since it will be
+ * automatically freed.
+ *
+ * Returns: %TRUE on success or %FALSE if the operation could not be started.
+ */
+gboolean
+inf_async_operation_start_io(InfAsyncOperation* op,
+                             GError** error)
+{
+  g_return_val_if_fail(op != NULL, FALSE);
+  g_return_val_if_fail(op->running == FALSE, FALSE);
+
+  return inf_async_operation_push(op, &inf_async_operation_io_pool, error);
+}
+
+/**
+ * inf_async_operation_set_pool_size:
+ * @n_threads: The maximum number of threads, or 0.
+ * @error: Location to store error information, if any.
+ *
+ * Sets the maximum number of threads that run pooled operations at the same
+ * time, see inf_async_operation_start_pooled(). If @n_threads is 0, then
+ * the number of processors is used, which is the default. The new limit
+ * applies to operations that are started or already queued, but operations
+ * which are already running are not interrupted.
+ *
+ * If new threads need to be created but this fails, @error is set and
+ * %FALSE is returned.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_async_operation_set_pool_size(guint n_threads,
+                                  GError** error)
+{
+  g_return_val_if_fail(n_threads <= G_MAXINT, FALSE);
+
+  return inf_async_operation_set_size(
+    &inf_async_operation_cpu_pool,
+    n_threads,
+    error
+  );
+}
+
+/**
+ * inf_async_operation_set_io_pool_size:
+ * @n_threads: The maximum number of threads, or 0.
+ * @error: Location to store error information, if any.
+ *
+ * Sets the maximum number of threads that run I/O operations at the same
+ * time, see inf_async_operation_start_io(). If @n_threads is 0, then the
+ * default of four threads is used. As with
+ * inf_async_operation_set_pool_size(), operations which are already running
+ * are not interrupted.
+ *
+ * If new threads need to be created but this fails, @error is set and
+ * %FALSE is returned.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_async_operation_set_io_pool_size(guint n_threads,
+                                     GError** error)
+{
+  g_return_val_if_fail(n_threads <= G_MAXINT, FALSE);
+
+  return inf_async_operation_set_size(
+    &inf_async_operation_io_pool,
+    n_threads,
+    error
+  );
+}
+
 /**
  * inf_async_operation_free:
  * @op: A #InfAsyncOperation.
@@ -242,7 +487,7 @@ inf_async_operation_free(InfAsyncOperation* op)
 {
   g_return_if_fail(op != NULL);
 
-  if(op->thread == NULL)
+  if(op->running == FALSE)
   {
     /* The async operation has not started yet,
      * or it has finished (dispatched) already. */
@@ -287,7 +532,7 @@ inf_async_operation_free(InfAsyncOperation* op)
 
       g_mutex_unlock(&op->mutex);
       g_mutex_clear(&op->mutex);
-      g_thread_unref(op->thread);
+      if(op->thread != NULL) g_thread_unref(op->thread);
       g_slice_free(InfAsyncOperation, op);
     }
   }
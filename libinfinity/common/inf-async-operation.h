@@ -70,6 +70,22 @@ gboolean
 inf_async_operation_start(InfAsyncOperation* op,
                           GError** error);
 
+gboolean
+inf_async_operation_start_pooled(InfAsyncOperation* op,
+                                 GError** error);
+
+gboolean
+inf_async_operation_start_io(InfAsyncOperation* op,
+                             GError** error);
+
+gboolean
+inf_async_operation_set_pool_size(guint n_threads,
+                                  GError** error);
+
+gboolean
+inf_async_operation_set_io_pool_size(guint n_threads,
+                                     GError** error);
+
 void
 inf_async_operation_free(InfAsyncOperation* op);
 
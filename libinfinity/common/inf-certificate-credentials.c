@@ -26,7 +26,8 @@
  * @stability: Unstable
  *
  * This is a thin wrapper class for #gnutls_certificate_credentials_t. It
- * provides reference counting and a boxed GType for it.
+ * provides reference counting and a boxed GType for it. The reference count
+ * is thread-safe, so that a reference can be dropped in a worker thread.
  **/
 
 #include <libinfinity/common/inf-certificate-credentials.h>
@@ -72,7 +73,7 @@ InfCertificateCredentials*
 inf_certificate_credentials_ref(InfCertificateCredentials* creds)
 {
   g_return_val_if_fail(creds != NULL, NULL);
-  ++creds->ref_count;
+  g_atomic_int_inc(&creds->ref_count);
   return creds;
 }
 
@@ -87,7 +88,7 @@ void
 inf_certificate_credentials_unref(InfCertificateCredentials* creds)
 {
   g_return_if_fail(creds != NULL);
-  if(!--creds->ref_count)
+  if(g_atomic_int_dec_and_test(&creds->ref_count))
   {
     gnutls_certificate_free_credentials(creds->creds);
     g_slice_free(InfCertificateCredentials, creds);
@@ -47,6 +47,12 @@ struct _InfChatSessionLogUserlistForeachData {
   guint users_total;
 };
 
+typedef struct _InfChatSessionSyncIter InfChatSessionSyncIter;
+struct _InfChatSessionSyncIter {
+  gpointer parent_iter; /* NULL when exhausted */
+  xmlNodePtr messages;
+};
+
 typedef struct _InfChatSessionPrivate InfChatSessionPrivate;
 struct _InfChatSessionPrivate {
   gchar* log_filename;
@@ -813,6 +819,90 @@ inf_chat_session_to_xml_sync(InfSession* session,
   }
 }
 
+static gpointer
+inf_chat_session_sync_iter_new(InfSession* session,
+                               guint* n_messages)
+{
+  InfChatSessionSyncIter* iter;
+  InfChatBuffer* buffer;
+  const InfChatBufferMessage* message;
+  guint i;
+
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
+  iter = g_slice_new(InfChatSessionSyncIter);
+
+  iter->parent_iter =
+    INF_SESSION_CLASS(inf_chat_session_parent_class)->sync_iter_new(
+      session,
+      n_messages
+    );
+
+  /* The chat buffer only keeps a limited number of messages, and older
+   * ones are overwritten by new ones, so serialize them right away. */
+  iter->messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
+  {
+    message = inf_chat_buffer_get_message(buffer, i);
+
+    xmlAddChild(
+      iter->messages,
+      inf_chat_session_message_to_xml(
+        INF_CHAT_SESSION(session),
+        message,
+        TRUE
+      )
+    );
+  }
+
+  *n_messages += i;
+  return iter;
+}
+
+static xmlNodePtr
+inf_chat_session_sync_iter_next(InfSession* session,
+                                gpointer iter_)
+{
+  InfChatSessionSyncIter* iter;
+  InfSessionClass* parent_class;
+  xmlNodePtr xml;
+
+  iter = (InfChatSessionSyncIter*)iter_;
+  parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
+
+  if(iter->parent_iter != NULL)
+  {
+    xml = parent_class->sync_iter_next(session, iter->parent_iter);
+    if(xml != NULL) return xml;
+
+    parent_class->sync_iter_free(session, iter->parent_iter);
+    iter->parent_iter = NULL;
+  }
+
+  xml = iter->messages->children;
+  if(xml != NULL) xmlUnlinkNode(xml);
+
+  return xml;
+}
+
+static void
+inf_chat_session_sync_iter_free(InfSession* session,
+                                gpointer iter_)
+{
+  InfChatSessionSyncIter* iter;
+  iter = (InfChatSessionSyncIter*)iter_;
+
+  if(iter->parent_iter != NULL)
+  {
+    INF_SESSION_CLASS(inf_chat_session_parent_class)->sync_iter_free(
+      session,
+      iter->parent_iter
+    );
+  }
+
+  xmlFreeNode(iter->messages);
+  g_slice_free(InfChatSessionSyncIter, iter);
+}
+
 static gboolean
 inf_chat_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1031,6 +1121,9 @@ inf_chat_session_class_init(InfChatSessionClass* chat_session_class)
   object_class->get_property = inf_chat_session_get_property;
 
   session_class->to_xml_sync = inf_chat_session_to_xml_sync;
+  session_class->sync_iter_new = inf_chat_session_sync_iter_new;
+  session_class->sync_iter_next = inf_chat_session_sync_iter_next;
+  session_class->sync_iter_free = inf_chat_session_sync_iter_free;
   session_class->process_xml_sync = inf_chat_session_process_xml_sync;
   session_class->process_xml_run = inf_chat_session_process_xml_run;
   session_class->synchronization_complete =
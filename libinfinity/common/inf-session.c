@@ -96,6 +96,10 @@ static const GEnumValue inf_session_status_values[] = {
 };
 
 typedef struct _InfSessionSync InfSessionSync;
+typedef struct _InfSessionSyncSource InfSessionSyncSource;
+typedef struct _InfSessionSyncSnapshot InfSessionSyncSnapshot;
+typedef struct _InfSessionSyncSnapshotMessage InfSessionSyncSnapshotMessage;
+
 struct _InfSessionSync {
   InfCommunicationGroup* group;
   InfXmlConnection* conn;
@@ -103,6 +107,50 @@ struct _InfSessionSync {
   guint messages_total;
   guint messages_sent;
   InfSessionSyncStatus status;
+
+  /* Creates the remaining messages, or NULL if all have been created */
+  InfSessionSyncSource* source;
+};
+
+/* Time in microseconds during which a synchronization snapshot is shared
+ * with further synchronizations, and the maximum number of messages to the
+ * subscription group these would need to catch up with. */
+static const gint64 INF_SESSION_SYNC_SHARE_TIME = 2 * G_USEC_PER_SEC;
+static const guint INF_SESSION_SYNC_SHARE_MAX_DELTA = 1024;
+
+struct _InfSessionSyncSnapshotMessage {
+  xmlNodePtr xml; /* NULL when freed */
+  guint unread; /* number of readers that did not yet get the message */
+};
+
+/* The synchronization messages for the session state at a given point in
+ * time. The messages are created from a sync_iter as the fastest reader
+ * needs them. Synchronizations to the subscription group beginning shortly
+ * after the snapshot was taken share it as long as it is open. In that
+ * case they additionally receive the messages sent to the subscription
+ * group in the meanwhile, after <sync-end/>, which is what the
+ * synchronizations that started earlier received as well. */
+struct _InfSessionSyncSnapshot {
+  guint ref_count; /* number of readers */
+  InfSession* session;
+  gint64 begin_time;
+  gboolean open; /* whether new readers can be added */
+
+  gpointer iter; /* NULL when all messages have been created */
+  guint n_messages;
+  GArray* messages; /* Messages created so far */
+  GPtrArray* delta; /* Messages to the subscription group while open */
+};
+
+/* Message source passed to inf_communication_group_send_source() that
+ * reads the messages of one synchronization from a snapshot. */
+struct _InfSessionSyncSource {
+  InfSessionSync* sync; /* NULL when the synchronization was released */
+  InfSessionSyncSnapshot* snapshot; /* NULL when done */
+  guint pos;
+  gboolean end_created;
+  guint delta_pos;
+  guint delta_end;
 };
 
 typedef struct _InfSessionPrivate InfSessionPrivate;
@@ -135,6 +183,7 @@ struct _InfSessionPrivate {
     /* INF_SESSION_RUNNING */
     struct {
       GSList* syncs;
+      InfSessionSyncSnapshot* snapshot; /* open snapshot, if any */
     } run;
   } shared;
 };
@@ -278,6 +327,334 @@ inf_session_find_sync_by_connection(InfSession* session,
   return (InfSessionSync*)item->data;
 }
 
+static void
+inf_session_sync_snapshot_close(InfSessionSyncSnapshot* snapshot)
+{
+  InfSessionPrivate* priv;
+  InfSessionSyncSnapshotMessage* message;
+  guint i;
+
+  priv = INF_SESSION_PRIVATE(snapshot->session);
+  g_assert(snapshot->open == TRUE);
+  g_assert(priv->shared.run.snapshot == snapshot);
+
+  priv->shared.run.snapshot = NULL;
+  snapshot->open = FALSE;
+
+  /* No one is going to need messages anymore that all current readers
+   * have received already. */
+  for(i = 0; i < snapshot->messages->len; ++ i)
+  {
+    message = &g_array_index(
+      snapshot->messages,
+      InfSessionSyncSnapshotMessage,
+      i
+    );
+
+    if(message->unread == 0 && message->xml != NULL)
+    {
+      xmlFreeNode(message->xml);
+      message->xml = NULL;
+    }
+  }
+}
+
+static gboolean
+inf_session_sync_snapshot_is_open(InfSessionSyncSnapshot* snapshot)
+{
+  gint64 age;
+
+  age = g_get_monotonic_time() - snapshot->begin_time;
+  if(snapshot->open && age > INF_SESSION_SYNC_SHARE_TIME)
+  {
+    inf_session_sync_snapshot_close(snapshot);
+  }
+
+  return snapshot->open;
+}
+
+static InfSessionSyncSnapshot*
+inf_session_sync_snapshot_new(InfSession* session,
+                              gboolean open)
+{
+  InfSessionPrivate* priv;
+  InfSessionClass* session_class;
+  InfSessionSyncSnapshot* snapshot;
+
+  priv = INF_SESSION_PRIVATE(session);
+  session_class = INF_SESSION_GET_CLASS(session);
+
+  snapshot = g_slice_new(InfSessionSyncSnapshot);
+  snapshot->ref_count = 0;
+  snapshot->session = session;
+  snapshot->begin_time = g_get_monotonic_time();
+  snapshot->open = open;
+
+  snapshot->iter = session_class->sync_iter_new(
+    session,
+    &snapshot->n_messages
+  );
+
+  if(snapshot->n_messages == 0)
+  {
+    session_class->sync_iter_free(session, snapshot->iter);
+    snapshot->iter = NULL;
+  }
+
+  snapshot->messages = g_array_new(
+    FALSE,
+    FALSE,
+    sizeof(InfSessionSyncSnapshotMessage)
+  );
+
+  snapshot->delta = g_ptr_array_new_with_free_func(
+    (GDestroyNotify)xmlFreeNode
+  );
+
+  if(open)
+  {
+    g_assert(priv->shared.run.snapshot == NULL);
+    priv->shared.run.snapshot = snapshot;
+  }
+
+  return snapshot;
+}
+
+static void
+inf_session_sync_snapshot_unref(InfSessionSyncSnapshot* snapshot)
+{
+  InfSessionSyncSnapshotMessage* message;
+  guint i;
+
+  g_assert(snapshot->ref_count > 0);
+  if(--snapshot->ref_count > 0)
+    return;
+
+  if(snapshot->open)
+    inf_session_sync_snapshot_close(snapshot);
+
+  /* If not all messages have been created then there was still a
+   * synchronization in progress until now, so the session is alive. */
+  if(snapshot->iter != NULL)
+  {
+    INF_SESSION_GET_CLASS(snapshot->session)->sync_iter_free(
+      snapshot->session,
+      snapshot->iter
+    );
+  }
+
+  for(i = 0; i < snapshot->messages->len; ++ i)
+  {
+    message = &g_array_index(
+      snapshot->messages,
+      InfSessionSyncSnapshotMessage,
+      i
+    );
+
+    if(message->xml != NULL)
+      xmlFreeNode(message->xml);
+  }
+
+  g_array_free(snapshot->messages, TRUE);
+  g_ptr_array_free(snapshot->delta, TRUE);
+  g_slice_free(InfSessionSyncSnapshot, snapshot);
+}
+
+/* Records a message sent to the subscription group, so that readers that
+ * are added to the snapshot later receive it as well. */
+static void
+inf_session_sync_snapshot_record(InfSession* session,
+                                 const xmlNodePtr xml)
+{
+  InfSessionPrivate* priv;
+  InfSessionSyncSnapshot* snapshot;
+
+  priv = INF_SESSION_PRIVATE(session);
+  if(priv->status != INF_SESSION_RUNNING)
+    return;
+
+  snapshot = priv->shared.run.snapshot;
+  if(snapshot != NULL && inf_session_sync_snapshot_is_open(snapshot))
+  {
+    if(snapshot->delta->len < INF_SESSION_SYNC_SHARE_MAX_DELTA)
+      g_ptr_array_add(snapshot->delta, xmlCopyNode(xml, 1));
+    else
+      inf_session_sync_snapshot_close(snapshot);
+  }
+}
+
+static xmlNodePtr
+inf_session_sync_snapshot_read(InfSessionSyncSnapshot* snapshot,
+                               guint index)
+{
+  InfSessionClass* session_class;
+  InfSessionSyncSnapshotMessage* message;
+  InfSessionSyncSnapshotMessage new_message;
+  gboolean open;
+  xmlNodePtr xml;
+
+  g_assert(index < snapshot->n_messages);
+
+  if(index == snapshot->messages->len)
+  {
+    session_class = INF_SESSION_GET_CLASS(snapshot->session);
+
+    new_message.xml = session_class->sync_iter_next(
+      snapshot->session,
+      snapshot->iter
+    );
+
+    /* The iterator must yield as many messages as it announced */
+    g_assert(new_message.xml != NULL);
+
+    new_message.unread = snapshot->ref_count;
+    g_array_append_val(snapshot->messages, new_message);
+
+    if(snapshot->messages->len == snapshot->n_messages)
+    {
+      session_class->sync_iter_free(snapshot->session, snapshot->iter);
+      snapshot->iter = NULL;
+    }
+  }
+
+  /* Closing the snapshot frees the messages everyone has read, so do this
+   * before marking this message as read. */
+  open = inf_session_sync_snapshot_is_open(snapshot);
+
+  message = &g_array_index(
+    snapshot->messages,
+    InfSessionSyncSnapshotMessage,
+    index
+  );
+
+  g_assert(message->xml != NULL && message->unread > 0);
+  -- message->unread;
+
+  /* The last reader can take the message itself */
+  if(message->unread == 0 && !open)
+  {
+    xml = message->xml;
+    message->xml = NULL;
+  }
+  else
+  {
+    xml = xmlCopyNode(message->xml, 1);
+  }
+
+  return xml;
+}
+
+static InfSessionSyncSource*
+inf_session_sync_source_new(InfSessionSync* sync,
+                            InfSessionSyncSnapshot* snapshot)
+{
+  InfSessionSyncSource* source;
+  guint i;
+
+  source = g_slice_new(InfSessionSyncSource);
+  source->sync = sync;
+  source->snapshot = snapshot;
+  source->pos = 0;
+  source->end_created = FALSE;
+  source->delta_pos = 0;
+  source->delta_end = snapshot->delta->len;
+
+  /* Since the snapshot is still open, all its messages are still there */
+  for(i = 0; i < snapshot->messages->len; ++ i)
+  {
+    ++ g_array_index(
+      snapshot->messages,
+      InfSessionSyncSnapshotMessage,
+      i
+    ).unread;
+  }
+
+  ++ snapshot->ref_count;
+  return source;
+}
+
+/* Stops source from producing more messages */
+static void
+inf_session_sync_source_stop(InfSessionSyncSource* source)
+{
+  InfSessionSyncSnapshot* snapshot;
+  InfSessionSyncSnapshotMessage* message;
+  guint i;
+
+  snapshot = source->snapshot;
+  if(snapshot == NULL)
+    return;
+
+  for(i = source->pos; i < snapshot->messages->len; ++ i)
+  {
+    message = &g_array_index(
+      snapshot->messages,
+      InfSessionSyncSnapshotMessage,
+      i
+    );
+
+    g_assert(message->unread > 0);
+    if(--message->unread == 0 && !snapshot->open)
+    {
+      xmlFreeNode(message->xml);
+      message->xml = NULL;
+    }
+  }
+
+  source->snapshot = NULL;
+  inf_session_sync_snapshot_unref(snapshot);
+}
+
+static xmlNodePtr
+inf_session_sync_source_func(gpointer user_data)
+{
+  InfSessionSyncSource* source;
+  InfSessionSyncSnapshot* snapshot;
+  xmlNodePtr xml;
+
+  source = (InfSessionSyncSource*)user_data;
+  snapshot = source->snapshot;
+  if(snapshot == NULL)
+    return NULL;
+
+  if(source->pos < snapshot->n_messages)
+  {
+    xml = inf_session_sync_snapshot_read(snapshot, source->pos);
+    ++ source->pos;
+    return xml;
+  }
+
+  if(!source->end_created)
+  {
+    source->end_created = TRUE;
+    return xmlNewNode(NULL, (const xmlChar*)"sync-end");
+  }
+
+  if(source->delta_pos < source->delta_end)
+  {
+    xml = g_ptr_array_index(snapshot->delta, source->delta_pos);
+    ++ source->delta_pos;
+    return xmlCopyNode(xml, 1);
+  }
+
+  inf_session_sync_source_stop(source);
+  return NULL;
+}
+
+static void
+inf_session_sync_source_free(gpointer user_data)
+{
+  InfSessionSyncSource* source;
+  source = (InfSessionSyncSource*)user_data;
+
+  inf_session_sync_source_stop(source);
+
+  if(source->sync != NULL)
+    source->sync->source = NULL;
+
+  g_slice_free(InfSessionSyncSource, source);
+}
+
 /* Required by inf_session_release_connection() */
 static void
 inf_session_connection_notify_status_cb(InfXmlConnection* connection,
@@ -319,6 +696,18 @@ inf_session_release_connection(InfSession* session,
 
     sync = item->data;
 
+    /* The source is owned by the group, which might ask it for more
+     * messages later. If the synchronization did not make it to the end,
+     * make sure it does not produce any. Otherwise, it still needs to send
+     * the messages recorded in the snapshot after sync-end. */
+    if(sync->source != NULL)
+    {
+      if(sync->status == INF_SESSION_SYNC_IN_PROGRESS)
+        inf_session_sync_source_stop(sync->source);
+
+      sync->source->sync = NULL;
+    }
+
     g_object_unref(sync->group);
 
     g_slice_free(InfSessionSync, sync);
@@ -362,6 +751,11 @@ inf_session_send_sync_error(InfSession* session,
     priv->shared.sync.conn,
     node
   );
+
+  inf_communication_group_flush(
+    priv->shared.sync.group,
+    priv->shared.sync.conn
+  );
 }
 
 /*
@@ -459,6 +853,7 @@ inf_session_init(InfSession* session)
   priv->status = INF_SESSION_RUNNING;
 
   priv->shared.run.syncs = NULL;
+  priv->shared.run.snapshot = NULL;
 }
 
 static void
@@ -834,6 +1229,44 @@ inf_session_to_xml_sync_impl(InfSession* session,
   );
 }
 
+static gpointer
+inf_session_sync_iter_new_impl(InfSession* session,
+                               guint* n_messages)
+{
+  xmlNodePtr container;
+  xmlNodePtr xml;
+
+  /* There are not many users, so there is nothing to be gained by
+   * serializing them lazily. */
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  inf_session_to_xml_sync_impl(session, container);
+
+  *n_messages = 0;
+  for(xml = container->children; xml != NULL; xml = xml->next)
+    ++ *n_messages;
+
+  return container;
+}
+
+static xmlNodePtr
+inf_session_sync_iter_next_impl(InfSession* session,
+                                gpointer iter)
+{
+  xmlNodePtr xml;
+
+  xml = ((xmlNodePtr)iter)->children;
+  if(xml != NULL) xmlUnlinkNode(xml);
+
+  return xml;
+}
+
+static void
+inf_session_sync_iter_free_impl(InfSession* session,
+                                gpointer iter)
+{
+  xmlFreeNode((xmlNodePtr)iter);
+}
+
 static gboolean
 inf_session_process_xml_sync_impl(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1297,6 +1730,8 @@ inf_session_handle_received_sync_message(InfSession* session,
         xml_reply
       );
 
+      inf_communication_group_flush(priv->shared.sync.group, connection);
+
       /* Synchronization complete */
       g_signal_emit(
         G_OBJECT(session),
@@ -1619,6 +2054,10 @@ inf_session_communication_object_received(InfCommunicationObject* comm_object,
         g_error_free(local_error);
       }
 
+      /* The message is forwarded to the other group members */
+      if(scope == INF_COMMUNICATION_SCOPE_GROUP)
+        inf_session_sync_snapshot_record(session, node);
+
       return scope;
     }
   case INF_SESSION_CLOSED:
@@ -1674,6 +2113,9 @@ inf_session_close_handler(InfSession* session)
      * or at least in addition (InfcSessionProxy needs to do it anway,
      * because it keeps the running state even on disconnection...) */
 
+    if(priv->shared.run.snapshot != NULL)
+      inf_session_sync_snapshot_close(priv->shared.run.snapshot);
+
     while(priv->shared.run.syncs != NULL)
     {
       sync = (InfSessionSync*)priv->shared.run.syncs->data;
@@ -1708,8 +2150,7 @@ inf_session_synchronization_begin_handler(InfSession* session,
   InfSessionPrivate* priv;
   InfSessionClass* session_class;
   InfSessionSync* sync;
-  xmlNodePtr messages;
-  xmlNodePtr next;
+  InfSessionSyncSnapshot* snapshot;
   xmlNodePtr xml;
   gchar num_messages_buf[16];
 
@@ -1719,12 +2160,11 @@ inf_session_synchronization_begin_handler(InfSession* session,
   g_assert(inf_session_find_sync_by_connection(session, connection) == NULL);
 
   session_class = INF_SESSION_GET_CLASS(session);
-  g_return_if_fail(session_class->to_xml_sync != NULL);
+  g_return_if_fail(session_class->sync_iter_new != NULL);
 
   sync = g_slice_new(InfSessionSync);
   sync->conn = connection;
   sync->messages_sent = 0;
-  sync->messages_total = 2; /* including sync-begin and sync-end */
   sync->status = INF_SESSION_SYNC_IN_PROGRESS;
 
   g_object_ref(G_OBJECT(connection));
@@ -1743,15 +2183,32 @@ inf_session_synchronization_begin_handler(InfSession* session,
   /* The group needs to contain that connection, of course. */
   g_assert(inf_communication_group_is_member(sync->group, connection));
 
-  /* Name is irrelevant because the node is only used to collect the child
-   * nodes via the to_xml_sync vfunc. */
-  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
-  session_class->to_xml_sync(session, messages);
+  /* Messages sent to the subscription group after the snapshot was taken
+   * reach the connection only if it synchronizes within that group, so
+   * only then can it catch up with a snapshot taken earlier. */
+  snapshot = NULL;
+  if(group == priv->subscription_group)
+  {
+    snapshot = priv->shared.run.snapshot;
+    if(snapshot != NULL && !inf_session_sync_snapshot_is_open(snapshot))
+      snapshot = NULL;
+  }
 
-  for(xml = messages->children; xml != NULL; xml = xml->next)
-    ++ sync->messages_total;
+  /* The snapshot is taken right now, but the messages are only created
+   * as the connection is able to send them. */
+  if(snapshot == NULL)
+  {
+    snapshot = inf_session_sync_snapshot_new(
+      session,
+      group == priv->subscription_group
+    );
+  }
 
-  sprintf(num_messages_buf, "%u", sync->messages_total - 2);
+  sync->source = inf_session_sync_source_new(sync, snapshot);
+
+  /* including sync-begin and sync-end */
+  sync->messages_total = snapshot->n_messages + 2;
+  sprintf(num_messages_buf, "%u", snapshot->n_messages);
 
   xml = xmlNewNode(NULL, (const xmlChar*)"sync-begin");
 
@@ -1763,18 +2220,17 @@ inf_session_synchronization_begin_handler(InfSession* session,
 
   inf_communication_group_send_message(sync->group, connection, xml);
 
-  /* TODO: Add a function that can send multiple messages */
-  for(xml = messages->children; xml != NULL; xml = next)
-  {
-    next = xml->next;
-    xmlUnlinkNode(xml);
-
-    inf_communication_group_send_message(sync->group, connection, xml);
-  }
+  /* The source finishes with sync-end */
+  inf_communication_group_send_source(
+    sync->group,
+    connection,
+    inf_session_sync_source_func,
+    sync->source,
+    inf_session_sync_source_free
+  );
 
-  xmlFreeNode(messages);
-  xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
-  inf_communication_group_send_message(sync->group, connection, xml);
+  /* Start the synchronization without waiting for the coalesce time */
+  inf_communication_group_flush(sync->group, connection);
 }
 
 static void
@@ -1796,6 +2252,7 @@ inf_session_synchronization_complete_handler(InfSession* session,
 
     priv->status = INF_SESSION_RUNNING;
     priv->shared.run.syncs = NULL;
+    priv->shared.run.snapshot = NULL;
 
     g_object_notify(G_OBJECT(session), "status");
     break;
@@ -1880,6 +2337,9 @@ inf_session_class_init(InfSessionClass* session_class)
   object_class->get_property = inf_session_get_property;
 
   session_class->to_xml_sync = inf_session_to_xml_sync_impl;
+  session_class->sync_iter_new = inf_session_sync_iter_new_impl;
+  session_class->sync_iter_next = inf_session_sync_iter_next_impl;
+  session_class->sync_iter_free = inf_session_sync_iter_free_impl;
   session_class->process_xml_sync = inf_session_process_xml_sync_impl;
   session_class->process_xml_run = inf_session_process_xml_run_impl;
 
@@ -2445,7 +2905,10 @@ inf_session_set_user_status(InfSession* session,
     );
 
     if(priv->subscription_group != NULL)
+    {
       inf_session_send_to_subscriptions(session, xml);
+      inf_communication_group_flush(priv->subscription_group, NULL);
+    }
 
     g_object_set(G_OBJECT(user), "status", status, NULL);
   }
@@ -2608,6 +3071,7 @@ inf_session_cancel_synchronization(InfSession* session,
 
       xml = xmlNewNode(NULL, (const xmlChar*)"sync-cancel");
       inf_communication_group_send_message(sync->group, sync->conn, xml);
+      inf_communication_group_flush(sync->group, sync->conn);
     }
 
     g_set_error_literal(
@@ -2841,6 +3305,14 @@ inf_session_set_subscription_group(InfSession* session,
 
   if(priv->subscription_group != group)
   {
+    /* Messages to the new group are not seen by synchronizations to the
+     * old one, so they cannot share a snapshot anymore. */
+    if(priv->status == INF_SESSION_RUNNING &&
+       priv->shared.run.snapshot != NULL)
+    {
+      inf_session_sync_snapshot_close(priv->shared.run.snapshot);
+    }
+
     if(priv->subscription_group != NULL)
       g_object_unref(priv->subscription_group);
 
@@ -2874,6 +3346,7 @@ inf_session_send_to_subscriptions(InfSession* session,
   priv = INF_SESSION_PRIVATE(session);
   g_return_if_fail(priv->subscription_group != NULL);
 
+  inf_session_sync_snapshot_record(session, xml);
   inf_communication_group_send_group_message(priv->subscription_group, xml);
 }
 
@@ -188,6 +188,18 @@ typedef enum _InfSessionSyncError {
  * #InfSession::synchronization-failed signal. If the session itself got
  * synchronized (and did not synchronize another session), then the default
  * handler changes status to %INF_SESSION_CLOSED.
+ * @sync_iter_new: Virtual function that takes a snapshot of the session
+ * for synchronizing it to another host. It returns an iterator that yields
+ * the same nodes as @to_xml_sync would, and sets @n_messages to their
+ * number. Implementations in derived classes chain up and yield their own
+ * nodes after those of the parent class. Later changes to the session must
+ * not affect the nodes yielded.
+ * @sync_iter_next: Virtual function that returns the next node of an
+ * iterator created by @sync_iter_new, or %NULL if there are no more nodes.
+ * Nodes are only created when requested, so that a synchronization does not
+ * need to hold the whole session in XML form in memory.
+ * @sync_iter_free: Virtual function that frees an iterator created by
+ * @sync_iter_new.
  *
  * This structure contains the virtual functions and default signal handlers
  * of #InfSession.
@@ -252,6 +264,16 @@ struct _InfSessionClass {
   void(*synchronization_failed)(InfSession* session,
                                 InfXmlConnection* connection,
                                 const GError* error);
+
+  /* Virtual table, continued */
+  gpointer(*sync_iter_new)(InfSession* session,
+                           guint* n_messages);
+
+  xmlNodePtr(*sync_iter_next)(InfSession* session,
+                              gpointer iter);
+
+  void(*sync_iter_free)(InfSession* session,
+                        gpointer iter);
 };
 
 /**
@@ -37,12 +37,17 @@
  * instead which implements the #InfIo interface. For the GTK+ toolkit, there
  * is #InfGtkIo in the libinfgtk library, to integrate with the Glib main
  * loop.
+ *
+ * On Linux, sockets are watched with epoll, so that the cost of an
+ * iteration depends on the number of sockets with pending events rather
+ * than on the total number of watched sockets. On other systems, or if
+ * epoll is not available at runtime, poll() is used instead.
  */
 
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
 
-/* TODO: Modularize the FD handling, then add epoll support */
+#include "config.h"
 
 #ifdef G_OS_WIN32
 # include <winsock2.h>
@@ -50,6 +55,9 @@
 # include <poll.h>
 # include <errno.h>
 # include <unistd.h>
+# ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+# endif
 #endif /* !G_OS_WIN32 */
 
 #include <string.h>
@@ -76,12 +84,17 @@ static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE = -1;
   (poll(events, (nfds_t)num_events, timeout))
 #endif
 
+#ifdef HAVE_EPOLL
+/* Maximum number of events to fetch with a single epoll_wait() call */
+#define INF_STANDALONE_IO_EPOLL_BATCH_SIZE 64
+#endif
+
 struct _InfIoWatch {
-  /* TODO: Do we actually need this? We can access the event by
-   * priv->events[watchindex+1]. */
+  /* Entry in priv->events, or NULL if the watch is handled by epoll. */
   InfStandaloneIoNativeEvent* event;
 
   InfNativeSocket* socket;
+  InfIoEvent events;
   InfIoWatchFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -93,8 +106,11 @@ struct _InfIoWatch {
 };
 
 struct _InfIoTimeout {
-  GTimeVal begin;
-  guint msecs;
+  /* Monotonic time in microseconds at which the timeout elapses */
+  gint64 expiration;
+  /* Position in priv->timeouts, or NULL while the timeout is running */
+  GSequenceIter* iter;
+
   InfIoTimeoutFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -114,16 +130,37 @@ struct _InfStandaloneIoPrivate {
   guint fd_size;
   guint fd_alloc;
 
-  /* this array has fd_size-1 entries and fd_alloc-1 allocations: */
+  /* this array has fd_size-1 entries and fd_alloc-1 allocations, it is
+   * not used with epoll: */
   InfIoWatch** watches;
 
-  GList* timeouts;
+  /* All watches, indexed by their socket */
+  GHashTable* watch_table;
+
+  /* Timeouts, sorted by expiration time */
+  GSequence* timeouts;
   GList* dispatchs;
 
 #ifndef G_OS_WIN32
   int wakeup_pipe[2];
 #endif
 
+#ifdef HAVE_EPOLL
+  /* -1 if epoll is not available at runtime, in which case we fall back
+   * to poll(). */
+  int epoll_fd;
+
+  /* Events returned by the last epoll_wait() call which have not been
+   * dispatched yet. */
+  struct epoll_event* ready_events;
+  guint ready_pos;
+  guint ready_count;
+
+  /* Watches removed while epoll_wait() was running. They are freed only
+   * after the call returned, since it might have reported them. */
+  GSList* disposed_watches;
+#endif
+
   gboolean polling;
   gboolean loop_running;
 };
@@ -155,19 +192,233 @@ G_DEFINE_TYPE_WITH_CODE(InfStandaloneIo, inf_standalone_io, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfStandaloneIo)
   G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_standalone_io_io_iface_init))
 
-static guint
-inf_standalone_io_timeval_diff(GTimeVal* first,
-                               GTimeVal* second)
+static long
+inf_standalone_io_native_events(InfIoEvent events)
+{
+  long pevents;
+
+#ifdef G_OS_WIN32
+  pevents = 0;
+  if(events & INF_IO_INCOMING)
+    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
+  if(events & INF_IO_OUTGOING)
+    pevents |= (FD_WRITE | FD_CONNECT);
+#else
+  pevents = 0;
+  if(events & INF_IO_INCOMING)
+    pevents |= POLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= POLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#endif
+
+  return pevents;
+}
+
+#ifdef HAVE_EPOLL
+static guint32
+inf_standalone_io_epoll_events(InfIoEvent events)
+{
+  guint32 epoll_events;
+
+  /* EPOLLERR and EPOLLHUP are always reported, like with poll() */
+  epoll_events = 0;
+  if(events & INF_IO_INCOMING)
+    epoll_events |= EPOLLIN;
+  if(events & INF_IO_OUTGOING)
+    epoll_events |= EPOLLOUT;
+  if(events & INF_IO_ERROR)
+    epoll_events |= EPOLLPRI;
+
+  return epoll_events;
+}
+#endif
+
+static gint
+inf_standalone_io_timeout_cmp(gconstpointer first,
+                              gconstpointer second,
+                              gpointer user_data)
+{
+  const InfIoTimeout* first_timeout;
+  const InfIoTimeout* second_timeout;
+
+  first_timeout = (const InfIoTimeout*)first;
+  second_timeout = (const InfIoTimeout*)second;
+
+  if(first_timeout->expiration < second_timeout->expiration)
+    return -1;
+  else if(first_timeout->expiration > second_timeout->expiration)
+    return 1;
+  else
+    return 0;
+}
+
+/* Runs the callback of a watch. Call this only with the mutex locked. */
+static void
+inf_standalone_io_run_watch(InfStandaloneIo* io,
+                            InfIoWatch* watch,
+                            InfIoEvent events)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* protect from removing the watch object via
+   * inf_io_remove_watch() when running the callback. */
+  watch->executing = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  watch->func(watch->socket, events, watch->user_data);
+
+  g_mutex_lock(&priv->mutex);
+  watch->executing = FALSE;
+  if(watch->disposed == TRUE)
+  {
+    g_mutex_unlock(&priv->mutex);
+    if(watch->notify) watch->notify(watch->user_data);
+    g_slice_free(InfIoWatch, watch);
+    g_mutex_lock(&priv->mutex);
+  }
+}
+
+#ifndef G_OS_WIN32
+static void
+inf_standalone_io_handle_wakeup(InfStandaloneIo* io,
+                                InfIoEvent events)
+{
+  InfStandaloneIoPrivate* priv;
+  ssize_t ret;
+  char buf[1];
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* we were not polling for outgoing */
+  g_assert(~events & INF_IO_OUTGOING);
+  if(events & INF_IO_ERROR)
+  {
+    /* TODO: Read error from FD? */
+    g_warning("Error condition on wakeup pipe");
+    /* TODO: Is there anything we could do here?
+     * Try to re-establish pipe? */
+  }
+  else
+  {
+    ret = read(priv->wakeup_pipe[0], &buf, 1);
+    if(ret == -1)
+    {
+      g_warning(
+        "read() on wakeup pipe failed: %s",
+        strerror(errno)
+      );
+
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else if(ret == 0)
+    {
+      g_warning("Wakeup pipe received EOF");
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else
+    {
+      /* this is what we send as wakeup call */
+      g_assert(buf[0] == 'c');
+    }
+  }
+}
+#endif
+
+#ifdef HAVE_EPOLL
+/* Called after epoll_wait() returned. Drops events for watches that were
+ * removed while waiting, and frees them. */
+static void
+inf_standalone_io_epoll_release_disposed(InfStandaloneIo* io)
 {
-  g_assert(first->tv_sec > second->tv_sec ||
-           (first->tv_sec == second->tv_sec &&
-            first->tv_usec >= second->tv_usec));
+  InfStandaloneIoPrivate* priv;
+  InfIoWatch* watch;
+  guint i;
 
-  /* Don't risk overflow, don't need to convert to signed int */
-  return (first->tv_sec - second->tv_sec) * 1000 +
-         (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  if(priv->disposed_watches == NULL)
+    return;
+
+  for(i = priv->ready_pos; i < priv->ready_count; ++i)
+  {
+    watch = (InfIoWatch*)priv->ready_events[i].data.ptr;
+    if(watch != NULL && watch->disposed == TRUE)
+      priv->ready_events[i].events = 0;
+  }
+
+  while(priv->disposed_watches != NULL)
+  {
+    watch = (InfIoWatch*)priv->disposed_watches->data;
+    priv->disposed_watches = g_slist_delete_link(
+      priv->disposed_watches,
+      priv->disposed_watches
+    );
+
+    if(watch->notify)
+      watch->notify(watch->user_data);
+    g_slice_free(InfIoWatch, watch);
+  }
 }
 
+/* Runs the callback for the next pending event from the last epoll_wait()
+ * call. Returns FALSE if there are no more pending events that would need
+ * a callback to be run. Call this only with the mutex locked. */
+static gboolean
+inf_standalone_io_epoll_dispatch(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event* event;
+  InfIoWatch* watch;
+  InfIoEvent events;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  while(priv->ready_pos < priv->ready_count)
+  {
+    event = &priv->ready_events[priv->ready_pos++];
+
+    /* Event of a watch that has been removed in the meanwhile */
+    if(event->events == 0) continue;
+
+    events = 0;
+    if(event->events & EPOLLIN)
+      events |= INF_IO_INCOMING;
+    if(event->events & EPOLLOUT)
+      events |= INF_IO_OUTGOING;
+    /* We treat EPOLLPRI as error because it should not occur in
+     * infinote. */
+    if(event->events & (EPOLLERR | EPOLLPRI | EPOLLHUP))
+      events |= INF_IO_ERROR;
+
+    if(event->data.ptr == NULL)
+    {
+      /* wakeup call */
+      inf_standalone_io_handle_wakeup(io, events);
+    }
+    else
+    {
+      watch = (InfIoWatch*)event->data.ptr;
+
+      /* The watch might have been updated since the event was reported, so
+       * do not report events the watch is no longer interested in. */
+      events &= (watch->events | INF_IO_ERROR);
+
+      if(events != 0)
+      {
+        inf_standalone_io_run_watch(io, watch, events);
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+#endif
+
 /* Run one iteration of the main loop. Call this only with the mutex locked
  * and a local reference added to io. */
 static void
@@ -179,24 +430,30 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   InfStandaloneIoPollResult result;
   guint i;
 
-  GList* item;
-  GTimeVal current;
+  GSequenceIter* iter;
+  gint64 current;
+  gint64 remaining;
   InfIoWatch* watch;
   InfIoTimeout* cur_timeout;
   InfIoDispatch* dispatch;
-  guint elapsed;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
   WSANETWORKEVENTS wsa_events;
   const InfStandaloneIoEventTableEntry* entry;
 #else
-  ssize_t ret;
-  char buf[1];
+  int wait_errno;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
+#ifdef HAVE_EPOLL
+  /* Handle events left from the previous epoll_wait() call first, before
+   * waiting for new ones. */
+  if(inf_standalone_io_epoll_dispatch(io) == TRUE)
+    return;
+#endif
+
   /* Find number of milliseconds to wait */
   if(priv->dispatchs != NULL)
   {
@@ -205,26 +462,28 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   }
   else
   {
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    /* Only the first timeout can be the next one to elapse */
+    iter = g_sequence_get_begin_iter(priv->timeouts);
+    if(!g_sequence_iter_is_end(iter))
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
+      cur_timeout = (InfIoTimeout*)g_sequence_get(iter);
+      remaining = cur_timeout->expiration - g_get_monotonic_time();
 
-      if(elapsed >= cur_timeout->msecs)
+      if(remaining <= 0)
       {
         /* already elapsed */
         /* TODO: Don't even poll */
         timeout = 0;
-        /* no need to check other timeouts */
-        break;
       }
       else
       {
+        /* round up, so that the timeout has elapsed when we wake up */
+        remaining = (remaining + 999) / 1000;
+
         if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
-           cur_timeout->msecs - elapsed < (guint)timeout)
+           remaining < (gint64)timeout)
         {
-          timeout = cur_timeout->msecs - elapsed;
+          timeout = (InfStandaloneIoPollTimeout)MIN(remaining, G_MAXINT);
         }
       }
     }
@@ -233,11 +492,38 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   priv->polling = TRUE;
   g_mutex_unlock(&priv->mutex);
 
-  result = inf_standalone_io_poll(priv->events, priv->fd_size, timeout);
+#ifdef HAVE_EPOLL
+  if(priv->epoll_fd != -1)
+  {
+    result = epoll_wait(
+      priv->epoll_fd,
+      priv->ready_events,
+      INF_STANDALONE_IO_EPOLL_BATCH_SIZE,
+      timeout
+    );
+  }
+  else
+#endif
+  {
+    result = inf_standalone_io_poll(priv->events, priv->fd_size, timeout);
+  }
+
+#ifndef G_OS_WIN32
+  wait_errno = errno;
+#endif
 
   g_mutex_lock(&priv->mutex);
   priv->polling = FALSE;
 
+#ifdef HAVE_EPOLL
+  if(priv->epoll_fd != -1)
+  {
+    priv->ready_pos = 0;
+    priv->ready_count = (result > 0) ? (guint)result : 0;
+    inf_standalone_io_epoll_release_disposed(io);
+  }
+#endif
+
 #ifdef G_OS_WIN32
   switch(result)
   {
@@ -254,8 +540,8 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
 #else
   if(result == -1)
   {
-    if(errno != EINTR)
-      g_warning("poll() failed: %s\n", strerror(errno));
+    if(wait_errno != EINTR)
+      g_warning("poll() failed: %s\n", strerror(wait_errno));
 
     return;
   }
@@ -264,14 +550,16 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   if(result == INF_STANDALONE_IO_POLL_TIMEOUT)
   {
     /* No file descriptor is active, so check whether a timeout elapsed */
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    iter = g_sequence_get_begin_iter(priv->timeouts);
+    if(!g_sequence_iter_is_end(iter))
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-      if(elapsed >= cur_timeout->msecs)
+      cur_timeout = (InfIoTimeout*)g_sequence_get(iter);
+      current = g_get_monotonic_time();
+
+      if(cur_timeout->expiration <= current)
       {
-        priv->timeouts = g_list_delete_link(priv->timeouts, item);
+        g_sequence_remove(iter);
+        cur_timeout->iter = NULL;
         g_mutex_unlock(&priv->mutex);
 
         cur_timeout->func(cur_timeout->user_data);
@@ -321,27 +609,18 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
         }
       }
 
-      /* protect from removing the watch object via
-       * inf_io_remove_watch() when running the callback. */
-      watch->executing = TRUE;
-      g_mutex_unlock(&priv->mutex);
-
-      watch->func(watch->socket, events, watch->user_data);
-
-      g_mutex_lock(&priv->mutex);
-      watch->executing = FALSE;
-      if(watch->disposed == TRUE)
-      {
-        g_mutex_unlock(&priv->mutex);
-        if(watch->notify) watch->notify(watch->user_data);
-        g_slice_free(InfIoWatch, watch);
-        g_mutex_lock(&priv->mutex);
-      }
-
+      inf_standalone_io_run_watch(io, watch, events);
       return;
     }
   }
 #else
+# ifdef HAVE_EPOLL
+  else if(priv->epoll_fd != -1)
+  {
+    if(inf_standalone_io_epoll_dispatch(io) == TRUE)
+      return;
+  }
+# endif
   else if(result > 0)
   {
     while(result--)
@@ -365,63 +644,12 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
           if(i == 0)
           {
             /* wakeup call */
-
-            /* we were not polling for outgoing */
-            g_assert(~events & INF_IO_OUTGOING);
-            if(events & INF_IO_ERROR)
-            {
-              /* TODO: Read error from FD? */
-              g_warning("Error condition on wakeup pipe");
-              /* TODO: Is there anything we could do here?
-               * Try to re-establish pipe? */
-            }
-            else
-            {
-              ret = read(priv->events[0].fd, &buf, 1);
-              if(ret == -1)
-              {
-                g_warning(
-                  "read() on wakeup pipe failed: %s",
-                  strerror(errno)
-                );
-
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else if(ret == 0)
-              {
-                g_warning("Wakeup pipe received EOF");
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else
-              {
-                /* this is what we send as wakeup call */
-                g_assert(buf[0] == 'c');
-              }
-            }
+            inf_standalone_io_handle_wakeup(io, events);
           }
           else
           {
             watch = priv->watches[i-1];
-
-            /* protect from removing the watch object via
-             * inf_io_remove_watch() when running the callback. */
-            watch->executing = TRUE;
-            g_mutex_unlock(&priv->mutex);
-
-            watch->func(watch->socket, events, watch->user_data);
-
-            g_mutex_lock(&priv->mutex);
-            watch->executing = FALSE;
-            if(watch->disposed == TRUE)
-            {
-              g_mutex_unlock(&priv->mutex);
-              if(watch->notify) watch->notify(watch->user_data);
-              g_slice_free(InfIoWatch, watch);
-              g_mutex_lock(&priv->mutex);
-            }
-
+            inf_standalone_io_run_watch(io, watch, events);
             return;
           }
         }
@@ -455,6 +683,10 @@ inf_standalone_io_init(InfStandaloneIo* io)
   gchar* error_message;
 #endif
 
+#ifdef HAVE_EPOLL
+  struct epoll_event epoll_event;
+#endif
+
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_init(&priv->mutex);
@@ -491,8 +723,47 @@ inf_standalone_io_init(InfStandaloneIo* io)
   }
 #endif
 
+#ifdef HAVE_EPOLL
+  /* Use epoll if the running kernel supports it; the wakeup pipe is
+   * registered with a NULL watch. */
+  priv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(priv->epoll_fd != -1)
+  {
+    epoll_event.events = EPOLLIN;
+    epoll_event.data.ptr = NULL;
+
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, priv->wakeup_pipe[0],
+                 &epoll_event) == -1)
+    {
+      g_warning(
+        "Failed to watch wakeup pipe with epoll, falling back to poll: %s",
+        strerror(errno)
+      );
+
+      close(priv->epoll_fd);
+      priv->epoll_fd = -1;
+    }
+  }
+
+  if(priv->epoll_fd != -1)
+  {
+    priv->ready_events = g_malloc(
+      sizeof(struct epoll_event) * INF_STANDALONE_IO_EPOLL_BATCH_SIZE
+    );
+  }
+  else
+  {
+    priv->ready_events = NULL;
+  }
+
+  priv->ready_pos = 0;
+  priv->ready_count = 0;
+  priv->disposed_watches = NULL;
+#endif
+
   priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
-  priv->timeouts = NULL;
+  priv->watch_table = g_hash_table_new(NULL, NULL);
+  priv->timeouts = g_sequence_new(NULL);
   priv->dispatchs = NULL;
 
   priv->polling = FALSE;
@@ -504,12 +775,15 @@ inf_standalone_io_finalize(GObject* object)
 {
   InfStandaloneIo* io;
   InfStandaloneIoPrivate* priv;
-  guint i;
+  GHashTableIter hash_iter;
+  gpointer value;
+  GSequenceIter* iter;
   GList* item;
   InfIoWatch* watch;
   InfIoTimeout* timeout;
   InfIoDispatch* dispatch;
 #ifdef G_OS_WIN32
+  guint i;
   gchar* error_message;
 #endif
 
@@ -518,9 +792,10 @@ inf_standalone_io_finalize(GObject* object)
 
   g_mutex_lock(&priv->mutex);
 
-  for(i = 1; i < priv->fd_size; ++i)
+  g_hash_table_iter_init(&hash_iter, priv->watch_table);
+  while(g_hash_table_iter_next(&hash_iter, NULL, &value))
   {
-    watch = priv->watches[i - 1];
+    watch = (InfIoWatch*)value;
 
     /* cannot dispose the IO while running a callback since the IO is
      * reffed on the stack. */
@@ -541,9 +816,11 @@ inf_standalone_io_finalize(GObject* object)
     g_slice_free(InfIoWatch, watch);
   }
 
-  for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+  for(iter = g_sequence_get_begin_iter(priv->timeouts);
+      !g_sequence_iter_is_end(iter);
+      iter = g_sequence_iter_next(iter))
   {
-    timeout = (InfIoTimeout*)item->data;
+    timeout = (InfIoTimeout*)g_sequence_get(iter);
     if(timeout->notify)
       timeout->notify(timeout->user_data);
     g_slice_free(InfIoTimeout, timeout);
@@ -569,9 +846,22 @@ inf_standalone_io_finalize(GObject* object)
   }
 #endif
 
+#ifdef HAVE_EPOLL
+  /* Watches are only disposed while polling, which cannot happen now */
+  g_assert(priv->disposed_watches == NULL);
+
+  if(priv->epoll_fd != -1)
+  {
+    if(close(priv->epoll_fd) == -1)
+      g_warning("Failed to close epoll instance: %s", strerror(errno));
+    g_free(priv->ready_events);
+  }
+#endif
+
   g_free(priv->events);
   g_free(priv->watches);
-  g_list_free(priv->timeouts);
+  g_hash_table_destroy(priv->watch_table);
+  g_sequence_free(priv->timeouts);
   g_list_free(priv->dispatchs);
 
 #ifndef G_OS_WIN32
@@ -598,35 +888,14 @@ inf_standalone_io_finalize(GObject* object)
   G_OBJECT_CLASS(inf_standalone_io_parent_class)->finalize(object);
 }
 
-static InfIoWatch**
-inf_standalone_io_find_watch(InfStandaloneIo* io,
-                             InfIoWatch* watch)
-{
-  InfStandaloneIoPrivate* priv;
-  guint i;
-
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1] == watch)
-      return &priv->watches[i-1];
-
-  return NULL;
-
-}
-
-static InfIoWatch**
-inf_standalone_io_find_watch_by_socket(InfStandaloneIo* io,
-                                       InfNativeSocket* socket)
+static gboolean
+inf_standalone_io_has_watch(InfStandaloneIo* io,
+                            InfIoWatch* watch)
 {
   InfStandaloneIoPrivate* priv;
-  guint i;
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1]->socket == socket)
-      return &priv->watches[i-1];
 
-  return NULL;
+  return g_hash_table_lookup(priv->watch_table, watch->socket) == watch;
 }
 
 static void
@@ -706,35 +975,58 @@ inf_standalone_io_io_add_watch(InfIo* io,
   gchar* error_message;
 #endif
 
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#ifdef HAVE_EPOLL
+  struct epoll_event epoll_event;
 #endif
 
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  pevents = inf_standalone_io_native_events(events);
+
   g_mutex_lock(&priv->mutex);
 
   /* Watching the same socket for different events at least won't work on
    * Windows since WSAEventSelect cancels the effect of previous
    * WSAEventSelect calls for the same socket. */
-  if(inf_standalone_io_find_watch_by_socket(INF_STANDALONE_IO(io), socket))
+  if(g_hash_table_lookup(priv->watch_table, socket) != NULL)
   {
     g_mutex_unlock(&priv->mutex);
     return NULL;
   }
 
+  watch = g_slice_new(InfIoWatch);
+  watch->event = NULL;
+  watch->socket = socket;
+  watch->events = events;
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->notify = notify;
+  watch->executing = FALSE;
+  watch->disposed = FALSE;
+
+#ifdef HAVE_EPOLL
+  if(priv->epoll_fd != -1)
+  {
+    epoll_event.events = inf_standalone_io_epoll_events(events);
+    epoll_event.data.ptr = watch;
+
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, *socket, &epoll_event) == -1)
+    {
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+      g_slice_free(InfIoWatch, watch);
+
+      g_mutex_unlock(&priv->mutex);
+      return NULL;
+    }
+
+    g_hash_table_insert(priv->watch_table, socket, watch);
+
+    /* A running epoll_wait() call picks up the new socket by itself, so
+     * there is no need to wake up the main loop. */
+    g_mutex_unlock(&priv->mutex);
+    return watch;
+  }
+#endif
+
   /* TODO: If we are currently polling we should not modify the fds array
    * array but do this after wakeup directly after the poll call. */
 
@@ -767,6 +1059,7 @@ inf_standalone_io_io_add_watch(InfIo* io,
     g_warning("WSACreateEvent() failed: %s", error_message);
     g_free(error_message);
 
+    g_slice_free(InfIoWatch, watch);
     g_mutex_unlock(&priv->mutex);
     return NULL;
   }
@@ -779,6 +1072,7 @@ inf_standalone_io_io_add_watch(InfIo* io,
     g_free(error_message);
 
     WSACloseEvent(priv->events[priv->fd_size]);
+    g_slice_free(InfIoWatch, watch);
     g_mutex_unlock(&priv->mutex);
     return NULL;
   }
@@ -788,18 +1082,12 @@ inf_standalone_io_io_add_watch(InfIo* io,
   priv->events[priv->fd_size].revents = 0;
 #endif
 
-  watch = g_slice_new(InfIoWatch);
   watch->event = &priv->events[priv->fd_size];
-  watch->socket = socket;
-  watch->func = func;
-  watch->user_data = user_data;
-  watch->notify = notify;
-  watch->executing = FALSE;
-  watch->disposed = FALSE;
-
   priv->watches[priv->fd_size-1] = watch;
   ++priv->fd_size;
 
+  g_hash_table_insert(priv->watch_table, socket, watch);
+
   inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
 
@@ -812,36 +1100,42 @@ inf_standalone_io_io_update_watch(InfIo* io,
                                   InfIoEvent events)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
   long pevents;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
 #endif
 
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#ifdef HAVE_EPOLL
+  struct epoll_event epoll_event;
 #endif
 
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  pevents = inf_standalone_io_native_events(events);
+
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
+    watch->events = events;
+
+#ifdef HAVE_EPOLL
+    if(priv->epoll_fd != -1)
+    {
+      epoll_event.events = inf_standalone_io_epoll_events(events);
+      epoll_event.data.ptr = watch;
+
+      if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_MOD, *watch->socket,
+                   &epoll_event) == -1)
+      {
+        g_warning("epoll_ctl() failed: %s", strerror(errno));
+      }
+
+      g_mutex_unlock(&priv->mutex);
+      return;
+    }
+#endif
+
     /* TODO: If we are currently polling we should not modify the fds array
      * array but do this after wakeup directly after the poll call. */
 
@@ -868,20 +1162,63 @@ inf_standalone_io_io_remove_watch(InfIo* io,
                                   InfIoWatch* watch)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
   guint index;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
 #endif
 
+#ifdef HAVE_EPOLL
+  guint i;
+#endif
+
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
+    g_hash_table_remove(priv->watch_table, watch->socket);
+
+#ifdef HAVE_EPOLL
+    if(priv->epoll_fd != -1)
+    {
+      /* The socket might have been closed already, in which case the
+       * kernel has removed it from the epoll set by itself. */
+      if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, *watch->socket, NULL) ==
+         -1 && errno != EBADF && errno != ENOENT)
+      {
+        g_warning("epoll_ctl() failed: %s", strerror(errno));
+      }
+
+      /* Make sure we do not report pending events for the watch */
+      for(i = priv->ready_pos; i < priv->ready_count; ++i)
+        if(priv->ready_events[i].data.ptr == watch)
+          priv->ready_events[i].events = 0;
+
+      if(watch->executing)
+      {
+        watch->disposed = TRUE;
+      }
+      else if(priv->polling)
+      {
+        /* epoll_wait() might be about to report this watch */
+        watch->disposed = TRUE;
+        priv->disposed_watches =
+          g_slist_prepend(priv->disposed_watches, watch);
+      }
+      else
+      {
+        if(watch->notify)
+          watch->notify(watch->user_data);
+        g_slice_free(InfIoWatch, watch);
+      }
+
+      g_mutex_unlock(&priv->mutex);
+      return;
+    }
+#endif
+
 #ifdef G_OS_WIN32
     if(WSAEventSelect(*watch->socket, *watch->event, 0) == SOCKET_ERROR)
     {
@@ -898,6 +1235,10 @@ inf_standalone_io_io_remove_watch(InfIo* io,
     }
 #endif
 
+    index = watch->event - priv->events;
+    g_assert(index > 0 && index < priv->fd_size);
+    g_assert(priv->watches[index - 1] == watch);
+
     /* TODO: If we are currently polling we should not modify the fds array
      * array but do this after wakeup directly after the poll call. */
     if(watch->executing)
@@ -917,7 +1258,6 @@ inf_standalone_io_io_remove_watch(InfIo* io,
     }
 
     /* Remove watch by replacing it by the last pollfd/watch */
-    index = 1 + (watch_iter - priv->watches);
     if(index != priv->fd_size - 1)
     {
       memcpy(
@@ -956,14 +1296,20 @@ inf_standalone_io_io_add_timeout(InfIo* io,
   priv = INF_STANDALONE_IO_PRIVATE(io);
   timeout = g_slice_new(InfIoTimeout);
 
-  g_get_current_time(&timeout->begin);
-  timeout->msecs = msecs;
+  timeout->expiration = g_get_monotonic_time() + (gint64)msecs * 1000;
   timeout->func = func;
   timeout->user_data = user_data;
   timeout->notify = notify;
 
   g_mutex_lock(&priv->mutex);
-  priv->timeouts = g_list_prepend(priv->timeouts, timeout);
+
+  timeout->iter = g_sequence_insert_sorted(
+    priv->timeouts,
+    timeout,
+    inf_standalone_io_timeout_cmp,
+    NULL
+  );
+
   inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
 
@@ -975,16 +1321,16 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
                                     InfIoTimeout* timeout)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  item = g_list_find(priv->timeouts, timeout);
-  if(item != NULL)
+  /* The iterator is unset while the timeout is being run */
+  if(timeout->iter != NULL)
   {
-    priv->timeouts = g_list_delete_link(priv->timeouts, item);
+    g_sequence_remove(timeout->iter);
+    timeout->iter = NULL;
     g_mutex_unlock(&priv->mutex);
 
     if(timeout->notify)
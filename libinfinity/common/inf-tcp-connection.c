@@ -57,6 +57,7 @@
 #ifndef G_OS_WIN32
 # include <sys/types.h>
 # include <sys/socket.h>
+# include <sys/uio.h>
 # include <netinet/in.h>
 # include <net/if.h>
 # include <arpa/inet.h>
@@ -106,10 +107,25 @@ struct _InfTcpConnectionPrivate {
   guint remote_port;
   unsigned int device_index;
 
-  guint8* queue;
-  gsize front_pos;
-  gsize back_pos;
-  gsize alloc;
+  /* Data waiting to be sent, as a queue of GBytes. The first queue_offset
+   * bytes of the head have already been sent. Data that has to be copied
+   * is collected in pending, which logically follows the queue tail. */
+  GQueue queue;
+  GByteArray* pending;
+  gsize queue_offset;
+  gsize queue_size;
+
+  guint high_watermark;
+  guint low_watermark;
+  gboolean send_queue_full;
+
+  /* Received data is passed to the received signal directly from this
+   * buffer. It is allocated on first use. */
+  gchar* receive_buffer;
+  gsize receive_buffer_alloc;
+  guint receive_buffer_size;
+  /* Maximum number of bytes to read per I/O event, or 0 for no limit */
+  guint receive_budget;
 };
 
 enum {
@@ -127,7 +143,15 @@ enum {
   PROP_LOCAL_PORT,
 
   PROP_DEVICE_INDEX,
-  PROP_DEVICE_NAME
+  PROP_DEVICE_NAME,
+
+  PROP_RECEIVE_BUFFER_SIZE,
+  PROP_RECEIVE_BUDGET,
+
+  PROP_SEND_QUEUE_SIZE,
+  PROP_HIGH_WATERMARK,
+  PROP_LOW_WATERMARK,
+  PROP_SEND_QUEUE_FULL
 };
 
 enum {
@@ -269,6 +293,142 @@ inf_tcp_connection_system_error(InfTcpConnection* connection,
   g_error_free(error);
 }
 
+/* Maximum number of queued buffers passed to a single send call */
+#define INF_TCP_CONNECTION_MAX_SEND_BUFFERS 64
+
+typedef struct _InfTcpConnectionSentChunk InfTcpConnectionSentChunk;
+struct _InfTcpConnectionSentChunk {
+  GBytes* bytes;
+  gsize offset;
+  gsize length;
+};
+
+static void
+inf_tcp_connection_update_send_queue_full(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->send_queue_full == FALSE)
+  {
+    if(priv->high_watermark > 0 && priv->queue_size > priv->high_watermark)
+    {
+      priv->send_queue_full = TRUE;
+      g_object_notify(G_OBJECT(connection), "send-queue-full");
+    }
+  }
+  else
+  {
+    if(priv->high_watermark == 0 || priv->queue_size <= priv->low_watermark)
+    {
+      priv->send_queue_full = FALSE;
+      g_object_notify(G_OBJECT(connection), "send-queue-full");
+    }
+  }
+}
+
+static void
+inf_tcp_connection_clear_queue(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  GBytes* bytes;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  while( (bytes = g_queue_pop_head(&priv->queue)) != NULL)
+    g_bytes_unref(bytes);
+
+  if(priv->pending != NULL)
+  {
+    g_byte_array_unref(priv->pending);
+    priv->pending = NULL;
+  }
+
+  priv->queue_offset = 0;
+  priv->queue_size = 0;
+}
+
+/* Moves the pending data into the queue, so that the queue can be sent or
+ * another buffer can be added after it. */
+static void
+inf_tcp_connection_seal_pending(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->pending != NULL)
+  {
+    g_assert(!g_queue_is_empty(&priv->queue) || priv->queue_offset == 0);
+
+    g_queue_push_tail(
+      &priv->queue,
+      g_byte_array_free_to_bytes(priv->pending)
+    );
+
+    priv->pending = NULL;
+  }
+}
+
+static void
+inf_tcp_connection_enqueued(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(~priv->events & INF_IO_OUTGOING)
+  {
+    priv->events |= INF_IO_OUTGOING;
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+
+  inf_tcp_connection_update_send_queue_full(connection);
+}
+
+/* Appends a reference to bytes to the send queue. The first offset bytes
+ * are skipped, which is only allowed if the queue is empty. */
+static void
+inf_tcp_connection_enqueue_bytes(InfTcpConnection* connection,
+                                 GBytes* bytes,
+                                 gsize offset)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_assert(offset < g_bytes_get_size(bytes));
+  g_assert(offset == 0 || priv->queue_size == 0);
+
+  inf_tcp_connection_seal_pending(connection);
+
+  if(g_queue_is_empty(&priv->queue))
+    priv->queue_offset = offset;
+
+  g_queue_push_tail(&priv->queue, g_bytes_ref(bytes));
+  priv->queue_size += g_bytes_get_size(bytes) - offset;
+
+  inf_tcp_connection_enqueued(connection);
+}
+
+/* Appends a copy of data to the send queue. Consecutive copies are
+ * collected in a single buffer. */
+static void
+inf_tcp_connection_enqueue_copy(InfTcpConnection* connection,
+                                gconstpointer data,
+                                guint len)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_assert(len > 0);
+
+  if(priv->pending == NULL)
+    priv->pending = g_byte_array_sized_new(MAX(len, 1024));
+
+  g_byte_array_append(priv->pending, data, len);
+  priv->queue_size += len;
+
+  inf_tcp_connection_enqueued(connection);
+}
+
 static void
 inf_tcp_connection_io(InfNativeSocket* socket,
                       InfIoEvent events,
@@ -282,8 +442,7 @@ inf_tcp_connection_connected(InfTcpConnection* connection)
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
 
   priv->status = INF_TCP_CONNECTION_CONNECTED;
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
 
   priv->events = INF_IO_INCOMING | INF_IO_ERROR;
 
@@ -638,7 +797,7 @@ static void
 inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 {
   InfTcpConnectionPrivate* priv;
-  gchar buf[2048];
+  gsize total;
   int errcode;
   ssize_t result;
 
@@ -646,9 +805,26 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 
   g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
 
+  /* The buffer size might have been changed by a received signal handler
+   * since the last call, so only reallocate here. */
+  if(priv->receive_buffer_alloc != priv->receive_buffer_size)
+  {
+    g_free(priv->receive_buffer);
+    priv->receive_buffer_alloc = priv->receive_buffer_size;
+    priv->receive_buffer = g_malloc(priv->receive_buffer_alloc);
+  }
+
+  total = 0;
+
   do
   {
-    result = recv(priv->socket, buf, 2048, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    result = recv(
+      priv->socket,
+      priv->receive_buffer,
+      priv->receive_buffer_alloc,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
     if(result < 0 &&
@@ -663,17 +839,167 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
     }
     else if(result > 0)
     {
+      total += result;
+
       g_signal_emit(
         G_OBJECT(connection),
         tcp_connection_signals[RECEIVED],
         0,
-        buf,
+        priv->receive_buffer,
         (guint)result
       );
     }
-  } while( ((result > 0) ||
+
+    /* A short read means that the socket has been drained, so we can save
+     * the recv() call that would fail with EAGAIN. Once the budget is used
+     * up, we return to the main loop so that other connections get their
+     * turn. The watch is level-triggered, so we are called again for the
+     * remaining data. */
+  } while( ((result > 0 && (gsize)result == priv->receive_buffer_alloc) ||
             (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
-           (priv->status != INF_TCP_CONNECTION_CLOSED));
+           (priv->status != INF_TCP_CONNECTION_CLOSED) &&
+           (priv->receive_budget == 0 || total < priv->receive_budget));
+}
+
+/* Sends as much of the send queue as the kernel accepts with one system
+ * call, passing up to INF_TCP_CONNECTION_MAX_SEND_BUFFERS queued buffers at
+ * once. If there is more, the watch reports the socket writable again. */
+static void
+inf_tcp_connection_flush(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+#ifdef G_OS_WIN32
+  WSABUF buffers[INF_TCP_CONNECTION_MAX_SEND_BUFFERS];
+  DWORD bytes_sent;
+#else
+  struct iovec buffers[INF_TCP_CONNECTION_MAX_SEND_BUFFERS];
+  struct msghdr msg;
+#endif
+  InfTcpConnectionSentChunk sent[INF_TCP_CONNECTION_MAX_SEND_BUFFERS];
+  guint n_buffers;
+  guint n_sent;
+  guint i;
+  gsize offset;
+  gsize size;
+  gconstpointer data;
+  GList* item;
+  GBytes* bytes;
+  int errcode;
+  ssize_t result;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  inf_tcp_connection_seal_pending(connection);
+
+  n_buffers = 0;
+  offset = priv->queue_offset;
+
+  for(item = priv->queue.head;
+      item != NULL && n_buffers < INF_TCP_CONNECTION_MAX_SEND_BUFFERS;
+      item = item->next)
+  {
+    data = g_bytes_get_data((GBytes*)item->data, &size);
+#ifdef G_OS_WIN32
+    buffers[n_buffers].buf = (char*)data + offset;
+    buffers[n_buffers].len = size - offset;
+#else
+    buffers[n_buffers].iov_base = (char*)data + offset;
+    buffers[n_buffers].iov_len = size - offset;
+#endif
+    offset = 0;
+    ++n_buffers;
+  }
+
+  g_assert(n_buffers > 0);
+
+  do
+  {
+#ifdef G_OS_WIN32
+    if(WSASend(priv->socket, buffers, n_buffers, &bytes_sent, 0, NULL, NULL)
+       == SOCKET_ERROR)
+    {
+      result = -1;
+    }
+    else
+    {
+      result = bytes_sent;
+    }
+#else
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = n_buffers;
+    result = sendmsg(priv->socket, &msg, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+#endif
+
+    /* Preserve error code so that it is not modified by future calls */
+    errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+  } while(result < 0 && errcode == INF_NATIVE_SOCKET_EINTR);
+
+  if(result < 0)
+  {
+    if(errcode != INF_NATIVE_SOCKET_EAGAIN)
+      inf_tcp_connection_system_error(connection, errcode);
+    return;
+  }
+  else if(result == 0)
+  {
+    inf_tcp_connection_close(connection);
+    return;
+  }
+
+  /* Remove what has been sent from the queue, but keep a reference to it
+   * until the sent signal has been emitted. */
+  priv->queue_size -= result;
+  n_sent = 0;
+
+  while(result > 0)
+  {
+    bytes = g_queue_peek_head(&priv->queue);
+    size = g_bytes_get_size(bytes) - priv->queue_offset;
+
+    sent[n_sent].offset = priv->queue_offset;
+    if((gsize)result >= size)
+    {
+      sent[n_sent].bytes = g_queue_pop_head(&priv->queue);
+      sent[n_sent].length = size;
+      priv->queue_offset = 0;
+    }
+    else
+    {
+      sent[n_sent].bytes = g_bytes_ref(bytes);
+      sent[n_sent].length = result;
+      priv->queue_offset += result;
+    }
+
+    result -= sent[n_sent].length;
+    ++n_sent;
+  }
+
+  if(priv->queue_size == 0)
+  {
+    /* sent everything */
+    priv->events &= ~INF_IO_OUTGOING;
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+
+  inf_tcp_connection_update_send_queue_full(connection);
+
+  for(i = 0; i < n_sent; ++i)
+  {
+    data = g_bytes_get_data(sent[i].bytes, NULL);
+
+    g_signal_emit(
+      G_OBJECT(connection),
+      tcp_connection_signals[SENT],
+      0,
+      (const char*)data + sent[i].offset,
+      (guint)sent[i].length
+    );
+  }
+
+  for(i = 0; i < n_sent; ++i)
+    g_bytes_unref(sent[i].bytes);
 }
 
 static void
@@ -684,9 +1010,6 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
   socklen_t len;
   int errcode;
 
-  gconstpointer data;
-  guint data_len;
-
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
   switch(priv->status)
   {
@@ -709,35 +1032,10 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
 
     break;
   case INF_TCP_CONNECTION_CONNECTED:
-    g_assert(priv->back_pos < priv->front_pos);
+    g_assert(priv->queue_size > 0);
     g_assert(priv->events & INF_IO_OUTGOING);
 
-    data = priv->queue + priv->back_pos;
-    data_len = priv->front_pos - priv->back_pos;
-    if(inf_tcp_connection_send_real(connection, data, &data_len) == TRUE)
-    {
-      priv->back_pos += data_len;
-
-      if(priv->front_pos == priv->back_pos)
-      {
-        /* sent everything */
-        priv->front_pos = 0;
-        priv->back_pos = 0;
-
-        priv->events &= ~INF_IO_OUTGOING;
-
-        inf_io_update_watch(priv->io, priv->watch, priv->events);
-      }
-
-      g_signal_emit(
-        G_OBJECT(connection),
-        tcp_connection_signals[SENT],
-        0,
-        data,
-        data_len
-      );
-    }
-
+    inf_tcp_connection_flush(connection);
     break;
   case INF_TCP_CONNECTION_CLOSED:
   default:
@@ -910,10 +1208,19 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->remote_port = 0;
   priv->device_index = 0;
 
-  priv->queue = g_malloc(1024);
-  priv->front_pos = 0;
-  priv->back_pos = 0;
-  priv->alloc = 1024;
+  g_queue_init(&priv->queue);
+  priv->pending = NULL;
+  priv->queue_offset = 0;
+  priv->queue_size = 0;
+
+  priv->high_watermark = 1024 * 1024;
+  priv->low_watermark = 256 * 1024;
+  priv->send_queue_full = FALSE;
+
+  priv->receive_buffer = NULL;
+  priv->receive_buffer_alloc = 0;
+  priv->receive_buffer_size = 16384;
+  priv->receive_budget = 65536;
 }
 
 static void
@@ -954,7 +1261,8 @@ inf_tcp_connection_finalize(GObject* object)
   if(priv->socket != INVALID_SOCKET)
     closesocket(priv->socket);
 
-  g_free(priv->queue);
+  inf_tcp_connection_clear_queue(connection);
+  g_free(priv->receive_buffer);
 
   G_OBJECT_CLASS(inf_tcp_connection_parent_class)->finalize(object);
 }
@@ -1045,6 +1353,20 @@ inf_tcp_connection_set_property(GObject* object,
     }
 #endif
     break;
+  case PROP_RECEIVE_BUFFER_SIZE:
+    priv->receive_buffer_size = g_value_get_uint(value);
+    break;
+  case PROP_RECEIVE_BUDGET:
+    priv->receive_budget = g_value_get_uint(value);
+    break;
+  case PROP_HIGH_WATERMARK:
+    priv->high_watermark = g_value_get_uint(value);
+    inf_tcp_connection_update_send_queue_full(INF_TCP_CONNECTION(object));
+    break;
+  case PROP_LOW_WATERMARK:
+    priv->low_watermark = g_value_get_uint(value);
+    inf_tcp_connection_update_send_queue_full(INF_TCP_CONNECTION(object));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1158,6 +1480,24 @@ inf_tcp_connection_get_property(GObject* object,
     }
 #endif
     break;
+  case PROP_RECEIVE_BUFFER_SIZE:
+    g_value_set_uint(value, priv->receive_buffer_size);
+    break;
+  case PROP_RECEIVE_BUDGET:
+    g_value_set_uint(value, priv->receive_budget);
+    break;
+  case PROP_SEND_QUEUE_SIZE:
+    g_value_set_uint(value, MIN(priv->queue_size, G_MAXUINT));
+    break;
+  case PROP_HIGH_WATERMARK:
+    g_value_set_uint(value, priv->high_watermark);
+    break;
+  case PROP_LOW_WATERMARK:
+    g_value_set_uint(value, priv->low_watermark);
+    break;
+  case PROP_SEND_QUEUE_FULL:
+    g_value_set_boolean(value, priv->send_queue_full);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1331,6 +1671,93 @@ inf_tcp_connection_class_init(InfTcpConnectionClass* tcp_connection_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_RECEIVE_BUFFER_SIZE,
+    g_param_spec_uint(
+      "receive-buffer-size",
+      "Receive buffer size",
+      "The maximum number of bytes to read from the socket at once",
+      1024,
+      G_MAXINT,
+      16384,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_RECEIVE_BUDGET,
+    g_param_spec_uint(
+      "receive-budget",
+      "Receive budget",
+      "The maximum number of bytes to read before giving other connections "
+      "in the same main loop a turn, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      65536,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SEND_QUEUE_SIZE,
+    g_param_spec_uint(
+      "send-queue-size",
+      "Send queue size",
+      "The number of bytes waiting to be sent",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_HIGH_WATERMARK,
+    g_param_spec_uint(
+      "high-watermark",
+      "High watermark",
+      "The send queue size above which the send queue is considered full, "
+      "or 0 to never consider it full",
+      0,
+      G_MAXUINT,
+      1024 * 1024,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_LOW_WATERMARK,
+    g_param_spec_uint(
+      "low-watermark",
+      "Low watermark",
+      "The send queue size at or below which a full send queue is no "
+      "longer considered full",
+      0,
+      G_MAXUINT,
+      256 * 1024,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SEND_QUEUE_FULL,
+    g_param_spec_boolean(
+      "send-queue-full",
+      "Send queue full",
+      "Whether the send queue has grown above the high watermark and not "
+      "yet been drained below the low watermark. Callers producing large "
+      "amounts of data should stop while this is set",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfTcpConnection::sent:
    * @connection: The #InfTcpConnection through which the data has been sent.
@@ -1360,7 +1787,11 @@ inf_tcp_connection_class_init(InfTcpConnectionClass* tcp_connection_class)
    * @length: A #guint holding the number of bytes that has been received.
    *
    * This signal is emitted whenever data has been received from the
-   * connection.
+   * connection. @data points into the connection's receive buffer, and is
+   * only valid during the signal emission. See the
+   * #InfTcpConnection:receive-buffer-size and
+   * #InfTcpConnection:receive-budget properties for how much data is read at
+   * once.
    */
   tcp_connection_signals[RECEIVED] = g_signal_new(
     "received",
@@ -1588,44 +2019,32 @@ inf_tcp_connection_close(InfTcpConnection* connection)
     priv->watch = NULL;
   }
 
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
+  inf_tcp_connection_update_send_queue_full(connection);
 
   priv->status = INF_TCP_CONNECTION_CLOSED;
   g_object_notify(G_OBJECT(connection), "status");
 }
 
-/**
- * inf_tcp_connection_send:
- * @connection: A #InfTcpConnection with status %INF_TCP_CONNECTION_CONNECTED.
- * @data: (type guint8*) (array length=len): The data to send.
- * @len: Number of bytes to send.
- *
- * Sends data through the TCP connection. The data is not sent immediately,
- * but enqueued to a buffer and will be sent as soon as kernel space
- * becomes available. The "sent" signal will be emitted when data has
- * really been sent.
- **/
-void
-inf_tcp_connection_send(InfTcpConnection* connection,
-                        gconstpointer data,
-                        guint len)
+static void
+inf_tcp_connection_send_impl(InfTcpConnection* connection,
+                             gconstpointer data,
+                             guint len,
+                             GBytes* bytes)
 {
   InfTcpConnectionPrivate* priv;
   gconstpointer sent_data;
   guint sent_len;
-
-  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
-  g_return_if_fail(len == 0 || data != NULL);
+  guint total_len;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
-  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
+  total_len = len;
 
   g_object_ref(connection);
 
   /* Check whether we have data currently queued. If we have, then we need
    * to wait until that data has been sent before sending the new data. */
-  if(priv->front_pos == priv->back_pos)
+  if(priv->queue_size == 0)
   {
     /* Must not be set, because otherwise we would need something to send,
      * but there is nothing in the queue. */
@@ -1654,43 +2073,21 @@ inf_tcp_connection_send(InfTcpConnection* connection,
     sent_len = 0;
   }
 
-  /* If we couldn't send all the data... */
+  /* If we couldn't send all the data, queue the rest. If the caller gave
+   * us a GBytes we keep a reference to it, otherwise we need a copy. */
   if(len > 0)
   {
-    /* If we have not enough space for the new data, move queue data back
-     * onto the beginning of the queue, if not already */
-    if(priv->alloc - priv->front_pos < len && priv->back_pos > 0)
+    if(bytes != NULL)
     {
-      memmove(
-        priv->queue,
-        priv->queue + priv->back_pos,
-        priv->front_pos - priv->back_pos
+      inf_tcp_connection_enqueue_bytes(
+        connection,
+        bytes,
+        total_len - len
       );
-
-      priv->front_pos -= priv->back_pos;
-      priv->back_pos = 0;
     }
-
-    /* Allocate more memory if there is still not enough space */
-    if(priv->alloc - priv->front_pos < len)
-    {
-      /* Make sure we allocate enough */
-      priv->alloc = priv->front_pos + len;
-
-      /* Always allocate a multiple of 1024 */
-      if(priv->alloc % 1024 != 0)
-        priv->alloc = priv->alloc + (1024 - priv->alloc % 1024);
-
-      priv->queue = g_realloc(priv->queue, priv->alloc);
-    }
-
-    memcpy(priv->queue + priv->front_pos, data, len);
-    priv->front_pos += len;
-
-    if(~priv->events & INF_IO_OUTGOING)
+    else
     {
-      priv->events |= INF_IO_OUTGOING;
-      inf_io_update_watch(priv->io, priv->watch, priv->events);
+      inf_tcp_connection_enqueue_copy(connection, data, len);
     }
   }
 
@@ -1708,6 +2105,66 @@ inf_tcp_connection_send(InfTcpConnection* connection,
   g_object_unref(connection);
 }
 
+/**
+ * inf_tcp_connection_send:
+ * @connection: A #InfTcpConnection with status %INF_TCP_CONNECTION_CONNECTED.
+ * @data: (type guint8*) (array length=len): The data to send.
+ * @len: Number of bytes to send.
+ *
+ * Sends data through the TCP connection. If the data cannot be sent
+ * immediately, it is copied into the send queue and will be sent as soon
+ * as kernel space becomes available. The "sent" signal will be emitted
+ * when data has really been sent.
+ **/
+void
+inf_tcp_connection_send(InfTcpConnection* connection,
+                        gconstpointer data,
+                        guint len)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  g_return_if_fail(len == 0 || data != NULL);
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  inf_tcp_connection_send_impl(connection, data, len, NULL);
+}
+
+/**
+ * inf_tcp_connection_send_bytes:
+ * @connection: A #InfTcpConnection with status %INF_TCP_CONNECTION_CONNECTED.
+ * @bytes: The data to send.
+ *
+ * Sends data through the TCP connection, like inf_tcp_connection_send().
+ * If the data cannot be sent immediately, the send queue keeps a reference
+ * to @bytes instead of copying the data. This allows the same data to be
+ * queued on many connections at the cost of a single allocation.
+ *
+ * Queued data is written with as few system calls as possible, gathering
+ * several queued buffers into a single write.
+ **/
+void
+inf_tcp_connection_send_bytes(InfTcpConnection* connection,
+                              GBytes* bytes)
+{
+  InfTcpConnectionPrivate* priv;
+  gconstpointer data;
+  gsize len;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  g_return_if_fail(bytes != NULL);
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  data = g_bytes_get_data(bytes, &len);
+  g_return_if_fail(len <= G_MAXUINT);
+
+  inf_tcp_connection_send_impl(connection, data, len, bytes);
+}
+
 /**
  * inf_tcp_connection_get_remote_address:
  * @connection: A #InfTcpConnection.
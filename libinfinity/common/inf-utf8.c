@@ -0,0 +1,517 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-utf8
+ * @title: UTF-8 utility functions
+ * @short_description: Fast scanning of UTF-8 encoded text
+ * @include: libinfinity/common/inf-utf8.h
+ * @stability: Unstable
+ *
+ * These functions count characters, translate character offsets into byte
+ * offsets and validate UTF-8 encoded text of known length. They behave like
+ * g_utf8_strlen(), g_utf8_offset_to_pointer() and g_utf8_validate(), but
+ * examine 16 or 32 bytes at a time using SSE2 or AVX2 instructions if the
+ * CPU supports them, and 8 bytes at a time otherwise. The implementation is
+ * selected at runtime when one of the functions is called for the first
+ * time. If the environment variable LIBINFINITY_DISABLE_SIMD is set, the
+ * portable implementation is always used.
+ **/
+
+#include "config.h"
+
+#include <libinfinity/common/inf-utf8.h>
+
+#include <string.h>
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+# include <immintrin.h>
+#endif
+
+typedef struct _InfUtf8Impl InfUtf8Impl;
+struct _InfUtf8Impl {
+  gsize(*strlen)(const guchar* text,
+                 gsize bytes);
+
+  gsize(*offset_to_index)(const guchar* text,
+                          gsize bytes,
+                          gsize offset);
+
+  /* Returns the number of leading bytes that are ASCII and not NUL */
+  gsize(*ascii_prefix)(const guchar* text,
+                       gsize bytes);
+};
+
+#define INF_UTF8_ONES G_GUINT64_CONSTANT(0x0101010101010101)
+#define INF_UTF8_HIGH G_GUINT64_CONSTANT(0x8080808080808080)
+
+/* Number of bytes after which inf_utf8_validate() tries the block-wise
+ * ASCII scan again after having seen a non-ASCII character. */
+#define INF_UTF8_VALIDATE_SCALAR_RUN 32
+
+/*
+ * Portable implementation, processing one 64 bit word at a time
+ */
+
+static inline guint64
+inf_utf8_load64(const guchar* text)
+{
+  guint64 word;
+  memcpy(&word, text, sizeof(word));
+  return word;
+}
+
+/* Number of bytes in word which are not UTF-8 continuation bytes */
+static inline guint
+inf_utf8_count_starts64(guint64 word)
+{
+  guint64 cont;
+
+  /* Continuation bytes have bit 7 set and bit 6 cleared. The shift moves
+   * bit 6 of each byte to bit 7 of the same byte. */
+  cont = word & ~(word << 1) & INF_UTF8_HIGH;
+  return 8 - (guint)((((cont >> 7) * INF_UTF8_ONES) >> 56) & 0xff);
+}
+
+static gsize
+inf_utf8_strlen_scalar(const guchar* text,
+                       gsize bytes)
+{
+  gsize count;
+  gsize i;
+
+  count = 0;
+  for(i = 0; bytes - i >= 8; i += 8)
+    count += inf_utf8_count_starts64(inf_utf8_load64(text + i));
+
+  for(; i < bytes; ++i)
+    if((text[i] & 0xc0) != 0x80)
+      ++count;
+
+  return count;
+}
+
+static gsize
+inf_utf8_offset_to_index_scalar(const guchar* text,
+                                gsize bytes,
+                                gsize offset)
+{
+  gsize i;
+  guint n;
+
+  /* If a block contains no more than offset characters then the character
+   * we are looking for starts behind it. */
+  for(i = 0; bytes - i >= 8; i += 8)
+  {
+    n = inf_utf8_count_starts64(inf_utf8_load64(text + i));
+    if(n > offset) break;
+    offset -= n;
+  }
+
+  for(; i < bytes; ++i)
+  {
+    if((text[i] & 0xc0) != 0x80)
+    {
+      if(offset == 0) return i;
+      --offset;
+    }
+  }
+
+  return bytes;
+}
+
+static gsize
+inf_utf8_ascii_prefix_scalar(const guchar* text,
+                             gsize bytes)
+{
+  guint64 word;
+  gsize i;
+
+  for(i = 0; bytes - i >= 8; i += 8)
+  {
+    word = inf_utf8_load64(text + i);
+    if(((word | ((word - INF_UTF8_ONES) & ~word)) & INF_UTF8_HIGH) != 0)
+      break;
+  }
+
+  for(; i < bytes; ++i)
+    if(text[i] == '\0' || text[i] >= 0x80)
+      break;
+
+  return i;
+}
+
+static const InfUtf8Impl inf_utf8_impl_scalar = {
+  inf_utf8_strlen_scalar,
+  inf_utf8_offset_to_index_scalar,
+  inf_utf8_ascii_prefix_scalar
+};
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+/*
+ * SSE2 implementation, processing 16 bytes at a time. A byte is not a
+ * continuation byte if, interpreted as a signed integer, it is greater than
+ * -65 (0xbf).
+ */
+
+__attribute__((target("sse2")))
+static gsize
+inf_utf8_strlen_sse2(const guchar* text,
+                     gsize bytes)
+{
+  const __m128i threshold = _mm_set1_epi8(-65);
+  __m128i acc;
+  __m128i v;
+  gsize count;
+  gsize i;
+  guint j;
+
+  count = 0;
+  i = 0;
+
+  while(bytes - i >= 16)
+  {
+    /* Every lane of acc counts up to 255 characters before it would
+     * overflow, so the sum is flushed every 255 blocks. */
+    acc = _mm_setzero_si128();
+    for(j = 0; j < 255 && bytes - i >= 16; ++j, i += 16)
+    {
+      v = _mm_loadu_si128((const __m128i*)(text + i));
+      acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(v, threshold));
+    }
+
+    acc = _mm_sad_epu8(acc, _mm_setzero_si128());
+    count += _mm_cvtsi128_si32(acc) + _mm_extract_epi16(acc, 4);
+  }
+
+  return count + inf_utf8_strlen_scalar(text + i, bytes - i);
+}
+
+__attribute__((target("sse2")))
+static gsize
+inf_utf8_offset_to_index_sse2(const guchar* text,
+                              gsize bytes,
+                              gsize offset)
+{
+  const __m128i threshold = _mm_set1_epi8(-65);
+  __m128i v;
+  gsize i;
+  guint n;
+
+  for(i = 0; bytes - i >= 16; i += 16)
+  {
+    v = _mm_loadu_si128((const __m128i*)(text + i));
+    n = __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(v, threshold)));
+    if(n > offset) break;
+    offset -= n;
+  }
+
+  return i + inf_utf8_offset_to_index_scalar(text + i, bytes - i, offset);
+}
+
+__attribute__((target("sse2")))
+static gsize
+inf_utf8_ascii_prefix_sse2(const guchar* text,
+                           gsize bytes)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v;
+  gsize i;
+
+  for(i = 0; bytes - i >= 16; i += 16)
+  {
+    v = _mm_loadu_si128((const __m128i*)(text + i));
+    if(_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))) != 0)
+      break;
+  }
+
+  return i + inf_utf8_ascii_prefix_scalar(text + i, bytes - i);
+}
+
+static const InfUtf8Impl inf_utf8_impl_sse2 = {
+  inf_utf8_strlen_sse2,
+  inf_utf8_offset_to_index_sse2,
+  inf_utf8_ascii_prefix_sse2
+};
+
+/*
+ * AVX2 implementation, processing 32 bytes at a time
+ */
+
+__attribute__((target("avx2")))
+static gsize
+inf_utf8_strlen_avx2(const guchar* text,
+                     gsize bytes)
+{
+  const __m256i threshold = _mm256_set1_epi8(-65);
+  __m256i acc;
+  __m256i v;
+  guint64 sums[4];
+  gsize count;
+  gsize i;
+  guint j;
+
+  count = 0;
+  i = 0;
+
+  while(bytes - i >= 32)
+  {
+    acc = _mm256_setzero_si256();
+    for(j = 0; j < 255 && bytes - i >= 32; ++j, i += 32)
+    {
+      v = _mm256_loadu_si256((const __m256i*)(text + i));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(v, threshold));
+    }
+
+    acc = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i*)sums, acc);
+    count += sums[0] + sums[1] + sums[2] + sums[3];
+  }
+
+  return count + inf_utf8_strlen_scalar(text + i, bytes - i);
+}
+
+__attribute__((target("avx2")))
+static gsize
+inf_utf8_offset_to_index_avx2(const guchar* text,
+                              gsize bytes,
+                              gsize offset)
+{
+  const __m256i threshold = _mm256_set1_epi8(-65);
+  __m256i v;
+  gsize i;
+  guint n;
+
+  for(i = 0; bytes - i >= 32; i += 32)
+  {
+    v = _mm256_loadu_si256((const __m256i*)(text + i));
+    n = __builtin_popcount(
+      (guint)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, threshold))
+    );
+
+    if(n > offset) break;
+    offset -= n;
+  }
+
+  return i + inf_utf8_offset_to_index_scalar(text + i, bytes - i, offset);
+}
+
+__attribute__((target("avx2")))
+static gsize
+inf_utf8_ascii_prefix_avx2(const guchar* text,
+                           gsize bytes)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i v;
+  gsize i;
+
+  for(i = 0; bytes - i >= 32; i += 32)
+  {
+    v = _mm256_loadu_si256((const __m256i*)(text + i));
+    if(_mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero))))
+      break;
+  }
+
+  return i + inf_utf8_ascii_prefix_scalar(text + i, bytes - i);
+}
+
+static const InfUtf8Impl inf_utf8_impl_avx2 = {
+  inf_utf8_strlen_avx2,
+  inf_utf8_offset_to_index_avx2,
+  inf_utf8_ascii_prefix_avx2
+};
+#endif /* HAVE_X86_SIMD_DISPATCH */
+
+static const InfUtf8Impl*
+inf_utf8_get_impl(void)
+{
+  static gsize impl = 0;
+  const InfUtf8Impl* chosen;
+
+  if(g_once_init_enter(&impl))
+  {
+    chosen = &inf_utf8_impl_scalar;
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+    if(g_getenv("LIBINFINITY_DISABLE_SIMD") == NULL)
+    {
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2"))
+        chosen = &inf_utf8_impl_avx2;
+      else if(__builtin_cpu_supports("sse2"))
+        chosen = &inf_utf8_impl_sse2;
+    }
+#endif
+
+    g_once_init_leave(&impl, (gsize)chosen);
+  }
+
+  return (const InfUtf8Impl*)impl;
+}
+
+/* Returns the length of the well-formed UTF-8 sequence at the beginning of
+ * text, or 0 if there is none. Overlong forms, surrogates and code points
+ * beyond U+10FFFF are rejected, as is NUL, like g_utf8_validate() does. */
+static guint
+inf_utf8_validate_char(const guchar* text,
+                       gsize bytes)
+{
+  guchar c;
+
+  c = text[0];
+  if(c < 0x80) return c != '\0' ? 1 : 0;
+  if(c < 0xc2) return 0;
+
+  if(c < 0xe0)
+  {
+    if(bytes < 2 || (text[1] & 0xc0) != 0x80) return 0;
+    return 2;
+  }
+
+  if(c < 0xf0)
+  {
+    if(bytes < 3) return 0;
+    if((text[1] & 0xc0) != 0x80 || (text[2] & 0xc0) != 0x80) return 0;
+    if(c == 0xe0 && text[1] < 0xa0) return 0;
+    if(c == 0xed && text[1] >= 0xa0) return 0;
+    return 3;
+  }
+
+  if(c < 0xf5)
+  {
+    if(bytes < 4) return 0;
+    if((text[1] & 0xc0) != 0x80 || (text[2] & 0xc0) != 0x80 ||
+       (text[3] & 0xc0) != 0x80)
+    {
+      return 0;
+    }
+
+    if(c == 0xf0 && text[1] < 0x90) return 0;
+    if(c == 0xf4 && text[1] >= 0x90) return 0;
+    return 4;
+  }
+
+  return 0;
+}
+
+/**
+ * inf_utf8_strlen:
+ * @text: (array length=bytes): UTF-8 encoded text.
+ * @bytes: The number of bytes of @text.
+ *
+ * Returns the number of characters in @text. This is equivalent to
+ * g_utf8_strlen(), except that @text does not need to be NUL-terminated
+ * and that embedded NUL characters are counted. @text is expected to be
+ * valid UTF-8.
+ *
+ * Returns: The number of characters in @text.
+ */
+gsize
+inf_utf8_strlen(const gchar* text,
+                gsize bytes)
+{
+  g_return_val_if_fail(text != NULL || bytes == 0, 0);
+  return inf_utf8_get_impl()->strlen((const guchar*)text, bytes);
+}
+
+/**
+ * inf_utf8_offset_to_index:
+ * @text: (array length=bytes): UTF-8 encoded text.
+ * @bytes: The number of bytes of @text.
+ * @offset: A character offset into @text.
+ *
+ * Returns the byte index of the character at position @offset in @text.
+ * This is equivalent to g_utf8_offset_to_pointer() except that the result
+ * is an index instead of a pointer and that it never reaches beyond @bytes.
+ * If @offset is equal to the number of characters in @text then @bytes is
+ * returned. @text is expected to be valid UTF-8.
+ *
+ * Returns: The byte index of the character at @offset.
+ */
+gsize
+inf_utf8_offset_to_index(const gchar* text,
+                         gsize bytes,
+                         gsize offset)
+{
+  g_return_val_if_fail(text != NULL || bytes == 0, 0);
+
+  return inf_utf8_get_impl()->offset_to_index(
+    (const guchar*)text,
+    bytes,
+    offset
+  );
+}
+
+/**
+ * inf_utf8_validate:
+ * @text: (array length=bytes): Text to validate.
+ * @bytes: The number of bytes of @text.
+ * @end: (out) (allow-none): Location to store the end of the valid text,
+ * or %NULL.
+ *
+ * Checks whether @text is valid UTF-8, in the same way g_utf8_validate()
+ * does. In particular, @text must not contain NUL characters. If @end is
+ * not %NULL, then it is set to the start of the first invalid character in
+ * @text, or to @text + @bytes if all of @text is valid.
+ *
+ * Returns: %TRUE if @text is valid UTF-8, or %FALSE otherwise.
+ */
+gboolean
+inf_utf8_validate(const gchar* text,
+                  gsize bytes,
+                  const gchar** end)
+{
+  const InfUtf8Impl* impl;
+  const guchar* utext;
+  gsize stop;
+  gsize i;
+  guint n;
+
+  g_return_val_if_fail(text != NULL || bytes == 0, FALSE);
+
+  impl = inf_utf8_get_impl();
+  utext = (const guchar*)text;
+  i = 0;
+
+  while(i < bytes)
+  {
+    i += impl->ascii_prefix(utext + i, bytes - i);
+    if(i == bytes) break;
+
+    /* Non-ASCII characters tend to come in groups, so validate the
+     * following bytes one by one before scanning block-wise again. */
+    stop = MIN(bytes, i + INF_UTF8_VALIDATE_SCALAR_RUN);
+    while(i < stop)
+    {
+      n = inf_utf8_validate_char(utext + i, bytes - i);
+      if(n == 0)
+      {
+        if(end != NULL) *end = text + i;
+        return FALSE;
+      }
+
+      i += n;
+    }
+  }
+
+  if(end != NULL) *end = text + bytes;
+  return TRUE;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -294,6 +294,44 @@ void inf_xml_connection_send(InfXmlConnection* connection,
   iface->send(connection, xml);
 }
 
+/**
+ * inf_xml_connection_send_serialized:
+ * @connection: A #InfXmlConnection.
+ * @xml: (transfer full): A XML message to send. The function takes ownership
+ * of the XML node.
+ * @serialized: The serialization of @xml, as returned by
+ * inf_xml_util_serialize().
+ *
+ * Sends the given XML message to the remote host, like
+ * inf_xml_connection_send(). If the connection supports it, @serialized is
+ * put on the wire instead of serializing @xml again. When the same message
+ * is sent to many connections, this allows it to be serialized only once.
+ * The #InfXmlConnection::sent signal is still emitted with @xml.
+ **/
+void
+inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GBytes* serialized)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+
+  if(iface->send_serialized != NULL)
+  {
+    iface->send_serialized(connection, xml, serialized);
+  }
+  else
+  {
+    g_return_if_fail(iface->send != NULL);
+    iface->send(connection, xml);
+  }
+}
+
 /**
  * inf_xml_connection_sent:
  * @connection: A #InfXmlConnection.
@@ -68,6 +68,9 @@ typedef enum _InfXmlConnectionStatus {
  * @received: Default signal handler of the #InfXmlConnection::received
  * signal.
  * @error: Default signal handler of the #InfXmlConnection::error signal.
+ * @send_serialized: Virtual function to transmit data over the connection
+ * whose serialization is already known. Can be %NULL, in which case the
+ * serialization is ignored and @send is used instead.
  *
  * Virtual functions and default signal handlers for the #InfXmlConnection
  * interface.
@@ -92,6 +95,11 @@ struct _InfXmlConnectionInterface {
                    const xmlNodePtr xml);
   void (*error)(InfXmlConnection* connection,
                 const GError* error);
+
+  /* Virtual table, continued */
+  void (*send_serialized)(InfXmlConnection* connection,
+                          xmlNodePtr xml,
+                          GBytes* serialized);
 };
 
 GType
@@ -111,6 +119,11 @@ void
 inf_xml_connection_send(InfXmlConnection* connection,
                         xmlNodePtr xml);
 
+void
+inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GBytes* serialized);
+
 void
 inf_xml_connection_sent(InfXmlConnection* connection,
                         const xmlNodePtr xml);
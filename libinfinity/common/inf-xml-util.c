@@ -31,6 +31,7 @@
  **/
 
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-utf8.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -273,6 +274,68 @@ inf_xml_util_string_to_double(const gchar* attribute,
   }
 }
 
+static void
+inf_xml_util_set_no_such_attribute_error(xmlNodePtr xml,
+                                         const gchar* attribute,
+                                         GError** error)
+{
+  g_set_error(
+    error,
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
+    _("Request '%s' does not contain required attribute '%s'"),
+    (const gchar*)xml->name,
+    attribute
+  );
+}
+
+/* Returns the value of the given attribute. Attributes created by the
+ * parser or by xmlNewProp() store their value in a single text node, which
+ * is returned directly, to save a copy for every number read from a
+ * request. Otherwise, a copy is made and returned in copy as well, and the
+ * caller needs to xmlFree() it. This only saves the copy; the element
+ * itself is still built by the parser, see the performance section in
+ * TODO. */
+static const xmlChar*
+inf_xml_util_peek_attribute(xmlNodePtr xml,
+                            const gchar* attribute,
+                            xmlChar** copy)
+{
+  xmlAttrPtr attr;
+
+  *copy = NULL;
+
+  attr = xmlHasProp(xml, (const xmlChar*)attribute);
+  if(attr == NULL) return NULL;
+
+  if(attr->type == XML_ATTRIBUTE_NODE &&
+     attr->children != NULL &&
+     attr->children->next == NULL &&
+     attr->children->type == XML_TEXT_NODE &&
+     attr->children->content != NULL)
+  {
+    return attr->children->content;
+  }
+
+  *copy = xmlGetProp(xml, (const xmlChar*)attribute);
+  return *copy;
+}
+
+static const xmlChar*
+inf_xml_util_peek_attribute_required(xmlNodePtr xml,
+                                     const gchar* attribute,
+                                     xmlChar** copy,
+                                     GError** error)
+{
+  const xmlChar* value;
+  value = inf_xml_util_peek_attribute(xml, attribute, copy);
+
+  if(value == NULL)
+    inf_xml_util_set_no_such_attribute_error(xml, attribute, error);
+
+  return value;
+}
+
 static gboolean
 inf_xml_util_valid_xml_char(gunichar codepoint)
 {
@@ -366,13 +429,15 @@ inf_xml_util_get_child_text(xmlNodePtr xml,
   GString* result = g_string_sized_new(16);
   guint num_codepoint;
   gsize char_count = 0;
+  gsize len;
   for(child = xml->children; child; child = child->next)
   {
     switch(child->type)
     {
     case XML_TEXT_NODE:
-      g_string_append(result, (const gchar*)child->content);
-      char_count += g_utf8_strlen((const gchar*)child->content, -1);
+      len = strlen((const gchar*)child->content);
+      g_string_append_len(result, (const gchar*)child->content, len);
+      char_count += inf_utf8_strlen((const gchar*)child->content, len);
       break;
     case XML_ELEMENT_NODE:
       if(strcmp((const char*) child->name, "uchar") != 0) {
@@ -446,16 +511,7 @@ inf_xml_util_get_attribute_required(xmlNodePtr xml,
   value = xmlGetProp(xml, (const xmlChar*)attribute);
 
   if(value == NULL)
-  {
-    g_set_error(
-      error,
-      inf_request_error_quark(),
-      INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
-      _("Request '%s' does not contain required attribute '%s'"),
-      (const gchar*)xml->name,
-      attribute
-    );
-  }
+    inf_xml_util_set_no_such_attribute_error(xml, attribute, error);
 
   return value;
 }
@@ -486,14 +542,15 @@ inf_xml_util_get_attribute_int(xmlNodePtr xml,
                                gint* result,
                                GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_int(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -521,14 +578,15 @@ inf_xml_util_get_attribute_int_required(xmlNodePtr xml,
                                         gint* result,
                                         GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_int(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -550,14 +608,15 @@ inf_xml_util_get_attribute_long(xmlNodePtr xml,
                                 glong* result,
                                 GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_long(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -579,14 +638,15 @@ inf_xml_util_get_attribute_long_required(xmlNodePtr xml,
                                          glong* result,
                                          GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_long(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -608,14 +668,15 @@ inf_xml_util_get_attribute_uint(xmlNodePtr xml,
                                 guint* result,
                                 GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_uint(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -637,14 +698,15 @@ inf_xml_util_get_attribute_uint_required(xmlNodePtr xml,
                                          guint* result,
                                          GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_uint(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -666,14 +728,15 @@ inf_xml_util_get_attribute_ulong(xmlNodePtr xml,
                                  gulong* result,
                                  GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_ulong(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -695,14 +758,15 @@ inf_xml_util_get_attribute_ulong_required(xmlNodePtr xml,
                                           gulong* result,
                                           GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_ulong(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -724,14 +788,15 @@ inf_xml_util_get_attribute_double(xmlNodePtr xml,
                                   gdouble* result,
                                   GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_double(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -754,14 +819,15 @@ inf_xml_util_get_attribute_double_required(xmlNodePtr xml,
                                            gdouble* result,
                                            GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_double(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -956,4 +1022,45 @@ inf_xml_util_new_error_from_node(xmlNodePtr xml)
   return result;
 }
 
+/**
+ * inf_xml_util_serialize:
+ * @xml: The XML node to serialize. It must not be linked into a tree.
+ *
+ * Serializes @xml and all of its children into a byte buffer, without
+ * any formatting and without an XML declaration. This is the same
+ * representation that #InfXmppConnection puts on the wire, so the result
+ * can be passed to inf_xml_connection_send_serialized().
+ *
+ * Returns: (transfer full): A new #GBytes holding the serialized XML. Free
+ * with g_bytes_unref() when no longer needed.
+ */
+GBytes*
+inf_xml_util_serialize(xmlNodePtr xml)
+{
+  xmlDocPtr doc;
+  xmlBufferPtr buffer;
+  GBytes* result;
+
+  g_return_val_if_fail(xml != NULL, NULL);
+  g_return_val_if_fail(xml->parent == NULL, NULL);
+  g_return_val_if_fail(xml->prev == NULL && xml->next == NULL, NULL);
+
+  /* Dump the node within a document, as InfXmppConnection does, so that
+   * the output is the same. */
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  buffer = xmlBufferCreate();
+
+  xmlDocSetRootElement(doc, xml);
+  xmlNodeDump(buffer, doc, xml, 0, 0);
+  xmlUnlinkNode(xml);
+  xmlSetListDoc(xml, NULL);
+
+  result = g_bytes_new(xmlBufferContent(buffer), xmlBufferLength(buffer));
+
+  xmlBufferFree(buffer);
+  xmlFreeDoc(doc);
+
+  return result;
+}
+
 /* vim:set et sw=2 ts=2: */
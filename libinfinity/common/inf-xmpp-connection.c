@@ -40,6 +40,7 @@
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-async-operation.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -53,6 +54,10 @@
 
 #include "config.h"
 
+#ifdef LIBINFINITY_HAVE_ZLIB
+# include <zlib.h>
+#endif
+
 static const GEnumValue inf_xmpp_connection_site_values[] = {
   {
     INF_XMPP_CONNECTION_CLIENT,
@@ -118,6 +123,8 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES,
   /* <starttls> request has been sent (client only) */
   INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED,
+  /* <compress> request has been sent (client only) */
+  INF_XMPP_CONNECTION_COMPRESSION_REQUESTED,
   /* TLS handshake is being performed */
   INF_XMPP_CONNECTION_HANDSHAKING,
   /* SASL authentication is in progress */
@@ -152,6 +159,25 @@ struct _InfXmppConnectionMessage {
   gpointer user_data;
 };
 
+/* A call to gnutls_handshake() running in a worker thread. While it runs,
+ * the session belongs to the step, and it reads and writes data from and to
+ * its own buffers instead of the TCP connection. */
+typedef struct _InfXmppConnectionTlsStep InfXmppConnectionTlsStep;
+struct _InfXmppConnectionTlsStep {
+  InfXmppConnection* xmpp; /* only accessed in the main thread */
+  InfAsyncOperation* operation;
+
+  gnutls_session_t session;
+  InfCertificateCredentials* creds;
+
+  gchar* input;
+  gsize input_len;
+  gsize input_pos;
+  GByteArray* output;
+
+  int result;
+};
+
 typedef struct _InfXmppConnectionPrivate InfXmppConnectionPrivate;
 struct _InfXmppConnectionPrivate {
   InfTcpConnection* tcp;
@@ -190,6 +216,18 @@ struct _InfXmppConnectionPrivate {
   const gchar* pull_data;
   gsize pull_len;
 
+  /* TLS handshake in a worker thread */
+  gboolean tls_offload;
+  InfXmppConnectionTlsStep* tls_step;
+  GByteArray* tls_pending; /* data received while tls_step is running */
+  gboolean tls_step_done;
+  int tls_step_result;
+
+  /* TLS session resumption */
+  GBytes* session_ticket_key; /* server: key to encrypt tickets with */
+  GBytes* session_data; /* client: parameters of the last session */
+  gboolean tls_resumed;
+
   /* SASL */
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
@@ -198,6 +236,24 @@ struct _InfXmppConnectionPrivate {
   gchar* sasl_remote_mechanisms;
 
   GError* sasl_error;
+
+  /* Stream compression (XEP-0138) */
+  gboolean compression;
+  gboolean compression_restart;
+  gboolean compression_refused;
+  /* Stanzas held back while the stream is restarted after compression has
+   * been enabled: outgoing ones on the server side, incoming ones on the
+   * client side. */
+  GQueue* compression_queue;
+#ifdef LIBINFINITY_HAVE_ZLIB
+  z_stream* deflate;
+  z_stream* inflate;
+#endif
+
+  /* Number of bytes before compression and on the wire */
+  guint64 compression_plain_bytes;
+  guint64 compression_wire_bytes;
+  gint64 compression_time;
 };
 
 enum {
@@ -214,6 +270,15 @@ enum {
 
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
+  PROP_TLS_OFFLOAD,
+  PROP_SESSION_TICKET_KEY,
+  PROP_SESSION_DATA,
+  PROP_TLS_RESUMED,
+
+  PROP_COMPRESSION,
+  PROP_COMPRESSION_ENABLED,
+  PROP_COMPRESSION_RATIO,
+  PROP_COMPRESSION_TIME,
 
   /* From InfXmlConnection */
   PROP_STATUS,
@@ -610,6 +675,13 @@ inf_xmpp_connection_pop_message(InfXmppConnection* connection)
   g_slice_free(InfXmppConnectionMessage, message);
 }
 
+/* Required by inf_xmpp_connection_clear */
+static void
+inf_xmpp_connection_tls_step_cancel(InfXmppConnection* xmpp);
+
+static void
+inf_xmpp_connection_tls_store_session_data(InfXmppConnection* xmpp);
+
 /* Note that this function does not change the state of xmpp, so it might
  * rest in a state where it expects to actually have the resources available
  * that are cleared here. Be sure to adjust state after having called
@@ -655,12 +727,25 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   }
 #endif
 
+  inf_xmpp_connection_tls_step_cancel(xmpp);
+
   if(priv->session != NULL)
   {
+    /* With TLS 1.3 the session ticket is only sent after the handshake, so
+     * look at the session once more before throwing it away. */
+    if(priv->site == INF_XMPP_CONNECTION_CLIENT)
+      inf_xmpp_connection_tls_store_session_data(xmpp);
+
     gnutls_deinit(priv->session);
     priv->session = NULL;
 
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
+
+    if(priv->tls_resumed == TRUE)
+    {
+      priv->tls_resumed = FALSE;
+      g_object_notify(G_OBJECT(xmpp), "tls-resumed");
+    }
   }
 
   if(priv->parser != NULL)
@@ -693,13 +778,42 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  priv->compression_restart = FALSE;
+  priv->compression_refused = FALSE;
+
+  if(priv->compression_queue != NULL)
+  {
+    g_queue_free_full(priv->compression_queue, (GDestroyNotify)xmlFreeNode);
+    priv->compression_queue = NULL;
+  }
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  if(priv->deflate != NULL)
+  {
+    g_assert(priv->inflate != NULL);
+
+    deflateEnd(priv->deflate);
+    inflateEnd(priv->inflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+
+    g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  }
+#endif
+
   g_object_thaw_notify(G_OBJECT(xmpp));
 }
 
+/* Sends data to the TLS session or the TCP connection, after compression.
+ * If bytes is given, data and len refer to its content, and the TCP
+ * connection may keep a reference to it instead of copying the data. */
 static void
-inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
-                               gconstpointer data,
-                               guint len)
+inf_xmpp_connection_send_wire(InfXmppConnection* xmpp,
+                              gconstpointer data,
+                              guint len,
+                              GBytes* bytes)
 {
   InfXmppConnectionPrivate* priv;
   ssize_t cur_bytes;
@@ -710,9 +824,6 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
            priv->status != INF_XMPP_CONNECTION_CLOSED);
 
-  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
-
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
    * down from a GnuTLS callback then we keep the GnuTLS context around
@@ -755,7 +866,11 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   else
   {
     priv->position += len;
-    inf_tcp_connection_send(priv->tcp, data, len);
+
+    if(bytes != NULL)
+      inf_tcp_connection_send_bytes(priv->tcp, bytes);
+    else
+      inf_tcp_connection_send(priv->tcp, data, len);
   }
 
   g_assert(priv->parsing > 0);
@@ -773,6 +888,86 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_send_data(InfXmppConnection* xmpp,
+                              gconstpointer data,
+                              guint len,
+                              GBytes* bytes)
+{
+  InfXmppConnectionPrivate* priv;
+#ifdef LIBINFINITY_HAVE_ZLIB
+  Bytef buffer[4096];
+  guint produced;
+  gint64 start;
+  int ret;
+#endif
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  if(priv->deflate != NULL)
+  {
+    priv->deflate->next_in = (Bytef*)data;
+    priv->deflate->avail_in = len;
+    priv->compression_plain_bytes += len;
+
+    /* Everything we send at once is normally a complete stanza, so flush
+     * the compressor every time to allow the remote side to process it
+     * right away. The compression history is kept across flushes. */
+    do
+    {
+      priv->deflate->next_out = buffer;
+      priv->deflate->avail_out = sizeof(buffer);
+
+      start = g_get_monotonic_time();
+      ret = deflate(priv->deflate, Z_SYNC_FLUSH);
+      priv->compression_time += g_get_monotonic_time() - start;
+
+      /* Z_BUF_ERROR only means that there was nothing left to do */
+      g_assert(ret == Z_OK || ret == Z_BUF_ERROR);
+
+      produced = sizeof(buffer) - priv->deflate->avail_out;
+      if(produced > 0)
+      {
+        priv->compression_wire_bytes += produced;
+        inf_xmpp_connection_send_wire(xmpp, buffer, produced, NULL);
+
+        /* The connection might have been closed and cleared while
+         * sending. */
+        if(priv->deflate == NULL)
+          break;
+      }
+    } while(priv->deflate->avail_out == 0);
+
+    return;
+  }
+#endif
+
+  inf_xmpp_connection_send_wire(xmpp, data, len, bytes);
+}
+
+static void
+inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
+{
+  inf_xmpp_connection_send_data(xmpp, data, len, NULL);
+}
+
+static void
+inf_xmpp_connection_send_bytes(InfXmppConnection* xmpp,
+                               GBytes* bytes)
+{
+  gconstpointer data;
+  gsize len;
+
+  data = g_bytes_get_data(bytes, &len);
+  inf_xmpp_connection_send_data(xmpp, data, len, bytes);
+}
+
 static void
 inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
                              xmlNodePtr xml)
@@ -847,6 +1042,150 @@ inf_xmpp_connection_node_new_sasl(const gchar* name)
   );
 }
 
+static xmlNodePtr
+inf_xmpp_connection_node_new_compress(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(
+    name,
+    "http://jabber.org/protocol/compress"
+  );
+}
+
+/*
+ * Stream compression
+ */
+
+/* Required by inf_xmpp_connection_compression_release */
+static void
+inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
+                                        xmlNodePtr xml);
+
+/* Returns whether we can offer or request stream compression */
+static gboolean
+inf_xmpp_connection_compression_available(InfXmppConnection* xmpp)
+{
+#ifdef LIBINFINITY_HAVE_ZLIB
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  return priv->compression == TRUE &&
+         priv->compression_refused == FALSE &&
+         priv->deflate == NULL;
+#else
+  return FALSE;
+#endif
+}
+
+/* Returns whether xml, received in the READY state, is a <compress> request
+ * rather than a stanza for the user of the connection */
+static gboolean
+inf_xmpp_connection_compression_is_request(xmlNodePtr xml)
+{
+  xmlChar* xmlns;
+  gboolean result;
+
+  if(strcmp((const gchar*)xml->name, "compress") != 0)
+    return FALSE;
+
+  xmlns = xmlGetProp(xml, (const xmlChar*)"xmlns");
+  if(xmlns == NULL)
+    return FALSE;
+
+  result = strcmp(
+    (const gchar*)xmlns,
+    "http://jabber.org/protocol/compress"
+  ) == 0;
+
+  xmlFree(xmlns);
+  return result;
+}
+
+/* Returns whether xml, a <compression> feature or a <compress> request,
+ * contains the zlib method */
+static gboolean
+inf_xmpp_connection_compression_has_zlib(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const gchar*)child->name, "method") == 0 &&
+       child->children != NULL &&
+       child->children->content != NULL &&
+       strcmp((const gchar*)child->children->content, "zlib") == 0)
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Compresses all data sent and decompresses all data received from now on.
+ * The stream needs to be restarted afterwards. */
+static void
+inf_xmpp_connection_compression_init(InfXmppConnection* xmpp)
+{
+#ifdef LIBINFINITY_HAVE_ZLIB
+  InfXmppConnectionPrivate* priv;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->deflate == NULL && priv->inflate == NULL);
+
+  priv->deflate = g_slice_new0(z_stream);
+  priv->inflate = g_slice_new0(z_stream);
+
+  /* These can only fail if we are running out of memory */
+  ret = deflateInit(priv->deflate, Z_DEFAULT_COMPRESSION);
+  g_assert(ret == Z_OK);
+  ret = inflateInit(priv->inflate);
+  g_assert(ret == Z_OK);
+
+  priv->compression_plain_bytes = 0;
+  priv->compression_wire_bytes = 0;
+  priv->compression_time = 0;
+
+  g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+#else
+  g_assert_not_reached();
+#endif
+}
+
+/* Sends (as a server) or delivers (as a client) the stanzas that were held
+ * back while the stream was restarted for compression. Takes ownership of
+ * queue. */
+static void
+inf_xmpp_connection_compression_release(InfXmppConnection* xmpp,
+                                        GQueue* queue)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  while((xml = g_queue_pop_head(queue)) != NULL)
+  {
+    /* The connection might have been closed in the meanwhile */
+    if(priv->status != INF_XMPP_CONNECTION_READY)
+    {
+      xmlFreeNode(xml);
+    }
+    else if(priv->site == INF_XMPP_CONNECTION_SERVER)
+    {
+      inf_xmpp_connection_xml_connection_send(INF_XML_CONNECTION(xmpp), xml);
+    }
+    else
+    {
+      inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
+      xmlFreeNode(xml);
+    }
+  }
+
+  g_queue_free(queue);
+}
+
 /*
  * XMPP deinitialization
  */
@@ -867,9 +1206,11 @@ inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
            priv->status != INF_XMPP_CONNECTION_CONNECTING);
 
   /* We cannot send </stream:stream> or a gnutls bye in these states
-   * because it would interfere with the handshake. */
+   * because it would interfere with the handshake, or because we do not
+   * know whether the server expects compressed data already. */
   if(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
-     priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED)
+     priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+     priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED)
   {
     /* Session termination is not required in these states because the session
      * did not yet even begin or </stream:stream> has already been sent,
@@ -998,7 +1339,8 @@ inf_xmpp_connection_terminate_error(InfXmppConnection* xmpp,
   g_assert(priv->parser != NULL);
 
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
-           priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED);
+           priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+           priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
 
   error = NULL;
   g_set_error_literal(
@@ -1092,6 +1434,13 @@ inf_xmpp_connection_deinitiate(InfXmppConnection* xmpp)
 static void
 inf_xmpp_connection_initiate(InfXmppConnection* xmpp);
 
+/* Required by inf_xmpp_connection_tls_step_done */
+static void
+inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
+                                gconstpointer data,
+                                guint len,
+                                gpointer user_data);
+
 static gboolean
 inf_xmpp_connection_prefers_tls(InfXmppConnection* xmpp)
 {
@@ -1156,6 +1505,250 @@ inf_xmpp_connection_tls_pull(gnutls_transport_ptr_t ptr,
   }
 }
 
+/* Transport functions used while the handshake runs in a worker thread.
+ * These must not access the InfXmppConnection. */
+static ssize_t
+inf_xmpp_connection_tls_step_push(gnutls_transport_ptr_t ptr,
+                                  const void* data,
+                                  size_t len)
+{
+  InfXmppConnectionTlsStep* step;
+  step = (InfXmppConnectionTlsStep*)ptr;
+
+  g_byte_array_append(step->output, data, len);
+  return len;
+}
+
+static ssize_t
+inf_xmpp_connection_tls_step_pull(gnutls_transport_ptr_t ptr,
+                                  void* data,
+                                  size_t len)
+{
+  InfXmppConnectionTlsStep* step;
+  size_t pull_len;
+
+  step = (InfXmppConnectionTlsStep*)ptr;
+
+  if(step->input_pos == step->input_len)
+  {
+    gnutls_transport_set_errno(step->session, EAGAIN);
+    return -1;
+  }
+
+  pull_len = step->input_len - step->input_pos;
+  if(len < pull_len) pull_len = len;
+
+  memcpy(data, step->input + step->input_pos, pull_len);
+  step->input_pos += pull_len;
+  return pull_len;
+}
+
+static void
+inf_xmpp_connection_tls_step_free(gpointer data)
+{
+  InfXmppConnectionTlsStep* step;
+  step = (InfXmppConnectionTlsStep*)data;
+
+  /* The session is still owned by the step if the handshake was cancelled,
+   * in which case this might run in the worker thread. */
+  if(step->session != NULL)
+    gnutls_deinit(step->session);
+
+  inf_certificate_credentials_unref(step->creds);
+  g_free(step->input);
+  g_byte_array_unref(step->output);
+  g_slice_free(InfXmppConnectionTlsStep, step);
+}
+
+static void
+inf_xmpp_connection_tls_step_run(gpointer* run_data,
+                                 GDestroyNotify* run_notify,
+                                 gpointer user_data)
+{
+  InfXmppConnectionTlsStep* step;
+  step = (InfXmppConnectionTlsStep*)user_data;
+
+  step->result = gnutls_handshake(step->session);
+
+  *run_data = step;
+  *run_notify = inf_xmpp_connection_tls_step_free;
+}
+
+static void
+inf_xmpp_connection_tls_step_done(gpointer run_data,
+                                  gpointer user_data)
+{
+  InfXmppConnectionTlsStep* step;
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+  GByteArray* input;
+
+  step = (InfXmppConnectionTlsStep*)run_data;
+  xmpp = step->xmpp;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->tls_step == step);
+  g_assert(priv->session == step->session);
+  g_assert(priv->status == INF_XMPP_CONNECTION_HANDSHAKING);
+
+  /* Take back the session */
+  priv->tls_step = NULL;
+  step->session = NULL;
+
+  gnutls_transport_set_ptr(priv->session, xmpp);
+  gnutls_transport_set_push_function(
+    priv->session,
+    inf_xmpp_connection_tls_push
+  );
+  gnutls_transport_set_pull_function(
+    priv->session,
+    inf_xmpp_connection_tls_pull
+  );
+
+  g_object_ref(xmpp);
+
+  if(step->output->len > 0)
+  {
+    priv->position += step->output->len;
+    inf_tcp_connection_send(priv->tcp, step->output->data, step->output->len);
+  }
+
+  /* The handshake result is processed in received_cb(), together with
+   * data that the handshake did not consume and data that was received in
+   * the meanwhile, as if it had been computed there. */
+  if(priv->status == INF_XMPP_CONNECTION_HANDSHAKING)
+  {
+    input = priv->tls_pending;
+    priv->tls_pending = NULL;
+
+    if(input == NULL)
+      input = g_byte_array_new();
+
+    g_byte_array_prepend(
+      input,
+      (const guint8*)step->input + step->input_pos,
+      step->input_len - step->input_pos
+    );
+
+    priv->tls_step_done = TRUE;
+    priv->tls_step_result = step->result;
+
+    inf_xmpp_connection_received_cb(priv->tcp, input->data, input->len, xmpp);
+    g_byte_array_unref(input);
+  }
+
+  g_object_unref(xmpp);
+}
+
+/* Cancels a handshake running in a worker thread. The session will be
+ * deinitialized once the worker thread is done with it. */
+static void
+inf_xmpp_connection_tls_step_cancel(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->tls_step != NULL)
+  {
+    g_assert(priv->session == priv->tls_step->session);
+
+    inf_async_operation_free(priv->tls_step->operation);
+    priv->tls_step = NULL;
+    priv->session = NULL;
+  }
+
+  if(priv->tls_pending != NULL)
+  {
+    g_byte_array_unref(priv->tls_pending);
+    priv->tls_pending = NULL;
+  }
+
+  priv->tls_step_done = FALSE;
+}
+
+/* Continues the TLS handshake with the data in pull_data. If TLS offloading
+ * is enabled, this runs gnutls_handshake() in a worker thread and returns
+ * GNUTLS_E_AGAIN right away. */
+static int
+inf_xmpp_connection_tls_handshake_step(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionTlsStep* step;
+  InfIo* io;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->tls_offload == TRUE)
+  {
+    g_object_get(G_OBJECT(priv->tcp), "io", &io, NULL);
+
+    step = g_slice_new(InfXmppConnectionTlsStep);
+    step->xmpp = xmpp;
+    step->session = priv->session;
+    step->creds = inf_certificate_credentials_ref(priv->creds);
+    step->input = g_memdup(priv->pull_data, priv->pull_len);
+    step->input_len = priv->pull_len;
+    step->input_pos = 0;
+    step->output = g_byte_array_new();
+    step->result = GNUTLS_E_AGAIN;
+
+    /* The TCP connection keeps the IO object alive while the operation
+     * runs, and the operation is cancelled before the TCP connection is
+     * released. */
+    step->operation = inf_async_operation_new(
+      io,
+      inf_xmpp_connection_tls_step_run,
+      inf_xmpp_connection_tls_step_done,
+      step
+    );
+
+    g_object_unref(io);
+
+    gnutls_transport_set_ptr(priv->session, step);
+    gnutls_transport_set_push_function(
+      priv->session,
+      inf_xmpp_connection_tls_step_push
+    );
+    gnutls_transport_set_pull_function(
+      priv->session,
+      inf_xmpp_connection_tls_step_pull
+    );
+
+    error = NULL;
+    if(inf_async_operation_start_pooled(step->operation, &error))
+    {
+      priv->tls_step = step;
+      priv->pull_data += priv->pull_len;
+      priv->pull_len = 0;
+      return GNUTLS_E_AGAIN;
+    }
+
+    /* Fall back to doing the handshake in this thread */
+    g_warning(
+      _("Failed to run TLS handshake in a worker thread: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+
+    gnutls_transport_set_ptr(priv->session, xmpp);
+    gnutls_transport_set_push_function(
+      priv->session,
+      inf_xmpp_connection_tls_push
+    );
+    gnutls_transport_set_pull_function(
+      priv->session,
+      inf_xmpp_connection_tls_pull
+    );
+
+    step->session = NULL;
+    inf_xmpp_connection_tls_step_free(step);
+  }
+
+  return gnutls_handshake(priv->session);
+}
+
 static gnutls_x509_crt_t
 inf_xmpp_connection_tls_import_own_certificate(InfXmppConnection* xmpp,
                                                GError** error)
@@ -1261,6 +1854,31 @@ inf_xmpp_connection_tls_import_peer_certificate(InfXmppConnection* xmpp,
   return inf_certificate_chain_new(certs, list_size);
 }
 
+static void
+inf_xmpp_connection_tls_store_session_data(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  gnutls_datum_t datum;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->session != NULL);
+
+  /* This fails if the handshake did not complete, in which case we keep
+   * whatever we had before. */
+  ret = gnutls_session_get_data2(priv->session, &datum);
+  if(ret != GNUTLS_E_SUCCESS || datum.size == 0)
+    return;
+
+  if(priv->session_data != NULL)
+    g_bytes_unref(priv->session_data);
+
+  priv->session_data = g_bytes_new(datum.data, datum.size);
+  gnutls_free(datum.data);
+
+  g_object_notify(G_OBJECT(xmpp), "session-data");
+}
+
 static void
 inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
 {
@@ -1273,8 +1891,23 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
   g_assert(priv->status == INF_XMPP_CONNECTION_HANDSHAKING);
   g_assert(priv->session != NULL);
+  g_assert(priv->tls_step == NULL);
+
+  if(priv->tls_step_done == TRUE)
+  {
+    /* A handshake step has finished in a worker thread */
+    priv->tls_step_done = FALSE;
+    ret = priv->tls_step_result;
+
+    /* If more data has been received in the meanwhile, go on with it */
+    if(ret == GNUTLS_E_AGAIN && priv->pull_len > 0)
+      ret = inf_xmpp_connection_tls_handshake_step(xmpp);
+  }
+  else
+  {
+    ret = inf_xmpp_connection_tls_handshake_step(xmpp);
+  }
 
-  ret = gnutls_handshake(priv->session);
   switch(ret)
   {
   case GNUTLS_E_AGAIN:
@@ -1285,6 +1918,12 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
     priv->status = INF_XMPP_CONNECTION_CONNECTED;
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
 
+    priv->tls_resumed = gnutls_session_is_resumed(priv->session) != 0;
+    g_object_notify(G_OBJECT(xmpp), "tls-resumed");
+
+    if(priv->site == INF_XMPP_CONNECTION_CLIENT)
+      inf_xmpp_connection_tls_store_session_data(xmpp);
+
     error = NULL;
 
     /* Extract own certificate */
@@ -1389,6 +2028,8 @@ static void
 inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
 {
   InfXmppConnectionPrivate* priv;
+  gnutls_datum_t datum;
+  gsize size;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
   g_assert(priv->session == NULL);
@@ -1410,10 +2051,30 @@ inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
   {
   case INF_XMPP_CONNECTION_CLIENT:
     gnutls_init(&priv->session, GNUTLS_CLIENT);
+    gnutls_session_ticket_enable_client(priv->session);
+
+    /* Try to resume the previous session, to save the expensive public key
+     * operations on reconnect. If the server does not accept the data, a
+     * full handshake is performed. */
+    if(priv->session_data != NULL)
+    {
+      datum.data = (unsigned char*)g_bytes_get_data(priv->session_data, &size);
+      datum.size = size;
+      gnutls_session_set_data(priv->session, datum.data, datum.size);
+    }
+
     break;
   case INF_XMPP_CONNECTION_SERVER:
     gnutls_init(&priv->session, GNUTLS_SERVER);
 
+    if(priv->session_ticket_key != NULL)
+    {
+      datum.data =
+        (unsigned char*)g_bytes_get_data(priv->session_ticket_key, &size);
+      datum.size = size;
+      gnutls_session_ticket_enable_server(priv->session, &datum);
+    }
+
     /* If the user wants to check the client's certificate, then require
      * that the client sends one. */
     if(priv->certificate_callback != NULL)
@@ -1930,9 +2591,11 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   xmlNodePtr features;
   xmlNodePtr starttls;
+  xmlNodePtr compression;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
   gchar* mechanism_dup;
+  GQueue* queue;
   GError* error;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -1940,7 +2603,9 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   g_assert(priv->parser != NULL);
 
   g_assert(priv->status == INF_XMPP_CONNECTION_CONNECTED ||
-           priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED);
+           priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED ||
+           (priv->status == INF_XMPP_CONNECTION_READY &&
+            priv->compression_queue != NULL));
 
   reply = g_strdup_printf(
     xmpp_connection_initial_request,
@@ -1959,6 +2624,10 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   case INF_XMPP_CONNECTION_AUTH_CONNECTED:
     priv->status = INF_XMPP_CONNECTION_AUTH_INITIATED;
     break;
+  case INF_XMPP_CONNECTION_READY:
+    /* The client restarted the stream after compression has been enabled.
+     * The connection stays open meanwhile. */
+    break;
   default:
     g_assert_not_reached();
     break;
@@ -1968,7 +2637,7 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   /* Don't offer TLS if we have already authenticated. It's pointless now. */
   if(priv->session == NULL &&
-     priv->status != INF_XMPP_CONNECTION_AUTH_INITIATED)
+     priv->status == INF_XMPP_CONNECTION_INITIATED)
   {
     if(priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
     {
@@ -1979,6 +2648,27 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
     }
   }
 
+  /* Compression is only offered after authentication, so that an
+   * unauthenticated client cannot make us allocate compression state, and
+   * so that TLS, if any, is in place before. */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED &&
+     inf_xmpp_connection_compression_available(xmpp))
+  {
+    compression = inf_xmpp_connection_node_new(
+      "compression",
+      "http://jabber.org/features/compress"
+    );
+
+    xmlNewTextChild(
+      compression,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)"zlib"
+    );
+
+    xmlAddChild(features, compression);
+  }
+
   if(priv->status == INF_XMPP_CONNECTION_INITIATED)
   {
     /* Not yet authenticated, so give the client a list of authentication
@@ -2063,10 +2753,19 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED)
   {
-    /* Authentication done, <stream:features> sent. Session is ready. */
+    /* Authentication done, <stream:features> sent. Session is ready. The
+     * client might still request compression, which is handled in
+     * inf_xmpp_connection_process_compress(). */
     priv->status = INF_XMPP_CONNECTION_READY;
     g_object_notify(G_OBJECT(xmpp), "status");
   }
+  else if(priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    /* Stream restarted, send what was held back in the meanwhile */
+    queue = priv->compression_queue;
+    priv->compression_queue = NULL;
+    inf_xmpp_connection_compression_release(xmpp, queue);
+  }
 }
 
 static void
@@ -2316,7 +3015,9 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   xmlNodePtr child;
   xmlNodePtr req;
   xmlNodePtr starttls;
+  xmlNodePtr compress;
   const char* suggestion;
+  GQueue* queue;
   GError* error;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -2390,6 +3091,35 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     }
   }
 
+  /* Request compression once authenticated if the server offers it */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES &&
+     inf_xmpp_connection_compression_available(xmpp))
+  {
+    for(child = xml->children; child != NULL; child = child->next)
+      if(strcmp((const gchar*)child->name, "compression") == 0)
+        break;
+
+    if(child != NULL && inf_xmpp_connection_compression_has_zlib(child))
+    {
+      compress = inf_xmpp_connection_node_new_compress("compress");
+      xmlNewTextChild(
+        compress,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)"zlib"
+      );
+
+      inf_xmpp_connection_send_xml(xmpp, compress);
+      xmlFreeNode(compress);
+
+      /* The server is ready already and might send stanzas before it
+       * receives our request. Keep them until we are ready, too. */
+      g_assert(priv->compression_queue == NULL);
+      priv->compression_queue = g_queue_new();
+      priv->status = INF_XMPP_CONNECTION_COMPRESSION_REQUESTED;
+    }
+  }
+
   /* If we did not request TLS above, then go on with authentication */
   if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
   {
@@ -2435,47 +3165,129 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   }
   else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
   {
-    priv->status = INF_XMPP_CONNECTION_READY;
-    g_object_notify(G_OBJECT(xmpp), "status");
+    queue = priv->compression_queue;
+    priv->compression_queue = NULL;
+
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+
+    /* Deliver what the server sent before it enabled compression */
+    if(queue != NULL)
+      inf_xmpp_connection_compression_release(xmpp, queue);
+  }
+}
+
+static void
+inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
+                                       xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED);
+  g_assert(priv->session == NULL);
+
+  if(strcmp((const gchar*)xml->name, "proceed") == 0)
+  {
+    inf_xmpp_connection_tls_init(xmpp);
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    error = g_error_new_literal(
+      inf_xmpp_connection_error_quark(),
+      INF_XMPP_CONNECTION_ERROR_TLS_FAILURE,
+      _("The server cannot perform the TLS handshake")
+    );
+
+    inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+    g_error_free(error);
+
+    /* The server is required to close the stream after failure, so wait
+     * for </stream:stream>. */
+    priv->status = INF_XMPP_CONNECTION_CLOSING_STREAM;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+  else
+  {
+    /* We got neither 'proceed' nor 'failure'. Ignore and wait for either
+     * of them. */
+  }
+}
+
+static void
+inf_xmpp_connection_process_compression(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  GQueue* queue;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
+  g_assert(priv->compression_queue != NULL);
+
+  if(strcmp((const gchar*)xml->name, "compressed") == 0)
+  {
+    /* Restart the stream in received_cb(), as after authentication. The
+     * connection becomes ready after the server's <stream:features>. */
+    inf_xmpp_connection_compression_init(xmpp);
+    priv->status = INF_XMPP_CONNECTION_AUTH_CONNECTED;
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    /* The stream stays usable without compression */
+    queue = priv->compression_queue;
+    priv->compression_queue = NULL;
+    priv->compression_refused = TRUE;
+
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+
+    inf_xmpp_connection_compression_release(xmpp, queue);
+  }
+  else
+  {
+    /* The server sent this before it got our request */
+    g_queue_push_tail(priv->compression_queue, xmlCopyNode(xml, 1));
   }
 }
 
+/* Handles a <compress> request from the client, which can arrive at any time
+ * after the server became ready. */
 static void
-inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
-                                       xmlNodePtr xml)
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
 {
   InfXmppConnectionPrivate* priv;
-  GError* error;
+  xmlNodePtr reply;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
-  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
-  g_assert(priv->status == INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED);
-  g_assert(priv->session == NULL);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  if(strcmp((const gchar*)xml->name, "proceed") == 0)
-  {
-    inf_xmpp_connection_tls_init(xmpp);
-  }
-  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  if(inf_xmpp_connection_compression_available(xmpp) &&
+     inf_xmpp_connection_compression_has_zlib(xml))
   {
-    error = g_error_new_literal(
-      inf_xmpp_connection_error_quark(),
-      INF_XMPP_CONNECTION_ERROR_TLS_FAILURE,
-      _("The server cannot perform the TLS handshake")
-    );
-
-    inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-    g_error_free(error);
-
-    /* The server is required to close the stream after failure, so wait
-     * for </stream:stream>. */
-    priv->status = INF_XMPP_CONNECTION_CLOSING_STREAM;
-    g_object_notify(G_OBJECT(xmpp), "status");
+    reply = inf_xmpp_connection_node_new_compress("compressed");
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+
+    /* Everything sent from now on is compressed, and needs to wait until
+     * the client has restarted the stream. We might be in a XML callback
+     * here, so the parser is reset in received_cb(). */
+    inf_xmpp_connection_compression_init(xmpp);
+    priv->compression_restart = TRUE;
+    priv->compression_queue = g_queue_new();
   }
   else
   {
-    /* We got neither 'proceed' nor 'failure'. Ignore and wait for either
-     * of them. */
+    /* The client goes on without compression */
+    reply = inf_xmpp_connection_node_new_compress("failure");
+    xmlNewChild(reply, NULL, (const xmlChar*)"unsupported-method", NULL);
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
   }
 }
 
@@ -2699,11 +3511,24 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
         inf_xmpp_connection_process_encryption(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+        /* This is a client-only state */
+        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+        inf_xmpp_connection_process_compression(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AUTHENTICATING:
         inf_xmpp_connection_process_authentication(xmpp, priv->root);
         break;
       case INF_XMPP_CONNECTION_READY:
-        inf_xml_connection_received(INF_XML_CONNECTION(xmpp), priv->root);
+        if(priv->site == INF_XMPP_CONNECTION_SERVER &&
+           inf_xmpp_connection_compression_is_request(priv->root))
+        {
+          inf_xmpp_connection_process_compress(xmpp, priv->root);
+        }
+        else
+        {
+          inf_xml_connection_received(INF_XML_CONNECTION(xmpp), priv->root);
+        }
         break;
       case INF_XMPP_CONNECTION_CLOSING_STREAM:
         /* We are waiting for </stream:stream>. It can be that we receive
@@ -2797,6 +3622,23 @@ inf_xmpp_connection_sax_start_element(void* context,
       inf_xmpp_connection_process_start_element(xmpp, name, attrs);
     }
 
+    break;
+  case INF_XMPP_CONNECTION_READY:
+    if(priv->site == INF_XMPP_CONNECTION_SERVER &&
+       priv->compression_queue != NULL)
+    {
+      /* We are waiting for the client to restart the stream after
+       * compression has been enabled. */
+      if(strcmp((const gchar*)name, "stream:stream") != 0)
+        inf_xmpp_connection_terminate(xmpp);
+      else
+        inf_xmpp_connection_process_connected(xmpp, attrs);
+    }
+    else
+    {
+      inf_xmpp_connection_process_start_element(xmpp, name, attrs);
+    }
+
     break;
   case INF_XMPP_CONNECTION_CLOSING_STREAM:
     /* We are still processing messages if we are waiting for
@@ -2804,8 +3646,8 @@ inf_xmpp_connection_sax_start_element(void* context,
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
-  case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_process_start_element(xmpp, name, attrs);
     break;
   case INF_XMPP_CONNECTION_CLOSING_GNUTLS:
@@ -2869,6 +3711,7 @@ inf_xmpp_connection_sax_end_element(void* context,
     case INF_XMPP_CONNECTION_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+    case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
     case INF_XMPP_CONNECTION_READY:
       /* Also terminate stream in these states */
       inf_xmpp_connection_terminate(xmpp);
@@ -2977,6 +3820,7 @@ inf_xmpp_connection_sax_error(void* context,
    * handshake, so we cannot send arbitrary XML here. Also cannot
    * send <stream:error> without having sent <stream:stream>. */
   if(priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+     priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED &&
      priv->status != INF_XMPP_CONNECTION_CONNECTED &&
      priv->status != INF_XMPP_CONNECTION_AUTH_CONNECTED)
   {
@@ -3040,6 +3884,22 @@ static xmlSAXHandler inf_xmpp_connection_handler = {
   NULL                                    /* serror */
 };
 
+static void
+inf_xmpp_connection_create_parser(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->parser != NULL) xmlFreeParserCtxt(priv->parser);
+  priv->parser = xmlCreatePushParserCtxt(
+    &inf_xmpp_connection_handler,
+    xmpp,
+    NULL,
+    0,
+    NULL
+  );
+}
+
 static void
 inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
 {
@@ -3056,14 +3916,7 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
            priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED);
 
   /* Create XML parser for incoming data */
-  if(priv->parser != NULL) xmlFreeParserCtxt(priv->parser);
-  priv->parser = xmlCreatePushParserCtxt(
-    &inf_xmpp_connection_handler,
-    xmpp,
-    NULL,
-    0,
-    NULL
-  );
+  inf_xmpp_connection_create_parser(xmpp);
 
   /* Create XML buffer for outgoing data */
   if(priv->buf == NULL)
@@ -3172,6 +4025,99 @@ inf_xmpp_connection_sent_cb(InfTcpConnection* tcp,
   g_object_unref(G_OBJECT(xmpp));
 }
 
+static void
+inf_xmpp_connection_parse_chunk(InfXmppConnection* xmpp,
+                                const gchar* data,
+                                gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+  {
+    if(priv->session != NULL)
+      printf("\033[00;32m%.*s\033[00;00m\n", (int)len, data);
+    else
+      printf("\033[00;31m%.*s\033[00;00m\n", (int)len, data);
+  }
+
+  xmlParseChunk(priv->parser, data, len, 0);
+}
+
+/* Feeds data received from the TLS session or the TCP connection into the
+ * XML parser, decompressing it first if compression is enabled. */
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len)
+{
+#ifdef LIBINFINITY_HAVE_ZLIB
+  InfXmppConnectionPrivate* priv;
+  gchar buffer[4096];
+  gsize produced;
+  gint64 start;
+  GError* error;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->inflate != NULL)
+  {
+    priv->inflate->next_in = (Bytef*)data;
+    priv->inflate->avail_in = len;
+    priv->compression_wire_bytes += len;
+
+    do
+    {
+      priv->inflate->next_out = (Bytef*)buffer;
+      priv->inflate->avail_out = sizeof(buffer);
+
+      start = g_get_monotonic_time();
+      ret = inflate(priv->inflate, Z_SYNC_FLUSH);
+      priv->compression_time += g_get_monotonic_time() - start;
+
+      if(ret != Z_OK && ret != Z_BUF_ERROR)
+      {
+        error = NULL;
+        g_set_error(
+          &error,
+          inf_xmpp_connection_error_quark(),
+          INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE,
+          _("Failed to decompress received data: %s"),
+          priv->inflate->msg != NULL ? priv->inflate->msg : "unknown error"
+        );
+
+        inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+        g_error_free(error);
+
+        /* There is no way to recover the stream */
+        inf_tcp_connection_close(priv->tcp);
+        break;
+      }
+
+      produced = sizeof(buffer) - priv->inflate->avail_out;
+      if(produced > 0)
+      {
+        priv->compression_plain_bytes += produced;
+        inf_xmpp_connection_parse_chunk(xmpp, buffer, produced);
+      }
+
+      /* If the callback made us disconnect then don't try to read more
+       * data. The inflate stream stays alive since we are parsing. */
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        break;
+      }
+    } while(priv->inflate->avail_in > 0 || priv->inflate->avail_out == 0);
+
+    return;
+  }
+#endif
+
+  inf_xmpp_connection_parse_chunk(xmpp, data, len);
+}
+
 static void
 inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
                                 gconstpointer data,
@@ -3193,6 +4139,16 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
   if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS)
     return;
 
+  /* The TLS handshake is running in a worker thread. Keep the data until it
+   * has finished. */
+  if(priv->tls_step != NULL)
+  {
+    if(priv->tls_pending == NULL)
+      priv->tls_pending = g_byte_array_new();
+    g_byte_array_append(priv->tls_pending, data, len);
+    return;
+  }
+
   g_object_ref(xmpp);
 
   g_assert(priv->parsing == 0);
@@ -3258,9 +4214,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         else
         {
           /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+          inf_xmpp_connection_parse(xmpp, buffer, res);
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3275,9 +4229,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-        printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_parse(xmpp, data, len);
     }
   }
 
@@ -3313,6 +4265,14 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
        * AUTHENTICATING */
       inf_xmpp_connection_initiate(xmpp);
     }
+    else if(priv->status == INF_XMPP_CONNECTION_READY &&
+            priv->compression_restart == TRUE)
+    {
+      /* Compression has been enabled, expect a new <stream:stream> from
+       * the client */
+      priv->compression_restart = FALSE;
+      inf_xmpp_connection_create_parser(xmpp);
+    }
   }
 
   g_object_unref(xmpp);
@@ -3543,6 +4503,7 @@ inf_xmpp_connection_get_xml_status(InfXmppConnection* xmpp)
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     return INF_XML_CONNECTION_OPENING;
@@ -3625,12 +4586,34 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  priv->tls_offload = FALSE;
+  priv->tls_step = NULL;
+  priv->tls_pending = NULL;
+  priv->tls_step_done = FALSE;
+  priv->tls_step_result = 0;
+
+  priv->session_ticket_key = NULL;
+  priv->session_data = NULL;
+  priv->tls_resumed = FALSE;
+
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_session = NULL;
   priv->sasl_local_mechanisms = NULL;
   priv->sasl_remote_mechanisms = NULL;
   priv->sasl_error = NULL;
+
+  priv->compression = FALSE;
+  priv->compression_restart = FALSE;
+  priv->compression_refused = FALSE;
+  priv->compression_queue = NULL;
+#ifdef LIBINFINITY_HAVE_ZLIB
+  priv->deflate = NULL;
+  priv->inflate = NULL;
+#endif
+  priv->compression_plain_bytes = 0;
+  priv->compression_wire_bytes = 0;
+  priv->compression_time = 0;
 }
 
 static void
@@ -3735,6 +4718,11 @@ inf_xmpp_connection_finalize(GObject* object)
   if(priv->sasl_error)
     g_error_free(priv->sasl_error);
 
+  if(priv->session_ticket_key != NULL)
+    g_bytes_unref(priv->session_ticket_key);
+  if(priv->session_data != NULL)
+    g_bytes_unref(priv->session_data);
+
   G_OBJECT_CLASS(inf_xmpp_connection_parent_class)->finalize(object);
 }
 
@@ -3826,6 +4814,22 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_TLS_OFFLOAD:
+    priv->tls_offload = g_value_get_boolean(value);
+    break;
+  case PROP_SESSION_TICKET_KEY:
+    if(priv->session_ticket_key != NULL)
+      g_bytes_unref(priv->session_ticket_key);
+    priv->session_ticket_key = g_value_dup_boxed(value);
+    break;
+  case PROP_SESSION_DATA:
+    if(priv->session_data != NULL)
+      g_bytes_unref(priv->session_data);
+    priv->session_data = g_value_dup_boxed(value);
+    break;
+  case PROP_COMPRESSION:
+    priv->compression = g_value_get_boolean(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3876,6 +4880,44 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_TLS_OFFLOAD:
+    g_value_set_boolean(value, priv->tls_offload);
+    break;
+  case PROP_SESSION_TICKET_KEY:
+    g_value_set_boxed(value, priv->session_ticket_key);
+    break;
+  case PROP_SESSION_DATA:
+    g_value_set_boxed(value, priv->session_data);
+    break;
+  case PROP_TLS_RESUMED:
+    g_value_set_boolean(value, priv->tls_resumed);
+    break;
+  case PROP_COMPRESSION:
+    g_value_set_boolean(value, priv->compression);
+    break;
+  case PROP_COMPRESSION_ENABLED:
+    g_value_set_boolean(
+      value,
+      inf_xmpp_connection_get_compression_enabled(xmpp)
+    );
+    break;
+  case PROP_COMPRESSION_RATIO:
+    if(priv->compression_plain_bytes == 0)
+    {
+      g_value_set_double(value, 1.0);
+    }
+    else
+    {
+      g_value_set_double(
+        value,
+        (gdouble)priv->compression_wire_bytes /
+        (gdouble)priv->compression_plain_bytes
+      );
+    }
+    break;
+  case PROP_COMPRESSION_TIME:
+    g_value_set_uint64(value, priv->compression_time);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -3979,6 +5021,11 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
     /* TODO: Shouldn't we close the TCP connection here, as in
      * inf_xmpp_connection_received_cb()? */
     break;
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+    /* We do not know whether the server has switched to compression
+     * already, so just close the connection. */
+    inf_tcp_connection_close(priv->tcp);
+    break;
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
     /* TODO: Perhaps we should wait for the TLS handshake being finished
@@ -3986,8 +5033,12 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
     /* I don't think we can do more here to make the closure more
      * explicit */
     g_assert(priv->session != NULL);
-    gnutls_deinit(priv->session);
-    priv->session = NULL;
+    inf_xmpp_connection_tls_step_cancel(INF_XMPP_CONNECTION(connection));
+    if(priv->session != NULL)
+    {
+      gnutls_deinit(priv->session);
+      priv->session = NULL;
+    }
     /* This will cause a status property notify which will actually set
      * the xmpp status */
     inf_tcp_connection_close(priv->tcp);
@@ -4016,17 +5067,30 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
 }
 
 static void
-inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
-                                        xmlNodePtr xml)
+inf_xmpp_connection_xml_connection_send_impl(InfXmlConnection* connection,
+                                             xmlNodePtr xml,
+                                             GBytes* serialized)
 {
   InfXmppConnectionPrivate* priv;
   priv = INF_XMPP_CONNECTION_PRIVATE(connection);
 
   g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  if(priv->compression_queue != NULL)
+  {
+    /* The client is restarting the stream after compression has been
+     * enabled, so send this once that is done. */
+    g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+    g_queue_push_tail(priv->compression_queue, xml);
+    return;
+  }
 
-  /* It can happen that while calling inf_xmpp_connection_send_xml we
+  if(serialized != NULL)
+    inf_xmpp_connection_send_bytes(INF_XMPP_CONNECTION(connection), serialized);
+  else
+    inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+
+  /* It can happen that while sending the data we
    * notice that the connection is down. Only proceed with sent notification
    * if the connection is still up and we could actually send the thing. */
   if(priv->status == INF_XMPP_CONNECTION_READY)
@@ -4044,6 +5108,21 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
+                                        xmlNodePtr xml)
+{
+  inf_xmpp_connection_xml_connection_send_impl(connection, xml, NULL);
+}
+
+static void
+inf_xmpp_connection_xml_connection_send_serialized(InfXmlConnection* conn,
+                                                   xmlNodePtr xml,
+                                                   GBytes* serialized)
+{
+  inf_xmpp_connection_xml_connection_send_impl(conn, xml, serialized);
+}
+
 /*
  * GObject type registration
  */
@@ -4178,6 +5257,106 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_OFFLOAD,
+    g_param_spec_boolean(
+      "tls-offload",
+      "TLS offload",
+      "Whether to perform the TLS handshake in a worker thread",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SESSION_TICKET_KEY,
+    g_param_spec_boxed(
+      "session-ticket-key",
+      "Session ticket key",
+      "Key to encrypt TLS session tickets with, or NULL to not issue tickets",
+      G_TYPE_BYTES,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SESSION_DATA,
+    g_param_spec_boxed(
+      "session-data",
+      "Session data",
+      "Parameters of a previous TLS session to resume",
+      G_TYPE_BYTES,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_RESUMED,
+    g_param_spec_boolean(
+      "tls-resumed",
+      "TLS resumed",
+      "Whether the TLS session was resumed from a previous one",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION,
+    g_param_spec_boolean(
+      "compression",
+      "Compression",
+      "Whether to request (or offer, as a server) zlib stream compression",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_ENABLED,
+    g_param_spec_boolean(
+      "compression-enabled",
+      "Compression enabled",
+      "Whether stream compression is enabled for the connection or not",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_RATIO,
+    g_param_spec_double(
+      "compression-ratio",
+      "Compression ratio",
+      "Ratio of compressed to uncompressed bytes transferred so far",
+      0.0,
+      G_MAXDOUBLE,
+      1.0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_TIME,
+    g_param_spec_uint64(
+      "compression-time",
+      "Compression time",
+      "Time in microseconds spent compressing and decompressing data",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4203,6 +5382,7 @@ inf_xmpp_connection_xml_connection_iface_init(
   iface->open = inf_xmpp_connection_xml_connection_open;
   iface->close = inf_xmpp_connection_xml_connection_close;
   iface->send = inf_xmpp_connection_xml_connection_send;
+  iface->send_serialized = inf_xmpp_connection_xml_connection_send_serialized;
 }
 
 /*
@@ -4321,6 +5501,34 @@ inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp)
   return TRUE;
 }
 
+/**
+ * inf_xmpp_connection_get_compression_enabled:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether zlib stream compression, as specified in XEP-0138, has
+ * been negotiated for @xmpp. Compression is only negotiated if the
+ * #InfXmppConnection:compression property is set on both sides and
+ * libinfinity was built with zlib support.
+ *
+ * Returns: %TRUE if compression is enabled and %FALSE otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp)
+{
+#ifdef LIBINFINITY_HAVE_ZLIB
+  InfXmppConnectionPrivate* priv;
+#endif
+
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  if(priv->deflate != NULL) return TRUE;
+#endif
+
+  return FALSE;
+}
+
 /**
  * inf_xmpp_connection_get_own_certificate:
  * @xmpp: A #InfXmppConnection.
@@ -109,6 +109,8 @@ typedef enum _InfXmppConnectionSecurityPolicy {
  * a suitable authentication mechanism that is accepted by the client.
  * @INF_XMPP_CONNECTION_ERROR_FAILED: General error code for otherwise
  * unknown errors.
+ * @INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE: Data received from the
+ * remote side could not be decompressed.
  *
  * Specifies the error codes in the
  * <literal>INF_XMPP_CONNECTION_ERROR</literal> error domain.
@@ -122,7 +124,9 @@ typedef enum _InfXmppConnectionError {
   INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
   INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM,
 
-  INF_XMPP_CONNECTION_ERROR_FAILED
+  INF_XMPP_CONNECTION_ERROR_FAILED,
+
+  INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE
 } InfXmppConnectionError;
 
 /**
@@ -329,6 +333,9 @@ inf_xmpp_connection_new(InfTcpConnection* tcp,
 gboolean
 inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp);
 
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp);
+
 gnutls_x509_crt_t
 inf_xmpp_connection_get_own_certificate(InfXmppConnection* xmpp);
 
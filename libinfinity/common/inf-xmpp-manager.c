@@ -51,6 +51,12 @@
  * name resolver. Once the hostname has been looked up, and if another
  * connection with the same address and port number exists already, the new
  * connection is removed in favor of the already existing one.
+ *
+ * The XMPP manager also remembers the TLS session of each connection it
+ * contains. When a new connection to the same host is added later, the
+ * session is set on the new connection via the #InfXmppConnection:session-data
+ * property, so that it can resume the previous TLS session instead of
+ * performing a full handshake.
  */
 
 typedef enum _InfXmppManagerKeyKind {
@@ -89,6 +95,9 @@ struct _InfXmppManagerConnectionInfo {
 typedef struct _InfXmppManagerPrivate InfXmppManagerPrivate;
 struct _InfXmppManagerPrivate {
   GTree* connections;
+
+  /* TLS session data of connections, by key, for resumption */
+  GTree* sessions;
 };
 
 enum {
@@ -333,6 +342,47 @@ inf_xmpp_manager_check_key(InfXmppManager* manager,
 static void
 inf_xmpp_manager_connection_info_free(InfXmppManagerConnectionInfo* info);
 
+/* If the connection has TLS session data, remember it for all of the
+ * connection's keys. Otherwise, provide it with session data from an earlier
+ * connection to the same host, if we have any. */
+static void
+inf_xmpp_manager_sync_session_data(InfXmppManager* manager,
+                                   InfXmppManagerConnectionInfo* info)
+{
+  InfXmppManagerPrivate* priv;
+  GBytes* data;
+  guint i;
+
+  priv = INF_XMPP_MANAGER_PRIVATE(manager);
+  g_object_get(G_OBJECT(info->xmpp), "session-data", &data, NULL);
+
+  if(data != NULL)
+  {
+    for(i = 0; i < info->n_keys; ++i)
+    {
+      g_tree_replace(
+        priv->sessions,
+        inf_xmpp_manager_key_copy(info->keys[i]),
+        g_bytes_ref(data)
+      );
+    }
+
+    g_bytes_unref(data);
+  }
+  else
+  {
+    for(i = 0; i < info->n_keys; ++i)
+    {
+      data = g_tree_lookup(priv->sessions, info->keys[i]);
+      if(data != NULL)
+      {
+        g_object_set(G_OBJECT(info->xmpp), "session-data", data, NULL);
+        break;
+      }
+    }
+  }
+}
+
 /* Updates all keys for the given connection info. is_added should be TRUE if
  * before the caller the connection was already added to the manager, i.e.
  * whether the connection-added signal has been emitted for the connection.
@@ -517,6 +567,10 @@ inf_xmpp_manager_update_keys(InfXmppManager* manager,
   }
 
   g_free(has_keys);
+
+  if(result == TRUE)
+    inf_xmpp_manager_sync_session_data(manager, info);
+
   return result;
 }
 
@@ -599,6 +653,17 @@ inf_xmpp_manager_connection_info_set_resolver(InfXmppManagerConnectionInfo* info
   }
 }
 
+static void
+inf_xmpp_manager_notify_session_data_cb(GObject* object,
+                                        GParamSpec* pspec,
+                                        gpointer user_data)
+{
+  InfXmppManagerConnectionInfo* info;
+  info = (InfXmppManagerConnectionInfo*)user_data;
+
+  inf_xmpp_manager_sync_session_data(info->manager, info);
+}
+
 static void
 inf_xmpp_manager_notify_resolver_cb(GObject* object,
                                     GParamSpec* pspec,
@@ -656,6 +721,13 @@ inf_xmpp_manager_connection_info_new(InfXmppManager* manager,
     info
   );
 
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "notify::session-data",
+    G_CALLBACK(inf_xmpp_manager_notify_session_data_cb),
+    info
+  );
+
   g_object_get(G_OBJECT(tcp), "resolver", &resolver, NULL);
 
   if(resolver != NULL)
@@ -690,6 +762,12 @@ inf_xmpp_manager_connection_info_free(InfXmppManagerConnectionInfo* info)
     info
   );
 
+  inf_signal_handlers_disconnect_by_func(
+    info->xmpp,
+    G_CALLBACK(inf_xmpp_manager_notify_session_data_cb),
+    info
+  );
+
   g_object_unref(tcp);
   g_object_unref(info->xmpp);
   g_free(info->keys);
@@ -722,6 +800,13 @@ inf_xmpp_manager_init(InfXmppManager* manager)
     inf_xmpp_manager_key_free,
     NULL
   );
+
+  priv->sessions = g_tree_new_full(
+    inf_xmpp_manager_key_cmp,
+    NULL,
+    inf_xmpp_manager_key_free,
+    (GDestroyNotify)g_bytes_unref
+  );
 }
 
 static void
@@ -742,6 +827,12 @@ inf_xmpp_manager_dispose(GObject* object)
   g_tree_destroy(priv->connections);
   priv->connections = NULL;
 
+  if(priv->sessions != NULL)
+  {
+    g_tree_destroy(priv->sessions);
+    priv->sessions = NULL;
+  }
+
   G_OBJECT_CLASS(inf_xmpp_manager_parent_class)->dispose(object);
 }
 
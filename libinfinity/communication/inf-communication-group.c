@@ -751,6 +751,117 @@ inf_communication_group_send_group_message(InfCommunicationGroup* group,
   }
 }
 
+/**
+ * inf_communication_group_send_source:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection to which to send the messages.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data, or %NULL.
+ *
+ * Sends the messages produced by @func to @connection, which must be a
+ * member of @group. Instead of creating all messages up front, @func is
+ * called only when the messages can actually be sent, that is when all
+ * messages previously scheduled for @connection in @group have been handed
+ * to the connection and the connection has sent them. This keeps the number
+ * of messages in memory small when sending a large amount of data.
+ *
+ * Messages sent to @connection in @group after this call are sent after all
+ * messages of @func. When @func returns %NULL, or when the messages are
+ * cancelled with inf_communication_group_cancel_messages(), @notify is
+ * called on @user_data.
+ */
+void
+inf_communication_group_send_source(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection,
+                                    InfCommunicationSourceFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify)
+{
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationMethod* method;
+  xmlNodePtr xml;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+
+  if(priv->communication_registry != NULL &&
+     inf_communication_registry_is_registered(
+       priv->communication_registry, group, connection))
+  {
+    inf_communication_registry_send_source(
+      priv->communication_registry,
+      group,
+      connection,
+      func,
+      user_data,
+      notify
+    );
+  }
+  else
+  {
+    /* The method does not send via the registry, so we have no way to
+     * find out when the connection is ready for more. */
+    while( (xml = func(user_data)) != NULL)
+      inf_communication_method_send_single(method, connection, xml);
+
+    if(notify != NULL)
+      notify(user_data);
+  }
+}
+
+/**
+ * inf_communication_group_flush:
+ * @group: A #InfCommunicationGroup.
+ * @connection: (allow-none): The #InfXmlConnection for which to send queued
+ * messages, or %NULL.
+ *
+ * Sends messages queued for @connection in @group right away, instead of
+ * waiting for more messages to send them together with, see
+ * #InfCommunicationRegistry:coalesce-time. If @connection is %NULL, this is
+ * done for all members of @group. Call this after sending messages for which
+ * latency matters, such as when a synchronization begins or a user joins.
+ */
+void
+inf_communication_group_flush(InfCommunicationGroup* group,
+                              InfXmlConnection* connection)
+{
+  InfCommunicationGroupPrivate* priv;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(connection == NULL || INF_IS_XML_CONNECTION(connection));
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  /* Messages of methods which do not send via the registry are not held
+   * back in the first place. */
+  if(priv->communication_registry == NULL)
+    return;
+
+  if(connection != NULL &&
+     !inf_communication_registry_is_registered(
+       priv->communication_registry, group, connection))
+  {
+    return;
+  }
+
+  inf_communication_registry_flush(
+    priv->communication_registry,
+    group,
+    connection
+  );
+}
+
 /**
  * inf_communication_group_cancel_messages:
  * @group: A #InfCommunicationGroup.
@@ -39,6 +39,19 @@ G_BEGIN_DECLS
 typedef struct _InfCommunicationGroup InfCommunicationGroup;
 typedef struct _InfCommunicationGroupClass InfCommunicationGroupClass;
 
+/**
+ * InfCommunicationSourceFunc:
+ * @user_data: User data passed to inf_communication_group_send_source().
+ *
+ * This function is called to produce the next message of a message source,
+ * see inf_communication_group_send_source(). It must not send any messages
+ * itself.
+ *
+ * Returns: (transfer full): The next message to send, or %NULL if there
+ * are no more messages.
+ */
+typedef xmlNodePtr(*InfCommunicationSourceFunc)(gpointer user_data);
+
 /**
  * InfCommunicationGroupClass:
  * @member_added: Default signal handler of the
@@ -108,6 +121,17 @@ void
 inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml);
 
+void
+inf_communication_group_send_source(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection,
+                                    InfCommunicationSourceFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify);
+
+void
+inf_communication_group_flush(InfCommunicationGroup* group,
+                              InfXmlConnection* connection);
+
 void
 inf_communication_group_cancel_messages(InfCommunicationGroup* group,
                                         InfXmlConnection* connection);
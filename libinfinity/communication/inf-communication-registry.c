@@ -34,11 +34,20 @@
  * inf_communication_method_enqueued() when sending the message cannot be
  * cancelled anymore via inf_communication_registry_cancel_messages() and
  * inf_communication_method_sent() when the message has been sent.
+ *
+ * Messages sent to the same group on the same connection are packed into a
+ * single container while previous messages are still being sent. If the
+ * #InfCommunicationRegistry:io and #InfCommunicationRegistry:coalesce-time
+ * properties are set, then messages are also held back for a short time
+ * when nothing is being sent, so that bursts of messages can be sent
+ * together. inf_communication_registry_flush() can be used to send a
+ * message for which latency matters right away.
  **/
 
 #include <libinfinity/communication/inf-communication-registry.h>
 #include <libinfinity/communication/inf-communication-group-private.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-io.h>
 #include <libinfinity/inf-signals.h>
 
 #include <string.h>
@@ -53,6 +62,17 @@ struct _InfCommunicationRegistryKey {
   const gchar* group_name;
 };
 
+/* A message source added with inf_communication_registry_send_source().
+ * The placeholder node is linked into the entry's queue at the position of
+ * the source's messages. */
+typedef struct _InfCommunicationRegistrySource InfCommunicationRegistrySource;
+struct _InfCommunicationRegistrySource {
+  xmlNodePtr placeholder;
+  InfCommunicationSourceFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
 typedef struct _InfCommunicationRegistryEntry InfCommunicationRegistryEntry;
 struct _InfCommunicationRegistryEntry {
   InfCommunicationRegistry* registry;
@@ -66,6 +86,13 @@ struct _InfCommunicationRegistryEntry {
   guint inner_count;
   xmlNodePtr queue_begin;
   xmlNodePtr queue_end;
+  gsize queue_size; /* estimated size of the queued messages in bytes */
+  GQueue sources; /* sources in queue, in queue order */
+  GQueue shared_messages; /* broadcast messages in queue, in queue order */
+
+  /* Link in the registry's pending queue if the entry waits for the
+   * coalescing timeout, or NULL otherwise. */
+  GList* pending_link;
 
   /* Activation status */
   gboolean registered;
@@ -82,11 +109,51 @@ struct _InfCommunicationRegistryForeachMethodData {
   xmlNodePtr xml;
 };
 
+/* A message sent with inf_communication_registry_send_all(). Each
+ * connection queues its own copy of the message, which refers to this
+ * structure until it is sent. If a <group> container holds only such
+ * messages, its serialization is stored with the first of them, together
+ * with the other messages in the container and the publisher string, and
+ * reused for every other connection whose container turns out the same.
+ * This works no matter whether the containers are sent right away or after
+ * the coalesce time. */
+typedef struct _InfCommunicationRegistryShared InfCommunicationRegistryShared;
+struct _InfCommunicationRegistryShared {
+  guint ref_count;
+
+  gchar* publisher_string;
+  GPtrArray* following; /* shared messages after this one in the container */
+  GBytes* serialized;
+};
+
+typedef struct _InfCommunicationRegistrySharedMessage
+  InfCommunicationRegistrySharedMessage;
+struct _InfCommunicationRegistrySharedMessage {
+  xmlNodePtr xml;
+  InfCommunicationRegistryShared* shared;
+};
+
 typedef struct _InfCommunicationRegistryPrivate
   InfCommunicationRegistryPrivate;
 struct _InfCommunicationRegistryPrivate {
   GHashTable* connections;
   GHashTable* entries;
+
+  InfIo* io;
+  guint coalesce_time;
+  guint max_batch_size;
+
+  /* Entries whose queue is sent when flush_timeout elapses */
+  GQueue pending;
+  InfIoTimeout* flush_timeout;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+  PROP_COALESCE_TIME,
+  PROP_MAX_BATCH_SIZE
 };
 
 #define INF_COMMUNICATION_REGISTRY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_COMMUNICATION_TYPE_REGISTRY, InfCommunicationRegistryPrivate))
@@ -94,20 +161,299 @@ struct _InfCommunicationRegistryPrivate {
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationRegistry, inf_communication_registry, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfCommunicationRegistry))
 
-/* Maximum number of messages enqueued at the same time */
-static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT = 5;
+/* Default for the maximum size of a message container. This fits the
+ * container into a single TLS record. */
+static const guint INF_COMMUNICATION_REGISTRY_MAX_BATCH_SIZE = 16 * 1024;
+
+/* Returns roughly the number of bytes xml takes when serialized, without
+ * actually serializing it. */
+static gsize
+inf_communication_registry_estimate_size(xmlNodePtr xml)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  gsize size;
+
+  switch(xml->type)
+  {
+  case XML_ELEMENT_NODE:
+    /* <name></name> */
+    size = 2 * strlen((const char*)xml->name) + 5;
+
+    for(attr = xml->properties; attr != NULL; attr = attr->next)
+    {
+      /* name="value" */
+      size += strlen((const char*)attr->name) + 4;
+      if(attr->children != NULL && attr->children->content != NULL)
+        size += strlen((const char*)attr->children->content);
+    }
+
+    for(child = xml->children; child != NULL; child = child->next)
+      size += inf_communication_registry_estimate_size(child);
+
+    return size;
+  case XML_TEXT_NODE:
+  case XML_CDATA_SECTION_NODE:
+    if(xml->content == NULL) return 0;
+    return strlen((const char*)xml->content);
+  default:
+    return 0;
+  }
+}
+
+static void
+inf_communication_registry_source_free(InfCommunicationRegistrySource* src)
+{
+  if(src->placeholder != NULL)
+  {
+    src->placeholder->next = NULL;
+    xmlFreeNode(src->placeholder);
+  }
+
+  if(src->notify != NULL)
+    src->notify(src->user_data);
+
+  g_slice_free(InfCommunicationRegistrySource, src);
+}
+
+/* Makes the next message of the source at the head of the queue available
+ * in front of its placeholder. Returns FALSE and removes the source if it
+ * has no more messages. */
+static gboolean
+inf_communication_registry_source_pull(InfCommunicationRegistryEntry* entry,
+                                       xmlNodePtr prev)
+{
+  InfCommunicationRegistrySource* source;
+  xmlNodePtr placeholder;
+  xmlNodePtr xml;
+  gboolean result;
+
+  source = g_queue_peek_head(&entry->sources);
+  placeholder = source->placeholder;
+  g_assert(placeholder == (prev != NULL ? prev->next : entry->queue_begin));
+
+  xml = source->func(source->user_data);
+  if(xml != NULL)
+  {
+    xmlUnlinkNode(xml);
+    xml->next = placeholder;
+    entry->queue_size += inf_communication_registry_estimate_size(xml);
+    result = TRUE;
+  }
+  else
+  {
+    xml = placeholder->next;
+    result = FALSE;
+    if(entry->queue_end == placeholder)
+      entry->queue_end = prev;
+
+    g_queue_pop_head(&entry->sources);
+    inf_communication_registry_source_free(source);
+  }
+
+  if(prev != NULL)
+    prev->next = xml;
+  else
+    entry->queue_begin = xml;
+
+  return result;
+}
+
+/* Replaces all sources in the queue by the messages they produce */
+static void
+inf_communication_registry_expand_sources(InfCommunicationRegistryEntry* ent)
+{
+  InfCommunicationRegistrySource* source;
+  xmlNodePtr prev;
+  xmlNodePtr xml;
+
+  prev = NULL;
+  xml = ent->queue_begin;
+
+  while( (source = g_queue_peek_head(&ent->sources)) != NULL)
+  {
+    while(xml != source->placeholder)
+    {
+      prev = xml;
+      xml = xml->next;
+    }
+
+    while(inf_communication_registry_source_pull(ent, prev))
+      prev = (prev != NULL) ? prev->next : ent->queue_begin;
+
+    xml = (prev != NULL) ? prev->next : ent->queue_begin;
+  }
+}
+
+static InfCommunicationRegistryShared*
+inf_communication_registry_shared_new(void)
+{
+  InfCommunicationRegistryShared* shared;
+
+  shared = g_slice_new(InfCommunicationRegistryShared);
+  shared->ref_count = 1;
+  shared->publisher_string = NULL;
+  shared->following = NULL;
+  shared->serialized = NULL;
+
+  return shared;
+}
+
+static void
+inf_communication_registry_shared_unref(gpointer data)
+{
+  InfCommunicationRegistryShared* shared;
+  shared = (InfCommunicationRegistryShared*)data;
+
+  if(--shared->ref_count == 0)
+  {
+    /* Frees the following messages as well. These are always newer than
+     * shared itself, so there cannot be a cycle. */
+    if(shared->following != NULL)
+      g_ptr_array_free(shared->following, TRUE);
+    if(shared->serialized != NULL)
+      g_bytes_unref(shared->serialized);
+
+    g_free(shared->publisher_string);
+    g_slice_free(InfCommunicationRegistryShared, shared);
+  }
+}
+
+static void
+inf_communication_registry_shared_message_free(
+  InfCommunicationRegistrySharedMessage* message)
+{
+  inf_communication_registry_shared_unref(message->shared);
+  g_slice_free(InfCommunicationRegistrySharedMessage, message);
+}
 
+static void
+inf_communication_registry_clear_queue(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistrySource* source;
+  InfCommunicationRegistrySharedMessage* message;
+
+  /* This frees the placeholders as well */
+  xmlFreeNodeList(entry->queue_begin);
+  entry->queue_begin = NULL;
+  entry->queue_end = NULL;
+  entry->queue_size = 0;
+
+  while( (source = g_queue_pop_head(&entry->sources)) != NULL)
+  {
+    source->placeholder = NULL;
+    inf_communication_registry_source_free(source);
+  }
+
+  while( (message = g_queue_pop_head(&entry->shared_messages)) != NULL)
+    inf_communication_registry_shared_message_free(message);
+}
+
+/* Returns the serialization of container if it holds only the shared
+ * messages in shared, in that order, or NULL otherwise. */
+static GBytes*
+inf_communication_registry_get_serialized(InfCommunicationRegistryEntry* entry,
+                                          xmlNodePtr container,
+                                          GPtrArray* shared)
+{
+  InfCommunicationRegistryShared* first;
+  xmlNodePtr child;
+  guint n_children;
+  guint i;
+
+  n_children = 0;
+  for(child = container->children; child != NULL; child = child->next)
+    ++n_children;
+
+  if(shared->len == 0 || shared->len != n_children)
+    return NULL;
+
+  first = g_ptr_array_index(shared, 0);
+
+  if(first->serialized != NULL &&
+     g_strcmp0(first->publisher_string, entry->publisher_string) == 0 &&
+     first->following->len == shared->len - 1)
+  {
+    for(i = 1; i < shared->len; ++i)
+    {
+      if(g_ptr_array_index(first->following, i - 1) !=
+         g_ptr_array_index(shared, i))
+      {
+        break;
+      }
+    }
+
+    if(i == shared->len)
+      return g_bytes_ref(first->serialized);
+  }
+
+  if(first->serialized != NULL)
+  {
+    g_bytes_unref(first->serialized);
+    g_ptr_array_free(first->following, TRUE);
+    g_free(first->publisher_string);
+  }
+
+  first->serialized = inf_xml_util_serialize(container);
+  first->publisher_string = g_strdup(entry->publisher_string);
+  first->following = g_ptr_array_new_full(
+    shared->len - 1,
+    inf_communication_registry_shared_unref
+  );
+
+  for(i = 1; i < shared->len; ++i)
+  {
+    ++((InfCommunicationRegistryShared*)g_ptr_array_index(shared, i))->
+      ref_count;
+    g_ptr_array_add(first->following, g_ptr_array_index(shared, i));
+  }
+
+  return g_bytes_ref(first->serialized);
+}
+
+static void
+inf_communication_registry_unschedule(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistryPrivate* priv;
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(entry->registry);
+
+  if(entry->pending_link != NULL)
+  {
+    g_queue_delete_link(&priv->pending, entry->pending_link);
+    entry->pending_link = NULL;
+
+    if(priv->pending.length == 0 && priv->flush_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, priv->flush_timeout);
+      priv->flush_timeout = NULL;
+    }
+  }
+}
+
+/* Sends queued messages of entry in a single container. Messages are added
+ * to the container until it would exceed max_size bytes, but at least one
+ * message is sent. */
 static void
 inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
-                                     guint num_messages)
+                                     gsize max_size)
 {
   InfXmlConnection* connection;
   InfXmlConnectionStatus status;
+  InfCommunicationRegistrySource* source;
+  InfCommunicationRegistrySharedMessage* message;
 
   xmlNodePtr container;
   xmlNodePtr child;
   xmlNodePtr xml;
-  guint i;
+  GPtrArray* shared;
+  GBytes* serialized;
+  gsize size;
+  gsize total;
+
+  inf_communication_registry_unschedule(entry);
+  shared = g_ptr_array_new_with_free_func(
+    inf_communication_registry_shared_unref
+  );
 
   container = xmlNewNode(NULL, (const xmlChar*)"group");
   if(entry->publisher_string != NULL)
@@ -121,8 +467,33 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
 
   inf_xml_util_set_attribute(container, "name", entry->key.group_name);
 
-  for(i = 0; i < num_messages && ((xml = entry->queue_begin) != NULL); ++ i)
+  total = 0;
+  while((xml = entry->queue_begin) != NULL)
   {
+    /* Messages of a source are only created when they are about to be
+     * sent. */
+    source = g_queue_peek_head(&entry->sources);
+    if(source != NULL && source->placeholder == xml)
+    {
+      inf_communication_registry_source_pull(entry, NULL);
+      continue;
+    }
+
+    size = inf_communication_registry_estimate_size(xml);
+    if(total > 0 && total + size > max_size)
+      break;
+
+    total += size;
+    entry->queue_size -= MIN(entry->queue_size, size);
+
+    message = g_queue_peek_head(&entry->shared_messages);
+    if(message != NULL && message->xml == xml)
+    {
+      g_queue_pop_head(&entry->shared_messages);
+      g_ptr_array_add(shared, message->shared);
+      g_slice_free(InfCommunicationRegistrySharedMessage, message);
+    }
+
     entry->queue_begin = entry->queue_begin->next;
     if(entry->queue_begin == NULL) entry->queue_end = NULL;
     ++ entry->inner_count;
@@ -131,6 +502,14 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
     xmlAddChild(container, xml);
   }
 
+  /* Can happen if the only queued thing was an exhausted source */
+  if(container->children == NULL)
+  {
+    g_ptr_array_free(shared, TRUE);
+    xmlFreeNode(container);
+    return;
+  }
+
   /* Keep order of enqueued() calls and inf_xml_connection_send() calls
    * intact even if this function is run recursively in one of the
    * functions mentioned above. */
@@ -141,6 +520,12 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
   }
   else
   {
+    serialized = inf_communication_registry_get_serialized(
+      entry,
+      container,
+      shared
+    );
+
     entry->enqueued_list = container;
     child = container;
 
@@ -180,7 +565,10 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
        * will simply append to entry->enqueued_list, and we will enqueue and
        * send the messages within the next iteration(s).
        */
-      inf_xml_connection_send(connection, xml);
+      if(xml == container && serialized != NULL)
+        inf_xml_connection_send_serialized(connection, xml, serialized);
+      else
+        inf_xml_connection_send(connection, xml);
 
       /* Break if sending the data lead to connection closure */
       g_object_get(G_OBJECT(connection), "status", &status, NULL);
@@ -188,8 +576,78 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
         break;
     }
 
+    if(serialized != NULL)
+      g_bytes_unref(serialized);
+
     g_object_unref(connection);
   }
+
+  g_ptr_array_free(shared, TRUE);
+}
+
+static void
+inf_communication_registry_flush_timeout_func(gpointer user_data)
+{
+  InfCommunicationRegistry* registry;
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryEntry* entry;
+  InfXmlConnectionStatus status;
+
+  registry = INF_COMMUNICATION_REGISTRY(user_data);
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  priv->flush_timeout = NULL;
+
+  g_object_ref(registry);
+
+  /* Sending can run callbacks that add or remove entries to the pending
+   * queue, so always take the next entry from the queue. */
+  while( (entry = g_queue_pop_head(&priv->pending)) != NULL)
+  {
+    entry->pending_link = NULL;
+
+    g_object_get(G_OBJECT(entry->key.connection), "status", &status, NULL);
+    if(status == INF_XML_CONNECTION_OPEN &&
+       entry->inner_count == 0 && entry->queue_begin != NULL)
+    {
+      inf_communication_registry_send_real(entry, priv->max_batch_size);
+    }
+  }
+
+  g_object_unref(registry);
+}
+
+/* Sends the queued messages of entry, or waits for more messages to be
+ * queued if coalescing is enabled. Must only be called if there are no
+ * messages of the entry currently being sent. */
+static void
+inf_communication_registry_schedule(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistryPrivate* priv;
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(entry->registry);
+
+  g_assert(entry->inner_count == 0);
+
+  if(priv->io == NULL || priv->coalesce_time == 0 ||
+     entry->queue_size >= priv->max_batch_size)
+  {
+    inf_communication_registry_send_real(entry, priv->max_batch_size);
+  }
+  else if(entry->pending_link == NULL)
+  {
+    g_queue_push_tail(&priv->pending, entry);
+    entry->pending_link = g_queue_peek_tail_link(&priv->pending);
+
+    if(priv->flush_timeout == NULL)
+    {
+      priv->flush_timeout = inf_io_add_timeout(
+        priv->io,
+        priv->coalesce_time,
+        inf_communication_registry_flush_timeout_func,
+        entry->registry,
+        NULL
+      );
+    }
+  }
 }
 
 /* Required by inf_communication_registry_entry_free() */
@@ -225,9 +683,12 @@ inf_communication_registry_entry_free(gpointer data)
      status != INF_XML_CONNECTION_CLOSED)
   {
     if(entry->queue_begin != NULL)
-      inf_communication_registry_send_real(entry, G_MAXUINT);
+      inf_communication_registry_send_real(entry, G_MAXSIZE);
   }
 
+  inf_communication_registry_clear_queue(entry);
+  inf_communication_registry_unschedule(entry);
+
   if(entry->group)
   {
     g_object_weak_unref(
@@ -482,14 +943,11 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
     /* Messages have been sent, meaning the number of queued messages has
      * decreased, so we can send more messages now. */
     /* Send next bunch of messages if inner_count reached zero, meaning no
-     * more messages have been enqueued, for better packing. */
+     * more messages have been enqueued, for better packing. Messages queued
+     * in the meanwhile have already waited long enough, so don't wait for
+     * the coalescing timeout here. */
     if(entry->inner_count == 0 && entry->queue_end != NULL)
-    {
-      inf_communication_registry_send_real(
-        entry,
-        INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-      );
-    }
+      inf_communication_registry_send_real(entry, priv->max_batch_size);
 
     /* Free the entry in case all scheduled messages have been sent after
      * unregistration. */
@@ -716,6 +1174,13 @@ inf_communication_registry_init(InfCommunicationRegistry* registry)
     NULL,
     inf_communication_registry_entry_free
   );
+
+  priv->io = NULL;
+  priv->coalesce_time = 0;
+  priv->max_batch_size = INF_COMMUNICATION_REGISTRY_MAX_BATCH_SIZE;
+
+  g_queue_init(&priv->pending);
+  priv->flush_timeout = NULL;
 }
 
 static void
@@ -767,9 +1232,90 @@ inf_communication_registry_dispose(GObject* object)
   g_hash_table_unref(priv->connections);
   g_hash_table_unref(priv->entries);
 
+  /* Freeing the entries has removed them from the pending queue */
+  g_assert(priv->pending.length == 0);
+
+  if(priv->flush_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->flush_timeout);
+    priv->flush_timeout = NULL;
+  }
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
   G_OBJECT_CLASS(inf_communication_registry_parent_class)->dispose(object);
 }
 
+static void
+inf_communication_registry_set_property(GObject* object,
+                                        guint prop_id,
+                                        const GValue* value,
+                                        GParamSpec* pspec)
+{
+  InfCommunicationRegistry* registry;
+  InfCommunicationRegistryPrivate* priv;
+
+  registry = INF_COMMUNICATION_REGISTRY(object);
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    /* Don't keep messages waiting for a timeout of the previous IO */
+    if(priv->flush_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, priv->flush_timeout);
+      inf_communication_registry_flush_timeout_func(registry);
+    }
+
+    if(priv->io != NULL) g_object_unref(priv->io);
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_COALESCE_TIME:
+    priv->coalesce_time = g_value_get_uint(value);
+    break;
+  case PROP_MAX_BATCH_SIZE:
+    priv->max_batch_size = g_value_get_uint(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_communication_registry_get_property(GObject* object,
+                                        guint prop_id,
+                                        GValue* value,
+                                        GParamSpec* pspec)
+{
+  InfCommunicationRegistry* registry;
+  InfCommunicationRegistryPrivate* priv;
+
+  registry = INF_COMMUNICATION_REGISTRY(object);
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, G_OBJECT(priv->io));
+    break;
+  case PROP_COALESCE_TIME:
+    g_value_set_uint(value, priv->coalesce_time);
+    break;
+  case PROP_MAX_BATCH_SIZE:
+    g_value_set_uint(value, priv->max_batch_size);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
 static void
 inf_communication_registry_class_init(
   InfCommunicationRegistryClass* registry_class)
@@ -778,6 +1324,49 @@ inf_communication_registry_class_init(
   object_class = G_OBJECT_CLASS(registry_class);
 
   object_class->dispose = inf_communication_registry_dispose;
+  object_class->set_property = inf_communication_registry_set_property;
+  object_class->get_property = inf_communication_registry_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The IO object used to schedule delayed sending of messages",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COALESCE_TIME,
+    g_param_spec_uint(
+      "coalesce-time",
+      "Coalesce time",
+      "Time in milliseconds to wait for more messages before sending a "
+      "message, or 0 to send messages right away",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_BATCH_SIZE,
+    g_param_spec_uint(
+      "max-batch-size",
+      "Maximum batch size",
+      "Approximate maximum size in bytes of messages sent together",
+      1,
+      G_MAXUINT,
+      INF_COMMUNICATION_REGISTRY_MAX_BATCH_SIZE,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 /**
@@ -858,6 +1447,10 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     entry->inner_count = 0;
     entry->queue_begin = NULL;
     entry->queue_end = NULL;
+    entry->queue_size = 0;
+    g_queue_init(&entry->sources);
+    g_queue_init(&entry->shared_messages);
+    entry->pending_link = NULL;
 
     entry->registered = TRUE;
     entry->activation_count = 0;
@@ -920,6 +1513,9 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
      * but wait until all scheduled messages have been sent. */
     entry->registered = FALSE;
     entry->activation_count = entry->inner_count;
+
+    /* Activation counts messages, so we need to know all of them now */
+    inf_communication_registry_expand_sources(entry);
     for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
       ++ entry->activation_count;
     g_assert(entry->activation_count > 0);
@@ -975,6 +1571,61 @@ inf_communication_registry_is_registered(InfCommunicationRegistry* registry,
   return entry != NULL && entry->registered == TRUE;
 }
 
+/* Queues xml for connection in group. If shared is not NULL, xml is a copy
+ * of a message sent to several connections. */
+static void
+inf_communication_registry_enqueue(InfCommunicationRegistry* registry,
+                                   InfCommunicationGroup* group,
+                                   InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   InfCommunicationRegistryShared* shared)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistrySharedMessage* message;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_assert(entry != NULL && entry->registered == TRUE);
+
+  xmlUnlinkNode(xml);
+  if(entry->queue_end == NULL)
+  {
+    entry->queue_begin = xml;
+    entry->queue_end = xml;
+  }
+  else
+  {
+    entry->queue_end->next = xml;
+    entry->queue_end = xml;
+  }
+
+  entry->queue_size += inf_communication_registry_estimate_size(xml);
+
+  if(shared != NULL)
+  {
+    message = g_slice_new(InfCommunicationRegistrySharedMessage);
+    message->xml = xml;
+    message->shared = shared;
+    ++shared->ref_count;
+
+    g_queue_push_tail(&entry->shared_messages, message);
+  }
+
+  /* If there is something in the inner queue, don't send directly but wait
+   * until the message has been sent, for better packing. */
+  if(entry->inner_count == 0)
+    inf_communication_registry_schedule(entry);
+
+  g_free(key.publisher_id);
+}
+
 /**
  * inf_communication_registry_send:
  * @registry: A #InfCommunicationRegistry.
@@ -996,15 +1647,159 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfCommunicationGroup* group,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml)
+{
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  inf_communication_registry_enqueue(registry, group, connection, xml, NULL);
+}
+
+/**
+ * inf_communication_registry_send_all:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connections: (element-type InfXmlConnection): The connections to send
+ * the message to.
+ * @except: (allow-none): A connection in @connections not to send the
+ * message to, or %NULL.
+ * @xml: (transfer full): The message to send.
+ *
+ * Sends an XML message to all connections in @connections, except @except.
+ * Connections which are not registered with @group or which are not open are
+ * skipped. This is equivalent to calling inf_communication_registry_send()
+ * with a copy of @xml for each of the connections, but the message is
+ * serialized only once for all connections to which it is sent in the same
+ * way, also when sending is delayed by
+ * #InfCommunicationRegistry:coalesce-time.
+ *
+ * This function takes ownership of @xml.
+ */
+void
+inf_communication_registry_send_all(InfCommunicationRegistry* registry,
+                                    InfCommunicationGroup* group,
+                                    GSList* connections,
+                                    InfXmlConnection* except,
+                                    xmlNodePtr xml)
+{
+  InfCommunicationRegistryShared* shared;
+  GSList* item;
+  InfXmlConnection* connection;
+  gboolean is_registered;
+  InfXmlConnectionStatus status;
+  xmlNodePtr copy;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(except == NULL || INF_IS_XML_CONNECTION(except));
+  g_return_if_fail(xml != NULL);
+
+  /* Each of the inf_communication_registry_send() calls can do a callback
+   * which might possibly screw up the connection list completely. So be
+   * safe here by copying all relevant information on the stack. */
+  g_object_ref(registry);
+  g_object_ref(group);
+
+  connections = g_slist_copy(connections);
+  for(item = connections; item != NULL; item = item->next)
+    g_object_ref(item->data);
+
+  shared = inf_communication_registry_shared_new();
+
+  while(connections)
+  {
+    connection = INF_XML_CONNECTION(connections->data);
+
+    /* A callback from a prior iteration might have unregistered the
+     * connection. */
+    is_registered = inf_communication_registry_is_registered(
+      registry,
+      group,
+      connection
+    );
+
+    /* in case the method's remove member was not yet called we also check
+     * the status here, i.e. if we are called in response to a handler of
+     * the notify::status signal that ran before the method's one. */
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+    if(is_registered &&
+       status == INF_XML_CONNECTION_OPEN &&
+       connection != except)
+    {
+      if(connections->next != NULL)
+      {
+        /* Keep ownership of XML if there might be more connections we should
+         * send it to. */
+        copy = xmlCopyNode(xml, 1);
+      }
+      else
+      {
+        /* Pass ownership of XML if this is definitely the last connection
+         * in the list. */
+        copy = xml;
+        xml = NULL;
+      }
+
+      inf_communication_registry_enqueue(
+        registry,
+        group,
+        connection,
+        copy,
+        shared
+      );
+    }
+
+    g_object_unref(connection);
+    connections = g_slist_delete_link(connections, connections);
+  }
+
+  inf_communication_registry_shared_unref(shared);
+
+  g_object_unref(registry);
+  g_object_unref(group);
+
+  if(xml != NULL)
+    xmlFreeNode(xml);
+}
+
+/**
+ * inf_communication_registry_send_source:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the messages.
+ * @connection: A registered #InfXmlConnection.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data, or %NULL.
+ *
+ * Schedules the messages produced by @func to be sent to @connection, as if
+ * each of them was sent with inf_communication_registry_send(). However,
+ * @func is only called when the next message can be put into a container,
+ * i.e. when all previous messages for @connection in @group have been sent.
+ * At most one container of messages is therefore held in memory at a time,
+ * independent of the total amount of messages.
+ *
+ * When @func returns %NULL, or the messages are cancelled with
+ * inf_communication_registry_cancel_messages(), @notify is called on
+ * @user_data.
+ */
+void
+inf_communication_registry_send_source(InfCommunicationRegistry* registry,
+                                       InfCommunicationGroup* group,
+                                       InfXmlConnection* connection,
+                                       InfCommunicationSourceFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify)
 {
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistrySource* source;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
-  g_return_if_fail(xml != NULL);
+  g_return_if_fail(func != NULL);
 
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
   key.connection = connection;
@@ -1015,29 +1810,109 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   entry = g_hash_table_lookup(priv->entries, &key);
   g_assert(entry != NULL && entry->registered == TRUE);
 
-  xmlUnlinkNode(xml);
+  source = g_slice_new(InfCommunicationRegistrySource);
+  source->placeholder = xmlNewNode(NULL, (const xmlChar*)"source");
+  source->func = func;
+  source->user_data = user_data;
+  source->notify = notify;
+
   if(entry->queue_end == NULL)
   {
-    entry->queue_begin = xml;
-    entry->queue_end = xml;
+    entry->queue_begin = source->placeholder;
+    entry->queue_end = source->placeholder;
   }
   else
   {
-    entry->queue_end->next = xml;
-    entry->queue_end = xml;
+    entry->queue_end->next = source->placeholder;
+    entry->queue_end = source->placeholder;
   }
 
-  /* If there is something in the inner queue, don't send directly but wait
-   * until the message has been sent, for better packing. */
+  g_queue_push_tail(&entry->sources, source);
+
+  /* A source typically produces enough messages to fill a container, so
+   * there is no point in waiting for more. */
   if(entry->inner_count == 0)
+    inf_communication_registry_send_real(entry, priv->max_batch_size);
+
+  g_free(key.publisher_id);
+}
+
+/**
+ * inf_communication_registry_flush:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send messages.
+ * @connection: (allow-none): A registered #InfXmlConnection, or %NULL.
+ *
+ * Sends the messages queued for @connection in @group right away instead of
+ * waiting for more messages to be sent with them, see
+ * #InfCommunicationRegistry:coalesce-time. If @connection is %NULL, the
+ * messages queued for all connections in @group are sent. This should be
+ * called after inf_communication_registry_send() for messages where latency
+ * matters. If previous messages are still being sent, the queued messages
+ * are sent as soon as these have been sent, independent of this function.
+ */
+void
+inf_communication_registry_flush(InfCommunicationRegistry* registry,
+                                 InfCommunicationGroup* group,
+                                 InfXmlConnection* connection)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+  InfXmlConnectionStatus status;
+  GList* item;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(connection == NULL || INF_IS_XML_CONNECTION(connection));
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  if(connection == NULL)
   {
-    inf_communication_registry_send_real(
-      entry,
-      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-    );
+    /* Only entries in the pending queue wait for the coalesce time. Sending
+     * can run callbacks that modify the pending queue, so start over after
+     * each entry. */
+    do
+    {
+      for(item = priv->pending.head; item != NULL; item = item->next)
+      {
+        entry = (InfCommunicationRegistryEntry*)item->data;
+        if(entry->group == group)
+          break;
+      }
+
+      if(item != NULL)
+      {
+        g_object_get(G_OBJECT(entry->key.connection), "status", &status, NULL);
+
+        if(status == INF_XML_CONNECTION_OPEN &&
+           entry->inner_count == 0 && entry->queue_begin != NULL)
+        {
+          inf_communication_registry_send_real(entry, priv->max_batch_size);
+        }
+        else
+        {
+          inf_communication_registry_unschedule(entry);
+        }
+      }
+    } while(item != NULL);
   }
+  else
+  {
+    key.connection = connection;
+    key.publisher_id =
+      inf_communication_group_get_publisher_id(group, connection);
+    key.group_name = inf_communication_group_get_name(group);
 
-  g_free(key.publisher_id);
+    entry = g_hash_table_lookup(priv->entries, &key);
+    g_assert(entry != NULL && entry->registered == TRUE);
+
+    if(entry->inner_count == 0 && entry->queue_begin != NULL)
+      inf_communication_registry_send_real(entry, priv->max_batch_size);
+
+    g_free(key.publisher_id);
+  }
 }
 
 /**
@@ -1072,9 +1947,9 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   /* TODO: Don't cancel messages prior activation? */
-  xmlFreeNodeList(entry->queue_begin);
-  entry->queue_begin = NULL;
-  entry->queue_end = NULL;
+  inf_communication_registry_clear_queue(entry);
+
+  inf_communication_registry_unschedule(entry);
 
   g_free(key.publisher_id);
 }
@@ -83,6 +83,26 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml);
 
+void
+inf_communication_registry_send_all(InfCommunicationRegistry* registry,
+                                    InfCommunicationGroup* group,
+                                    GSList* connections,
+                                    InfXmlConnection* except,
+                                    xmlNodePtr xml);
+
+void
+inf_communication_registry_send_source(InfCommunicationRegistry* registry,
+                                       InfCommunicationGroup* group,
+                                       InfXmlConnection* connection,
+                                       InfCommunicationSourceFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify);
+
+void
+inf_communication_registry_flush(InfCommunicationRegistry* registry,
+                                 InfCommunicationGroup* group,
+                                 InfXmlConnection* connection);
+
 void
 inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
@@ -59,6 +59,9 @@ typedef enum _InfdDirectoryNodeType {
   INFD_DIRECTORY_NODE_UNKNOWN,
 } InfdDirectoryNodeType;
 
+typedef struct _InfdDirectoryExplore InfdDirectoryExplore;
+typedef struct _InfdDirectorySessionSave InfdDirectorySessionSave;
+
 typedef struct _InfdDirectoryNode InfdDirectoryNode;
 struct _InfdDirectoryNode {
   InfdDirectoryNode* parent;
@@ -80,6 +83,8 @@ struct _InfdDirectoryNode {
       const InfdNotePlugin* plugin;
       /* Timeout to save the session when inactive for some time */
       InfIoTimeout* save_timeout;
+      /* Save of the inactive session in progress, or NULL */
+      InfdDirectorySessionSave* save;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
     } note;
@@ -99,10 +104,46 @@ struct _InfdDirectoryNode {
        * This is required because the nodes field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
       gboolean explored;
+      /* Exploration that is reading the node from the storage, or NULL */
+      InfdDirectoryExplore* explore;
     } subdir;
   } shared;
 };
 
+/* A connection that waits for an exploration to finish */
+typedef struct _InfdDirectoryExploreReply InfdDirectoryExploreReply;
+struct _InfdDirectoryExploreReply {
+  InfXmlConnection* connection;
+  gchar* seq;
+};
+
+typedef struct _InfdDirectoryExploreChild InfdDirectoryExploreChild;
+struct _InfdDirectoryExploreChild {
+  InfdDirectoryExplore* explore;
+  InfdStorageNode* storage_node;
+  gchar* path;
+  /* Pending read of the ACL of this child, or NULL */
+  InfdStorageRequest* request;
+  GSList* acl;
+};
+
+/* Subdirectory and ACLs of its children are read from the storage in the
+ * I/O thread pool, and the directory tree is filled once all are available,
+ * so that a slow storage does not block the main thread. */
+struct _InfdDirectoryExplore {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdProgressRequest* request;
+  GSList* replies;
+
+  /* Pending read of the subdirectory listing, or NULL */
+  InfdStorageRequest* list_request;
+  /* One entry for each node in the subdirectory, once it has been read */
+  InfdDirectoryExploreChild* children;
+  guint n_children;
+  guint n_pending;
+};
+
 typedef struct _InfdDirectorySessionSaveTimeoutData
   InfdDirectorySessionSaveTimeoutData;
 struct _InfdDirectorySessionSaveTimeoutData {
@@ -110,6 +151,14 @@ struct _InfdDirectorySessionSaveTimeoutData {
   InfdDirectoryNode* node;
 };
 
+/* The session is written in the I/O thread pool if the note plugin supports
+ * it, and dropped from memory once it has been written. */
+struct _InfdDirectorySessionSave {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdStorageRequest* request;
+};
+
 typedef struct _InfdDirectorySyncIn InfdDirectorySyncIn;
 struct _InfdDirectorySyncIn {
   InfdDirectory* directory;
@@ -205,6 +254,7 @@ struct _InfdDirectoryPrivate {
 
   GSList* sync_ins;
   GSList* subscription_requests;
+  GSList* explores;
 
   InfdSessionProxy* chat_session;
 };
@@ -384,68 +434,197 @@ infd_directory_session_save_timeout_data_free(gpointer data)
 }
 
 static void
-infd_directory_session_save_timeout_func(gpointer user_data)
+infd_directory_session_save_cancel(InfdDirectoryNode* node)
+{
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save != NULL);
+
+  /* The session is still written, only the result is discarded */
+  infd_storage_request_cancel(node->shared.note.save->request);
+  g_slice_free(InfdDirectorySessionSave, node->shared.note.save);
+  node->shared.note.save = NULL;
+}
+
+static void
+infd_directory_session_save_done(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 const GError* error)
+{
+  gchar* path;
+
+  if(error != NULL)
+  {
+    infd_directory_node_get_path(node, &path, NULL);
+
+    g_warning(
+      _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+        "save attempt will be made when the server is shut down."),
+      path,
+      error->message
+    );
+
+    g_free(path);
+  }
+  else
+  {
+    infd_directory_node_unlink_session(directory, node, NULL);
+  }
+}
+
+static void
+infd_directory_session_save_finished_func(InfdStorage* storage,
+                                          const GError* error,
+                                          gpointer user_data)
+{
+  InfdDirectorySessionSave* save;
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+
+  save = (InfdDirectorySessionSave*)user_data;
+  directory = save->directory;
+  node = save->node;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save == save);
+
+  g_slice_free(InfdDirectorySessionSave, save);
+  node->shared.note.save = NULL;
+
+  infd_directory_session_save_done(directory, node, error);
+}
+
+static gboolean
+infd_directory_session_saved_func(InfdStorage* storage,
+                                  gpointer run_data,
+                                  GError** error)
+{
+  /* The session has been written already, only report the result */
+  return TRUE;
+}
+
+/* Writes the session of node without blocking if the note plugin supports
+ * it, and calls func once done. Otherwise, the session is written right
+ * away, and only the result is reported later. */
+static InfdStorageRequest*
+infd_directory_node_save_session_async(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error)
 {
-  InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
-  GError* error;
+  const InfdNotePlugin* plugin;
+  InfdStorageRequest* request;
   gchar* path;
-  gboolean result;
   InfSession* session;
+  gboolean result;
 
-  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  plugin = node->shared.note.plugin;
 
-  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
-  priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
-  error = NULL;
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+  g_assert(priv->storage != NULL);
 
-  infd_directory_node_get_path(timeout_data->node, &path, NULL);
+  infd_directory_node_get_path(node, &path, NULL);
 
   g_object_get(
-    G_OBJECT(timeout_data->node->shared.note.session),
+    G_OBJECT(node->shared.note.session),
     "session", &session,
     NULL
   );
 
-  /* TODO: Only write if the buffer modified-flag is set */
+  if(plugin->session_write_async != NULL)
+  {
+    request = plugin->session_write_async(
+      priv->storage,
+      priv->io,
+      session,
+      path,
+      plugin->user_data,
+      func,
+      user_data,
+      error
+    );
+  }
+  else
+  {
+    result = plugin->session_write(
+      priv->storage,
+      session,
+      path,
+      plugin->user_data,
+      error
+    );
 
-  result = timeout_data->node->shared.note.plugin->session_write(
-    priv->storage,
-    session,
-    path,
-    timeout_data->node->shared.note.plugin->user_data,
-    &error
-  );
+    request = NULL;
+    if(result == TRUE)
+    {
+      request = infd_storage_run_async(
+        priv->storage,
+        priv->io,
+        infd_directory_session_saved_func,
+        NULL,
+        NULL,
+        func,
+        user_data,
+        error
+      );
+    }
+  }
 
   g_object_unref(session);
+  g_free(path);
 
-  /* TODO: Unset modified flag of buffer if result == TRUE */
+  return request;
+}
+
+static void
+infd_directory_session_save_timeout_func(gpointer user_data)
+{
+  InfdDirectorySessionSaveTimeoutData* timeout_data;
+  InfdDirectoryNode* node;
+  InfdDirectorySessionSave* save;
+  GError* error;
+
+  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
+  node = timeout_data->node;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save_timeout != NULL);
+  g_assert(node->shared.note.save == NULL);
 
   /* The timeout is removed automatically after it has elapsed */
-  timeout_data->node->shared.note.save_timeout = NULL;
+  node->shared.note.save_timeout = NULL;
 
-  if(result == FALSE)
-  {
-    g_warning(
-      _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
-        "save attempt will be made when the server is shut down."),
-      path,
-      error->message
-    );
+  /* TODO: Only write if the buffer modified-flag is set */
+
+  save = g_slice_new(InfdDirectorySessionSave);
+  save->directory = timeout_data->directory;
+  save->node = node;
+  error = NULL;
+
+  save->request = infd_directory_node_save_session_async(
+    timeout_data->directory,
+    node,
+    infd_directory_session_save_finished_func,
+    save,
+    &error
+  );
 
+  if(save->request == NULL)
+  {
+    g_slice_free(InfdDirectorySessionSave, save);
+    infd_directory_session_save_done(timeout_data->directory, node, error);
     g_error_free(error);
   }
   else
   {
-    infd_directory_node_unlink_session(
-      timeout_data->directory,
-      timeout_data->node,
-      NULL
-    );
+    node->shared.note.save = save;
   }
 
-  g_free(path);
+  /* TODO: Unset modified flag of buffer once the session has been
+   * written */
 }
 
 static void
@@ -482,6 +661,7 @@ infd_directory_session_weak_ref_cb(gpointer data,
   g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
   g_assert(node->shared.note.weakref == TRUE);
   g_assert(node->shared.note.save_timeout == NULL);
+  g_assert(node->shared.note.save == NULL);
 
   node->shared.note.session = NULL;
   node->shared.note.weakref = FALSE;
@@ -507,7 +687,8 @@ infd_directory_session_idle_notify_cb(GObject* object,
   if(infd_session_proxy_is_idle(INFD_SESSION_PROXY(object)))
   {
     if(node->shared.note.weakref == FALSE &&
-       node->shared.note.save_timeout == NULL)
+       node->shared.note.save_timeout == NULL &&
+       node->shared.note.save == NULL)
     {
       infd_directory_start_session_save_timeout(directory, node);
     }
@@ -519,6 +700,7 @@ infd_directory_session_idle_notify_cb(GObject* object,
     {
       g_object_ref(node->shared.note.session);
       g_assert(node->shared.note.save_timeout == NULL);
+      g_assert(node->shared.note.save == NULL);
       node->shared.note.weakref = FALSE;
 
       g_object_weak_unref(
@@ -532,6 +714,10 @@ infd_directory_session_idle_notify_cb(GObject* object,
       inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
       node->shared.note.save_timeout = NULL;
     }
+    else if(node->shared.note.save != NULL)
+    {
+      infd_directory_session_save_cancel(node);
+    }
   }
 }
 
@@ -610,6 +796,9 @@ infd_directory_release_session(InfdDirectory* directory,
     node->shared.note.save_timeout = NULL;
   }
 
+  if(node->shared.note.save != NULL)
+    infd_directory_session_save_cancel(node);
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(session),
     G_CALLBACK(infd_directory_session_idle_notify_cb),
@@ -1404,23 +1593,21 @@ infd_directory_verify_all_acls(InfdDirectory* directory,
     g_hash_table_destroy(own_table);
 }
 
-/* node can be NULL. If node is not NULL, additional sheets are returned
- * which correspond to erasure of the current ACL for the node. This allows
- * the ACL change to be performed atomically on the node.
+/* Creates a sheet set from the ACL that has been read from the storage for
+ * the node at path. node can be NULL. If node is not NULL, additional sheets
+ * are returned which correspond to erasure of the current ACL for the node.
+ * This allows the ACL change to be performed atomically on the node.
  *
  * The verify_accounts table is a cache when verifying whether the accounts
  * present in the sheet exist or not. */
 static InfAclSheetSet*
-infd_directory_read_acl(InfdDirectory* directory,
-                        const gchar* path,
-                        InfdDirectoryNode* node,
-                        GHashTable* verify_accounts,
-                        GError** error)
+infd_directory_acl_from_storage(InfdDirectory* directory,
+                                const gchar* path,
+                                InfdDirectoryNode* node,
+                                GSList* acl,
+                                GHashTable* verify_accounts)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  GError* local_error;
-  GSList* acl;
   GSList* item;
   InfdStorageAcl* storage_acl;
   InfAclSheetSet* sheet_set;
@@ -1430,17 +1617,6 @@ infd_directory_read_acl(InfdDirectory* directory,
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(priv->storage != NULL);
-
-  local_error = NULL;
-  acl = infd_storage_read_acl(priv->storage, path, &local_error);
-
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
-
   /* If there are any ACLs set already for this node, then clear them. This
    * should usually not happen because we only call this function for new
    * nodes, but it can happen when the storage is changed on the fly and the
@@ -1464,8 +1640,6 @@ infd_directory_read_acl(InfdDirectory* directory,
     sheet->perms = storage_acl->perms;
   }
 
-  infd_storage_acl_list_free(acl);
-
   if(priv->account_storage != NULL)
   {
     verify_sheets = infd_directory_verify_acl(
@@ -1490,6 +1664,45 @@ infd_directory_read_acl(InfdDirectory* directory,
   return sheet_set;
 }
 
+/* Reads the ACL for the node at path synchronously, see
+ * infd_directory_acl_from_storage(). */
+static InfAclSheetSet*
+infd_directory_read_acl(InfdDirectory* directory,
+                        const gchar* path,
+                        InfdDirectoryNode* node,
+                        GHashTable* verify_accounts,
+                        GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  GError* local_error;
+  GSList* acl;
+  InfAclSheetSet* sheet_set;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+
+  local_error = NULL;
+  acl = infd_storage_read_acl(priv->storage, path, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  sheet_set = infd_directory_acl_from_storage(
+    directory,
+    path,
+    node,
+    acl,
+    verify_accounts
+  );
+
+  infd_storage_acl_list_free(acl);
+  return sheet_set;
+}
+
 static void
 infd_directory_report_support(InfdDirectory* directory,
                               gboolean* add_account,
@@ -2226,6 +2439,7 @@ infd_directory_node_new_subdirectory(InfdDirectory* directory,
   node->shared.subdir.connections = NULL;
   node->shared.subdir.child = NULL;
   node->shared.subdir.explored = FALSE;
+  node->shared.subdir.explore = NULL;
 
   return node;
 }
@@ -2254,6 +2468,7 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.session = NULL;
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
+  node->shared.note.save = NULL;
   node->shared.note.weakref = FALSE;
 
   return node;
@@ -2295,6 +2510,10 @@ static void
 infd_directory_remove_subreq(InfdDirectory* directory,
                              InfdDirectorySubreq* request);
 
+static void
+infd_directory_explore_fail(InfdDirectoryExplore* explore,
+                            const GError* error);
+
 static void
 infd_directory_node_free(InfdDirectory* directory,
                          InfdDirectoryNode* node)
@@ -2302,6 +2521,7 @@ infd_directory_node_free(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfBrowserIter iter;
   gboolean removed;
+  GError* error;
 
   GSList* item;
   GSList* next;
@@ -2316,6 +2536,21 @@ infd_directory_node_free(InfdDirectory* directory,
   switch(node->type)
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    if(node->shared.subdir.explore != NULL)
+    {
+      error = NULL;
+
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_NO_SUCH_NODE)
+      );
+
+      infd_directory_explore_fail(node->shared.subdir.explore, error);
+      g_error_free(error);
+    }
+
     g_slist_free(node->shared.subdir.connections);
 
     /* Free child nodes */
@@ -4307,111 +4542,50 @@ infd_directory_node_is_name_available(InfdDirectory* directory,
   return TRUE;
 }
 
-static gboolean
-infd_directory_node_explore(InfdDirectory* directory,
-                            InfdDirectoryNode* node,
-                            InfdProgressRequest* request,
-                            GError** error)
+/* Returns the storage path of the child called name of the node whose
+ * storage path is path. */
+static gchar*
+infd_directory_get_child_path(const gchar* path,
+                              gsize len,
+                              const gchar* name)
+{
+  g_assert(len > 0);
+
+  if(path[len - 1] == '/')
+    return g_strconcat(path, name, NULL);
+  else
+    return g_strconcat(path, "/", name, NULL);
+}
+
+/* Fills the directory tree of node with the nodes in list, with the ACL of
+ * the i-th node in the i-th sheet set in acls. Takes ownership of both. */
+static void
+infd_directory_node_explore_fill(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdProgressRequest* request,
+                                 GSList* list,
+                                 GPtrArray* acls)
 {
   InfdDirectoryPrivate* priv;
   InfdStorageNode* storage_node;
   InfdDirectoryNode* new_node;
   InfBrowserIter iter;
   InfdNotePlugin* plugin;
-  GError* local_error;
-  GSList* list;
   InfAclSheetSet* sheet_set;
-  GPtrArray* acls;
-  GHashTable* verify_table;
   GSList* item;
-  gchar* path;
-  gsize len;
-  gsize node_len;
-  gsize sep_len;
-  gsize path_len;
   guint index;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(priv->storage != NULL);
-  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
   g_assert(node->shared.subdir.explored == FALSE);
+  node->shared.subdir.explored = TRUE;
 
-  local_error = NULL;
-  infd_directory_node_get_path(node, &path, &len);
-  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
+  if(request != NULL) infd_progress_request_initiated(request, acls->len);
 
-  if(local_error != NULL)
-  {
-    g_free(path);
-    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
-
-  /* First pass: Count the total number of items and read the ACLs for each
-   * node. If there is a problem reading the ACL for one node, cancel the
-   * full exploration. */
-  path_len = len;
-  acls = g_ptr_array_sized_new(16);
-  verify_table = g_hash_table_new(NULL, NULL);
-  for(item = list; item != NULL; item = g_slist_next(item))
-  {
-    storage_node = (InfdStorageNode*)item->data;
-
-    /* Construct the storage path for this node */
-    node_len = strlen(storage_node->name);
-
-    sep_len = 1;
-    if(path[len - 1] == '/') sep_len = 0;
-
-    if(len + sep_len + node_len < path_len)
-    {
-      path_len = len + sep_len + node_len;
-      path = g_realloc(path, path_len + sep_len);
-    }
-
-    if(sep_len > 0)
-      path[len] = '/';
-
-    memcpy(path + len + sep_len, storage_node->name, node_len + 1);
-
-    /* Read ACL */
-    sheet_set = infd_directory_read_acl(
-      directory,
-      path,
-      NULL,
-      verify_table,
-      &local_error
-    );
-
-    if(local_error != NULL)
-    {
-      for(index = 0; index < acls->len; ++index)
-        inf_acl_sheet_set_free(g_ptr_array_index(acls, index));
-      g_ptr_array_free(acls, TRUE);
-      g_hash_table_destroy(verify_table);
-      infd_storage_node_list_free(list);
-      g_free(path);
-      if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
-
-    g_ptr_array_add(acls, sheet_set);
-  }
-
-  g_hash_table_destroy(verify_table);
-  node->shared.subdir.explored = TRUE;
-
-  g_free(path);
-  if(request != NULL) infd_progress_request_initiated(request, acls->len);
-
-  /* Second pass, fill the directory tree */
-  index = 0;
-  for(item = list, index = 0;
-      item != NULL;
-      item = g_slist_next(item), ++index)
+  index = 0;
+  for(item = list, index = 0;
+      item != NULL;
+      item = g_slist_next(item), ++index)
   {
     storage_node = (InfdStorageNode*)item->data;
     sheet_set = (InfAclSheetSet*)g_ptr_array_index(acls, index);
@@ -4492,22 +4666,468 @@ infd_directory_node_explore(InfdDirectory* directory,
 
   g_ptr_array_free(acls, TRUE);
 
-  if(request != NULL)
+  if(request != NULL)
+  {
+    iter.node_id = node->id;
+    iter.node = node;
+
+    inf_request_finish(
+      INF_REQUEST(request),
+      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
+    );
+  }
+
+  infd_storage_node_list_free(list);
+}
+
+/* Reads the node from the storage synchronously. This is only used when
+ * the storage is replaced and the root node needs to be re-explored
+ * immediately, see infd_directory_set_storage(). Otherwise nodes are
+ * explored with infd_directory_explore_new(). */
+static gboolean
+infd_directory_node_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfdProgressRequest* request,
+                            GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdStorageNode* storage_node;
+  GError* local_error;
+  GSList* list;
+  InfAclSheetSet* sheet_set;
+  GPtrArray* acls;
+  GHashTable* verify_table;
+  GSList* item;
+  gchar* path;
+  gchar* child_path;
+  gsize len;
+  guint index;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
+
+  local_error = NULL;
+  infd_directory_node_get_path(node, &path, &len);
+  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_free(path);
+    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  /* First pass: Count the total number of items and read the ACLs for each
+   * node. If there is a problem reading the ACL for one node, cancel the
+   * full exploration. */
+  acls = g_ptr_array_sized_new(16);
+  verify_table = g_hash_table_new(NULL, NULL);
+  for(item = list; item != NULL; item = g_slist_next(item))
+  {
+    storage_node = (InfdStorageNode*)item->data;
+    child_path = infd_directory_get_child_path(path, len, storage_node->name);
+
+    /* Read ACL */
+    sheet_set = infd_directory_read_acl(
+      directory,
+      child_path,
+      NULL,
+      verify_table,
+      &local_error
+    );
+
+    g_free(child_path);
+
+    if(local_error != NULL)
+    {
+      for(index = 0; index < acls->len; ++index)
+        inf_acl_sheet_set_free(g_ptr_array_index(acls, index));
+      g_ptr_array_free(acls, TRUE);
+      g_hash_table_destroy(verify_table);
+      infd_storage_node_list_free(list);
+      g_free(path);
+      if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    g_ptr_array_add(acls, sheet_set);
+  }
+
+  g_hash_table_destroy(verify_table);
+  g_free(path);
+
+  infd_directory_node_explore_fill(directory, node, request, list, acls);
+  return TRUE;
+}
+
+static void
+infd_directory_explore_reset(InfdDirectoryExplore* explore)
+{
+  InfdDirectoryExploreChild* child;
+  guint i;
+
+  if(explore->list_request != NULL)
+  {
+    infd_storage_request_cancel(explore->list_request);
+    explore->list_request = NULL;
+  }
+
+  for(i = 0; i < explore->n_children; ++i)
+  {
+    child = &explore->children[i];
+
+    if(child->request != NULL)
+      infd_storage_request_cancel(child->request);
+    if(child->storage_node != NULL)
+      infd_storage_node_free(child->storage_node);
+
+    infd_storage_acl_list_free(child->acl);
+    g_free(child->path);
+  }
+
+  g_free(explore->children);
+  explore->children = NULL;
+  explore->n_children = 0;
+  explore->n_pending = 0;
+}
+
+static void
+infd_directory_explore_free(InfdDirectoryExplore* explore)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+
+  infd_directory_explore_reset(explore);
+
+  for(item = explore->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+    g_free(reply->seq);
+    g_slice_free(InfdDirectoryExploreReply, reply);
+  }
+
+  g_slist_free(explore->replies);
+
+  if(explore->request != NULL)
+    g_object_unref(explore->request);
+
+  explore->node->shared.subdir.explore = NULL;
+  priv->explores = g_slist_remove(priv->explores, explore);
+  g_slice_free(InfdDirectoryExplore, explore);
+}
+
+static void
+infd_directory_explore_fail(InfdDirectoryExplore* explore,
+                            const GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdProgressRequest* request;
+  InfdDirectoryExploreReply* reply;
+  xmlNodePtr reply_xml;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+
+  for(item = explore->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+
+    reply_xml = inf_xml_util_new_node_from_error(
+      (GError*)error,
+      NULL,
+      "request-failed"
+    );
+
+    if(reply->seq != NULL)
+      inf_xml_util_set_attribute(reply_xml, "seq", reply->seq);
+
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      reply->connection,
+      reply_xml
+    );
+  }
+
+  /* Free the exploration before failing the request, so that the node can
+   * be explored again from within a signal handler. */
+  request = explore->request;
+  explore->request = NULL;
+  infd_directory_explore_free(explore);
+
+  if(request != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), error);
+    g_object_unref(request);
+  }
+}
+
+static void
+infd_directory_send_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfXmlConnection* connection,
+                            const gchar* seq);
+
+static void
+infd_directory_explore_finish(InfdDirectoryExplore* explore)
+{
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdDirectoryExploreChild* child;
+  InfdDirectoryExploreReply* reply;
+  InfdProgressRequest* request;
+  GSList* replies;
+  GSList* list;
+  GPtrArray* acls;
+  GHashTable* verify_table;
+  GSList* item;
+  guint i;
+
+  directory = explore->directory;
+  node = explore->node;
+
+  list = NULL;
+  acls = g_ptr_array_sized_new(explore->n_children);
+  verify_table = g_hash_table_new(NULL, NULL);
+
+  for(i = 0; i < explore->n_children; ++i)
+  {
+    child = &explore->children[i];
+
+    list = g_slist_prepend(list, child->storage_node);
+    child->storage_node = NULL;
+
+    g_ptr_array_add(
+      acls,
+      infd_directory_acl_from_storage(
+        directory,
+        child->path,
+        NULL,
+        child->acl,
+        verify_table
+      )
+    );
+  }
+
+  g_hash_table_destroy(verify_table);
+  list = g_slist_reverse(list);
+
+  request = explore->request;
+  replies = explore->replies;
+  explore->request = NULL;
+  explore->replies = NULL;
+  infd_directory_explore_free(explore);
+
+  infd_directory_node_explore_fill(directory, node, request, list, acls);
+
+  for(item = replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+
+    infd_directory_send_explore(
+      directory,
+      node,
+      reply->connection,
+      reply->seq
+    );
+
+    g_free(reply->seq);
+    g_slice_free(InfdDirectoryExploreReply, reply);
+  }
+
+  g_slist_free(replies);
+  if(request != NULL) g_object_unref(request);
+}
+
+static void
+infd_directory_explore_acl_cb(InfdStorage* storage,
+                              GSList* acl,
+                              const GError* error,
+                              gpointer user_data)
+{
+  InfdDirectoryExploreChild* child;
+  InfdDirectoryExplore* explore;
+
+  child = (InfdDirectoryExploreChild*)user_data;
+  explore = child->explore;
+  child->request = NULL;
+
+  if(error != NULL)
+  {
+    infd_directory_explore_fail(explore, error);
+  }
+  else
+  {
+    child->acl = g_slist_copy_deep(
+      acl,
+      (GCopyFunc)infd_storage_acl_copy,
+      NULL
+    );
+
+    --explore->n_pending;
+    if(explore->n_pending == 0)
+      infd_directory_explore_finish(explore);
+  }
+}
+
+static void
+infd_directory_explore_list_cb(InfdStorage* storage,
+                               GSList* nodes,
+                               const GError* error,
+                               gpointer user_data)
+{
+  InfdDirectoryExplore* explore;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploreChild* child;
+  GError* local_error;
+  GSList* item;
+  gchar* path;
+  gsize len;
+  guint i;
+
+  explore = (InfdDirectoryExplore*)user_data;
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  explore->list_request = NULL;
+
+  if(error != NULL)
+  {
+    infd_directory_explore_fail(explore, error);
+    return;
+  }
+
+  explore->n_children = g_slist_length(nodes);
+  explore->children = g_new(InfdDirectoryExploreChild, explore->n_children);
+
+  infd_directory_node_get_path(explore->node, &path, &len);
+  for(item = nodes, i = 0; item != NULL; item = item->next, ++i)
+  {
+    child = &explore->children[i];
+    child->explore = explore;
+    child->storage_node = infd_storage_node_copy(item->data);
+    child->path = infd_directory_get_child_path(
+      path,
+      len,
+      child->storage_node->name
+    );
+
+    child->request = NULL;
+    child->acl = NULL;
+  }
+
+  g_free(path);
+
+  /* Read the ACLs of all children concurrently. If there is a problem
+   * reading the ACL for one of them, the whole exploration fails. */
+  for(i = 0; i < explore->n_children; ++i)
+  {
+    child = &explore->children[i];
+    local_error = NULL;
+
+    child->request = infd_storage_read_acl_async(
+      priv->storage,
+      priv->io,
+      child->path,
+      infd_directory_explore_acl_cb,
+      child,
+      &local_error
+    );
+
+    if(local_error != NULL)
+    {
+      infd_directory_explore_fail(explore, local_error);
+      g_error_free(local_error);
+      return;
+    }
+
+    ++explore->n_pending;
+  }
+
+  if(explore->n_pending == 0)
+    infd_directory_explore_finish(explore);
+}
+
+static gboolean
+infd_directory_explore_start(InfdDirectoryExplore* explore,
+                             GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  gchar* path;
+  gsize len;
+
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  g_assert(priv->storage != NULL);
+  g_assert(explore->list_request == NULL);
+  g_assert(explore->n_children == 0);
+
+  infd_directory_node_get_path(explore->node, &path, &len);
+
+  explore->list_request = infd_storage_read_subdirectory_async(
+    priv->storage,
+    priv->io,
+    path,
+    infd_directory_explore_list_cb,
+    explore,
+    error
+  );
+
+  g_free(path);
+  return explore->list_request != NULL;
+}
+
+/* Starts to explore node in the background. Connections waiting for the
+ * result can be added to the replies of the returned exploration. If the
+ * exploration cannot be started, request is failed, error is set and NULL
+ * is returned. */
+static InfdDirectoryExplore*
+infd_directory_explore_new(InfdDirectory* directory,
+                           InfdDirectoryNode* node,
+                           InfdProgressRequest* request,
+                           GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExplore* explore;
+  GError* local_error;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
+  g_assert(node->shared.subdir.explore == NULL);
+
+  explore = g_slice_new(InfdDirectoryExplore);
+  explore->directory = directory;
+  explore->node = node;
+  explore->request = request;
+  explore->replies = NULL;
+  explore->list_request = NULL;
+  explore->children = NULL;
+  explore->n_children = 0;
+  explore->n_pending = 0;
+
+  if(request != NULL)
+    g_object_ref(request);
+
+  node->shared.subdir.explore = explore;
+  priv->explores = g_slist_prepend(priv->explores, explore);
+
+  local_error = NULL;
+  if(!infd_directory_explore_start(explore, &local_error))
   {
-    iter.node_id = node->id;
-    iter.node = node;
-
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
-    );
+    infd_directory_explore_fail(explore, local_error);
+    g_propagate_error(error, local_error);
+    return NULL;
   }
 
-  infd_storage_node_list_free(list);
-
-  return TRUE;
+  return explore;
 }
-
 static InfdDirectoryNode*
 infd_directory_node_add_subdirectory(InfdDirectory* directory,
                                      InfdDirectoryNode* parent,
@@ -5562,86 +6182,20 @@ infd_directory_get_node_from_xml_typed(InfdDirectory* directory,
   return node;
 }
 
-static gboolean
-infd_directory_handle_explore_node(InfdDirectory* directory,
-                                   InfXmlConnection* connection,
-                                   const xmlNodePtr xml,
-                                   GError** error)
+static void
+infd_directory_send_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfXmlConnection* connection,
+                            const gchar* seq)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  InfAclMask perms;
-  GSList* item;
-  InfdProgressRequest* request;
-  InfBrowserIter iter;
-  GError* local_error;
   InfdDirectoryNode* child;
   xmlNodePtr reply_xml;
-  gchar* seq;
   guint total;
-  const InfAclSheetSet* sheet_set;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  node = infd_directory_get_node_from_xml_typed(
-    directory,
-    xml,
-    "id",
-    INFD_DIRECTORY_NODE_SUBDIRECTORY,
-    error
-  );
-
-  if(node == NULL) return FALSE;
-
-  inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
-  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
-    return FALSE;
-
-  if(node->shared.subdir.explored == FALSE)
-  {
-    request = INFD_PROGRESS_REQUEST(
-      g_object_new(
-        INFD_TYPE_PROGRESS_REQUEST,
-        "type", "explore-node",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
-    );
-
-    iter.node_id = node->id;
-    iter.node = node;
-    inf_browser_begin_request(
-      INF_BROWSER(directory),
-      &iter,
-      INF_REQUEST(request)
-    );
-
-    local_error = NULL;
-    infd_directory_node_explore(directory, node, request, &local_error);
-    g_object_unref(request);
-
-    if(local_error != NULL)
-    {
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
-  }
-
-  if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
-  {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_ALREADY_EXPLORED,
-      inf_directory_strerror(INF_DIRECTORY_ERROR_ALREADY_EXPLORED)
-    );
-
-    return FALSE;
-  }
-
-  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
-    return FALSE;
+  g_assert(node->shared.subdir.explored == TRUE);
 
   total = 0;
   for(child = node->shared.subdir.child; child != NULL; child = child->next)
@@ -5698,8 +6252,108 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     node->shared.subdir.connections,
     connection
   );
+}
 
-  g_free(seq);
+static gboolean
+infd_directory_handle_explore_node(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const xmlNodePtr xml,
+                                   GError** error)
+{
+  InfdDirectoryNode* node;
+  InfAclMask perms;
+  GSList* item;
+  InfdProgressRequest* request;
+  InfBrowserIter iter;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryExploreReply* reply;
+  gchar* seq;
+
+  node = infd_directory_get_node_from_xml_typed(
+    directory,
+    xml,
+    "id",
+    INFD_DIRECTORY_NODE_SUBDIRECTORY,
+    error
+  );
+
+  if(node == NULL) return FALSE;
+
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
+  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
+    return FALSE;
+
+  explore = node->shared.subdir.explore;
+  if(explore != NULL)
+  {
+    for(item = explore->replies; item != NULL; item = item->next)
+      if(((InfdDirectoryExploreReply*)item->data)->connection == connection)
+        break;
+  }
+  else
+  {
+    item = g_slist_find(node->shared.subdir.connections, connection);
+  }
+
+  if(item != NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_ALREADY_EXPLORED,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_ALREADY_EXPLORED)
+    );
+
+    return FALSE;
+  }
+
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+    return FALSE;
+
+  if(node->shared.subdir.explored == TRUE)
+  {
+    infd_directory_send_explore(directory, node, connection, seq);
+    g_free(seq);
+    return TRUE;
+  }
+
+  /* The node is read from the storage in the background, and the reply is
+   * sent once that has finished. If another connection is exploring the
+   * node already, then wait for the same result. */
+  if(explore == NULL)
+  {
+    request = INFD_PROGRESS_REQUEST(
+      g_object_new(
+        INFD_TYPE_PROGRESS_REQUEST,
+        "type", "explore-node",
+        "node-id", node->id,
+        "requestor", connection,
+        NULL
+      )
+    );
+
+    iter.node_id = node->id;
+    iter.node = node;
+    inf_browser_begin_request(
+      INF_BROWSER(directory),
+      &iter,
+      INF_REQUEST(request)
+    );
+
+    explore = infd_directory_explore_new(directory, node, request, error);
+    g_object_unref(request);
+
+    if(explore == NULL)
+    {
+      g_free(seq);
+      return FALSE;
+    }
+  }
+
+  reply = g_slice_new(InfdDirectoryExploreReply);
+  reply->connection = connection;
+  reply->seq = seq;
+  explore->replies = g_slist_prepend(explore->replies, reply);
   return TRUE;
 }
 
@@ -6259,6 +6913,7 @@ infd_directory_handle_save_session(InfdDirectory* directory,
    * subscribed, however we just made sure that the connection the request
    * comes from is subscribed. */
   g_assert(node->shared.note.save_timeout == NULL);
+  g_assert(node->shared.note.save == NULL);
 
   g_free(path);
 
@@ -7816,6 +8471,9 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   InfXmlConnection* sync_in_connection;
   InfdDirectorySubreq* request;
   InfdDirectoryConnectionInfo* info;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryExploreReply* reply;
+  GSList* reply_item;
 
   directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -7852,6 +8510,26 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
       infd_directory_remove_subreq(directory, request);
   }
 
+  /* Do not send the result of explorations to this connection */
+  for(item = priv->explores; item != NULL; item = item->next)
+  {
+    explore = (InfdDirectoryExplore*)item->data;
+
+    for(reply_item = explore->replies;
+        reply_item != NULL;
+        reply_item = reply_item->next)
+    {
+      reply = (InfdDirectoryExploreReply*)reply_item->data;
+      if(reply->connection == connection)
+      {
+        explore->replies = g_slist_delete_link(explore->replies, reply_item);
+        g_free(reply->seq);
+        g_slice_free(InfdDirectoryExploreReply, reply);
+        break;
+      }
+    }
+  }
+
   if(priv->root != NULL)
   {
     if(priv->root->shared.subdir.explored == TRUE)
@@ -7924,6 +8602,8 @@ infd_directory_set_storage(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* child;
+  InfdDirectoryExplore* explore;
+  GSList* item;
   GError* error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -7957,6 +8637,11 @@ infd_directory_set_storage(InfdDirectory* directory,
     }
   }
 
+  /* Explorations that are still in progress read from the previous storage.
+   * Discard what they have read so far, and restart them below. */
+  for(item = priv->explores; item != NULL; item = item->next)
+    infd_directory_explore_reset((InfdDirectoryExplore*)item->data);
+
   if(priv->storage != NULL)
     g_object_unref(priv->storage);
 
@@ -7996,6 +8681,44 @@ infd_directory_set_storage(InfdDirectory* directory,
 
     g_object_ref(storage);
   }
+
+  /* Failing an exploration runs signal handlers which might start or cancel
+   * other explorations, so look for the next one that still needs to be
+   * restarted every time. */
+  do
+  {
+    for(item = priv->explores; item != NULL; item = item->next)
+    {
+      explore = (InfdDirectoryExplore*)item->data;
+      if(explore->list_request == NULL && explore->n_children == 0)
+        break;
+    }
+
+    if(item != NULL)
+    {
+      error = NULL;
+
+      if(storage == NULL)
+      {
+        g_set_error_literal(
+          &error,
+          inf_directory_error_quark(),
+          INF_DIRECTORY_ERROR_NO_STORAGE,
+          inf_directory_strerror(INF_DIRECTORY_ERROR_NO_STORAGE)
+        );
+      }
+      else
+      {
+        infd_directory_explore_start(explore, &error);
+      }
+
+      if(error != NULL)
+      {
+        infd_directory_explore_fail(explore, error);
+        g_error_free(error);
+      }
+    }
+  } while(item != NULL);
 }
 
 /* This function goes through the client list and changes the account of
@@ -8559,6 +9282,7 @@ infd_directory_init(InfdDirectory* directory)
   priv->orig_root_acl = NULL;
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
+  priv->explores = NULL;
 
   priv->chat_session = NULL;
 }
@@ -8676,8 +9400,11 @@ infd_directory_dispose(GObject* object)
     TRUE
   );
 
+  /* This also cancels all explorations in progress, which no longer have any
+   * connections waiting for them at this point. */
   infd_directory_set_storage(directory, NULL);
   infd_directory_set_account_storage(directory, NULL);
+  g_assert(priv->explores == NULL);
 
   g_assert(priv->root != NULL);
   infd_directory_node_free(directory, priv->root);
@@ -9133,6 +9860,9 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
       node->shared.note.save_timeout = NULL;
     }
 
+    if(node->shared.note.save != NULL)
+      infd_directory_session_save_cancel(node);
+
     g_object_weak_ref(
       G_OBJECT(node->shared.note.session),
       infd_directory_session_weak_ref_cb,
@@ -9263,6 +9993,7 @@ infd_directory_browser_explore(InfBrowser* browser,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfdProgressRequest* request;
+  InfdDirectoryExplore* explore;
 
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -9272,6 +10003,7 @@ infd_directory_browser_explore(InfBrowser* browser,
   node = (InfdDirectoryNode*)iter->node;
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY, NULL);
   g_return_val_if_fail(node->shared.subdir.explored == FALSE, NULL);
+  g_return_val_if_fail(node->shared.subdir.explore == NULL, NULL);
 
   request = g_object_new(
     INFD_TYPE_PROGRESS_REQUEST,
@@ -9293,15 +10025,14 @@ infd_directory_browser_explore(InfBrowser* browser,
 
   inf_browser_begin_request(browser, iter, INF_REQUEST(request));
 
-  infd_directory_node_explore(
-    directory,
-    node,
-    request,
-    NULL
-  );
-
+  /* The exploration keeps the request alive until it has finished */
+  explore = infd_directory_explore_new(directory, node, request, NULL);
   g_object_unref(request);
-  return NULL;
+
+  if(explore == NULL)
+    return NULL;
+
+  return INF_REQUEST(request);
 }
 
 static gboolean
@@ -9744,6 +10475,7 @@ infd_directory_browser_list_pending_requests(InfBrowser* browser,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfdDirectorySubreq* subreq;
+  InfdDirectoryExplore* explore;
   InfRequest* request;
   gchar* type;
   gboolean right_type;
@@ -9806,6 +10538,16 @@ infd_directory_browser_list_pending_requests(InfBrowser* browser,
     }
   }
 
+  if(iter != NULL && node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
+  {
+    explore = node->shared.subdir.explore;
+    if(explore != NULL && explore->request != NULL)
+    {
+      if(request_type == NULL || strcmp(request_type, "explore-node") == 0)
+        list = g_slist_prepend(list, explore->request);
+    }
+  }
+
   return list;
 }
 
@@ -10848,6 +11590,11 @@ infd_directory_set_certificate(InfdDirectory* directory,
  * not matter, and the plugin's @session_read and @session_write functions
  * will not be used (and can therefore be %NULL).
  *
+ * If the plugin provides @session_write_async, sessions that are no longer
+ * in use are written to the storage with it before they are dropped from
+ * memory, so that the directory keeps serving other sessions in the
+ * meanwhile.
+ *
  * Returns: Whether the plugin was added successfully.
  **/
 gboolean
@@ -10903,6 +11650,7 @@ infd_directory_add_plugin(InfdDirectory* directory,
       node->shared.note.session = NULL;
       node->shared.note.plugin = plugin;
       node->shared.note.save_timeout = NULL;
+      node->shared.note.save = NULL;
       node->shared.note.weakref = FALSE;
     }
   }
@@ -10971,6 +11719,7 @@ infd_directory_remove_plugin(InfdDirectory* directory,
       g_assert(node->shared.note.session == NULL);
       g_assert(node->shared.note.plugin == plugin);
       g_assert(node->shared.note.save_timeout == NULL);
+      g_assert(node->shared.note.save == NULL);
       g_assert(node->shared.note.weakref == FALSE);
 
       /* Then, change the type to unknown */
@@ -11356,6 +12105,68 @@ infd_directory_iter_save_session(InfdDirectory* directory,
   return result;
 }
 
+/**
+ * infd_directory_iter_save_session_async:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a note in @directory.
+ * @func: (scope async) (allow-none): Function to call when the session has
+ * been stored, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information.
+ *
+ * Stores the session the node @iter points to into the background storage,
+ * like infd_directory_iter_save_session(), but without blocking on the
+ * storage. The session is serialized right away, and written in a worker
+ * thread, if the note plugin for the session implements
+ * session_write_async. Otherwise the session is written right away. In
+ * both cases, @func is called later in the thread of the directory's
+ * #InfIo with the result.
+ *
+ * The returned request can be cancelled with infd_storage_request_cancel()
+ * as long as @func has not yet been called. If the session cannot be
+ * stored, @error is set and %NULL is returned, and @func is not called.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ */
+InfdStorageRequest*
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  infd_directory_return_val_if_iter_fail(directory, iter, NULL);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = (InfdDirectoryNode*)iter->node;
+  g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_NOTE, NULL);
+  g_return_val_if_fail(node->shared.note.session != NULL, NULL);
+
+  if(priv->storage == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      _("No background storage available")
+    );
+
+    return NULL;
+  }
+
+  return infd_directory_node_save_session_async(
+    directory,
+    node,
+    func,
+    user_data,
+    error
+  );
+}
+
 /**
  * infd_directory_enable_chat:
  * @directory: A #InfdDirectory.
@@ -149,6 +149,13 @@ infd_directory_iter_save_session(InfdDirectory* directory,
                                  const InfBrowserIter* iter,
                                  GError** error);
 
+InfdStorageRequest*
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
 void
 infd_directory_enable_chat(InfdDirectory* directory,
                            gboolean enable);
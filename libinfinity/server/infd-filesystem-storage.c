@@ -33,7 +33,9 @@
 #include <string.h>
 #include <errno.h>
 
-#ifndef G_OS_WIN32
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
 # include <sys/types.h>
 # include <sys/stat.h>
 # include <fcntl.h>
@@ -44,6 +46,26 @@
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+
+  /* Notes that are being written, see infd_filesystem_storage_begin_write().
+   * Protected by mutex, since writes happen in worker threads. */
+  GMutex mutex;
+  GCond cond;
+  GHashTable* writes;
+
+  /* Held while a directory is listed, and while files of a note are renamed
+   * or removed, see infd_filesystem_storage_lock_files(). */
+  GMutex files_mutex;
+};
+
+typedef struct _InfdFilesystemStorageWrite InfdFilesystemStorageWrite;
+struct _InfdFilesystemStorageWrite {
+  /* Number of writes begun and not yet ended */
+  guint ref_count;
+  /* Serial of the write begun most recently */
+  guint serial;
+  /* Whether one of the writes holds the lock for the note */
+  gboolean locked;
 };
 
 enum {
@@ -56,6 +78,15 @@ enum {
 
 static GQuark infd_filesystem_storage_error_quark;
 
+/* Files of a note with these suffixes appended to the note's identifier are
+ * removed together with the note. */
+static const gchar* const INFD_FILESYSTEM_STORAGE_NOTE_SUFFIXES[] = {
+  ".journal",
+  ".new",
+  ".tmp",
+  NULL
+};
+
 static void infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface);
 G_DEFINE_TYPE_WITH_CODE(InfdFilesystemStorage, infd_filesystem_storage, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdFilesystemStorage)
@@ -196,6 +227,7 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
 #else
   if(strcmp(mode, "r") == 0) open_mode = O_RDONLY;
   else if(strcmp(mode, "w") == 0) open_mode = O_CREAT | O_WRONLY | O_TRUNC;
+  else if(strcmp(mode, "a") == 0) open_mode = O_CREAT | O_WRONLY | O_APPEND;
   else g_assert_not_reached();
   fd = open(path, O_NOFOLLOW | open_mode, 0644);
   if(fd == -1)
@@ -330,6 +362,65 @@ infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
   return TRUE;
 }
 
+/* Removes a file, but it is not an error if it does not exist */
+static gboolean
+infd_filesystem_storage_unlink_impl(const gchar* path,
+                                    GError** error)
+{
+  int save_errno;
+
+  if(g_unlink(path) == -1)
+  {
+    save_errno = errno;
+    if(save_errno != ENOENT)
+    {
+      infd_filesystem_storage_system_error(save_errno, error);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Makes sure that changes to the entries of the directory containing the
+ * file at path, such as a rename, survive a crash of the operating system.
+ * There is no equivalent on Windows, where the metadata is journaled by the
+ * filesystem. */
+static gboolean
+infd_filesystem_storage_sync_directory_impl(const gchar* path,
+                                            GError** error)
+{
+#ifndef G_OS_WIN32
+  gchar* dirname;
+  int fd;
+  int save_errno;
+
+  dirname = g_path_get_dirname(path);
+  fd = open(dirname, O_RDONLY);
+  save_errno = errno;
+  g_free(dirname);
+
+  if(fd == -1)
+  {
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  /* Some filesystems do not support syncing directories, and report EINVAL
+   * for it. There is nothing more that can be done for them. */
+  if(fsync(fd) == -1 && errno != EINVAL)
+  {
+    save_errno = errno;
+    close(fd);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  close(fd);
+#endif
+  return TRUE;
+}
+
 static gchar*
 infd_filesystem_storage_get_acl_path(InfdFilesystemStorage* storage,
                                      const gchar* path,
@@ -358,6 +449,11 @@ infd_filesystem_storage_init(InfdFilesystemStorage* storage)
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   priv->root_directory = NULL;
+
+  g_mutex_init(&priv->mutex);
+  g_cond_init(&priv->cond);
+  g_mutex_init(&priv->files_mutex);
+  priv->writes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -371,6 +467,13 @@ infd_filesystem_storage_finalize(GObject* object)
 
   g_free(priv->root_directory);
 
+  /* Every write holds a reference on the storage until it has ended */
+  g_assert(g_hash_table_size(priv->writes) == 0);
+  g_hash_table_destroy(priv->writes);
+  g_mutex_clear(&priv->files_mutex);
+  g_cond_clear(&priv->cond);
+  g_mutex_clear(&priv->mutex);
+
   G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
 }
 
@@ -435,6 +538,7 @@ infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
   gchar* converted_name;
   gsize name_len;
   gchar* separator;
+  gchar* new_name;
 
   list = (GSList**)data;
   converted_name = g_filename_to_utf8(name, -1, NULL, &name_len, error);
@@ -453,6 +557,33 @@ infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
      * types starting with "Inf" are recognized, other files are
      * auxiliary files in the directory. */
     separator = g_strrstr_len(converted_name, name_len, ".");
+
+    /* A note whose first version was being written when the server went
+     * down might only exist as a ".new" file. It is listed under the note's
+     * identifier, and moved into place by the note plugin when the note is
+     * read. If the note itself exists, it is listed on its own. */
+    if(separator != NULL && strcmp(separator, ".new") == 0)
+    {
+      new_name = g_strndup(path, strlen(path) - 4);
+      if(g_file_test(new_name, G_FILE_TEST_EXISTS))
+      {
+        separator = NULL;
+      }
+      else
+      {
+        separator = g_strrstr_len(
+          converted_name,
+          separator - converted_name,
+          "."
+        );
+      }
+
+      g_free(new_name);
+
+      if(separator != NULL)
+        converted_name[name_len - 4] = '\0';
+    }
+
     if(separator != NULL && strncmp(separator + 1, "Inf", 3) == 0)
     {
       *separator = '\0';
@@ -494,6 +625,11 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
 
   list = NULL;
 
+  /* The list function looks at the ".new" file of a note and the note
+   * itself together, so make sure that a note is not replaced in another
+   * thread in between. */
+  g_mutex_lock(&priv->files_mutex);
+
   result = inf_file_util_list_directory(
     full_name,
     infd_filesystem_storage_storage_read_subdirectory_list_func,
@@ -501,6 +637,7 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
     error
   );
 
+  g_mutex_unlock(&priv->files_mutex);
   g_free(full_name);
 
   if(result == FALSE)
@@ -553,8 +690,9 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   gchar* converted_name;
   gchar* disk_name;
   gchar* full_name;
+  const gchar* const* suffix;
+  gboolean only_new;
   gboolean result;
-  int save_errno;
 
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
@@ -566,6 +704,18 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   if(converted_name == NULL)
     return FALSE;
 
+  /* Wait for a write of the note that is in progress, and make sure that
+   * writes which have begun before are not performed anymore, so that they
+   * do not bring back the note after it has been removed. */
+  if(identifier != NULL)
+  {
+    infd_filesystem_storage_lock_write(
+      fs_storage,
+      path,
+      infd_filesystem_storage_begin_write(fs_storage, path)
+    );
+  }
+
   if(identifier != NULL)
   {
     disk_name = g_strconcat(converted_name, ".", identifier, NULL);
@@ -578,7 +728,22 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, disk_name, NULL);
   if(disk_name != converted_name) g_free(disk_name);
 
-  result = inf_file_util_delete(full_name, error);
+  g_mutex_lock(&priv->files_mutex);
+
+  /* A note that only exists as a ".new" file, see
+   * infd_filesystem_storage_storage_read_subdirectory_list_func(), is
+   * removed together with the auxiliary files below. */
+  only_new = FALSE;
+  if(identifier != NULL && !g_file_test(full_name, G_FILE_TEST_EXISTS))
+  {
+    disk_name = g_strconcat(full_name, ".new", NULL);
+    only_new = g_file_test(disk_name, G_FILE_TEST_EXISTS);
+    g_free(disk_name);
+  }
+
+  result = TRUE;
+  if(only_new == FALSE)
+    result = inf_file_util_delete(full_name, error);
   g_free(full_name);
 
   if(result == TRUE)
@@ -587,19 +752,29 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
     full_name = g_build_filename(priv->root_directory, disk_name, NULL);
     g_free(disk_name);
 
-    if(g_unlink(full_name) == -1)
-    {
-      save_errno = errno;
-      if(save_errno != ENOENT)
-      {
-        infd_filesystem_storage_system_error(save_errno, error);
-        result = FALSE;
-      }
-    }
+    result = infd_filesystem_storage_unlink_impl(full_name, error);
+    g_free(full_name);
+  }
+
+  /* Also remove auxiliary files that belong to the note, see
+   * infd_filesystem_storage_rename(). */
+  for(suffix = INFD_FILESYSTEM_STORAGE_NOTE_SUFFIXES;
+      result == TRUE && identifier != NULL && *suffix != NULL;
+      ++suffix)
+  {
+    disk_name = g_strconcat(converted_name, ".", identifier, *suffix, NULL);
+    full_name = g_build_filename(priv->root_directory, disk_name, NULL);
+    g_free(disk_name);
 
+    result = infd_filesystem_storage_unlink_impl(full_name, error);
     g_free(full_name);
   }
 
+  g_mutex_unlock(&priv->files_mutex);
+
+  if(identifier != NULL)
+    infd_filesystem_storage_end_write(fs_storage, path);
+
   g_free(converted_name);
   return result;
 }
@@ -791,6 +966,16 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
   return TRUE;
 }
 
+static InfdStorageSupport
+infd_filesystem_storage_storage_get_support(InfdStorage* storage)
+{
+  /* The root directory is construct-only, the notes being written are
+   * protected by a mutex, and listing a directory does not overlap with
+   * replacing or removing a note, see
+   * infd_filesystem_storage_lock_files(). */
+  return INFD_STORAGE_SUPPORT_THREAD_SAFE;
+}
+
 static void
 infd_filesystem_storage_class_init(
   InfdFilesystemStorageClass* filesystem_storage_class)
@@ -832,6 +1017,8 @@ infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface)
     infd_filesystem_storage_storage_read_acl;
   iface->write_acl =
     infd_filesystem_storage_storage_write_acl;
+  iface->get_support =
+    infd_filesystem_storage_storage_get_support;
 }
 
 /**
@@ -910,13 +1097,15 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * @storage: A #InfdFilesystemStorage.
  * @identifier: The type of node to open.
  * @path: The path to open, in UTF-8.
- * @mode: Either "r" for reading or "w" for writing.
+ * @mode: Either "r" for reading, "w" for writing or "a" for appending.
  * @full_path: (out) (type filename) (transfer full): Return location
  * of the full filename, or %NULL.
  * @error: Location to store error information, if any.
  *
  * Opens a file in the given path within the storage's root directory. If
  * the file exists already, and @mode is set to "w", the file is overwritten.
+ * If @mode is set to "a", the file is created if it does not exist, and all
+ * data is written to the end of the file.
  *
  * If @full_path is not %NULL, then it will be set to a newly allocated
  * string which contains the full name of the opened file, in the Glib file
@@ -1078,6 +1267,305 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
   return result;
 }
 
+/**
+ * infd_filesystem_storage_rename:
+ * @storage: A #InfdFilesystemStorage.
+ * @identifier: The type of the file to rename.
+ * @path: The path of the file, in UTF-8.
+ * @new_identifier: The type under which to store the file.
+ * @error: Location to store error information, if any.
+ *
+ * Renames the file at @path with @identifier so that it is stored at the
+ * same path with @new_identifier. If such a file exists already, it is
+ * replaced. On POSIX systems the replacement is atomic, so a file can be
+ * written completely under a temporary identifier and then be moved into
+ * place without ever leaving a partially written file behind. The directory
+ * is synced after the rename, so that the rename survives a crash of the
+ * operating system. Sync the renamed file with
+ * infd_filesystem_storage_stream_sync() before closing it to make its
+ * content survive as well.
+ *
+ * Files whose identifier is the identifier of a note followed by
+ * ".journal", ".new" or ".tmp" are considered to belong to that note, and
+ * are removed together with it by infd_storage_remove_node(). Note plugins
+ * can use them for journals and for writing new versions of the note.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+infd_filesystem_storage_rename(InfdFilesystemStorage* storage,
+                               const gchar* identifier,
+                               const gchar* path,
+                               const gchar* new_identifier,
+                               GError** error)
+{
+  gchar* full_name;
+  gchar* new_full_name;
+  int save_errno;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(new_identifier != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  full_name = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_name == NULL)
+    return FALSE;
+
+  new_full_name = infd_filesystem_storage_get_path(
+    storage,
+    new_identifier,
+    path,
+    error
+  );
+
+  if(new_full_name == NULL)
+  {
+    g_free(full_name);
+    return FALSE;
+  }
+
+  result = TRUE;
+
+#ifdef G_OS_WIN32
+  /* rename() does not replace existing files on Windows */
+  result = infd_filesystem_storage_unlink_impl(new_full_name, error);
+#endif
+
+  if(result == TRUE && g_rename(full_name, new_full_name) == -1)
+  {
+    save_errno = errno;
+    infd_filesystem_storage_system_error(save_errno, error);
+    result = FALSE;
+  }
+
+  if(result == TRUE)
+    result = infd_filesystem_storage_sync_directory_impl(new_full_name, error);
+
+  g_free(full_name);
+  g_free(new_full_name);
+  return result;
+}
+
+/**
+ * infd_filesystem_storage_unlink:
+ * @storage: A #InfdFilesystemStorage.
+ * @identifier: The type of the file to remove.
+ * @path: The path of the file, in UTF-8.
+ * @error: Location to store error information, if any.
+ *
+ * Removes the file at @path with @identifier from the storage. Unlike
+ * infd_storage_remove_node(), this only removes the one file, and it is not
+ * an error if the file does not exist.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+infd_filesystem_storage_unlink(InfdFilesystemStorage* storage,
+                               const gchar* identifier,
+                               const gchar* path,
+                               GError** error)
+{
+  gchar* full_name;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  full_name = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_name == NULL)
+    return FALSE;
+
+  result = infd_filesystem_storage_unlink_impl(full_name, error);
+  g_free(full_name);
+
+  return result;
+}
+
+/**
+ * infd_filesystem_storage_begin_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: The path of the note that is going to be written, in UTF-8.
+ *
+ * Announces that a new version of the note at @path is going to be
+ * written. This is used by note plugins that write notes in worker threads,
+ * to make sure that writes of the same note do not interfere with each
+ * other, and that an older version does not replace a newer one. Writes of
+ * different notes are independent of each other.
+ *
+ * The returned serial identifies the write. Before any files of the note
+ * are written, infd_filesystem_storage_lock_write() needs to be called with
+ * it, and once the note has been written or if it is not going to be
+ * written anymore, infd_filesystem_storage_end_write(). This is required
+ * also if the write has been superseded.
+ *
+ * Returns: A serial to pass to infd_filesystem_storage_lock_write().
+ */
+guint
+infd_filesystem_storage_begin_write(InfdFilesystemStorage* storage,
+                                    const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  guint serial;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), 0);
+  g_return_val_if_fail(path != NULL, 0);
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  g_object_ref(storage);
+
+  g_mutex_lock(&priv->mutex);
+  write = g_hash_table_lookup(priv->writes, path);
+  if(write == NULL)
+  {
+    write = g_slice_new(InfdFilesystemStorageWrite);
+    write->ref_count = 0;
+    write->serial = 0;
+    write->locked = FALSE;
+    g_hash_table_insert(priv->writes, g_strdup(path), write);
+  }
+
+  ++write->ref_count;
+  serial = ++write->serial;
+  g_mutex_unlock(&priv->mutex);
+
+  return serial;
+}
+
+/**
+ * infd_filesystem_storage_lock_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: The path of the note that is going to be written, in UTF-8.
+ * @serial: The serial returned by infd_filesystem_storage_begin_write().
+ *
+ * Waits until no other write of the note at @path holds the lock for the
+ * note, and then takes it. If another write of the note has begun after the
+ * one identified by @serial, or if the note has been removed with
+ * infd_storage_remove_node() in the meanwhile, the function returns
+ * %FALSE. In that case the write is superseded, and the files of the note
+ * must not be changed anymore. In both cases, the write needs to be ended
+ * with infd_filesystem_storage_end_write().
+ *
+ * Returns: %TRUE if the note should be written, or %FALSE otherwise.
+ */
+gboolean
+infd_filesystem_storage_lock_write(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   guint serial)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->mutex);
+  write = g_hash_table_lookup(priv->writes, path);
+  g_assert(write != NULL);
+
+  while(write->locked == TRUE)
+    g_cond_wait(&priv->cond, &priv->mutex);
+
+  write->locked = TRUE;
+  result = (write->serial == serial);
+  g_mutex_unlock(&priv->mutex);
+
+  return result;
+}
+
+/**
+ * infd_filesystem_storage_end_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: The path of the note that has been written, in UTF-8.
+ *
+ * Releases the lock taken with infd_filesystem_storage_lock_write(), and
+ * ends the write, so that the next write of the note can proceed.
+ */
+void
+infd_filesystem_storage_end_write(InfdFilesystemStorage* storage,
+                                  const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->mutex);
+  write = g_hash_table_lookup(priv->writes, path);
+  g_assert(write != NULL);
+  g_assert(write->locked == TRUE);
+
+  write->locked = FALSE;
+  if(--write->ref_count == 0)
+  {
+    g_hash_table_remove(priv->writes, path);
+    g_slice_free(InfdFilesystemStorageWrite, write);
+  }
+
+  g_cond_broadcast(&priv->cond);
+  g_mutex_unlock(&priv->mutex);
+
+  /* This might drop the last reference in a worker thread */
+  g_object_unref(storage);
+}
+
+/**
+ * infd_filesystem_storage_lock_files:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Takes a lock that is held by @storage while it lists a directory or
+ * removes a note. Hold it while renaming or removing several files of a
+ * note in a row, so that the steps appear as one to other threads. Since
+ * directories are listed in worker threads, they might otherwise see a note
+ * in the middle of being replaced, for example both or none of its files.
+ *
+ * The lock is not recursive, and it must not be held while calling
+ * functions of the #InfdStorage interface on @storage. Release it with
+ * infd_filesystem_storage_unlock_files().
+ */
+void
+infd_filesystem_storage_lock_files(InfdFilesystemStorage* storage)
+{
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_mutex_lock(&INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->files_mutex);
+}
+
+/**
+ * infd_filesystem_storage_unlock_files:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Releases the lock taken with infd_filesystem_storage_lock_files().
+ */
+void
+infd_filesystem_storage_unlock_files(InfdFilesystemStorage* storage)
+{
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_mutex_unlock(&INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->files_mutex);
+}
+
 /**
  * infd_filesystem_storage_stream_close:
  * @file: A #FILE opened with infd_filesystem_storage_open().
@@ -1138,4 +1626,48 @@ infd_filesystem_storage_stream_write(FILE* file,
   return fwrite(buffer, 1, len, file);
 }
 
+/**
+ * infd_filesystem_storage_stream_flush:
+ * @file: A #FILE opened with infd_filesystem_storage_open().
+ *
+ * This is a thin wrapper around fflush(). Use this function instead of
+ * fflush() if you have opened the file with infd_filesystem_storage_open(),
+ * to make sure that the same C runtime is flushing the file that has opened
+ * it. Once flushed, the data survives a crash of the process, but not
+ * necessarily one of the operating system, see
+ * infd_filesystem_storage_stream_sync() for that.
+ *
+ * Returns: The return value of fflush().
+ */
+int
+infd_filesystem_storage_stream_flush(FILE* file)
+{
+  return fflush(file);
+}
+
+/**
+ * infd_filesystem_storage_stream_sync:
+ * @file: A #FILE opened with infd_filesystem_storage_open().
+ *
+ * Flushes the data written to @file with fflush(), and then makes the
+ * operating system write it to the disk with fsync(), so that it survives
+ * not only a crash of the process but also one of the operating system or
+ * a power failure. This waits for the disk, so it should be done only when
+ * the data is relied upon, not after every write.
+ *
+ * Returns: 0 on success, or -1 on error, in which case errno is set.
+ */
+int
+infd_filesystem_storage_stream_sync(FILE* file)
+{
+  if(fflush(file) != 0)
+    return -1;
+
+#ifdef G_OS_WIN32
+  return _commit(_fileno(file));
+#else
+  return fsync(fileno(file));
+#endif
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -91,6 +91,38 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
                                        xmlDocPtr doc,
                                        GError** error);
 
+gboolean
+infd_filesystem_storage_rename(InfdFilesystemStorage* storage,
+                               const gchar* identifier,
+                               const gchar* path,
+                               const gchar* new_identifier,
+                               GError** error);
+
+gboolean
+infd_filesystem_storage_unlink(InfdFilesystemStorage* storage,
+                               const gchar* identifier,
+                               const gchar* path,
+                               GError** error);
+
+guint
+infd_filesystem_storage_begin_write(InfdFilesystemStorage* storage,
+                                    const gchar* path);
+
+gboolean
+infd_filesystem_storage_lock_write(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   guint serial);
+
+void
+infd_filesystem_storage_end_write(InfdFilesystemStorage* storage,
+                                  const gchar* path);
+
+void
+infd_filesystem_storage_lock_files(InfdFilesystemStorage* storage);
+
+void
+infd_filesystem_storage_unlock_files(InfdFilesystemStorage* storage);
+
 int
 infd_filesystem_storage_stream_close(FILE* file);
 
@@ -104,6 +136,12 @@ infd_filesystem_storage_stream_write(FILE* file,
                                      gconstpointer buffer,
                                      gsize len);
 
+int
+infd_filesystem_storage_stream_flush(FILE* file);
+
+int
+infd_filesystem_storage_stream_sync(FILE* file);
+
 G_END_DECLS
 
 #endif /* __INFD_FILESYSTEM_STORAGE_H__ */
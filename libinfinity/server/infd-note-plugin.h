@@ -53,6 +53,16 @@ typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               gpointer,
                                               GError**);
 
+typedef InfdStorageRequest*(*InfdNotePluginSessionWriteAsync)(
+  InfdStorage*,
+  InfIo*,
+  InfSession*,
+  const gchar*,
+  gpointer,
+  InfdStorageFinishedFunc,
+  gpointer,
+  GError**);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +77,11 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Optional, can be NULL. Serializes the session right away, writes it to
+   * the storage without blocking, and calls the given function in the
+   * thread of the InfIo once done, like infd_storage_run_async(). */
+  InfdNotePluginSessionWriteAsync session_write_async;
 };
 
 G_END_DECLS
@@ -468,6 +468,12 @@ infd_session_proxy_perform_user_join(InfdSessionProxy* proxy,
 
   inf_session_send_to_subscriptions(priv->session, xml);
 
+  /* Others should see the new user right away */
+  inf_communication_group_flush(
+    INF_COMMUNICATION_GROUP(priv->subscription_group),
+    NULL
+  );
+
   if(connection != NULL)
   {
     subscription = infd_session_proxy_find_subscription(proxy, connection);
@@ -535,6 +541,14 @@ infd_session_proxy_member_removed_cb(InfCommunicationGroup* group,
     inf_session_send_to_subscriptions(priv->session, xml);
   }
 
+  if(subscription->users != NULL)
+  {
+    inf_communication_group_flush(
+      INF_COMMUNICATION_GROUP(priv->subscription_group),
+      NULL
+    );
+  }
+
   g_signal_emit(
     proxy,
     session_proxy_signals[REMOVE_SUBSCRIPTION],
@@ -17,9 +17,95 @@
  * MA 02110-1301, USA.
  */
 
+/**
+ * SECTION:infd-storage
+ * @title: InfdStorage
+ * @short_description: Interface to the directory tree storage
+ * @include: libinfinity/server/infd-storage.h
+ * @see_also: #InfdDirectory, #InfdFilesystemStorage
+ * @stability: Unstable
+ *
+ * #InfdStorage provides an interface for #InfdDirectory to access the
+ * directory tree of an infinote server, and the ACLs of its nodes.
+ * Libinfinity provides an implementation which stores the tree in the file
+ * system, see #InfdFilesystemStorage.
+ *
+ * The virtual functions of the interface are synchronous. Every operation
+ * can also be performed asynchronously, such as with
+ * infd_storage_read_subdirectory_async(), which calls a function in the
+ * thread of a #InfIo once the operation has finished. If the storage
+ * reports %INFD_STORAGE_SUPPORT_THREAD_SAFE with
+ * infd_storage_get_support(), the asynchronous operations run in the I/O
+ * thread pool of #InfAsyncOperation, so that a slow storage does not block
+ * the thread in which the storage is used. Otherwise they run synchronously
+ * in the calling thread, and only the result is reported later.
+ * Implementations must only report %INFD_STORAGE_SUPPORT_THREAD_SAFE if all
+ * of their virtual functions can be called from any thread, also
+ * concurrently.
+ */
+
 #include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/inf-define-enum.h>
 
+typedef enum _InfdStorageRequestType {
+  INFD_STORAGE_REQUEST_READ_SUBDIRECTORY,
+  INFD_STORAGE_REQUEST_CREATE_SUBDIRECTORY,
+  INFD_STORAGE_REQUEST_REMOVE_NODE,
+  INFD_STORAGE_REQUEST_READ_ACL,
+  INFD_STORAGE_REQUEST_WRITE_ACL,
+  INFD_STORAGE_REQUEST_RUN
+} InfdStorageRequestType;
+
+/**
+ * InfdStorageRequest: (foreign)
+ *
+ * #InfdStorageRequest is an opaque data type representing an asynchronous
+ * storage operation. It can be used to cancel the operation with
+ * infd_storage_request_cancel() before it has finished.
+ */
+
+/* The request owns copies of all arguments, since the worker thread might
+ * still use them after the request has been cancelled in the main thread.
+ * It is freed by the InfAsyncOperation, either after the result has been
+ * delivered or when the worker is done with a cancelled request. For
+ * storages that are not thread-safe, the operation is performed right away
+ * and the request is freed by the dispatch delivering its result. */
+struct _InfdStorageRequest {
+  InfdStorageRequestType type;
+  InfdStorage* storage;
+  InfAsyncOperation* operation;
+
+  InfIo* io;
+  InfIoDispatch* dispatch;
+
+  gchar* identifier;
+  gchar* path;
+  InfAclSheetSet* sheet_set;
+
+  InfdStorageRunFunc run_func;
+  gpointer run_data;
+  GDestroyNotify run_notify;
+
+  GCallback func;
+  gpointer user_data;
+
+  GSList* result;
+  GError* error;
+};
+
+static const GFlagsValue infd_storage_support_values[] = {
+  {
+    INFD_STORAGE_SUPPORT_THREAD_SAFE,
+    "INFD_STORAGE_SUPPORT_THREAD_SAFE",
+    "thread-safe"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
 static const GEnumValue infd_storage_node_type_values[] = {
   {
     INFD_STORAGE_NODE_SUBDIRECTORY,
@@ -36,6 +122,7 @@ static const GEnumValue infd_storage_node_type_values[] = {
   }
 };
 
+INF_DEFINE_FLAGS_TYPE(InfdStorageSupport, infd_storage_support, infd_storage_support_values)
 INF_DEFINE_ENUM_TYPE(InfdStorageNodeType, infd_storage_node_type, infd_storage_node_type_values)
 G_DEFINE_BOXED_TYPE(InfdStorageNode, infd_storage_node, infd_storage_node_copy, infd_storage_node_free)
 G_DEFINE_BOXED_TYPE(InfdStorageAcl, infd_storage_acl, infd_storage_acl_copy, infd_storage_acl_free)
@@ -233,6 +320,54 @@ infd_storage_acl_list_free(GSList* node_list)
   }
 }
 
+/**
+ * infd_storage_get_support:
+ * @storage: A #InfdStorage.
+ *
+ * Returns a bitmask of the optional capabilities of @storage.
+ *
+ * Returns: A bitmask of supported capabilities.
+ */
+InfdStorageSupport
+infd_storage_get_support(InfdStorage* storage)
+{
+  InfdStorageInterface* iface;
+
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), 0);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+  if(iface->get_support == NULL)
+    return 0;
+
+  return iface->get_support(storage);
+}
+
+/**
+ * infd_storage_supports:
+ * @storage: A #InfdStorage.
+ * @support: A bitmask of capabilities to test.
+ *
+ * Checks whether all capabilities specified in @support are available for
+ * @storage. This is equivalent to calling infd_storage_get_support() and
+ * testing the returned value for containing the bits in @support.
+ *
+ * Returns: %TRUE if all capabilities in @support are supported or %FALSE
+ * otherwise.
+ */
+gboolean
+infd_storage_supports(InfdStorage* storage,
+                      InfdStorageSupport support)
+{
+  InfdStorageSupport available_support;
+
+  available_support = infd_storage_get_support(storage);
+
+  if( (available_support & support) != support)
+    return FALSE;
+
+  return TRUE;
+}
+
 /**
  * infd_storage_read_subdirectory:
  * @storage: A #InfdStorage
@@ -380,4 +515,592 @@ infd_storage_write_acl(InfdStorage* storage,
   return iface->write_acl(storage, path, sheet_set, error);
 }
 
+static void
+infd_storage_request_free(gpointer data)
+{
+  InfdStorageRequest* request;
+  request = (InfdStorageRequest*)data;
+
+  switch(request->type)
+  {
+  case INFD_STORAGE_REQUEST_READ_SUBDIRECTORY:
+    infd_storage_node_list_free(request->result);
+    break;
+  case INFD_STORAGE_REQUEST_READ_ACL:
+    infd_storage_acl_list_free(request->result);
+    break;
+  default:
+    g_assert(request->result == NULL);
+    break;
+  }
+
+  if(request->error != NULL)
+    g_error_free(request->error);
+  if(request->sheet_set != NULL)
+    inf_acl_sheet_set_free(request->sheet_set);
+  if(request->run_notify != NULL)
+    request->run_notify(request->run_data);
+
+  g_free(request->path);
+  g_free(request->identifier);
+
+  if(request->io != NULL)
+    g_object_unref(request->io);
+
+  /* This might drop the last reference to the storage in a worker thread
+   * if the request has been cancelled. */
+  g_object_unref(request->storage);
+  g_slice_free(InfdStorageRequest, request);
+}
+
+static void
+infd_storage_request_run(gpointer* run_data,
+                         GDestroyNotify* run_notify,
+                         gpointer user_data)
+{
+  InfdStorageRequest* request;
+  InfdStorageInterface* iface;
+
+  request = (InfdStorageRequest*)user_data;
+  iface = INFD_STORAGE_GET_IFACE(request->storage);
+
+  switch(request->type)
+  {
+  case INFD_STORAGE_REQUEST_READ_SUBDIRECTORY:
+    request->result = iface->read_subdirectory(
+      request->storage,
+      request->path,
+      &request->error
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_CREATE_SUBDIRECTORY:
+    iface->create_subdirectory(
+      request->storage,
+      request->path,
+      &request->error
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_REMOVE_NODE:
+    iface->remove_node(
+      request->storage,
+      request->identifier,
+      request->path,
+      &request->error
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_READ_ACL:
+    request->result = iface->read_acl(
+      request->storage,
+      request->path,
+      &request->error
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_WRITE_ACL:
+    iface->write_acl(
+      request->storage,
+      request->path,
+      request->sheet_set,
+      &request->error
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_RUN:
+    request->run_func(
+      request->storage,
+      request->run_data,
+      &request->error
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  *run_data = request;
+  *run_notify = infd_storage_request_free;
+}
+
+static void
+infd_storage_request_done(gpointer run_data,
+                          gpointer user_data)
+{
+  InfdStorageRequest* request;
+  request = (InfdStorageRequest*)run_data;
+
+  if(request->func == NULL)
+    return;
+
+  switch(request->type)
+  {
+  case INFD_STORAGE_REQUEST_READ_SUBDIRECTORY:
+    ((InfdStorageReadSubdirectoryFunc)request->func)(
+      request->storage,
+      request->result,
+      request->error,
+      request->user_data
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_READ_ACL:
+    ((InfdStorageReadAclFunc)request->func)(
+      request->storage,
+      request->result,
+      request->error,
+      request->user_data
+    );
+
+    break;
+  case INFD_STORAGE_REQUEST_CREATE_SUBDIRECTORY:
+  case INFD_STORAGE_REQUEST_REMOVE_NODE:
+  case INFD_STORAGE_REQUEST_WRITE_ACL:
+  case INFD_STORAGE_REQUEST_RUN:
+    ((InfdStorageFinishedFunc)request->func)(
+      request->storage,
+      request->error,
+      request->user_data
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+infd_storage_request_dispatch_func(gpointer user_data)
+{
+  infd_storage_request_done(user_data, NULL);
+}
+
+static InfdStorageRequest*
+infd_storage_request_start(InfdStorage* storage,
+                           InfIo* io,
+                           InfdStorageRequestType type,
+                           const gchar* identifier,
+                           const gchar* path,
+                           const InfAclSheetSet* sheet_set,
+                           InfdStorageRunFunc run_func,
+                           gpointer run_func_data,
+                           GDestroyNotify run_func_notify,
+                           GCallback func,
+                           gpointer user_data,
+                           GError** error)
+{
+  InfdStorageRequest* request;
+  gpointer run_data;
+  GDestroyNotify run_notify;
+
+  request = g_slice_new(InfdStorageRequest);
+  request->type = type;
+  request->storage = storage;
+  request->operation = NULL;
+  request->io = NULL;
+  request->dispatch = NULL;
+  request->identifier = g_strdup(identifier);
+  request->path = g_strdup(path);
+  request->sheet_set = NULL;
+  request->run_func = run_func;
+  request->run_data = run_func_data;
+  request->run_notify = run_func_notify;
+  request->func = func;
+  request->user_data = user_data;
+  request->result = NULL;
+  request->error = NULL;
+
+  g_object_ref(storage);
+
+  if(sheet_set != NULL)
+  {
+    request->sheet_set = inf_acl_sheet_set_copy(sheet_set);
+    inf_acl_sheet_set_sink(request->sheet_set);
+  }
+
+  if(!infd_storage_supports(storage, INFD_STORAGE_SUPPORT_THREAD_SAFE))
+  {
+    infd_storage_request_run(&run_data, &run_notify, request);
+
+    request->io = io;
+    g_object_ref(io);
+
+    request->dispatch = inf_io_add_dispatch(
+      io,
+      infd_storage_request_dispatch_func,
+      request,
+      run_notify
+    );
+
+    return request;
+  }
+
+  request->operation = inf_async_operation_new(
+    io,
+    infd_storage_request_run,
+    infd_storage_request_done,
+    request
+  );
+
+  if(!inf_async_operation_start_io(request->operation, error))
+  {
+    infd_storage_request_free(request);
+    return NULL;
+  }
+
+  return request;
+}
+
+/**
+ * infd_storage_read_subdirectory_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @path: A path pointing to a subdirectory node.
+ * @func: (scope async): Function to call with the result.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Reads a subdirectory from the storage like
+ * infd_storage_read_subdirectory(), but asynchronously. If @storage
+ * supports %INFD_STORAGE_SUPPORT_THREAD_SAFE, it is accessed in the I/O
+ * thread pool, see inf_async_operation_start_io(), so that the calling
+ * thread is not blocked. Otherwise the subdirectory is read right away in
+ * the calling thread. In both cases @func is called later in the thread of
+ * @io, once the listing is available or reading it has failed.
+ *
+ * The returned request can be cancelled with infd_storage_request_cancel()
+ * as long as @func has not yet been called. If the operation cannot be
+ * started, @error is set and %NULL is returned, and @func is not called.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ **/
+InfdStorageRequest*
+infd_storage_read_subdirectory_async(InfdStorage* storage,
+                                     InfIo* io,
+                                     const gchar* path,
+                                     InfdStorageReadSubdirectoryFunc func,
+                                     gpointer user_data,
+                                     GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    INFD_STORAGE_GET_IFACE(storage)->read_subdirectory != NULL,
+    NULL
+  );
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_READ_SUBDIRECTORY,
+    NULL,
+    path,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_create_subdirectory_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @path: A path pointing to non-existing node.
+ * @func: (scope async) (allow-none): Function to call when the
+ * subdirectory has been created, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Creates a new subdirectory like infd_storage_create_subdirectory(),
+ * asynchronously. See infd_storage_read_subdirectory_async() for where the
+ * storage is accessed and how the result is reported.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ **/
+InfdStorageRequest*
+infd_storage_create_subdirectory_async(InfdStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    INFD_STORAGE_GET_IFACE(storage)->create_subdirectory != NULL,
+    NULL
+  );
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_CREATE_SUBDIRECTORY,
+    NULL,
+    path,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_remove_node_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @identifier: The type of the node to remove, or %NULL to remove a
+ * subdirectory.
+ * @path: A path pointing to an existing node.
+ * @func: (scope async) (allow-none): Function to call when the node has
+ * been removed, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Removes the node at @path like infd_storage_remove_node(),
+ * asynchronously. See infd_storage_read_subdirectory_async() for where the
+ * storage is accessed and how the result is reported.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ **/
+InfdStorageRequest*
+infd_storage_remove_node_async(InfdStorage* storage,
+                               InfIo* io,
+                               const gchar* identifier,
+                               const gchar* path,
+                               InfdStorageFinishedFunc func,
+                               gpointer user_data,
+                               GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    INFD_STORAGE_GET_IFACE(storage)->remove_node != NULL,
+    NULL
+  );
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_REMOVE_NODE,
+    identifier,
+    path,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_read_acl_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @path: A path pointing to an existing node.
+ * @func: (scope async): Function to call with the result.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Reads the ACL for the node at @path like infd_storage_read_acl(),
+ * asynchronously. See infd_storage_read_subdirectory_async() for where the
+ * storage is accessed and how the result is reported.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ */
+InfdStorageRequest*
+infd_storage_read_acl_async(InfdStorage* storage,
+                            InfIo* io,
+                            const gchar* path,
+                            InfdStorageReadAclFunc func,
+                            gpointer user_data,
+                            GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    INFD_STORAGE_GET_IFACE(storage)->read_acl != NULL,
+    NULL
+  );
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_READ_ACL,
+    NULL,
+    path,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_write_acl_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @path: A path to an existing node.
+ * @sheet_set: Sheets to set for the node at @path, or %NULL.
+ * @func: (scope async) (allow-none): Function to call when the ACL has been
+ * written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Writes the ACL defined by @sheet_set like infd_storage_write_acl(),
+ * asynchronously. A copy of @sheet_set is made, so it
+ * can be freed or changed after the function has returned. See
+ * infd_storage_read_subdirectory_async() for where the storage is accessed
+ * and how the result is reported.
+ *
+ * Note that two requests started for the same node are not necessarily
+ * executed in the order in which they were started. If this matters, wait
+ * for the first request to finish before starting the second one.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ */
+InfdStorageRequest*
+infd_storage_write_acl_async(InfdStorage* storage,
+                             InfIo* io,
+                             const gchar* path,
+                             const InfAclSheetSet* sheet_set,
+                             InfdStorageFinishedFunc func,
+                             gpointer user_data,
+                             GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    INFD_STORAGE_GET_IFACE(storage)->write_acl != NULL,
+    NULL
+  );
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_WRITE_ACL,
+    NULL,
+    path,
+    sheet_set,
+    NULL,
+    NULL,
+    NULL,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_run_async:
+ * @storage: A #InfdStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @run_func: (scope async): Function performing the operation.
+ * @run_data: Data to pass to @run_func.
+ * @run_notify: (allow-none): Function to free @run_data, or %NULL.
+ * @func: (scope async) (allow-none): Function to call when @run_func has
+ * finished, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Performs a custom operation on @storage asynchronously, in the same way
+ * as the other asynchronous functions, see
+ * infd_storage_read_subdirectory_async(). This allows code that knows
+ * about a particular storage implementation, such as note plugins, to
+ * access it without blocking the calling thread. @run_func is called in a
+ * worker thread if @storage supports %INFD_STORAGE_SUPPORT_THREAD_SAFE,
+ * and must therefore not access any objects that are used in the calling
+ * thread. It reports failure by returning %FALSE and setting its error,
+ * which is then passed to @func.
+ *
+ * @run_data is freed with @run_notify once the request is done. If the
+ * request is cancelled while @run_func is running, this happens in the
+ * worker thread.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ */
+InfdStorageRequest*
+infd_storage_run_async(InfdStorage* storage,
+                       InfIo* io,
+                       InfdStorageRunFunc run_func,
+                       gpointer run_data,
+                       GDestroyNotify run_notify,
+                       InfdStorageFinishedFunc func,
+                       gpointer user_data,
+                       GError** error)
+{
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(run_func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  return infd_storage_request_start(
+    storage,
+    io,
+    INFD_STORAGE_REQUEST_RUN,
+    NULL,
+    NULL,
+    NULL,
+    run_func,
+    run_data,
+    run_notify,
+    G_CALLBACK(func),
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_storage_request_cancel:
+ * @request: A #InfdStorageRequest.
+ *
+ * Cancels an asynchronous storage operation, so that its callback function
+ * is not called. This must not be called anymore once the callback function
+ * has been called, since the request is freed at that point. Note that the
+ * operation might already be in progress in a worker thread, in which case
+ * it still takes effect in the storage, only its result is discarded.
+ */
+void
+infd_storage_request_cancel(InfdStorageRequest* request)
+{
+  g_return_if_fail(request != NULL);
+
+  if(request->dispatch != NULL)
+    inf_io_remove_dispatch(request->io, request->dispatch);
+  else
+    inf_async_operation_free(request->operation);
+}
+
 /* vim:set et sw=2 ts=2: */
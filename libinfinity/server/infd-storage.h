@@ -23,6 +23,7 @@
 #include <glib-object.h>
 
 #include <libinfinity/common/inf-acl.h>
+#include <libinfinity/common/inf-io.h>
 
 G_BEGIN_DECLS
 
@@ -31,12 +32,28 @@ G_BEGIN_DECLS
 #define INFD_IS_STORAGE(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_STORAGE))
 #define INFD_STORAGE_GET_IFACE(inst)      (G_TYPE_INSTANCE_GET_INTERFACE((inst), INFD_TYPE_STORAGE, InfdStorageInterface))
 
+#define INFD_TYPE_STORAGE_SUPPORT         (infd_storage_support_get_type())
 #define INFD_TYPE_STORAGE_NODE_TYPE       (infd_storage_node_type_get_type())
 #define INFD_TYPE_STORAGE_NODE            (infd_storage_node_get_type())
 #define INFD_TYPE_STORAGE_ACL             (infd_storage_acl_get_type())
 
 typedef struct _InfdStorage InfdStorage;
 typedef struct _InfdStorageInterface InfdStorageInterface;
+typedef struct _InfdStorageRequest InfdStorageRequest;
+
+/**
+ * InfdStorageSupport:
+ * @INFD_STORAGE_SUPPORT_THREAD_SAFE: Whether the virtual functions of the
+ * storage can be called from any thread, also concurrently. If set, the
+ * asynchronous functions such as infd_storage_read_subdirectory_async()
+ * access the storage in worker threads.
+ *
+ * This enumeration specifies optional capabilities of a particular
+ * #InfdStorage implementation.
+ */
+typedef enum _InfdStorageSupport {
+  INFD_STORAGE_SUPPORT_THREAD_SAFE = 1 << 0
+} InfdStorageSupport;
 
 typedef enum _InfdStorageNodeType {
   INFD_STORAGE_NODE_SUBDIRECTORY,
@@ -62,9 +79,12 @@ struct _InfdStorageInterface {
   GTypeInterface parent;
 
   /* All these calls are supposed to be synchronous, e.g. completly perform
-   * the required task. Some day, we could implement asynchronous
-   * behaviour in InfdDirectory (e.g. it caches operations and executes
-   * them via the storage in the background). */
+   * the required task. If get_support() reports
+   * INFD_STORAGE_SUPPORT_THREAD_SAFE, the asynchronous variants such as
+   * infd_storage_read_subdirectory_async() call them in a worker thread,
+   * therefore they must then allow to be called from any thread, also
+   * concurrently. Otherwise they are only called in the thread in which
+   * the storage is used. */
 
   /* Virtual Table */
   GSList* (*read_subdirectory)(InfdStorage* storage,
@@ -91,8 +111,77 @@ struct _InfdStorageInterface {
                         const gchar* path,
                         const InfAclSheetSet* sheet_set,
                         GError** error);
+
+  /* Can be NULL, in which case no optional capability is supported */
+  InfdStorageSupport (*get_support)(InfdStorage* storage);
 };
 
+/**
+ * InfdStorageReadSubdirectoryFunc:
+ * @storage: The #InfdStorage that has read the subdirectory.
+ * @nodes: (element-type InfdStorageNode) (allow-none): The list of
+ * #InfdStorageNode objects in the subdirectory, or %NULL.
+ * @error: Reason why the subdirectory could not be read, or %NULL.
+ * @user_data: Additional data passed to
+ * infd_storage_read_subdirectory_async().
+ *
+ * Signature of the function that is called in the main thread when an
+ * asynchronous read of a subdirectory has finished. The list is freed after
+ * the function has returned; nodes that are needed later must be copied.
+ */
+typedef void(*InfdStorageReadSubdirectoryFunc)(InfdStorage* storage,
+                                               GSList* nodes,
+                                               const GError* error,
+                                               gpointer user_data);
+
+/**
+ * InfdStorageReadAclFunc:
+ * @storage: The #InfdStorage that has read the ACL.
+ * @acl: (element-type InfdStorageAcl) (allow-none): The list of
+ * #InfdStorageAcl objects for the node, or %NULL.
+ * @error: Reason why the ACL could not be read, or %NULL.
+ * @user_data: Additional data passed to infd_storage_read_acl_async().
+ *
+ * Signature of the function that is called in the main thread when an
+ * asynchronous read of a node's ACL has finished. The list is freed after
+ * the function has returned.
+ */
+typedef void(*InfdStorageReadAclFunc)(InfdStorage* storage,
+                                      GSList* acl,
+                                      const GError* error,
+                                      gpointer user_data);
+
+/**
+ * InfdStorageFinishedFunc:
+ * @storage: The #InfdStorage that has performed the operation.
+ * @error: Reason why the operation failed, or %NULL.
+ * @user_data: Additional data passed along with this function.
+ *
+ * Signature of the function that is called in the main thread when an
+ * asynchronous storage operation without a result has finished.
+ */
+typedef void(*InfdStorageFinishedFunc)(InfdStorage* storage,
+                                       const GError* error,
+                                       gpointer user_data);
+
+/**
+ * InfdStorageRunFunc:
+ * @storage: The #InfdStorage on which to perform the operation.
+ * @run_data: Data passed to infd_storage_run_async().
+ * @error: Location to store error information, if any.
+ *
+ * Signature of a custom operation performed with infd_storage_run_async().
+ * It might be called in a worker thread.
+ *
+ * Returns: %TRUE on success or %FALSE if @error has been set.
+ */
+typedef gboolean(*InfdStorageRunFunc)(InfdStorage* storage,
+                                      gpointer run_data,
+                                      GError** error);
+
+GType
+infd_storage_support_get_type(void) G_GNUC_CONST;
+
 GType
 infd_storage_node_type_get_type(void) G_GNUC_CONST;
 
@@ -130,6 +219,13 @@ infd_storage_acl_free(InfdStorageAcl* acl);
 void
 infd_storage_acl_list_free(GSList* acl_list);
 
+InfdStorageSupport
+infd_storage_get_support(InfdStorage* storage);
+
+gboolean
+infd_storage_supports(InfdStorage* storage,
+                      InfdStorageSupport support);
+
 GSList*
 infd_storage_read_subdirectory(InfdStorage* storage,
                                const gchar* path,
@@ -157,6 +253,61 @@ infd_storage_write_acl(InfdStorage* storage,
                        const InfAclSheetSet* sheet_set,
                        GError** error);
 
+InfdStorageRequest*
+infd_storage_read_subdirectory_async(InfdStorage* storage,
+                                     InfIo* io,
+                                     const gchar* path,
+                                     InfdStorageReadSubdirectoryFunc func,
+                                     gpointer user_data,
+                                     GError** error);
+
+InfdStorageRequest*
+infd_storage_create_subdirectory_async(InfdStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
+InfdStorageRequest*
+infd_storage_remove_node_async(InfdStorage* storage,
+                               InfIo* io,
+                               const gchar* identifier,
+                               const gchar* path,
+                               InfdStorageFinishedFunc func,
+                               gpointer user_data,
+                               GError** error);
+
+InfdStorageRequest*
+infd_storage_read_acl_async(InfdStorage* storage,
+                            InfIo* io,
+                            const gchar* path,
+                            InfdStorageReadAclFunc func,
+                            gpointer user_data,
+                            GError** error);
+
+InfdStorageRequest*
+infd_storage_write_acl_async(InfdStorage* storage,
+                             InfIo* io,
+                             const gchar* path,
+                             const InfAclSheetSet* sheet_set,
+                             InfdStorageFinishedFunc func,
+                             gpointer user_data,
+                             GError** error);
+
+InfdStorageRequest*
+infd_storage_run_async(InfdStorage* storage,
+                       InfIo* io,
+                       InfdStorageRunFunc run_func,
+                       gpointer run_data,
+                       GDestroyNotify run_notify,
+                       InfdStorageFinishedFunc func,
+                       gpointer user_data,
+                       GError** error);
+
+void
+infd_storage_request_cancel(InfdStorageRequest* request);
+
 G_END_DECLS
 
 #endif /* __INFD_STORAGE_H__ */
@@ -67,6 +67,10 @@ struct _InfdTcpServerPrivate {
   guint local_port;
 
   InfKeepalive keepalive;
+
+  guint backlog;
+  guint accept_batch_size;
+  gboolean reuse_port;
 };
 
 enum {
@@ -79,7 +83,11 @@ enum {
   PROP_LOCAL_ADDRESS,
   PROP_LOCAL_PORT,
 
-  PROP_KEEPALIVE
+  PROP_KEEPALIVE,
+
+  PROP_BACKLOG,
+  PROP_ACCEPT_BATCH_SIZE,
+  PROP_REUSE_PORT
 };
 
 enum {
@@ -175,6 +183,7 @@ infd_tcp_server_io(InfNativeSocket* socket,
 
   InfIpAddress* address;
   guint port;
+  guint n_accepted;
 
   server = INFD_TCP_SERVER(user_data);
   priv = INFD_TCP_SERVER_PRIVATE(server);
@@ -193,6 +202,11 @@ infd_tcp_server_io(InfNativeSocket* socket,
   }
   else if(events & INF_IO_INCOMING)
   {
+    /* Accept at most accept_batch_size connections at a time. If more are
+     * pending, the socket stays readable and we are called again after
+     * other events have been handled. */
+    n_accepted = 0;
+
     do
     {
       /* Note that we do not do anything with native_addr and len. This is
@@ -217,6 +231,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
       }
       else if(new_socket != INVALID_SOCKET)
       {
+        ++n_accepted;
+
         switch(native_addr.in_generic.sa_family)
         {
         case AF_INET:
@@ -271,7 +287,9 @@ infd_tcp_server_io(InfNativeSocket* socket,
     } while( (new_socket != INVALID_SOCKET ||
               (new_socket == INVALID_SOCKET &&
                errcode == INF_NATIVE_SOCKET_EINTR)) &&
-             (priv->socket != INVALID_SOCKET));
+             (priv->socket != INVALID_SOCKET) &&
+             (priv->accept_batch_size == 0 ||
+              n_accepted < priv->accept_batch_size));
   }
 
   g_object_unref(G_OBJECT(server));
@@ -292,6 +310,10 @@ infd_tcp_server_init(InfdTcpServer* server)
   priv->local_port = 0;
 
   priv->keepalive.mask = 0;
+
+  priv->backlog = 128;
+  priv->accept_batch_size = 64;
+  priv->reuse_port = FALSE;
 }
 
 static void
@@ -363,6 +385,16 @@ infd_tcp_server_set_property(GObject* object,
     g_assert(g_value_get_boxed(value) != NULL);
     priv->keepalive = *(const InfKeepalive*)g_value_get_boxed(value);
     break;
+  case PROP_BACKLOG:
+    priv->backlog = g_value_get_uint(value);
+    break;
+  case PROP_ACCEPT_BATCH_SIZE:
+    priv->accept_batch_size = g_value_get_uint(value);
+    break;
+  case PROP_REUSE_PORT:
+    g_assert(priv->status == INFD_TCP_SERVER_CLOSED);
+    priv->reuse_port = g_value_get_boolean(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -398,6 +430,15 @@ infd_tcp_server_get_property(GObject* object,
   case PROP_KEEPALIVE:
     g_value_set_boxed(value, &priv->keepalive);
     break;
+  case PROP_BACKLOG:
+    g_value_set_uint(value, priv->backlog);
+    break;
+  case PROP_ACCEPT_BATCH_SIZE:
+    g_value_set_uint(value, priv->accept_batch_size);
+    break;
+  case PROP_REUSE_PORT:
+    g_value_set_boolean(value, priv->reuse_port);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -508,6 +549,48 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_BACKLOG,
+    g_param_spec_uint(
+      "backlog",
+      "Backlog",
+      "Maximum number of pending connections, taking effect when the server "
+      "is opened",
+      1,
+      G_MAXINT,
+      128,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_ACCEPT_BATCH_SIZE,
+    g_param_spec_uint(
+      "accept-batch-size",
+      "Accept batch size",
+      "Maximum number of connections to accept in one go, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      64,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_REUSE_PORT,
+    g_param_spec_boolean(
+      "reuse-port",
+      "Reuse port",
+      "Whether to allow another process to bind to the same address and "
+      "port, so that it can take over from this one",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
   tcp_server_signals[NEW_CONNECTION] = g_signal_new(
     "new-connection",
     G_OBJECT_CLASS_TYPE(object_class),
@@ -544,6 +627,17 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
  * is 0, a random available port will be assigned. If the function fails,
  * %FALSE is returned and an error is set.
  *
+ * If #InfdTcpServer:reuse-port is %TRUE, another socket with the property
+ * set can be bound to the same address and port as well. This allows a new
+ * server process to start listening before the old one stops, so that no
+ * connection is refused while the server is replaced. While both listen,
+ * the operating system distributes incoming connections among them, so the
+ * old process should close its server right after the new one has bound.
+ * Serving the port from both for longer is only sensible if they do not
+ * share any state, which is not the case for two #InfdDirectory<!-- -->s
+ * on the same storage. This is not supported on all platforms; where it is
+ * not, the property has no effect.
+ *
  * @server must be in %INFD_TCP_SERVER_CLOSED state for this function to be
  * called.
  *
@@ -563,7 +657,8 @@ infd_tcp_server_bind(InfdTcpServer* server,
   struct sockaddr* addr;
   socklen_t addrlen;
 
-#if !defined(G_OS_WIN32) && defined(HAVE_SO_REUSEADDR)
+#if !defined(G_OS_WIN32) && \
+    (defined(HAVE_SO_REUSEADDR) || defined(HAVE_SO_REUSEPORT))
   int value;
 #endif
 
@@ -643,6 +738,25 @@ infd_tcp_server_bind(InfdTcpServer* server,
   }
 #endif
 
+#if !defined(G_OS_WIN32) && defined(HAVE_SO_REUSEPORT)
+  /* Allow a new server process to bind to this port before this one has
+   * closed its socket, see infd_tcp_server_bind(). */
+  if(priv->reuse_port)
+  {
+    value = 1;
+
+    if(setsockopt(priv->socket, SOL_SOCKET, SO_REUSEPORT, &value,
+        sizeof(int)) == -1)
+    {
+      inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+
+      closesocket(priv->socket);
+      priv->socket = INVALID_SOCKET;
+      return FALSE;
+    }
+  }
+#endif
+
   if(bind(priv->socket, addr, addrlen) == -1)
   {
     inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
@@ -769,7 +883,7 @@ infd_tcp_server_open(InfdTcpServer* server,
   }
 #endif
 
-  if(listen(priv->socket, 5) == -1)
+  if(listen(priv->socket, priv->backlog) == -1)
   {
     inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
     if(!was_bound)
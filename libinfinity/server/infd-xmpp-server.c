@@ -23,6 +23,9 @@
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-signals.h>
 
+#include <gnutls/gnutls.h>
+#include <string.h>
+
 /* Some Windows header #defines ERROR for no good */
 #ifdef G_OS_WIN32
 # ifdef ERROR
@@ -47,6 +50,13 @@ struct _InfdXmppServerPrivate {
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
   gchar* sasl_mechanisms;
+
+  gboolean tls_offload;
+
+  /* Key for TLS session tickets, replaced after session_ticket_lifetime */
+  guint session_ticket_lifetime;
+  GBytes* session_ticket_key;
+  gint64 session_ticket_key_time;
 };
 
 enum {
@@ -60,6 +70,8 @@ enum {
   PROP_SASL_MECHANISMS,
 
   PROP_SECURITY_POLICY,
+  PROP_TLS_OFFLOAD,
+  PROP_SESSION_TICKET_LIFETIME,
 
   /* Overridden from XML server */
   PROP_STATUS
@@ -80,6 +92,57 @@ G_DEFINE_TYPE_WITH_CODE(InfdXmppServer, infd_xmpp_server, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdXmppServer)
   G_IMPLEMENT_INTERFACE(INFD_TYPE_XML_SERVER, infd_xmpp_server_xml_server_iface_init))
 
+static void
+infd_xmpp_server_clear_session_ticket_key(InfdXmppServer* xmpp)
+{
+  InfdXmppServerPrivate* priv;
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  if(priv->session_ticket_key != NULL)
+  {
+    g_bytes_unref(priv->session_ticket_key);
+    priv->session_ticket_key = NULL;
+  }
+}
+
+static GBytes*
+infd_xmpp_server_get_session_ticket_key(InfdXmppServer* xmpp)
+{
+  InfdXmppServerPrivate* priv;
+  gint64 now;
+  gnutls_datum_t datum;
+  int ret;
+
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+  if(priv->session_ticket_lifetime == 0)
+    return NULL;
+
+  /* Tickets encrypted with a previous key cannot be decrypted anymore after
+   * the key has been replaced, so the lifetime also bounds how long a client
+   * can resume its session. */
+  now = g_get_monotonic_time();
+  if(priv->session_ticket_key != NULL &&
+     now - priv->session_ticket_key_time <
+     (gint64)priv->session_ticket_lifetime * G_USEC_PER_SEC)
+  {
+    return priv->session_ticket_key;
+  }
+
+  infd_xmpp_server_clear_session_ticket_key(xmpp);
+
+  ret = gnutls_session_ticket_key_generate(&datum);
+  if(ret != GNUTLS_E_SUCCESS)
+    return NULL;
+
+  priv->session_ticket_key = g_bytes_new(datum.data, datum.size);
+  priv->session_ticket_key_time = now;
+
+  memset(datum.data, 0, datum.size);
+  gnutls_free(datum.data);
+
+  return priv->session_ticket_key;
+}
+
 static void
 infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
                                    InfTcpConnection* tcp_connection,
@@ -90,6 +153,7 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
   InfXmppConnection* xmpp_connection;
   InfIpAddress* addr;
   gchar* addr_str;
+  GBytes* ticket_key;
 
   xmpp_server = INFD_XMPP_SERVER(user_data);
   priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
@@ -113,6 +177,19 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
 
   g_free(addr_str);
 
+  if(priv->tls_offload)
+    g_object_set(G_OBJECT(xmpp_connection), "tls-offload", TRUE, NULL);
+
+  ticket_key = infd_xmpp_server_get_session_ticket_key(xmpp_server);
+  if(ticket_key != NULL)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "session-ticket-key", ticket_key,
+      NULL
+    );
+  }
+
   /* We could, alternatively, keep the connection around until authentication
    * has completed and emit the new_connection signal after that, to guarantee
    * that the connection is open when new_connection is emitted. */
@@ -358,6 +435,11 @@ infd_xmpp_server_init(InfdXmppServer* xmpp)
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_mechanisms = NULL;
+  priv->tls_offload = FALSE;
+
+  priv->session_ticket_lifetime = 0;
+  priv->session_ticket_key = NULL;
+  priv->session_ticket_key_time = 0;
 }
 
 static void
@@ -407,6 +489,8 @@ infd_xmpp_server_finalize(GObject* object)
   g_free(priv->local_hostname);
   g_free(priv->sasl_mechanisms);
 
+  infd_xmpp_server_clear_session_ticket_key(xmpp);
+
   G_OBJECT_CLASS(infd_xmpp_server_parent_class)->finalize(object);
 }
 
@@ -462,6 +546,17 @@ infd_xmpp_server_set_property(GObject* object,
   case PROP_SECURITY_POLICY:
     infd_xmpp_server_set_security_policy(xmpp, g_value_get_enum(value));
     break;
+  case PROP_TLS_OFFLOAD:
+    priv->tls_offload = g_value_get_boolean(value);
+    break;
+  case PROP_SESSION_TICKET_LIFETIME:
+    /* Start over with a fresh key when the lifetime changes */
+    if(priv->session_ticket_lifetime != g_value_get_uint(value))
+    {
+      priv->session_ticket_lifetime = g_value_get_uint(value);
+      infd_xmpp_server_clear_session_ticket_key(xmpp);
+    }
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -515,6 +610,12 @@ infd_xmpp_server_get_property(GObject* object,
   case PROP_SECURITY_POLICY:
     g_value_set_enum(value, priv->security_policy);
     break;
+  case PROP_TLS_OFFLOAD:
+    g_value_set_boolean(value, priv->tls_offload);
+    break;
+  case PROP_SESSION_TICKET_LIFETIME:
+    g_value_set_uint(value, priv->session_ticket_lifetime);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -628,6 +729,34 @@ infd_xmpp_server_class_init(InfdXmppServerClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_OFFLOAD,
+    g_param_spec_boolean(
+      "tls-offload",
+      "TLS offload",
+      "Whether to perform TLS handshakes of new connections in worker "
+      "threads",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SESSION_TICKET_LIFETIME,
+    g_param_spec_uint(
+      "session-ticket-lifetime",
+      "Session ticket lifetime",
+      "Number of seconds after which the key for TLS session tickets is "
+      "replaced, or 0 to disable TLS session resumption",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 
   xmpp_server_signals[ERROR] = g_signal_new(
@@ -39,8 +39,11 @@
  */
 
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-buffer-private.h>
 #include <libinfinity/common/inf-buffer.h>
 
+#include <string.h>
+
 G_DEFINE_INTERFACE(InfTextBuffer, inf_text_buffer, INF_TYPE_BUFFER)
 
 enum {
@@ -256,6 +259,174 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
   iface->erase_text(buffer, pos, len, user);
 }
 
+/**
+ * inf_text_buffer_append:
+ * @buffer: A #InfTextBuffer.
+ * @chunk: (transfer none): A #InfTextChunk.
+ * @user: (allow-none): A #InfUser inserting @chunk, or %NULL.
+ *
+ * Inserts @chunk at the end of @buffer. This is equivalent to calling
+ * inf_text_buffer_insert_chunk() with the length of @buffer as position,
+ * but buffer implementations can do this more efficiently. For example,
+ * a document can be loaded by collecting all of its segments in one
+ * #InfTextChunk and appending that to an empty buffer, which causes only a
+ * single emission of #InfTextBuffer::text-inserted.
+ **/
+void
+inf_text_buffer_append(InfTextBuffer* buffer,
+                       InfTextChunk* chunk,
+                       InfUser* user)
+{
+  InfTextBufferInterface* iface;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(chunk != NULL);
+  g_return_if_fail(user == NULL || INF_IS_USER(user));
+
+  g_return_if_fail(
+    strcmp(
+      inf_text_chunk_get_encoding(chunk),
+      inf_text_buffer_get_encoding(buffer)
+    ) == 0
+  );
+
+  if(inf_text_chunk_get_length(chunk) == 0)
+    return;
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->append != NULL)
+  {
+    iface->append(buffer, chunk, user);
+  }
+  else
+  {
+    g_return_if_fail(iface->insert_text != NULL);
+
+    iface->insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      chunk,
+      user
+    );
+  }
+}
+
+/**
+ * inf_text_buffer_clear:
+ * @buffer: A #InfTextBuffer.
+ * @user: (allow-none): A #InfUser that erases the text, or %NULL.
+ *
+ * Erases all text from @buffer. If @buffer is not empty, then
+ * #InfTextBuffer::text-erased is emitted once with the whole previous
+ * content of the buffer.
+ **/
+void
+inf_text_buffer_clear(InfTextBuffer* buffer,
+                      InfUser* user)
+{
+  InfTextBufferInterface* iface;
+  guint length;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(user == NULL || INF_IS_USER(user));
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->clear != NULL)
+  {
+    iface->clear(buffer, user);
+  }
+  else
+  {
+    g_return_if_fail(iface->erase_text != NULL);
+
+    length = inf_text_buffer_get_length(buffer);
+    if(length > 0)
+      iface->erase_text(buffer, 0, length, user);
+  }
+}
+
+/**
+ * inf_text_buffer_apply_batch:
+ * @buffer: A #InfTextBuffer.
+ * @edits: (array length=n_edits): The edits to apply.
+ * @n_edits: The number of elements in @edits.
+ * @user: (allow-none): A #InfUser that makes the modifications, or %NULL.
+ *
+ * Applies the given edits to @buffer, one after the other. The position of
+ * each edit refers to the buffer content after the previous edits have been
+ * applied. All edits are validated before the first one is applied, so
+ * either all or none of them take effect.
+ *
+ * Buffer implementations supporting batches apply all of them in one pass
+ * and emit #InfTextBuffer::text-erased and #InfTextBuffer::text-inserted
+ * only once, for the smallest range of the buffer that covers all edits.
+ * Note that this means that unmodified text between two edits is reported
+ * as erased and re-inserted. Other buffers apply the edits one by one,
+ * with one signal emission per edit.
+ **/
+void
+inf_text_buffer_apply_batch(InfTextBuffer* buffer,
+                            const InfTextBufferEdit* edits,
+                            guint n_edits,
+                            InfUser* user)
+{
+  InfTextBufferInterface* iface;
+  const gchar* encoding;
+  guint length;
+  guint i;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(edits != NULL || n_edits == 0);
+  g_return_if_fail(user == NULL || INF_IS_USER(user));
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+  g_return_if_fail(iface->insert_text != NULL);
+  g_return_if_fail(iface->erase_text != NULL);
+
+  encoding = inf_text_buffer_get_encoding(buffer);
+  length = inf_text_buffer_get_length(buffer);
+
+  for(i = 0; i < n_edits; ++i)
+  {
+    g_return_if_fail(edits[i].pos <= length);
+    g_return_if_fail(edits[i].len <= length - edits[i].pos);
+
+    length -= edits[i].len;
+    if(edits[i].chunk != NULL)
+    {
+      g_return_if_fail(
+        strcmp(inf_text_chunk_get_encoding(edits[i].chunk), encoding) == 0
+      );
+
+      length += inf_text_chunk_get_length(edits[i].chunk);
+    }
+  }
+
+  if(n_edits == 0)
+    return;
+
+  if(iface->apply_batch != NULL)
+  {
+    iface->apply_batch(buffer, edits, n_edits, user);
+  }
+  else
+  {
+    for(i = 0; i < n_edits; ++i)
+    {
+      if(edits[i].len > 0)
+        iface->erase_text(buffer, edits[i].pos, edits[i].len, user);
+
+      if(edits[i].chunk != NULL &&
+         inf_text_chunk_get_length(edits[i].chunk) > 0)
+      {
+        iface->insert_text(buffer, edits[i].pos, edits[i].chunk, user);
+      }
+    }
+  }
+}
+
 /**
  * inf_text_buffer_create_begin_iter:
  * @buffer: A #InfTextBuffer.
@@ -575,4 +746,69 @@ inf_text_buffer_text_erased(InfTextBuffer* buffer,
   );
 }
 
+/* Computes the smallest range [*pos, *pos + *len) of the buffer which
+ * covers all of the given edits, and returns the content that this range
+ * has after the edits have been applied. This is used by buffer
+ * implementations to apply a batch of edits with a single erase and a
+ * single insertion. */
+InfTextChunk*
+_inf_text_buffer_coalesce_edits(InfTextBuffer* buffer,
+                                const InfTextBufferEdit* edits,
+                                guint n_edits,
+                                guint* pos,
+                                guint* len)
+{
+  InfTextChunk* result;
+  guint begin;
+  guint end;
+  guint erased;
+  guint inserted;
+  guint chunk_len;
+  guint i;
+
+  g_assert(n_edits > 0);
+
+  /* begin and end delimit the modified range in the buffer as it looks
+   * after the edits processed so far. */
+  begin = G_MAXUINT;
+  end = 0;
+  erased = 0;
+  inserted = 0;
+
+  for(i = 0; i < n_edits; ++i)
+  {
+    chunk_len = 0;
+    if(edits[i].chunk != NULL)
+      chunk_len = inf_text_chunk_get_length(edits[i].chunk);
+
+    begin = MIN(begin, edits[i].pos);
+    end = MAX(end, edits[i].pos + edits[i].len);
+    end = end - edits[i].len + chunk_len;
+
+    erased += edits[i].len;
+    inserted += chunk_len;
+  }
+
+  *pos = begin;
+  *len = end - begin + erased - inserted;
+
+  result = inf_text_buffer_get_slice(buffer, *pos, *len);
+  for(i = 0; i < n_edits; ++i)
+  {
+    if(edits[i].len > 0)
+      inf_text_chunk_erase(result, edits[i].pos - begin, edits[i].len);
+
+    if(edits[i].chunk != NULL)
+    {
+      inf_text_chunk_insert_chunk(
+        result,
+        edits[i].pos - begin,
+        edits[i].chunk
+      );
+    }
+  }
+
+  return result;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -50,6 +50,24 @@ typedef struct _InfTextBufferInterface InfTextBufferInterface;
  */
 typedef struct _InfTextBufferIter InfTextBufferIter;
 
+/**
+ * InfTextBufferEdit:
+ * @pos: Character offset at which the edit takes place.
+ * @len: Number of characters to erase at @pos.
+ * @chunk: (allow-none): Text to insert at @pos after having erased @len
+ * characters, or %NULL.
+ *
+ * Describes a single modification of a batch applied with
+ * inf_text_buffer_apply_batch(). @pos refers to the buffer content after
+ * all previous edits of the batch have been applied.
+ */
+typedef struct _InfTextBufferEdit InfTextBufferEdit;
+struct _InfTextBufferEdit {
+  guint pos;
+  guint len;
+  InfTextChunk* chunk;
+};
+
 /**
  * InfTextBufferInterface:
  * @get_encoding: Virtual function which returns the character coding of the
@@ -83,6 +101,13 @@ typedef struct _InfTextBufferIter InfTextBufferIter;
  * signal.
  * @text_erased: Default signal handler of the #InfTextBuffer::text-erased
  * signal.
+ * @append: Virtual function to insert text at the end of the buffer. If
+ * %NULL, @insert_text is used instead.
+ * @clear: Virtual function to remove all text from the buffer. If %NULL,
+ * @erase_text is used instead.
+ * @apply_batch: Virtual function to apply a sequence of edits to the
+ * buffer. If %NULL, the edits are applied one by one with @erase_text and
+ * @insert_text.
  *
  * This structure contains virtual functions and signal handlers of the
  * #InfTextBuffer interface.
@@ -150,6 +175,19 @@ struct _InfTextBufferInterface {
                      guint pos,
                      InfTextChunk* chunk,
                      InfUser* user);
+
+  /* Added after the signal handlers to keep the existing slot offsets */
+  void(*append)(InfTextBuffer* buffer,
+                InfTextChunk* chunk,
+                InfUser* user);
+
+  void(*clear)(InfTextBuffer* buffer,
+               InfUser* user);
+
+  void(*apply_batch)(InfTextBuffer* buffer,
+                     const InfTextBufferEdit* edits,
+                     guint n_edits,
+                     InfUser* user);
 };
 
 GType
@@ -186,6 +224,21 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
                            guint len,
                            InfUser* user);
 
+void
+inf_text_buffer_append(InfTextBuffer* buffer,
+                       InfTextChunk* chunk,
+                       InfUser* user);
+
+void
+inf_text_buffer_clear(InfTextBuffer* buffer,
+                      InfUser* user);
+
+void
+inf_text_buffer_apply_batch(InfTextBuffer* buffer,
+                            const InfTextBufferEdit* edits,
+                            guint n_edits,
+                            InfUser* user);
+
 InfTextBufferIter*
 inf_text_buffer_create_begin_iter(InfTextBuffer* buffer);
 
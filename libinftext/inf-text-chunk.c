@@ -47,6 +47,7 @@
 
 #include <libinftext/inf-text-chunk.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-utf8.h>
 
 #include <string.h>
 
@@ -57,270 +58,1224 @@ G_DEFINE_BOXED_TYPE(InfTextChunk, inf_text_chunk, inf_text_chunk_copy, inf_text_
 /*#define CHUNK_CHECK_INTEGRITY*/
 
 typedef struct _InfTextChunkPath InfTextChunkPath;
+typedef struct _InfTextChunkSegment InfTextChunkSegment;
+typedef struct _InfTextChunkTree InfTextChunkTree;
+typedef struct _InfTextChunkBuffer InfTextChunkBuffer;
+
 struct _InfTextChunkPath {
   gsize (*get_byte_index)(InfTextChunk* chunk,
-                          gchar* text,
-                          gsize bytes,
+                          InfTextChunkSegment* segment,
                           guint offset);
+
+  /* Used by inf_text_chunk_get_byte_index_indexed() to advance count
+   * characters in text. */
+  gsize (*skip)(InfTextChunk* chunk,
+                const gchar* text,
+                gsize bytes,
+                guint count);
+
+  /* Number of bytes per character, for fixed-width encodings */
+  guint width;
 };
 
+/* The segments are stored in a treap, ordered by their position in the
+ * chunk. Instead of an absolute offset, each segment only knows its own
+ * length, and every node caches the total number of characters and bytes
+ * in its subtree. This allows to look up, insert and remove segments in
+ * O(log n), without having to adjust all segments behind the modified one.
+ *
+ * Chunks are copied very often, so the tree is shared between a chunk and
+ * its copies, and only duplicated when one of them is modified. The text
+ * of the segments lives in reference-counted buffers which are shared even
+ * between the segments of different trees, so that neither copying the
+ * tree nor taking a substring copies any text. */
 struct _InfTextChunk {
-  GSequence* segments;
+  InfTextChunkTree* tree;
   guint length; /* in characters */
   GQuark encoding;
 
   const InfTextChunkPath* path;
+  /* Conversion descriptor for inf_text_chunk_skip_iconv(), opened on
+   * first use. This is not shared with copies of the chunk. */
+  GIConv iconv;
 };
 
-typedef struct _InfTextChunkSegment InfTextChunkSegment;
+struct _InfTextChunkTree {
+  gint ref_count;
+  InfTextChunkSegment* root;
+};
+
+/* The text of a buffer follows directly behind this header. A buffer must
+ * only be modified if it is referenced by a single segment. */
+struct _InfTextChunkBuffer {
+  gint ref_count;
+  gsize size; /* allocated text bytes */
+};
+
+#define INF_TEXT_CHUNK_BUFFER_DATA(buffer) ((gchar*)((buffer) + 1))
+
 struct _InfTextChunkSegment {
   guint author;
+  InfTextChunkBuffer* buffer;
   /* This is gchar so that we can do pointer arithmetic. It does not
    * necessarily store a full character in each byte. This depends on the
-   * encoding specified in the InfTextChunk. */
+   * encoding specified in the InfTextChunk. It points into the data of
+   * buffer, not necessarily to its beginning. */
   gchar* text;
   gsize length; /* in bytes */
-  guint offset; /* absolute to chunk begin in characters, sort criteria */
+  guint chars; /* in characters */
+
+  /* For variable-width encodings other than UTF-8, this caches the byte
+   * index of every INF_TEXT_CHUNK_INDEX_STRIDE-th character in text. It is
+   * filled lazily and truncated when the segment is modified. */
+  GArray* index;
+
+  InfTextChunkSegment* parent;
+  InfTextChunkSegment* left;
+  InfTextChunkSegment* right;
+  guint priority;
+
+  guint subtree_chars;
+  gsize subtree_bytes;
 };
 
+/* Distance in characters between two entries in a segment's index */
+#define INF_TEXT_CHUNK_INDEX_STRIDE 64
+
 /*
  * get_byte_index paths
  */
 
-gsize inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
-                                         gchar* text,
-                                         gsize bytes,
-                                         guint offset)
+static gsize
+inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
+                                   InfTextChunkSegment* segment,
+                                   guint offset)
 {
 #ifdef CHUNK_CHECK_INTEGRITY
-  g_assert(offset <= g_utf8_strlen(text, bytes));
+  g_assert(offset <= g_utf8_strlen(segment->text, segment->length));
 #endif
 
-  return g_utf8_offset_to_pointer(text, offset) - text;
+  return inf_utf8_offset_to_index(segment->text, segment->length, offset);
+}
+
+static gsize
+inf_text_chunk_get_byte_index_fixed(InfTextChunk* self,
+                                    InfTextChunkSegment* segment,
+                                    guint offset)
+{
+  return (gsize)offset * self->path->width;
+}
+
+static gsize
+inf_text_chunk_get_byte_index_linear(InfTextChunk* self,
+                                     InfTextChunkSegment* segment,
+                                     guint offset)
+{
+  return self->path->skip(self, segment->text, segment->length, offset);
+}
+
+static gsize
+inf_text_chunk_get_byte_index_indexed(InfTextChunk* self,
+                                      InfTextChunkSegment* segment,
+                                      guint offset)
+{
+  guint checkpoint;
+  gsize index;
+  gsize next;
+
+  checkpoint = offset / INF_TEXT_CHUNK_INDEX_STRIDE;
+
+  if(g_atomic_int_get(&self->tree->ref_count) > 1)
+  {
+    /* The segment is shared with other chunks which might be accessed from
+     * another thread, so only use what is already there, but do not
+     * modify the index. */
+    if(segment->index != NULL)
+    {
+      checkpoint = MIN(checkpoint, segment->index->len - 1);
+      index = g_array_index(segment->index, gsize, checkpoint);
+    }
+    else
+    {
+      checkpoint = 0;
+      index = 0;
+    }
+  }
+  else
+  {
+    if(segment->index == NULL)
+    {
+      segment->index = g_array_new(FALSE, FALSE, sizeof(gsize));
+      index = 0;
+      g_array_append_val(segment->index, index);
+    }
+
+    while(segment->index->len <= checkpoint)
+    {
+      index = g_array_index(segment->index, gsize, segment->index->len - 1);
+
+      next = index + self->path->skip(
+        self,
+        segment->text + index,
+        segment->length - index,
+        INF_TEXT_CHUNK_INDEX_STRIDE
+      );
+
+      g_array_append_val(segment->index, next);
+    }
+
+    index = g_array_index(segment->index, gsize, checkpoint);
+  }
+
+  return index + self->path->skip(
+    self,
+    segment->text + index,
+    segment->length - index,
+    offset - checkpoint * INF_TEXT_CHUNK_INDEX_STRIDE
+  );
+}
+
+/*
+ * skip functions for the indexed path
+ */
+
+static gsize
+inf_text_chunk_skip_utf16le(InfTextChunk* self,
+                            const gchar* text,
+                            gsize bytes,
+                            guint count)
+{
+  const guchar* pos;
+  pos = (const guchar*)text;
+
+  for(; count > 0; --count)
+  {
+    g_assert(pos + 2 <= (const guchar*)text + bytes);
+
+    /* Skip the low surrogate if this is a high surrogate */
+    if((pos[1] & 0xfc) == 0xd8)
+      pos += 4;
+    else
+      pos += 2;
+  }
+
+  return pos - (const guchar*)text;
+}
+
+static gsize
+inf_text_chunk_skip_utf16be(InfTextChunk* self,
+                            const gchar* text,
+                            gsize bytes,
+                            guint count)
+{
+  const guchar* pos;
+  pos = (const guchar*)text;
+
+  for(; count > 0; --count)
+  {
+    g_assert(pos + 2 <= (const guchar*)text + bytes);
+
+    if((pos[0] & 0xfc) == 0xd8)
+      pos += 4;
+    else
+      pos += 2;
+  }
+
+  return pos - (const guchar*)text;
 }
 
-gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
-                                          gchar* text,
-                                          gsize bytes,
-                                          guint offset)
+static void
+inf_text_chunk_reset_iconv(InfTextChunk* self)
 {
-  /* We convert the segment's text into UCS-4, character by character.
-   * This assumes every UCS-4 character is 4 bytes in length */
+  if(self->iconv == (GIConv)-1)
+  {
+    self->iconv = g_iconv_open("UCS-4", g_quark_to_string(self->encoding));
+    g_assert(self->iconv != (GIConv)-1);
+  }
+  else
+  {
+    /* Reset shift state */
+    g_iconv(self->iconv, NULL, NULL, NULL, NULL);
+  }
+}
 
-  /* This is quite inefficient, but a general-purpose solution. It looks like
-   * libicu has a function, UCharIteratorMove, which would allow us to move
-   * directly N characters ahead and get the new byte index.
+static gsize
+inf_text_chunk_skip_iconv(InfTextChunk* self,
+                          const gchar* text,
+                          gsize bytes,
+                          guint count)
+{
+  /* We convert the segment's text into UCS-4 and limit the output buffer
+   * to the number of characters we want to skip, so that iconv stops
+   * right behind them. This assumes every UCS-4 character is 4 bytes in
+   * length. */
+
+  /* This is still not very efficient, but a general-purpose solution. It
+   * looks like libicu has a function, UCharIteratorMove, which would allow
+   * us to move directly N characters ahead and get the new byte index.
    * TODO: We could profile it, and if it brings a benefit, we could use it,
    * maybe with an option to fall back to iconv at configure time */
 
-  GIConv cd;
-  gchar buffer[4];
-
+  gchar buffer[4 * INF_TEXT_CHUNK_INDEX_STRIDE];
   gchar* inbuf;
   gchar* outbuf;
   gsize inlen;
   gsize outlen;
-  guint count;
-  gsize result;
+  guint n;
 
-  cd = g_iconv_open("UCS-4", g_quark_to_string(self->encoding));
-  g_assert(cd != (GIConv)-1);
+  inf_text_chunk_reset_iconv(self);
 
-  inbuf = text;
+  inbuf = (gchar*)text;
   inlen = bytes;
 
-  for(count = 0; count < offset; ++count)
+  while(count > 0)
   {
-    g_assert(inlen > 0);
+    n = MIN(count, INF_TEXT_CHUNK_INDEX_STRIDE);
 
     outbuf = buffer;
-    outlen = 4;
+    outlen = 4 * n;
 
-    result = g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
-    g_assert(result == (size_t)(-1)); /* errno == E2BIG */
+    /* This either fails with E2BIG because the output buffer is full, or
+     * succeeds because the input ends exactly after n characters. */
+    g_iconv(self->iconv, &inbuf, &inlen, &outbuf, &outlen);
+    g_assert(outlen == 0);
+
+    count -= n;
   }
 
-  g_iconv_close(cd);
   return bytes - inlen;
 }
 
-const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF8 = {
-  inf_text_chunk_get_byte_index_utf8
+/* Returns the number of characters that text decodes to, or a number
+ * greater than one if it is more than a few. */
+static guint
+inf_text_chunk_count_iconv(InfTextChunk* self,
+                           const gchar* text,
+                           gsize bytes)
+{
+  gchar buffer[4 * 4];
+  gchar* inbuf;
+  gchar* outbuf;
+  gsize inlen;
+  gsize outlen;
+
+  inf_text_chunk_reset_iconv(self);
+
+  inbuf = (gchar*)text;
+  inlen = bytes;
+  outbuf = buffer;
+  outlen = sizeof(buffer);
+
+  /* The second call writes out a character that iconv holds back in case
+   * a combining mark follows. */
+  g_iconv(self->iconv, &inbuf, &inlen, &outbuf, &outlen);
+  g_iconv(self->iconv, NULL, NULL, &outbuf, &outlen);
+
+  return (sizeof(buffer) - outlen) / 4;
+}
+
+/* For single-byte encodings in which iconv composes a letter with the
+ * combining marks following it into one character, such as CP1255 and
+ * CP1258. iconv holds a letter back until it has seen the next byte, so
+ * skip_iconv cannot be used. Instead, a character is extended by the bytes
+ * following it for as long as they still decode to a single character. All
+ * combining marks of these encodings are in the upper half of the code
+ * page, so iconv is only asked for those. */
+static gsize
+inf_text_chunk_skip_iconv_composing(InfTextChunk* self,
+                                    const gchar* text,
+                                    gsize bytes,
+                                    guint count)
+{
+  gsize start;
+  gsize end;
+
+  start = 0;
+  for(; count > 0; --count)
+  {
+    g_assert(start < bytes);
+
+    end = start + 1;
+    while(end < bytes && (guchar)text[end] >= 0xc0 &&
+          inf_text_chunk_count_iconv(self, text + start, end + 1 - start) == 1)
+    {
+      ++end;
+    }
+
+    start = end;
+  }
+
+  return start;
+}
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF8 = {
+  inf_text_chunk_get_byte_index_utf8,
+  NULL,
+  0
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_FIXED1 = {
+  inf_text_chunk_get_byte_index_fixed,
+  NULL,
+  1
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_FIXED2 = {
+  inf_text_chunk_get_byte_index_fixed,
+  NULL,
+  2
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_FIXED4 = {
+  inf_text_chunk_get_byte_index_fixed,
+  NULL,
+  4
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16LE = {
+  inf_text_chunk_get_byte_index_indexed,
+  inf_text_chunk_skip_utf16le,
+  0
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16BE = {
+  inf_text_chunk_get_byte_index_indexed,
+  inf_text_chunk_skip_utf16be,
+  0
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
+  inf_text_chunk_get_byte_index_indexed,
+  inf_text_chunk_skip_iconv,
+  0
+};
+
+/* Checkpoints of the index are at character boundaries, after which iconv
+ * starts a new character regardless of the bytes before. */
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV_COMPOSING = {
+  inf_text_chunk_get_byte_index_indexed,
+  inf_text_chunk_skip_iconv_composing,
+  0
+};
+
+/* Stateful encodings cannot be decoded starting in the middle of a text, so
+ * we cannot use an index for them. */
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV_STATEFUL = {
+  inf_text_chunk_get_byte_index_linear,
+  inf_text_chunk_skip_iconv,
+  0
 };
 
-const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
-  inf_text_chunk_get_byte_index_iconv
+typedef struct _InfTextChunkEncodingPath InfTextChunkEncodingPath;
+struct _InfTextChunkEncodingPath {
+  const gchar* encoding;
+  const InfTextChunkPath* path;
 };
 
+/* Encodings with a specialized path, all others use
+ * INF_TEXT_CHUNK_PATH_ICONV. Note that UTF-16 and UTF-32 without explicit
+ * byte order are not in this list since they might be prefixed by a byte
+ * order mark. */
+static const InfTextChunkEncodingPath INF_TEXT_CHUNK_ENCODING_PATHS[] = {
+  { "UTF-8", &INF_TEXT_CHUNK_PATH_UTF8 },
+  { "UTF8", &INF_TEXT_CHUNK_PATH_UTF8 },
+  { "ASCII", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "US-ASCII", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ANSI_X3.4-1968", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "LATIN1", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "LATIN2", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "LATIN9", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-1", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-2", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-3", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-4", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-5", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-6", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-7", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-8", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-9", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-10", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-11", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-13", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-14", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-15", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "ISO-8859-16", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "KOI8-R", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "KOI8-U", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1250", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1251", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1252", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1253", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1254", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1256", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "CP1257", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1250", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1251", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1252", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1253", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1254", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1256", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "WINDOWS-1257", &INF_TEXT_CHUNK_PATH_FIXED1 },
+  { "UCS-2BE", &INF_TEXT_CHUNK_PATH_FIXED2 },
+  { "UCS-2LE", &INF_TEXT_CHUNK_PATH_FIXED2 },
+  { "UCS-4", &INF_TEXT_CHUNK_PATH_FIXED4 },
+  { "UCS-4BE", &INF_TEXT_CHUNK_PATH_FIXED4 },
+  { "UCS-4LE", &INF_TEXT_CHUNK_PATH_FIXED4 },
+  { "UTF-32BE", &INF_TEXT_CHUNK_PATH_FIXED4 },
+  { "UTF-32LE", &INF_TEXT_CHUNK_PATH_FIXED4 },
+  { "UTF-16LE", &INF_TEXT_CHUNK_PATH_UTF16LE },
+  { "UTF-16BE", &INF_TEXT_CHUNK_PATH_UTF16BE },
+  { "ISO-2022-JP", &INF_TEXT_CHUNK_PATH_ICONV_STATEFUL },
+  { "ISO-2022-JP-2", &INF_TEXT_CHUNK_PATH_ICONV_STATEFUL },
+  { "ISO-2022-KR", &INF_TEXT_CHUNK_PATH_ICONV_STATEFUL },
+  { "ISO-2022-CN", &INF_TEXT_CHUNK_PATH_ICONV_STATEFUL },
+  { "UTF-7", &INF_TEXT_CHUNK_PATH_ICONV_STATEFUL },
+  /* iconv composes a letter with the combining marks following it for
+   * these, so one byte is not always one character */
+  { "CP1255", &INF_TEXT_CHUNK_PATH_ICONV_COMPOSING },
+  { "CP1258", &INF_TEXT_CHUNK_PATH_ICONV_COMPOSING },
+  { "WINDOWS-1255", &INF_TEXT_CHUNK_PATH_ICONV_COMPOSING },
+  { "WINDOWS-1258", &INF_TEXT_CHUNK_PATH_ICONV_COMPOSING }
+};
+
+static const InfTextChunkPath*
+inf_text_chunk_lookup_path(const gchar* encoding)
+{
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEXT_CHUNK_ENCODING_PATHS); ++i)
+  {
+    if(g_ascii_strcasecmp(INF_TEXT_CHUNK_ENCODING_PATHS[i].encoding,
+                          encoding) == 0)
+    {
+      return INF_TEXT_CHUNK_ENCODING_PATHS[i].path;
+    }
+  }
+
+  return &INF_TEXT_CHUNK_PATH_ICONV;
+}
+
 /*
  * Helper functions
  */
 
+static InfTextChunkBuffer*
+inf_text_chunk_buffer_new(gsize size)
+{
+  InfTextChunkBuffer* buffer;
+
+  buffer = g_malloc(sizeof(InfTextChunkBuffer) + size);
+  buffer->ref_count = 1;
+  buffer->size = size;
+
+  return buffer;
+}
+
+static void
+inf_text_chunk_buffer_unref(InfTextChunkBuffer* buffer)
+{
+  if(g_atomic_int_dec_and_test(&buffer->ref_count))
+    g_free(buffer);
+}
+
+/* Takes ownership of the reference to buffer. text needs to point into the
+ * buffer's data. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new(guint author,
+                           InfTextChunkBuffer* buffer,
+                           gchar* text,
+                           gsize length,
+                           guint chars)
+{
+  InfTextChunkSegment* segment;
+  guint key;
+
+  segment = g_slice_new(InfTextChunkSegment);
+  segment->author = author;
+  segment->buffer = buffer;
+  segment->text = text;
+  segment->length = length;
+  segment->chars = chars;
+  segment->index = NULL;
+
+  segment->parent = NULL;
+  segment->left = NULL;
+  segment->right = NULL;
+
+  /* The priority only needs to be pseudo-random to keep the tree balanced
+   * in the average case. Like GSequence, we derive it from the address of
+   * the node, which saves us from having to lock the global random number
+   * generator. This hash function is based on one found on Thomas Wang's
+   * web page. */
+  key = GPOINTER_TO_UINT(segment);
+  key = (key << 15) - key - 1;
+  key = key ^ (key >> 12);
+  key = key + (key << 2);
+  key = key ^ (key >> 4);
+  key = key + (key << 3) + (key << 11);
+  key = key ^ (key >> 16);
+  segment->priority = key;
+
+  segment->subtree_chars = chars;
+  segment->subtree_bytes = length;
+  return segment;
+}
+
+/* Creates a new segment with a copy of text */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new_copy(guint author,
+                                gconstpointer text,
+                                gsize bytes,
+                                guint chars)
+{
+  InfTextChunkBuffer* buffer;
+
+  buffer = inf_text_chunk_buffer_new(bytes);
+  memcpy(INF_TEXT_CHUNK_BUFFER_DATA(buffer), text, bytes);
+
+  return inf_text_chunk_segment_new(
+    author,
+    buffer,
+    INF_TEXT_CHUNK_BUFFER_DATA(buffer),
+    bytes,
+    chars
+  );
+}
+
+/* Creates a new segment with the text of segment between the byte indices
+ * begin and end, consisting of chars characters. The text is shared with
+ * segment, not copied. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new_part(InfTextChunkSegment* segment,
+                                gsize begin,
+                                gsize end,
+                                guint chars)
+{
+  g_assert(begin <= end && end <= segment->length);
+  g_atomic_int_inc(&segment->buffer->ref_count);
+
+  return inf_text_chunk_segment_new(
+    segment->author,
+    segment->buffer,
+    segment->text + begin,
+    end - begin,
+    chars
+  );
+}
+
 static void
 inf_text_chunk_segment_free(InfTextChunkSegment* segment)
 {
-  g_free(segment->text);
+  if(segment->index != NULL)
+    g_array_free(segment->index, TRUE);
+
+  inf_text_chunk_buffer_unref(segment->buffer);
   g_slice_free(InfTextChunkSegment, segment);
 }
 
-static int
-inf_text_chunk_segment_cmp(gconstpointer first,
-                           gconstpointer second,
-                           gpointer userdata)
-{
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
- 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
-
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
-
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return 0;
-  else
-    return 1;
+static void
+inf_text_chunk_segment_free_tree(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+  {
+    inf_text_chunk_segment_free_tree(segment->left);
+    inf_text_chunk_segment_free_tree(segment->right);
+    inf_text_chunk_segment_free(segment);
+  }
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_copy_tree(InfTextChunkSegment* segment,
+                                 InfTextChunkSegment* parent)
+{
+  InfTextChunkSegment* new_segment;
+
+  if(segment == NULL)
+    return NULL;
+
+  /* Keep the shape and priorities of the original tree, so that no
+   * rebalancing is required for the copy. The text is shared. */
+  g_atomic_int_inc(&segment->buffer->ref_count);
+
+  new_segment = g_slice_new(InfTextChunkSegment);
+  new_segment->author = segment->author;
+  new_segment->buffer = segment->buffer;
+  new_segment->text = segment->text;
+  new_segment->length = segment->length;
+  new_segment->chars = segment->chars;
+  new_segment->index = NULL;
+  new_segment->parent = parent;
+  new_segment->priority = segment->priority;
+  new_segment->subtree_chars = segment->subtree_chars;
+  new_segment->subtree_bytes = segment->subtree_bytes;
+
+  new_segment->left =
+    inf_text_chunk_segment_copy_tree(segment->left, new_segment);
+  new_segment->right =
+    inf_text_chunk_segment_copy_tree(segment->right, new_segment);
+
+  return new_segment;
+}
+
+static InfTextChunkTree*
+inf_text_chunk_tree_new(InfTextChunkSegment* root)
+{
+  InfTextChunkTree* tree;
+
+  tree = g_slice_new(InfTextChunkTree);
+  tree->ref_count = 1;
+  tree->root = root;
+
+  return tree;
+}
+
+static void
+inf_text_chunk_tree_unref(InfTextChunkTree* tree)
+{
+  if(g_atomic_int_dec_and_test(&tree->ref_count))
+  {
+    inf_text_chunk_segment_free_tree(tree->root);
+    g_slice_free(InfTextChunkTree, tree);
+  }
+}
+
+/* Makes sure the segment tree of self is not shared with another chunk, so
+ * that it can be modified. This must be called before any segment of self
+ * is looked up for modification. */
+static void
+inf_text_chunk_make_writable(InfTextChunk* self)
+{
+  InfTextChunkTree* tree;
+
+  if(g_atomic_int_get(&self->tree->ref_count) > 1)
+  {
+    tree = inf_text_chunk_tree_new(
+      inf_text_chunk_segment_copy_tree(self->tree->root, NULL)
+    );
+
+    inf_text_chunk_tree_unref(self->tree);
+    self->tree = tree;
+  }
+}
+
+static guint
+inf_text_chunk_segment_subtree_chars(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->subtree_chars;
+}
+
+static gsize
+inf_text_chunk_segment_subtree_bytes(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->subtree_bytes;
+}
+
+static void
+inf_text_chunk_segment_update(InfTextChunkSegment* segment)
+{
+  segment->subtree_chars = segment->chars +
+    inf_text_chunk_segment_subtree_chars(segment->left) +
+    inf_text_chunk_segment_subtree_chars(segment->right);
+
+  segment->subtree_bytes = segment->length +
+    inf_text_chunk_segment_subtree_bytes(segment->left) +
+    inf_text_chunk_segment_subtree_bytes(segment->right);
+}
+
+/* Updates the cached subtree sizes of segment and all of its ancestors. Needs
+ * to be called whenever the length of segment has changed. */
+static void
+inf_text_chunk_segment_update_path(InfTextChunkSegment* segment)
+{
+  for(; segment != NULL; segment = segment->parent)
+    inf_text_chunk_segment_update(segment);
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_first(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->left != NULL)
+      segment = segment->left;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_last(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->right != NULL)
+      segment = segment->right;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_next(InfTextChunkSegment* segment)
+{
+  if(segment->right != NULL)
+    return inf_text_chunk_segment_first(segment->right);
+
+  while(segment->parent != NULL && segment->parent->right == segment)
+    segment = segment->parent;
+
+  return segment->parent;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_prev(InfTextChunkSegment* segment)
+{
+  if(segment->left != NULL)
+    return inf_text_chunk_segment_last(segment->left);
+
+  while(segment->parent != NULL && segment->parent->left == segment)
+    segment = segment->parent;
+
+  return segment->parent;
+}
+
+/* Returns the character offset of the segment, relative to the beginning
+ * of the chunk. */
+static guint
+inf_text_chunk_segment_get_offset(InfTextChunkSegment* segment)
+{
+  guint offset;
+
+  offset = inf_text_chunk_segment_subtree_chars(segment->left);
+  for(; segment->parent != NULL; segment = segment->parent)
+  {
+    if(segment->parent->right == segment)
+    {
+      offset += segment->parent->chars +
+        inf_text_chunk_segment_subtree_chars(segment->parent->left);
+    }
+  }
+
+  return offset;
+}
+
+/* Drops all entries from the segment's index that are behind the byte index
+ * index, since the segment is about to be modified at that position. */
+static void
+inf_text_chunk_segment_invalidate_index(InfTextChunkSegment* segment,
+                                        gsize index)
+{
+  guint len;
+
+  if(segment->index != NULL)
+  {
+    len = segment->index->len;
+    while(len > 1 && g_array_index(segment->index, gsize, len - 1) > index)
+      --len;
+
+    g_array_set_size(segment->index, len);
+  }
+}
+
+/* Inserts bytes bytes of text, consisting of chars characters, into segment
+ * at byte index index. If the segment's buffer is shared with other
+ * segments, then the segment's text is copied into a new buffer first. */
+static void
+inf_text_chunk_segment_insert(InfTextChunkSegment* segment,
+                              gsize index,
+                              const gchar* text,
+                              gsize bytes,
+                              guint chars)
+{
+  InfTextChunkBuffer* buffer;
+  gsize text_offset;
+
+  g_assert(index <= segment->length);
+  inf_text_chunk_segment_invalidate_index(segment, index);
+
+  if(g_atomic_int_get(&segment->buffer->ref_count) == 1)
+  {
+    buffer = segment->buffer;
+    text_offset = segment->text - INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+
+    if(text_offset + segment->length + bytes > buffer->size)
+    {
+      buffer = g_realloc(
+        buffer,
+        sizeof(InfTextChunkBuffer) + text_offset + segment->length + bytes
+      );
+
+      buffer->size = text_offset + segment->length + bytes;
+      segment->buffer = buffer;
+      segment->text = INF_TEXT_CHUNK_BUFFER_DATA(buffer) + text_offset;
+    }
+
+    if(index < segment->length)
+    {
+      g_memmove(
+        segment->text + index + bytes,
+        segment->text + index,
+        segment->length - index
+      );
+    }
+
+    memcpy(segment->text + index, text, bytes);
+  }
+  else
+  {
+    buffer = inf_text_chunk_buffer_new(segment->length + bytes);
+
+    memcpy(INF_TEXT_CHUNK_BUFFER_DATA(buffer), segment->text, index);
+    memcpy(INF_TEXT_CHUNK_BUFFER_DATA(buffer) + index, text, bytes);
+
+    memcpy(
+      INF_TEXT_CHUNK_BUFFER_DATA(buffer) + index + bytes,
+      segment->text + index,
+      segment->length - index
+    );
+
+    inf_text_chunk_buffer_unref(segment->buffer);
+    segment->buffer = buffer;
+    segment->text = INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+  }
+
+  segment->length += bytes;
+  segment->chars += chars;
+
+  inf_text_chunk_segment_update_path(segment);
+}
+
+/* Removes the text between the byte indices begin and end, consisting of
+ * chars characters, from segment. */
+static void
+inf_text_chunk_segment_erase(InfTextChunkSegment* segment,
+                             gsize begin,
+                             gsize end,
+                             guint chars)
+{
+  InfTextChunkBuffer* buffer;
+
+  g_assert(begin <= end && end <= segment->length);
+  inf_text_chunk_segment_invalidate_index(segment, begin);
+
+  if(end == segment->length)
+  {
+    /* Don't realloc to make smaller */
+  }
+  else if(g_atomic_int_get(&segment->buffer->ref_count) == 1)
+  {
+    g_memmove(
+      segment->text + begin,
+      segment->text + end,
+      segment->length - end
+    );
+  }
+  else if(begin == 0)
+  {
+    /* The buffer is shared, but we can simply skip the erased text */
+    segment->text += end;
+  }
+  else
+  {
+    buffer = inf_text_chunk_buffer_new(segment->length - (end - begin));
+    memcpy(INF_TEXT_CHUNK_BUFFER_DATA(buffer), segment->text, begin);
+
+    memcpy(
+      INF_TEXT_CHUNK_BUFFER_DATA(buffer) + begin,
+      segment->text + end,
+      segment->length - end
+    );
+
+    inf_text_chunk_buffer_unref(segment->buffer);
+    segment->buffer = buffer;
+    segment->text = INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+  }
+
+  segment->length -= end - begin;
+  segment->chars -= chars;
+
+  inf_text_chunk_segment_update_path(segment);
+}
+
+/* Moves segment one level up in the tree, making its parent its child. */
+static void
+inf_text_chunk_rotate_up(InfTextChunk* self,
+                         InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* parent;
+  InfTextChunkSegment* grandparent;
+
+  parent = segment->parent;
+  grandparent = parent->parent;
+
+  if(parent->left == segment)
+  {
+    parent->left = segment->right;
+    if(segment->right != NULL) segment->right->parent = parent;
+    segment->right = parent;
+  }
+  else
+  {
+    parent->right = segment->left;
+    if(segment->left != NULL) segment->left->parent = parent;
+    segment->left = parent;
+  }
+
+  parent->parent = segment;
+  segment->parent = grandparent;
+
+  if(grandparent == NULL)
+    self->tree->root = segment;
+  else if(grandparent->left == parent)
+    grandparent->left = segment;
+  else
+    grandparent->right = segment;
+
+  /* The ancestors still contain the same segments, so only the two rotated
+   * nodes need to be updated. */
+  inf_text_chunk_segment_update(parent);
+  inf_text_chunk_segment_update(segment);
+}
+
+/* Inserts segment into self before the segment before. If before is NULL,
+ * then segment is appended at the end of the chunk. Note that this does not
+ * adjust self->length. */
+static void
+inf_text_chunk_insert_segment_before(InfTextChunk* self,
+                                     InfTextChunkSegment* before,
+                                     InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* parent;
+
+  segment->left = NULL;
+  segment->right = NULL;
+
+  if(self->tree->root == NULL)
+  {
+    g_assert(before == NULL);
+    segment->parent = NULL;
+    self->tree->root = segment;
+  }
+  else
+  {
+    if(before == NULL)
+    {
+      parent = inf_text_chunk_segment_last(self->tree->root);
+      parent->right = segment;
+    }
+    else if(before->left == NULL)
+    {
+      parent = before;
+      parent->left = segment;
+    }
+    else
+    {
+      parent = inf_text_chunk_segment_last(before->left);
+      parent->right = segment;
+    }
+
+    segment->parent = parent;
+  }
+
+  inf_text_chunk_segment_update_path(segment);
+
+  /* Restore heap property */
+  while(segment->parent != NULL &&
+        segment->parent->priority < segment->priority)
+  {
+    inf_text_chunk_rotate_up(self, segment);
+  }
 }
 
-/* This is a special comparison function which is only used
- * in inf_text_chunk_get_segment. It makes sure that when two segments
- * have the same offset, the second one gets sorted behind. This ensures
- * that the first segment in the sequence is never returned, since it
- * always has offset 0, which is a precondition for the algorithm
- * in inf_text_chunk_get_segment. See also libinfinity github issue #10. */
-static int
-inf_text_chunk_segment_cmp_for_get_segment(gconstpointer first,
-                                           gconstpointer second,
-                                           gpointer userdata)
+/* Removes segment from self and frees it. Note that this does not adjust
+ * self->length. */
+static void
+inf_text_chunk_remove_segment(InfTextChunk* self,
+                              InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
+  InfTextChunkSegment* child;
+  InfTextChunkSegment* parent;
+
+  /* Move the segment down until it has at most one child */
+  while(segment->left != NULL && segment->right != NULL)
+  {
+    if(segment->left->priority > segment->right->priority)
+      inf_text_chunk_rotate_up(self, segment->left);
+    else
+      inf_text_chunk_rotate_up(self, segment->right);
+  }
 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+  if(segment->left != NULL)
+    child = segment->left;
+  else
+    child = segment->right;
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+  parent = segment->parent;
+  if(child != NULL)
+    child->parent = parent;
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return -1;
+  if(parent == NULL)
+    self->tree->root = child;
+  else if(parent->left == segment)
+    parent->left = child;
   else
-    return 1;
+    parent->right = child;
+
+  inf_text_chunk_segment_update_path(parent);
+  inf_text_chunk_segment_free(segment);
 }
 
-static guint
-inf_text_chunk_next_offset(InfTextChunk* self,
-                           GSequenceIter* iter)
+/* Removes all segments in the range [first, last). If last is NULL, then
+ * all segments from first until the end of the chunk are removed. */
+static void
+inf_text_chunk_remove_segments(InfTextChunk* self,
+                               InfTextChunkSegment* first,
+                               InfTextChunkSegment* last)
 {
-  GSequenceIter* next_iter;
+  InfTextChunkSegment* next;
 
-  g_assert(iter != g_sequence_get_end_iter(self->segments));
-  
-  next_iter = g_sequence_iter_next(iter);
-  if(next_iter == g_sequence_get_end_iter(self->segments))
-    return self->length;
-  else
-    return ((InfTextChunkSegment*)g_sequence_get(next_iter))->offset;
+  while(first != last)
+  {
+    next = inf_text_chunk_segment_next(first);
+    inf_text_chunk_remove_segment(self, first);
+    first = next;
+  }
 }
 
 #ifdef CHUNK_CHECK_INTEGRITY
 static gboolean
-inf_text_chunk_check_integrity(InfTextChunk* self)
+inf_text_chunk_check_segment_integrity(InfTextChunkSegment* segment)
 {
-  GSequenceIter* iter;
-  InfTextChunkSegment* segment;
-  guint offset;
-  guint new_offset;
-
-  offset = 0;
+  if(segment == NULL)
+    return TRUE;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
+  if(segment->left != NULL)
   {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    if(offset != segment->offset)
+    if(segment->left->parent != segment)
       return FALSE;
-
-    new_offset = inf_text_chunk_next_offset(self, iter);
-    if(new_offset <= offset)
+    if(segment->left->priority > segment->priority)
       return FALSE;
+  }
 
-    if(new_offset - offset > segment->length)
+  if(segment->right != NULL)
+  {
+    if(segment->right->parent != segment)
+      return FALSE;
+    if(segment->right->priority > segment->priority)
       return FALSE;
+  }
+
+  if(segment->chars == 0 || segment->chars > segment->length)
+    return FALSE;
+
+  if(segment->text < INF_TEXT_CHUNK_BUFFER_DATA(segment->buffer))
+    return FALSE;
+
+  if(segment->text + segment->length >
+     INF_TEXT_CHUNK_BUFFER_DATA(segment->buffer) + segment->buffer->size)
+  {
+    return FALSE;
+  }
+
+  if(segment->subtree_chars != segment->chars +
+     inf_text_chunk_segment_subtree_chars(segment->left) +
+     inf_text_chunk_segment_subtree_chars(segment->right))
+  {
+    return FALSE;
+  }
 
-    offset = new_offset;
+  if(segment->subtree_bytes != segment->length +
+     inf_text_chunk_segment_subtree_bytes(segment->left) +
+     inf_text_chunk_segment_subtree_bytes(segment->right))
+  {
+    return FALSE;
   }
 
+  if(!inf_text_chunk_check_segment_integrity(segment->left))
+    return FALSE;
+  if(!inf_text_chunk_check_segment_integrity(segment->right))
+    return FALSE;
+
   return TRUE;
 }
+
+static gboolean
+inf_text_chunk_check_integrity(InfTextChunk* self)
+{
+  if(self->tree->root == NULL)
+    return self->length == 0;
+
+  if(self->tree->root->parent != NULL)
+    return FALSE;
+  if(self->tree->root->subtree_chars != self->length)
+    return FALSE;
+
+  return inf_text_chunk_check_segment_integrity(self->tree->root);
+}
 #endif
 
-static GSequenceIter*
+/* Returns the segment which contains the character at position pos. If pos
+ * is at the border of two segments, the latter one is returned. If pos is
+ * the length of the chunk, then the last segment is returned. index is set
+ * to the byte index in the segment's text where that character starts, and
+ * char_index to the number of characters before it in the segment. */
+static InfTextChunkSegment*
 inf_text_chunk_get_segment(InfTextChunk* self,
                            guint pos,
-                           gsize* index)
+                           gsize* index,
+                           guint* char_index)
 {
-  InfTextChunkSegment* found;
-  InfTextChunkSegment key;
-  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  guint left;
 
   g_assert(pos <= self->length);
 
-  /* only offset is relevant for lookup */
-  key.offset = pos;
-
-  /* TODO: Verify this does binary search */
-  iter = g_sequence_search(
-    self->segments,
-    &key,
-    inf_text_chunk_segment_cmp_for_get_segment,
-    NULL
-  );
+  segment = self->tree->root;
+  if(segment == NULL)
+  {
+    if(index != NULL) *index = 0;
+    if(char_index != NULL) *char_index = 0;
+    return NULL;
+  }
 
-  if(self->length > 0)
+  for(;;)
   {
-    g_assert(iter != g_sequence_get_begin_iter(self->segments));
+    left = inf_text_chunk_segment_subtree_chars(segment->left);
+    if(pos < left)
+    {
+      segment = segment->left;
+    }
+    else
+    {
+      pos -= left;
 
-    iter = g_sequence_iter_prev(iter);
-    found = g_sequence_get(iter);
+      /* This is not "<=" because it should rather find position 0 on the
+       * next segment in that case. */
+      if(pos < segment->chars || segment->right == NULL)
+        break;
 
-    g_assert(pos >= found->offset);
+      pos -= segment->chars;
+      segment = segment->right;
+    }
+  }
 
-    /* This is not "<=" because it should rather find position 0 on the
-     * next segment in that case. */
-    g_assert(pos <= inf_text_chunk_next_offset(self, iter));
+  g_assert(pos <= segment->chars);
 
-    /* Find byte index in the segment where the specified character starts.
-     * This is rather ugly, I wish iconv or glib or someone had some nice(r)
-     * API for this. */
-    if(index != NULL)
+  /* Find byte index in the segment where the specified character starts.
+   * This is rather ugly, I wish iconv or glib or someone had some nice(r)
+   * API for this. */
+  if(index != NULL)
+  {
+    if(pos == segment->chars)
     {
-      if(pos == inf_text_chunk_next_offset(self, iter))
-      {
-        *index = found->length;
-      }
-      else
-      {
-        *index = self->path->get_byte_index(
-          self,
-          found->text,
-          found->length,
-          pos - found->offset
-        );
-      }
+      *index = segment->length;
+    }
+    else
+    {
+      *index = self->path->get_byte_index(self, segment, pos);
     }
   }
-  else
-  {
-    if(index != NULL)
-      *index = 0;
-  }
-  
-  return iter;
+
+  if(char_index != NULL)
+    *char_index = pos;
+
+  return segment;
 }
 
 /*
@@ -373,18 +1328,12 @@ InfTextChunk*
 inf_text_chunk_new(const gchar* encoding)
 {
   InfTextChunk* chunk = g_slice_new(InfTextChunk);
-  
-  chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
 
+  chunk->tree = inf_text_chunk_tree_new(NULL);
   chunk->length = 0;
   chunk->encoding = g_quark_from_string(encoding);
-
-  if(chunk->encoding == g_quark_from_static_string("UTF-8"))
-    chunk->path = &INF_TEXT_CHUNK_PATH_UTF8;
-  else
-    chunk->path = &INF_TEXT_CHUNK_PATH_ICONV;
+  chunk->path = inf_text_chunk_lookup_path(encoding);
+  chunk->iconv = (GIConv)-1;
 
   return chunk;
 }
@@ -393,7 +1342,8 @@ inf_text_chunk_new(const gchar* encoding)
  * inf_text_chunk_copy:
  * @self: A #InfTextChunk.
  *
- * Returns a copy of @self.
+ * Returns a copy of @self. This is a cheap operation since the copy shares
+ * its content with @self until one of the two chunks is modified.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -401,31 +1351,17 @@ InfTextChunk*
 inf_text_chunk_copy(InfTextChunk* self)
 {
   InfTextChunk* new_chunk;
-  GSequenceIter* iter;
 
   g_return_val_if_fail(self != NULL, NULL);
 
-  new_chunk = g_slice_new(InfTextChunk);
-  new_chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
-  
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    InfTextChunkSegment* segment = g_sequence_get(iter);
-    InfTextChunkSegment* new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(segment->text, segment->length);
-    new_segment->length = segment->length;
-    new_segment->offset = segment->offset;
-    g_sequence_append(new_chunk->segments, new_segment);
-  }
+  g_atomic_int_inc(&self->tree->ref_count);
 
+  new_chunk = g_slice_new(InfTextChunk);
+  new_chunk->tree = self->tree;
   new_chunk->length = self->length;
   new_chunk->encoding = self->encoding;
   new_chunk->path = self->path;
+  new_chunk->iconv = (GIConv)-1;
 
   return new_chunk;
 }
@@ -441,7 +1377,11 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
+
+  if(self->iconv != (GIConv)-1)
+    g_iconv_close(self->iconv);
+
+  inf_text_chunk_tree_unref(self->tree);
   g_slice_free(InfTextChunk, self);
 }
 
@@ -491,86 +1431,82 @@ inf_text_chunk_substring(InfTextChunk* self,
                          guint begin,
                          guint length)
 {
-  GSequenceIter* begin_iter;
-  GSequenceIter* end_iter;
+  InfTextChunkSegment* begin_segment;
+  InfTextChunkSegment* end_segment;
   gsize begin_index;
   gsize end_index;
+  guint begin_chars;
+  guint end_chars;
 
   InfTextChunk* result;
-  InfTextChunkSegment* segment;
   InfTextChunkSegment* new_segment;
-  guint current_length;
 
   g_return_val_if_fail(self != NULL, NULL);
   g_return_val_if_fail(begin + length <= self->length, NULL);
 
+  if(begin == 0 && length == self->length)
+    return inf_text_chunk_copy(self);
+
+  result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+
   if(self->length > 0 && length > 0)
   {
-    begin_iter = inf_text_chunk_get_segment(self, begin, &begin_index);
-    end_iter = inf_text_chunk_get_segment(self, begin + length, &end_index);
+    begin_segment = inf_text_chunk_get_segment(
+      self,
+      begin,
+      &begin_index,
+      &begin_chars
+    );
+
+    end_segment = inf_text_chunk_get_segment(
+      self,
+      begin + length,
+      &end_index,
+      &end_chars
+    );
 
     if(end_index == 0)
     {
-      g_assert(end_iter != g_sequence_get_end_iter(self->segments));
-      end_iter = g_sequence_iter_prev(end_iter);
-      end_index = ((InfTextChunkSegment*)g_sequence_get(end_iter))->length;
-    }
+      end_segment = inf_text_chunk_segment_prev(end_segment);
+      g_assert(end_segment != NULL);
 
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
-
-    current_length = 0;
-    segment = g_sequence_get(begin_iter);
+      end_index = end_segment->length;
+      end_chars = end_segment->chars;
+    }
 
-    while(begin_iter != end_iter)
+    while(begin_segment != end_segment)
     {
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = segment->author;
-
-      new_segment->text = g_memdup(
-        segment->text + begin_index,
-        segment->length - begin_index
+      new_segment = inf_text_chunk_segment_new_part(
+        begin_segment,
+        begin_index,
+        begin_segment->length,
+        begin_segment->chars - begin_chars
       );
-      
-      new_segment->length = segment->length - begin_index;
-      new_segment->offset = current_length;
-
-      begin_iter = g_sequence_iter_next(begin_iter);
-      segment = g_sequence_get(begin_iter);
 
-      /* Add (remaining) length of this segment to current length */
-      current_length = segment->offset - begin;
+      inf_text_chunk_insert_segment_before(result, NULL, new_segment);
 
       /* So we get the next segment from the beginning. This may only be
        * non-zero during the first iteration. */
       begin_index = 0;
-    /*  begin = new_segment->offset;*/
-      
-      g_sequence_append(result->segments, new_segment);
+      begin_chars = 0;
+
+      begin_segment = inf_text_chunk_segment_next(begin_segment);
     }
 
     /* Don't forget last segment */
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(
-      segment->text + begin_index,
-      end_index - begin_index
+    new_segment = inf_text_chunk_segment_new_part(
+      begin_segment,
+      begin_index,
+      end_index,
+      end_chars - begin_chars
     );
-    
-    new_segment->length = end_index - begin_index;
-    new_segment->offset = current_length;
-    
-    g_sequence_append(result->segments, new_segment);
 
+    inf_text_chunk_insert_segment_before(result, NULL, new_segment);
     result->length = length;
-    result->encoding = self->encoding;
-    result->path = self->path;
   }
   else
   {
     g_assert(length == 0 || begin == 0);
-
-    /* New, empty chunk */
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -601,102 +1537,108 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author)
 {
-  GSequenceIter* iter;
-  gsize offset_index;
   InfTextChunkSegment* segment;
   InfTextChunkSegment* new_segment;
+  gsize offset_index;
+  guint offset_chars;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(offset <= self->length);
 
+  /* Empty segments would break the segment lookup */
+  if(length == 0)
+    return;
+
+  inf_text_chunk_make_writable(self);
+
   if(self->length > 0)
   {
-    iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    segment = inf_text_chunk_get_segment(
+      self,
+      offset,
+      &offset_index,
+      &offset_chars
+    );
 
     /* Have to split segment, unless it is between two segments in which
      * case we can perhaps append to the previous. */
     if(segment->author != author && offset > 0 && offset_index == 0)
     {
-      g_assert(iter != g_sequence_get_begin_iter(self->segments));
+      segment = inf_text_chunk_segment_prev(segment);
+      g_assert(segment != NULL);
 
-      iter = g_sequence_iter_prev(iter);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
       offset_index = segment->length;
+      offset_chars = segment->chars;
     }
 
     if(segment->author != author)
     {
+      new_segment = inf_text_chunk_segment_new_copy(
+        author,
+        text,
+        bytes,
+        length
+      );
+
       /* No luck, split if necessary */
       if(offset_index > 0 && offset_index < segment->length)
       {
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(
-          segment->text + offset_index,
-          segment->length - offset_index
+        inf_text_chunk_insert_segment_before(
+          self,
+          inf_text_chunk_segment_next(segment),
+          inf_text_chunk_segment_new_part(
+            segment,
+            offset_index,
+            segment->length,
+            segment->chars - offset_chars
+          )
         );
 
-        new_segment->length = segment->length - offset_index;
-        new_segment->offset = offset;
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* Don't realloc to make smaller */
-        segment->length = offset_index;
-        /* Note that we did not invalidate offsets so far */
+        inf_text_chunk_segment_erase(
+          segment,
+          offset_index,
+          segment->length,
+          segment->chars - offset_chars
+        );
       }
-      else if(offset_index == segment->length)
+
+      if(offset_index > 0)
       {
         /* Insert behind segment */
-        iter = g_sequence_iter_next(iter);
+        inf_text_chunk_insert_segment_before(
+          self,
+          inf_text_chunk_segment_next(segment),
+          new_segment
+        );
       }
-
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = author;
-      new_segment->text = g_memdup(text, bytes);
-      new_segment->length = bytes;
-      new_segment->offset = offset;
-      g_sequence_insert_before(iter, new_segment);
-    }
-    else
-    {
-      /* TODO: g_malloc + g_free + 2*memcpy? */
-      segment->text = g_realloc(segment->text, segment->length + bytes);
-      if(offset_index < segment->length)
+      else
       {
-        g_memmove(
-          segment->text + offset_index + bytes,
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
+        inf_text_chunk_insert_segment_before(self, segment, new_segment);
       }
-      
-      memcpy(segment->text + offset_index, text, bytes);
-      segment->length += bytes;
-      iter = g_sequence_iter_next(iter);
     }
-
-    /* Adjust offsets */
-    while(iter != g_sequence_get_end_iter(self->segments))
+    else
     {
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      segment->offset += length;
-      iter = g_sequence_iter_next(iter);
+      inf_text_chunk_segment_insert(
+        segment,
+        offset_index,
+        text,
+        bytes,
+        length
+      );
     }
 
     self->length += length;
   }
   else
   {
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = author;
-    new_segment->text = g_memdup(text, bytes);
-    new_segment->length = bytes;
-    new_segment->offset = 0;
+    new_segment = inf_text_chunk_segment_new_copy(
+      author,
+      text,
+      bytes,
+      length
+    );
 
-    g_sequence_append(self->segments, new_segment);
+    inf_text_chunk_insert_segment_before(self, NULL, new_segment);
     self->length = length;
   }
 
@@ -719,239 +1661,181 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
                             InfTextChunk* text)
 {
-  GSequenceIter* iter;
-  GSequenceIter* text_iter;
-  gsize offset_index;
   InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
+  InfTextChunkSegment* text_segment;
+  gsize offset_index;
+  guint offset_chars;
 
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
   InfTextChunkSegment* first;
   InfTextChunkSegment* last;
-
   InfTextChunkSegment* first_merge;
   InfTextChunkSegment* last_merge;
-  GSequenceIter* beyond;
+  InfTextChunkSegment* before;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(offset <= self->length);
   g_return_if_fail(text != NULL);
   g_return_if_fail(self->encoding == text->encoding);
 
+  inf_text_chunk_make_writable(self);
+
+  first = inf_text_chunk_segment_first(text->tree->root);
+  last = inf_text_chunk_segment_last(text->tree->root);
+
   if(self->length > 0 && text->length > 0)
   {
-    if(g_sequence_get_length(text->segments) == 1)
+    if(first == last)
     {
-      segment = g_sequence_get(g_sequence_get_begin_iter(text->segments));
-
       inf_text_chunk_insert_text(
         self,
         offset,
-        segment->text,
-        segment->length,
+        first->text,
+        first->length,
         text->length,
-        segment->author
+        first->author
       );
     }
     else
     {
-      iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
+      segment = inf_text_chunk_get_segment(
+        self,
+        offset,
+        &offset_index,
+        &offset_chars
+      );
 
       /* First, we insert the first and last segment of text into self,
        * possibly merging with adjacent segments. Then, the rest is
-       * copied. */
-      first_iter = g_sequence_get_begin_iter(text->segments);
-      last_iter = g_sequence_iter_prev(
-        g_sequence_get_end_iter(text->segments)
-      );
-
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      last = (InfTextChunkSegment*)g_sequence_get(last_iter);
-
-      /* 0 and 1 segment special cases have been handled above */
-      g_assert(first != last);
-
+       * copied. first and last are advanced when they have been merged,
+       * so that afterwards [first, last] is the range of segments of text
+       * still to be inserted before the segment before. */
       last_merge = segment;
       first_merge = segment;
 
-      /* beyond points to the first segment that needs offset adjustment
-       * after insertion */
-      beyond = iter;
-
       /* Try merge with end of previous segment if inserting inbetween two
        * segments. */
       if(offset_index == 0 && offset > 0)
       {
-        g_assert(iter != g_sequence_get_begin_iter(self->segments));
+        first_merge = inf_text_chunk_segment_prev(segment);
+        g_assert(first_merge != NULL);
 
-        iter = g_sequence_iter_prev(iter);
-        first_merge = (InfTextChunkSegment*)g_sequence_get(iter);
         offset_index = first_merge->length;
+        offset_chars = first_merge->chars;
       }
 
       if(offset == 0 || offset == self->length || first_merge != last_merge)
       {
         /* Insert between two segments, or at beginning/end */
+        if(offset == 0)
+          before = last_merge;
+        else
+          before = inf_text_chunk_segment_next(first_merge);
+
         if(first_merge->author == first->author && offset > 0)
         {
           /* Can merge first segment */
-          first_merge->length += first->length;
-
-          first_merge->text = g_realloc(
-            first_merge->text,
-            first_merge->length
-          );
-
-          memcpy(
-            first_merge->text + first_merge->length - first->length,
+          inf_text_chunk_segment_insert(
+            first_merge,
+            first_merge->length,
             first->text,
-            first->length
+            first->length,
+            first->chars
           );
 
           /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
+          first = inf_text_chunk_segment_next(first);
         }
 
         if(last_merge->author == last->author && offset < self->length)
         {
           /* Can merge last segment */
-          last_merge->length += last->length;
-          last_merge->text = g_realloc(last_merge->text, last_merge->length);
-
-          g_memmove(
-            last_merge->text + last->length,
-            last_merge->text,
-            last_merge->length - last->length
+          inf_text_chunk_segment_insert(
+            last_merge,
+            0,
+            last->text,
+            last->length,
+            last->chars
           );
 
-          memcpy(last_merge->text, last->text, last->length);
-          last_merge->offset = offset + last->offset;
-
-          /* Merged with last, so don't need to adjust last_merge->offset
-           * anymore, continue behind with offset adjustment. */
-          beyond = g_sequence_iter_next(beyond);
-        }
-        else
-        {
-          /* Could not merge last segment, so we have to insert it. Therefore,
-           * make last_iter point to the end of the sequence. */
-          last_iter = g_sequence_iter_next(last_iter);
-
-          if(offset_index > 0) /* Note: This is only false for offset == 0 */
-            beyond = g_sequence_iter_next(iter);
-        }
-
-        if(offset_index > 0) /* Note: This is only false for offset == 0 */
-        {
-          /* Pointing to the position before which to insert
-           * the rest of text. */
-          iter = g_sequence_iter_next(iter);
+          /* Already inserted */
+          last = inf_text_chunk_segment_prev(last);
         }
       }
       else
       {
         /* Insert within a segment, split segment */
+        before = inf_text_chunk_segment_new_part(
+          segment,
+          offset_index,
+          segment->length,
+          segment->chars - offset_chars
+        );
 
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = last_merge->author;
-
-        if(last_merge->author == last->author)
+        if(before->author == last->author)
         {
           /* Merge last part into new segment */
-          new_segment->length = last_merge->length - offset_index +
-            last->length;
-
-          new_segment->text = g_malloc(new_segment->length);
-          memcpy(new_segment->text, last->text, last->length);
-
-          memcpy(
-            new_segment->text + last->length,
-            last_merge->text + offset_index,
-            last_merge->length - offset_index
-          );
-
-          new_segment->offset = offset + last->offset;
-        }
-        else
-        {
-          /* Split up last part */
-          new_segment->length = last_merge->length - offset_index;
-          new_segment->text = g_malloc(new_segment->length);
-
-          memcpy(
-            new_segment->text,
-            last_merge->text + offset_index,
-            new_segment->length
+          inf_text_chunk_segment_insert(
+            before,
+            0,
+            last->text,
+            last->length,
+            last->chars
           );
 
-          new_segment->offset = offset + text->length;
-
-          /* We still have to insert last segment since we could not merge */
-          last_iter = g_sequence_iter_next(last_iter);
+          last = inf_text_chunk_segment_prev(last);
         }
 
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
+        inf_text_chunk_insert_segment_before(
+          self,
+          inf_text_chunk_segment_next(segment),
+          before
+        );
 
-        /* The segment just inserted is the last one being inserted, so
-         * we need to adjust beyond that */
-        beyond = g_sequence_iter_next(iter);
+        inf_text_chunk_segment_erase(
+          segment,
+          offset_index,
+          segment->length,
+          segment->chars - offset_chars
+        );
 
-        /* Note first_merge == last_merge */
-        if(first_merge->author == first->author)
+        if(segment->author == first->author)
         {
           /* Merge into first */
-          if(first_merge->length < offset_index + first->length)
-          {
-            first_merge->text = g_realloc(
-              first_merge->text,
-              offset_index + first->length
-            );
-          }
-
-          first_merge->length = offset_index + first->length;
-
-          memcpy(
-            first_merge->text + offset_index,
+          inf_text_chunk_segment_insert(
+            segment,
+            segment->length,
             first->text,
-            first->length
+            first->length,
+            first->chars
           );
 
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        else
-        {
-          /* Cannot merge, just cut */
-          first_merge->length = offset_index;
+          first = inf_text_chunk_segment_next(first);
         }
       }
 
-      /* iter now points to the segment before which the rest of text has to
-       * be inserted */
-
-      for(text_iter = first_iter;
-          text_iter != last_iter;
-          text_iter = g_sequence_iter_next(text_iter))
+      /* Copy the remaining segments. Note that if both the first and the
+       * last segment have been merged, then first is the successor of
+       * last if text consists of only two segments. */
+      if(first != inf_text_chunk_segment_next(last))
       {
-        segment = g_sequence_get(text_iter);
-        new_segment = g_slice_new(InfTextChunkSegment);
-
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(segment->text, segment->length);
-        new_segment->length = segment->length;
-        new_segment->offset = offset + segment->offset;
-        g_sequence_insert_before(iter, new_segment);
-      }
+        for(text_segment = first;
+            text_segment != NULL;
+            text_segment = inf_text_chunk_segment_next(text_segment))
+        {
+          inf_text_chunk_insert_segment_before(
+            self,
+            before,
+            inf_text_chunk_segment_new_part(
+              text_segment,
+              0,
+              text_segment->length,
+              text_segment->chars
+            )
+          );
 
-      for(iter = beyond;
-          iter != g_sequence_get_end_iter(self->segments);
-          iter = g_sequence_iter_next(iter))
-      {
-        segment = g_sequence_get(iter);
-        segment->offset += inf_text_chunk_get_length(text);
+          if(text_segment == last)
+            break;
+        }
       }
 
       self->length += text->length;
@@ -959,19 +1843,20 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
   }
   else
   {
-    for(text_iter = g_sequence_get_begin_iter(text->segments);
-        text_iter != g_sequence_get_end_iter(text->segments);
-        text_iter = g_sequence_iter_next(text_iter))
+    for(text_segment = first;
+        text_segment != NULL;
+        text_segment = inf_text_chunk_segment_next(text_segment))
     {
-      segment = (InfTextChunkSegment*)g_sequence_get(text_iter);
-      new_segment = g_slice_new(InfTextChunkSegment);
-
-      new_segment->author = segment->author;
-      new_segment->text = g_memdup(segment->text, segment->length);
-      new_segment->length = segment->length;
-      new_segment->offset = segment->offset;
-
-      g_sequence_append(self->segments, new_segment);
+      inf_text_chunk_insert_segment_before(
+        self,
+        NULL,
+        inf_text_chunk_segment_new_part(
+          text_segment,
+          0,
+          text_segment->length,
+          text_segment->chars
+        )
+      );
     }
 
     self->length += text->length;
@@ -995,33 +1880,43 @@ inf_text_chunk_erase(InfTextChunk* self,
                      guint begin,
                      guint length)
 {
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
-  GSequenceIter* beyond;
-  gsize first_index;
-  gsize last_index;
   InfTextChunkSegment* first;
   InfTextChunkSegment* last;
+  gsize first_index;
+  gsize last_index;
+  guint first_chars;
+  guint last_chars;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(begin + length <= self->length);
 
   if(self->length > 0 && length > 0)
   {
-    first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
-    last_iter = inf_text_chunk_get_segment(self, begin + length, &last_index);
+    inf_text_chunk_make_writable(self);
+
+    first = inf_text_chunk_get_segment(
+      self,
+      begin,
+      &first_index,
+      &first_chars
+    );
 
-    first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-    last = (InfTextChunkSegment*)g_sequence_get(last_iter);
+    last = inf_text_chunk_get_segment(
+      self,
+      begin + length,
+      &last_index,
+      &last_chars
+    );
 
     if(begin > 0 && begin + length < self->length)
     {
       if(first_index == 0)
       {
-        g_assert(first_iter != g_sequence_get_end_iter(self->segments));
-        first_iter = g_sequence_iter_prev(first_iter);
-        first = (InfTextChunkSegment*)g_sequence_get(first_iter);
+        first = inf_text_chunk_segment_prev(first);
+        g_assert(first != NULL);
+
         first_index = first->length;
+        first_chars = first->chars;
       }
 
       if(first->author == last->author)
@@ -1030,35 +1925,36 @@ inf_text_chunk_erase(InfTextChunk* self,
         if(first == last)
         {
           /* Remove within a segment */
-          g_memmove(
-            first->text + first_index,
-            first->text + last_index,
-            first->length - last_index
+          inf_text_chunk_segment_erase(
+            first,
+            first_index,
+            last_index,
+            last_chars - first_chars
           );
-
-          first->length -= (last_index - first_index);
-          beyond = g_sequence_iter_next(last_iter);
         }
         else
         {
-          if(first->length < first_index + last->length - last_index)
-          {
-            first->text = g_realloc(
-              first->text,
-              first_index + last->length - last_index
-            );
-          }
-
-          first->length = first_index + last->length - last_index;
-
-          memcpy(
-            first->text + first_index,
+          inf_text_chunk_segment_erase(
+            first,
+            first_index,
+            first->length,
+            first->chars - first_chars
+          );
+
+          inf_text_chunk_segment_insert(
+            first,
+            first_index,
             last->text + last_index,
-            last->length - last_index
+            last->length - last_index,
+            last->chars - last_chars
           );
 
-          last_iter = g_sequence_iter_next(last_iter);
-          beyond = last_iter;
+          /* last has been merged into first, so remove it as well */
+          inf_text_chunk_remove_segments(
+            self,
+            inf_text_chunk_segment_next(first),
+            inf_text_chunk_segment_next(last)
+          );
         }
       }
       else
@@ -1068,38 +1964,32 @@ inf_text_chunk_erase(InfTextChunk* self,
          * (as checked above). */
         g_assert(first_index > 0);
         g_assert(last_index < last->length);
-        
+
         /* Erase from border segments */
-        first->length = first_index;
+        inf_text_chunk_segment_erase(
+          first,
+          first_index,
+          first->length,
+          first->chars - first_chars
+        );
 
         if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-        }
+          inf_text_chunk_segment_erase(last, 0, last_index, last_chars);
 
-        last->length -= last_index;
-        last->offset = begin;
-
-        /* We already adjusted offset of last, so only adjust behind */
-        beyond = g_sequence_iter_next(last_iter);
+        inf_text_chunk_remove_segments(
+          self,
+          inf_text_chunk_segment_next(first),
+          last
+        );
       }
-
-      /* Keep first alive, we merged stuff into it */
-      first_iter = g_sequence_iter_next(first_iter);
     }
     else
     {
       if(begin == 0 && length == self->length)
       {
         /* Erase everything */
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
-
-        beyond = last_iter;
+        inf_text_chunk_segment_free_tree(self->tree->root);
+        self->tree->root = NULL;
       }
       else if(begin == 0)
       {
@@ -1107,23 +1997,13 @@ inf_text_chunk_erase(InfTextChunk* self,
 
         /* Erase from beginning */
         if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last->length -= last_index;
-          last->offset = 0;
+          inf_text_chunk_segment_erase(last, 0, last_index, last_chars);
 
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          /* First segments are completely removed */
-          beyond = last_iter;
-        }
+        inf_text_chunk_remove_segments(
+          self,
+          inf_text_chunk_segment_first(self->tree->root),
+          last
+        );
       }
       else
       {
@@ -1134,35 +2014,22 @@ inf_text_chunk_erase(InfTextChunk* self,
          * catched elsewhere. */
         g_assert(first_index < first->length);
 
-
         if(first_index > 0)
         {
           /* Cannot erase whole first chunk */
-          first->length = first_index;
-          first_iter = g_sequence_iter_next(first_iter);
+          inf_text_chunk_segment_erase(
+            first,
+            first_index,
+            first->length,
+            first->chars - first_chars
+          );
+
+          first = inf_text_chunk_segment_next(first);
         }
-        
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
 
-        beyond = last_iter;
+        inf_text_chunk_remove_segments(self, first, NULL);
       }
     }
-
-    /* first_iter and last_iter have been adjusted so that we have to
-     * remove [first_iter, last_iter). */
-
-    /* segments are freed through the sequence's destroy function */
-    g_sequence_remove_range(first_iter, last_iter);
-
-    /* adjust offsets */
-    for(first_iter = beyond;
-        first_iter != g_sequence_get_end_iter(self->segments);
-        first_iter = g_sequence_iter_next(first_iter))
-    {
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      first->offset -= length;
-    }
   }
 
   self->length -= length;
@@ -1188,33 +2055,21 @@ gpointer
 inf_text_chunk_get_text(InfTextChunk* self,
                         gsize* length)
 {
-  GSequenceIter* iter;
   InfTextChunkSegment* segment;
   gsize bytes;
   gsize cur;
   gchar* result;
-  
-  g_return_val_if_fail(self != NULL, NULL);
-  bytes = 0;
 
-  /* First pass, determine size */
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    bytes += segment->length;
-  }
+  g_return_val_if_fail(self != NULL, NULL);
 
-  /* Second pass, copy */
+  bytes = inf_text_chunk_segment_subtree_bytes(self->tree->root);
   result = g_malloc(bytes);
   cur = 0;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
+  for(segment = inf_text_chunk_segment_first(self->tree->root);
+      segment != NULL;
+      segment = inf_text_chunk_segment_next(segment))
   {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
     memcpy(result + cur, segment->text, segment->length);
     cur += segment->length;
   }
@@ -1237,8 +2092,6 @@ gboolean
 inf_text_chunk_equal(InfTextChunk* self,
                      InfTextChunk* other)
 {
-  GSequenceIter* iter1;
-  GSequenceIter* iter2;
   InfTextChunkSegment* segment1;
   InfTextChunkSegment* segment2;
 
@@ -1246,30 +2099,32 @@ inf_text_chunk_equal(InfTextChunk* self,
   g_return_val_if_fail(other != NULL, FALSE);
   g_return_val_if_fail(self->encoding == other->encoding, FALSE);
 
-  iter1 = g_sequence_get_begin_iter(self->segments);
-  iter2 = g_sequence_get_begin_iter(other->segments);
+  if(self->length != other->length)
+    return FALSE;
 
-  while(iter1 != g_sequence_get_end_iter(self->segments) &&
-        iter2 != g_sequence_get_end_iter(other->segments))
+  if(inf_text_chunk_segment_subtree_bytes(self->tree->root) !=
+     inf_text_chunk_segment_subtree_bytes(other->tree->root))
   {
-    segment1 = (InfTextChunkSegment*)g_sequence_get(iter1);
-    segment2 = (InfTextChunkSegment*)g_sequence_get(iter2);
+    return FALSE;
+  }
+
+  segment1 = inf_text_chunk_segment_first(self->tree->root);
+  segment2 = inf_text_chunk_segment_first(other->tree->root);
 
+  while(segment1 != NULL && segment2 != NULL)
+  {
     if(segment1->length != segment2->length)
       return FALSE;
 
     if(memcmp(segment1->text, segment2->text, segment1->length) != 0)
       return FALSE;
 
-    iter1 = g_sequence_iter_next(iter1);
-    iter2 = g_sequence_iter_next(iter2);
+    segment1 = inf_text_chunk_segment_next(segment1);
+    segment2 = inf_text_chunk_segment_next(segment2);
   }
 
-  if(iter1 != g_sequence_get_end_iter(self->segments) ||
-     iter2 != g_sequence_get_end_iter(other->segments))
-  {
+  if(segment1 != NULL || segment2 != NULL)
     return FALSE;
-  }
 
   return TRUE;
 }
@@ -1289,14 +2144,18 @@ gboolean
 inf_text_chunk_iter_init_begin(InfTextChunk* self,
                                InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* first;
+
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
   if(self->length > 0)
   {
+    first = inf_text_chunk_segment_first(self->tree->root);
+
     iter->chunk = self;
-    iter->first = g_sequence_get_begin_iter(self->segments);
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->first = first;
+    iter->second = inf_text_chunk_segment_next(first);
     return TRUE;
   }
   else
@@ -1326,8 +2185,8 @@ inf_text_chunk_iter_init_end(InfTextChunk* self,
   if(self->length > 0)
   {
     iter->chunk = self;
-    iter->second = g_sequence_get_end_iter(self->segments);
-    iter->first = g_sequence_iter_prev(iter->second);
+    iter->first = inf_text_chunk_segment_last(self->tree->root);
+    iter->second = NULL;
     return TRUE;
   }
   else
@@ -1350,10 +2209,10 @@ inf_text_chunk_iter_next(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_end(iter->second) == FALSE)
+  if(iter->second != NULL)
   {
     iter->first = iter->second;
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->second = inf_text_chunk_segment_next(iter->first);
     return TRUE;
   }
   else
@@ -1374,12 +2233,15 @@ inf_text_chunk_iter_next(InfTextChunkIter* iter)
 gboolean
 inf_text_chunk_iter_prev(InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* prev;
+
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_begin(iter->first) == FALSE)
+  prev = inf_text_chunk_segment_prev(iter->first);
+  if(prev != NULL)
   {
     iter->second = iter->first;
-    iter->first = g_sequence_iter_prev(iter->first);
+    iter->first = prev;
     return TRUE;
   }
   else
@@ -1401,7 +2263,7 @@ gconstpointer
 inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, NULL);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->text;
+  return ((InfTextChunkSegment*)iter->first)->text;
 }
 
 /**
@@ -1416,12 +2278,8 @@ inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-  return first->offset;
+  return inf_text_chunk_segment_get_offset(iter->first);
 }
 
 /**
@@ -1435,22 +2293,8 @@ inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_length(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* second;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  if(g_sequence_iter_is_end(iter->second) == TRUE)
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    return iter->chunk->length - first->offset;
-  }
-  else
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    second = (InfTextChunkSegment*)g_sequence_get(iter->second);
-    return second->offset - first->offset;
-  }
+  return ((InfTextChunkSegment*)iter->first)->chars;
 }
 
 /**
@@ -1465,7 +2309,7 @@ gsize
 inf_text_chunk_iter_get_bytes(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->length;
+  return ((InfTextChunkSegment*)iter->first)->length;
 }
 
 /**
@@ -1480,7 +2324,7 @@ guint
 inf_text_chunk_iter_get_author(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->author;
+  return ((InfTextChunkSegment*)iter->first)->author;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -19,6 +19,7 @@
 
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-buffer-private.h>
 #include <libinftext/inf-text-chunk.h>
 #include <libinfinity/common/inf-buffer.h>
 
@@ -225,6 +226,85 @@ inf_text_default_buffer_buffer_erase_text(InfTextBuffer* buffer,
   }
 }
 
+static void
+inf_text_default_buffer_buffer_append(InfTextBuffer* buffer,
+                                      InfTextChunk* chunk,
+                                      InfUser* user)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+
+  if(inf_text_chunk_get_length(priv->chunk) == 0)
+  {
+    /* Share the segments of chunk instead of copying them */
+    inf_text_chunk_free(priv->chunk);
+    priv->chunk = inf_text_chunk_copy(chunk);
+
+    inf_text_buffer_text_inserted(buffer, 0, chunk, user);
+
+    if(priv->modified == FALSE)
+    {
+      priv->modified = TRUE;
+      g_object_notify(G_OBJECT(buffer), "modified");
+    }
+  }
+  else
+  {
+    inf_text_default_buffer_buffer_insert_text(
+      buffer,
+      inf_text_chunk_get_length(priv->chunk),
+      chunk,
+      user
+    );
+  }
+}
+
+static void
+inf_text_default_buffer_buffer_clear(InfTextBuffer* buffer,
+                                     InfUser* user)
+{
+  InfTextDefaultBufferPrivate* priv;
+  InfTextChunk* chunk;
+
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+  if(inf_text_chunk_get_length(priv->chunk) == 0)
+    return;
+
+  /* The old chunk is exactly the erased text */
+  chunk = priv->chunk;
+  priv->chunk = inf_text_chunk_new(priv->encoding);
+
+  inf_text_buffer_text_erased(buffer, 0, chunk, user);
+  inf_text_chunk_free(chunk);
+
+  if(priv->modified == FALSE)
+  {
+    priv->modified = TRUE;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
+static void
+inf_text_default_buffer_buffer_apply_batch(InfTextBuffer* buffer,
+                                           const InfTextBufferEdit* edits,
+                                           guint n_edits,
+                                           InfUser* user)
+{
+  InfTextChunk* chunk;
+  guint pos;
+  guint len;
+
+  chunk = _inf_text_buffer_coalesce_edits(buffer, edits, n_edits, &pos, &len);
+
+  if(len > 0)
+    inf_text_default_buffer_buffer_erase_text(buffer, pos, len, user);
+
+  if(inf_text_chunk_get_length(chunk) > 0)
+    inf_text_default_buffer_buffer_insert_text(buffer, pos, chunk, user);
+
+  inf_text_chunk_free(chunk);
+}
+
 static InfTextBufferIter*
 inf_text_default_buffer_buffer_create_begin_iter(InfTextBuffer* buffer)
 {
@@ -375,6 +455,9 @@ inf_text_default_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->iter_get_length = inf_text_default_buffer_buffer_iter_get_length;
   iface->iter_get_bytes = inf_text_default_buffer_buffer_iter_get_bytes;
   iface->iter_get_author = inf_text_default_buffer_buffer_iter_get_author;
+  iface->append = inf_text_default_buffer_buffer_append;
+  iface->clear = inf_text_default_buffer_buffer_clear;
+  iface->apply_batch = inf_text_default_buffer_buffer_apply_batch;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
 }
@@ -46,7 +46,7 @@ enum {
   PROP_CHUNK
 };
 
-#define INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION, InfTextDefaultDeleteOperationPrivate))
+#define INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(obj) ((InfTextDefaultDeleteOperationPrivate*)inf_text_default_delete_operation_get_instance_private((InfTextDefaultDeleteOperation*)(obj)))
 
 static void inf_text_default_delete_operation_operation_iface_init(InfAdoptedOperationInterface* iface);
 static void inf_text_default_delete_operation_delete_operation_iface_init(InfTextDeleteOperationInterface* iface);
@@ -120,6 +120,24 @@ inf_text_default_delete_operation_finalize(GObject* object)
   G_OBJECT_CLASS(inf_text_default_delete_operation_parent_class)->finalize(object);
 }
 
+/* Like inf_text_default_delete_operation_new(), but takes ownership of
+ * chunk and sets the members directly instead of via properties. */
+static InfTextDefaultDeleteOperation*
+inf_text_default_delete_operation_new_take(guint position,
+                                           InfTextChunk* chunk)
+{
+  GObject* object;
+  InfTextDefaultDeleteOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION, NULL);
+  priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return INF_TEXT_DEFAULT_DELETE_OPERATION(object);
+}
+
 static void
 inf_text_default_delete_operation_set_property(GObject* object,
                                                guint prop_id,
@@ -223,11 +241,9 @@ inf_text_default_delete_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_delete_operation_new_take(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -325,11 +341,9 @@ inf_text_default_delete_operation_transform_position(
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_TEXT_DELETE_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_delete_operation_new_take(
+      position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -345,21 +359,14 @@ inf_text_default_delete_operation_transform_overlap(
 {
   InfTextDefaultDeleteOperationPrivate* priv;
   InfTextChunk* chunk;
-  GObject* result;
 
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
   chunk = inf_text_chunk_copy(priv->chunk);
   inf_text_chunk_erase(chunk, begin, length);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  return INF_TEXT_DELETE_OPERATION(
+    inf_text_default_delete_operation_new_take(position, chunk)
   );
-
-  inf_text_chunk_free(chunk);
-  return INF_TEXT_DELETE_OPERATION(result);
 }
 
 static InfAdoptedSplitOperation*
@@ -371,8 +378,8 @@ inf_text_default_delete_operation_transform_split(
   InfTextDefaultDeleteOperationPrivate* priv;
   InfTextChunk* first_chunk;
   InfTextChunk* second_chunk;
-  GObject* first;
-  GObject* second;
+  InfTextDefaultDeleteOperation* first;
+  InfTextDefaultDeleteOperation* second;
   InfAdoptedSplitOperation* result;
 
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
@@ -384,23 +391,16 @@ inf_text_default_delete_operation_transform_split(
     inf_text_chunk_get_length(priv->chunk) - split_pos
   );
 
-  first = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position,
-    "chunk", first_chunk,
-    NULL
+  first = inf_text_default_delete_operation_new_take(
+    priv->position,
+    first_chunk
   );
 
-  second = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position + split_len,
-    "chunk", second_chunk,
-    NULL
+  second = inf_text_default_delete_operation_new_take(
+    priv->position + split_len,
+    second_chunk
   );
 
-  inf_text_chunk_free(first_chunk);
-  inf_text_chunk_free(second_chunk);
-
   result = inf_adopted_split_operation_new(
     INF_ADOPTED_OPERATION(first),
     INF_ADOPTED_OPERATION(second)
@@ -492,18 +492,12 @@ InfTextDefaultDeleteOperation*
 inf_text_default_delete_operation_new(guint position,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_delete_operation_new_take(
+    position,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_DELETE_OPERATION(object);
 }
 
 /**
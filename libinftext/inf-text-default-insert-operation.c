@@ -40,7 +40,7 @@ enum {
   PROP_CHUNK
 };
 
-#define INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, InfTextDefaultInsertOperationPrivate))
+#define INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(obj) ((InfTextDefaultInsertOperationPrivate*)inf_text_default_insert_operation_get_instance_private((InfTextDefaultInsertOperation*)(obj)))
 
 static void inf_text_default_insert_operation_operation_iface_init(InfAdoptedOperationInterface* iface);
 static void inf_text_default_insert_operation_insert_operation_iface_init(InfTextInsertOperationInterface* iface);
@@ -74,6 +74,25 @@ inf_text_default_insert_operation_finalize(GObject* object)
   G_OBJECT_CLASS(inf_text_default_insert_operation_parent_class)->finalize(object);
 }
 
+/* Operations are created very often during transformation, so this
+ * bypasses the property machinery of g_object_new() and takes ownership of
+ * chunk, which is cheap to copy since chunks are copy-on-write. */
+static InfTextDefaultInsertOperation*
+inf_text_default_insert_operation_new_take(guint position,
+                                           InfTextChunk* chunk)
+{
+  GObject* object;
+  InfTextDefaultInsertOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, NULL);
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
+}
+
 static void
 inf_text_default_insert_operation_set_property(GObject* object,
                                                guint prop_id,
@@ -185,11 +204,9 @@ inf_text_default_insert_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_insert_operation_new_take(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -270,18 +287,14 @@ inf_text_default_insert_operation_transform_position(
   guint position)
 {
   InfTextDefaultInsertOperationPrivate* priv;
-  GObject* result;
-
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", position,
-    "chunk", priv->chunk,
-    NULL
+  return INF_TEXT_INSERT_OPERATION(
+    inf_text_default_insert_operation_new_take(
+      position,
+      inf_text_chunk_copy(priv->chunk)
+    )
   );
-
-  return INF_TEXT_INSERT_OPERATION(result);
 }
 
 static void
@@ -362,18 +375,12 @@ InfTextDefaultInsertOperation*
 inf_text_default_insert_operation_new(guint pos,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", pos,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_insert_operation_new_take(
+    pos,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
 }
 
 /**
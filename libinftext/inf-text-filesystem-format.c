@@ -30,19 +30,144 @@
  * implementing a #InfdNotePlugin to handle #InfTextSession<!-- -->s. These
  * functions implement reading and writing the content of an #InfTextSession
  * to an XML file in the storage.
+ *
+ * Alternatively, a session can be written in a compact binary format with
+ * inf_text_filesystem_format_write_with_flags(). Such files are memory-mapped
+ * when they are read back, and the text of the document can optionally be
+ * compressed. inf_text_filesystem_format_read() recognizes both formats, so
+ * a document is converted from one format to the other simply by reading it
+ * and writing it again with different flags.
+ *
+ * #InfTextFilesystemJournal records the changes to a session in an
+ * append-only journal as they happen. Saving the session then costs time
+ * proportional to the amount of changes rather than to the size of the
+ * document, and the full document only needs to be written from time to
+ * time to keep the journal short.
+ *
+ * Every new version of a document is synced to the disk before it is
+ * relied upon, with infd_filesystem_storage_stream_sync() and
+ * infd_filesystem_storage_rename(), so that it survives a crash of the
+ * operating system or a power failure, not only a crash of the server.
+ * Journal records are handed to the operating system as they are
+ * recorded, but synced to the disk in groups, see
+ * inf_text_filesystem_journal_set_commit_interval().
+ *
+ * inf_text_filesystem_format_write_async() serializes a session in the
+ * calling thread, and writes it to the disk in a worker thread, so that a
+ * slow disk does not block the thread in which the session is used.
  */
 
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <glib/gstdio.h>
+
 #include <string.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+/* The binary format starts with the magic bytes below, which can never start
+ * an XML document. All integers are stored in little endian byte order:
+ *
+ *   magic, guint32 version, guint32 flags,
+ *   guint32 length and name of the buffer encoding,
+ *   guint32 number of users, and for each user:
+ *     guint32 ID, guint64 hue as IEEE 754 double, guint32 length and name,
+ *   guint32 number of segments, guint64 size of the segment data,
+ *   segment data, deflated if the compressed flag is set, for each segment:
+ *     guint32 author, guint32 characters, guint32 length and text in the
+ *     buffer encoding. */
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC "\211InfText"
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_LEN 8
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION 1
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_FLAG_COMPRESSED (1 << 0)
+
+#define INF_TEXT_FILESYSTEM_FORMAT_IDENTIFIER "InfText"
+#define INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER "InfText.journal"
+#define INF_TEXT_FILESYSTEM_FORMAT_NEW_IDENTIFIER "InfText.new"
+#define INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER "InfText.tmp"
+
+/* The journal is a sequence of records, each consisting of a guint32 length
+ * and a guint32 checksum of the record data, followed by the data. The data
+ * starts with one of the type bytes below:
+ *
+ *   user: guint32 ID, guint64 hue, guint32 length and name,
+ *   insert: guint32 position, guint32 number of segments, and for each
+ *     segment guint32 author, guint32 characters, guint32 length and text
+ *     in UTF-8,
+ *   erase: guint32 position, guint32 characters. */
+#define INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_USER 'u'
+#define INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_INSERT 'i'
+#define INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_ERASE 'e'
 
 typedef struct _InfTextFilesystemFormatWriteData {
   xmlNodePtr root;
   GHashTable* encountered_authors;
 } InfTextFilesystemFormatWriteData;
 
+typedef struct _InfTextFilesystemFormatBinaryWriteData {
+  GPtrArray* users;
+  GHashTable* encountered_authors;
+} InfTextFilesystemFormatBinaryWriteData;
+
+typedef struct _InfTextFilesystemFormatReader {
+  const guchar* data;
+  gsize len;
+  gsize pos;
+} InfTextFilesystemFormatReader;
+
+struct _InfTextFilesystemJournal {
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+
+  FILE* stream;
+  guint64 size;
+  GHashTable* recorded_users;
+
+  /* Records are synced to the disk commit_interval milliseconds after the
+   * first one that has not been synced yet, or each one right away if
+   * sync_records is set. */
+  InfIo* io;
+  guint commit_interval;
+  gboolean sync_records;
+  gboolean uncommitted;
+  InfIoTimeout* commit_timeout;
+
+  /* Set when a change could not be recorded. The journal is then no longer
+   * appended to until the next checkpoint. */
+  GError* error;
+};
+
+typedef struct _InfTextFilesystemFormatWriter {
+  FILE* stream;
+  GByteArray* memory; /* Written to instead if stream is NULL */
+#ifdef LIBINFINITY_HAVE_ZLIB
+  gboolean compressed;
+  z_stream zstream;
+  guchar zbuffer[16384];
+#endif
+} InfTextFilesystemFormatWriter;
+
+/* A document written in the I/O thread pool. It does not hold a reference on
+ * the storage, since infd_filesystem_storage_begin_write() does. */
+typedef struct _InfTextFilesystemFormatWriteJob {
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  GBytes* bytes;
+  guint serial;
+  gboolean ended;
+} InfTextFilesystemFormatWriteJob;
+
 static GQuark
 inf_text_filesystem_format_error_quark()
 {
@@ -69,6 +194,56 @@ inf_text_filesystem_format_read_close_func(void* context)
   return infd_filesystem_storage_stream_close((FILE*)context);
 }
 
+static gboolean
+inf_text_filesystem_format_add_user(InfUserTable* user_table,
+                                    guint id,
+                                    const gchar* name,
+                                    gdouble hue,
+                                    GError** error)
+{
+  InfUser* user;
+
+  if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+      _("User with ID %u exists already"),
+      id
+    );
+
+    return FALSE;
+  }
+
+  if(inf_user_table_lookup_user_by_name(user_table, name))
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+      _("User with name \"%s\" exists already"),
+      name
+    );
+
+    return FALSE;
+  }
+
+  user = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", id,
+      "name", name,
+      "hue", hue,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, user);
+  g_object_unref(user);
+  return TRUE;
+}
+
 static gboolean
 inf_text_filesystem_format_read_user(InfUserTable* user_table,
                                      xmlNodePtr node,
@@ -78,7 +253,6 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
   gdouble hue;
   xmlChar* name;
   gboolean result;
-  InfUser* user;
 
   if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
     return FALSE;
@@ -90,49 +264,13 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
   if(name == NULL)
     return FALSE;
 
-  if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
-  {
-    g_set_error(
-      error,
-      inf_text_filesystem_format_error_quark(),
-      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-      _("User with ID %u exists already"),
-      id
-    );
-
-    result = FALSE;
-  }
-  else
-  {
-    if(inf_user_table_lookup_user_by_name(user_table, (const gchar*)name))
-    {
-      g_set_error(
-        error,
-        inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-        _("User with name \"%s\" exists already"),
-        (const gchar*)name
-      );
-
-      result = FALSE;
-    }
-    else
-    {
-      user = INF_USER(
-        g_object_new(
-          INF_TEXT_TYPE_USER,
-          "id", id,
-          "name", name,
-          "hue", hue,
-          NULL
-        )
-      );
-
-      inf_user_table_add_user(user_table, user);
-      g_object_unref(user);
-      result = TRUE;
-    }
-  }
+  result = inf_text_filesystem_format_add_user(
+    user_table,
+    id,
+    (const gchar*)name,
+    hue,
+    error
+  );
 
   xmlFree(name);
   return result;
@@ -147,7 +285,6 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
   xmlNodePtr child;
   guint author;
   gchar* content;
-  gboolean result;
   gboolean res;
   InfUser* user;
   gsize bytes;
@@ -157,12 +294,18 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
   gchar* converted;
   gsize converted_bytes;
 
+  InfTextChunk* chunk;
+
   g_assert(inf_text_buffer_get_length(buffer) == 0);
 
   is_utf8 = TRUE;
   if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
     is_utf8 = FALSE;
 
+  /* Collect all segments first, and then add them to the buffer at once,
+   * so that the buffer is only modified and notified once. */
+  chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
+
   for(child = node->children; child != NULL; child = child->next)
   {
     if(child->type != XML_ELEMENT_NODE)
@@ -178,7 +321,10 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
       );
 
       if(res == FALSE)
+      {
+        inf_text_chunk_free(chunk);
         return FALSE;
+      }
 
       if(author != 0)
       {
@@ -194,28 +340,29 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
             author
           );
 
+          inf_text_chunk_free(chunk);
           return FALSE;
         }
       }
-      else
-      {
-        user = NULL;
-      }
 
       content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
-      if(!content) return FALSE;
+      if(!content)
+      {
+        inf_text_chunk_free(chunk);
+        return FALSE;
+      }
 
       if(*content != '\0')
       {
         if(is_utf8)
         {
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
+          inf_text_chunk_insert_text(
+            chunk,
+            inf_text_chunk_get_length(chunk),
             content,
             bytes,
             chars,
-            user
+            author
           );
 
           g_free(content);
@@ -235,23 +382,33 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
           g_free(content);
 
           if(converted == NULL)
+          {
+            inf_text_chunk_free(chunk);
             return FALSE;
+          }
 
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
+          inf_text_chunk_insert_text(
+            chunk,
+            inf_text_chunk_get_length(chunk),
             converted,
             converted_bytes,
             chars,
-            user
+            author
           );
 
           g_free(converted);
         }
       }
+      else
+      {
+        g_free(content);
+      }
     }
   }
 
+  inf_text_buffer_append(buffer, chunk, NULL);
+  inf_text_chunk_free(chunk);
+
   return TRUE;
 }
 
@@ -281,320 +438,2854 @@ inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
   }
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static void
+inf_text_filesystem_format_set_invalid_data_error(GError** error)
 {
-  FILE* stream;
-  gchar* full_path;
-  gchar* uri;
-
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  xmlNodePtr root;
-  xmlNodePtr child;
-  gboolean result;
-
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
-
-  /* TODO: Use a SAX parser for better performance */
-  full_path = NULL;
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    &full_path,
-    error
+  g_set_error_literal(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_DATA,
+    _("The file is truncated or contains invalid data")
   );
+}
 
-  if(stream == NULL)
+static gboolean
+inf_text_filesystem_format_reader_get(InfTextFilesystemFormatReader* reader,
+                                      gsize len,
+                                      const guchar** data,
+                                      GError** error)
+{
+  if(reader->len - reader->pos < len)
   {
-    g_free(full_path);
+    inf_text_filesystem_format_set_invalid_data_error(error);
     return FALSE;
   }
 
-  uri = g_filename_to_uri(full_path, NULL, error);
-  g_free(full_path);
+  *data = reader->data + reader->pos;
+  reader->pos += len;
+  return TRUE;
+}
 
-  if(uri == NULL)
+static gboolean
+inf_text_filesystem_format_reader_get_uint32(
+  InfTextFilesystemFormatReader* reader,
+  guint32* value,
+  GError** error)
+{
+  const guchar* data;
+
+  if(!inf_text_filesystem_format_reader_get(reader, 4, &data, error))
     return FALSE;
 
-  doc = xmlReadIO(
-    inf_text_filesystem_format_read_read_func,
-    inf_text_filesystem_format_read_close_func,
-    stream,
-    uri,
-    "UTF-8",
-    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
-  );
+  memcpy(value, data, 4);
+  *value = GUINT32_FROM_LE(*value);
+  return TRUE;
+}
 
-  g_free(uri);
+static gboolean
+inf_text_filesystem_format_reader_get_uint64(
+  InfTextFilesystemFormatReader* reader,
+  guint64* value,
+  GError** error)
+{
+  const guchar* data;
 
-  if(doc == NULL)
-  {
-    xmlerror = xmlGetLastError();
+  if(!inf_text_filesystem_format_reader_get(reader, 8, &data, error))
+    return FALSE;
 
-    g_set_error(
-      error,
-      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
-      xmlerror->code,
-      _("Error parsing XML in file \"%s\": [%d]: %s"),
-      path,
-      xmlerror->line,
-      xmlerror->message
-    );
+  memcpy(value, data, 8);
+  *value = GUINT64_FROM_LE(*value);
+  return TRUE;
+}
 
-    result = FALSE;
+/* Reads a length-prefixed UTF-8 string */
+static gchar*
+inf_text_filesystem_format_reader_get_string(
+  InfTextFilesystemFormatReader* reader,
+  GError** error)
+{
+  guint32 len;
+  const guchar* data;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(reader, &len, error))
+    return NULL;
+  if(!inf_text_filesystem_format_reader_get(reader, len, &data, error))
+    return NULL;
+
+  if(memchr(data, '\0', len) != NULL ||
+     !g_utf8_validate((const gchar*)data, len, NULL))
+  {
+    inf_text_filesystem_format_set_invalid_data_error(error);
+    return NULL;
   }
-  else
+
+  return g_strndup((const gchar*)data, len);
+}
+
+static gboolean
+inf_text_filesystem_format_read_binary_segments(
+  InfTextFilesystemFormatReader* reader,
+  guint32 n_segments,
+  const gchar* encoding,
+  InfUserTable* user_table,
+  InfTextBuffer* buffer,
+  GError** error)
+{
+  InfTextChunk* chunk;
+  gboolean is_utf8;
+  gboolean convert;
+  guint32 i;
+
+  guint32 author;
+  guint32 chars;
+  guint32 bytes;
+  const guchar* text;
+  gchar* converted;
+  gsize converted_bytes;
+  gchar* utf8;
+  gsize utf8_bytes;
+  gboolean valid;
+
+  is_utf8 = (strcmp(encoding, "UTF-8") == 0);
+  convert = (strcmp(encoding, inf_text_buffer_get_encoding(buffer)) != 0);
+
+  /* As for the XML format, collect all segments first so that the buffer is
+   * only modified once. The text is copied straight out of the mapping. */
+  chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
+
+  for(i = 0; i < n_segments; ++i)
   {
-    root = xmlDocGetRootElement(doc);
-    if(strcmp((const char*)root->name, "inf-text-session") != 0)
+    if(!inf_text_filesystem_format_reader_get_uint32(reader, &author, error) ||
+       !inf_text_filesystem_format_reader_get_uint32(reader, &chars, error) ||
+       !inf_text_filesystem_format_reader_get_uint32(reader, &bytes, error) ||
+       !inf_text_filesystem_format_reader_get(reader, bytes, &text, error))
+    {
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    if(author != 0 &&
+       inf_user_table_lookup_user_by_id(user_table, author) == NULL)
     {
       g_set_error(
         error,
         inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
-        _("Error processing file \"%s\": %s"),
-        path,
-        _("The document is not a text session")
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
       );
 
-      result = FALSE;
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    /* The character count is trusted by the buffer, so check it for every
+     * encoding. Other encodings are converted to UTF-8 to count. */
+    if(is_utf8)
+    {
+      utf8 = NULL;
+      valid = g_utf8_validate((const gchar*)text, bytes, NULL) &&
+              g_utf8_strlen((const gchar*)text, bytes) == chars;
     }
     else
     {
-      for(child = root->children; child != NULL; child = child->next)
-      {
-        if(child->type != XML_ELEMENT_NODE)
-          continue;
+      utf8 = g_convert(
+        (const gchar*)text,
+        bytes,
+        "UTF-8",
+        encoding,
+        NULL,
+        &utf8_bytes,
+        NULL
+      );
 
-        if(strcmp((const char*)child->name, "user") == 0)
-        {
-          if(!inf_text_filesystem_format_read_user(user_table, child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-        else if(strcmp((const char*)child->name, "buffer") == 0)
-        {
-          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
-                                                     child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-      }
+      valid = utf8 != NULL && g_utf8_strlen(utf8, utf8_bytes) == chars;
+    }
 
-      if(child == NULL)
-        result = TRUE;
+    if(!valid)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      g_free(utf8);
+      inf_text_chunk_free(chunk);
+      return FALSE;
     }
 
-    xmlFreeDoc(doc);
-  }
+    if(bytes == 0)
+    {
+      g_free(utf8);
+      continue;
+    }
+
+    if(convert && utf8 != NULL &&
+       strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        utf8,
+        utf8_bytes,
+        chars,
+        author
+      );
+    }
+    else if(convert)
+    {
+      converted = g_convert(
+        (const gchar*)text,
+        bytes,
+        inf_text_buffer_get_encoding(buffer),
+        encoding,
+        NULL,
+        &converted_bytes,
+        error
+      );
+
+      if(converted == NULL)
+      {
+        g_free(utf8);
+        inf_text_chunk_free(chunk);
+        return FALSE;
+      }
+
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        converted,
+        converted_bytes,
+        chars,
+        author
+      );
+
+      g_free(converted);
+    }
+    else
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        text,
+        bytes,
+        chars,
+        author
+      );
+    }
+
+    g_free(utf8);
+  }
+
+  if(reader->pos != reader->len)
+  {
+    inf_text_filesystem_format_set_invalid_data_error(error);
+    inf_text_chunk_free(chunk);
+    return FALSE;
+  }
+
+  inf_text_buffer_append(buffer, chunk, NULL);
+  inf_text_chunk_free(chunk);
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_format_read_binary(const guchar* data,
+                                       gsize len,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       GError** error)
+{
+  InfTextFilesystemFormatReader reader;
+  InfTextFilesystemFormatReader payload;
+  guint32 version;
+  guint32 flags;
+  gchar* encoding;
+  guint32 n_users;
+  guint32 n_segments;
+  guint64 payload_size;
+  guint32 i;
+  gboolean result;
+
+  guint32 id;
+  union { guint64 bits; gdouble value; } hue;
+  gchar* name;
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  z_stream zstream;
+  guchar* inflated;
+  int status;
+#endif
+
+  reader.data = data;
+  reader.len = len;
+  reader.pos = INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_LEN;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(&reader, &version, error))
+    return FALSE;
+
+  if(version > INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_UNSUPPORTED,
+      _("Binary format version %u is not supported"),
+      (guint)version
+    );
+
+    return FALSE;
+  }
+
+  if(!inf_text_filesystem_format_reader_get_uint32(&reader, &flags, error))
+    return FALSE;
+
+  encoding = inf_text_filesystem_format_reader_get_string(&reader, error);
+  if(encoding == NULL)
+    return FALSE;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(&reader, &n_users, error))
+  {
+    g_free(encoding);
+    return FALSE;
+  }
+
+  for(i = 0; i < n_users; ++i)
+  {
+    if(!inf_text_filesystem_format_reader_get_uint32(&reader, &id, error) ||
+       !inf_text_filesystem_format_reader_get_uint64(&reader, &hue.bits,
+                                                     error))
+    {
+      g_free(encoding);
+      return FALSE;
+    }
+
+    name = inf_text_filesystem_format_reader_get_string(&reader, error);
+    if(name == NULL)
+    {
+      g_free(encoding);
+      return FALSE;
+    }
+
+    result = inf_text_filesystem_format_add_user(
+      user_table,
+      id,
+      name,
+      hue.value,
+      error
+    );
+
+    g_free(name);
+
+    if(result == FALSE)
+    {
+      g_free(encoding);
+      return FALSE;
+    }
+  }
+
+  if(!inf_text_filesystem_format_reader_get_uint32(&reader, &n_segments,
+                                                   error) ||
+     !inf_text_filesystem_format_reader_get_uint64(&reader, &payload_size,
+                                                   error))
+  {
+    g_free(encoding);
+    return FALSE;
+  }
+
+  if(flags & INF_TEXT_FILESYSTEM_FORMAT_BINARY_FLAG_COMPRESSED)
+  {
+#ifdef LIBINFINITY_HAVE_ZLIB
+    /* deflate cannot compress better than about 1:1032, which protects
+     * against allocating huge amounts of memory for a corrupted header. */
+    inflated = NULL;
+    if(payload_size / 1032 <= reader.len - reader.pos)
+      inflated = g_try_malloc(payload_size > 0 ? payload_size : 1);
+
+    if(inflated == NULL)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      g_free(encoding);
+      return FALSE;
+    }
+
+    memset(&zstream, 0, sizeof(zstream));
+    status = inflateInit(&zstream);
+    g_assert(status == Z_OK);
+
+    zstream.next_in = (Bytef*)reader.data + reader.pos;
+    zstream.next_out = inflated;
+
+    /* avail_in and avail_out are only 32 bit wide, so refill them until
+     * inflate() reports the end of the stream or cannot make progress. */
+    do
+    {
+      zstream.avail_in =
+        MIN(reader.len - (zstream.next_in - reader.data), G_MAXUINT32);
+      zstream.avail_out =
+        MIN(payload_size - (zstream.next_out - inflated), G_MAXUINT32);
+
+      status = inflate(&zstream, Z_NO_FLUSH);
+    } while(status == Z_OK);
+
+    inflateEnd(&zstream);
+
+    /* A valid file ends exactly with the deflate stream, which in turn ends
+     * exactly after the announced payload size. */
+    if(status != Z_STREAM_END ||
+       (guint64)(zstream.next_out - inflated) != payload_size ||
+       (gsize)(zstream.next_in - reader.data) != reader.len)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      g_free(inflated);
+      g_free(encoding);
+      return FALSE;
+    }
+
+    payload.data = inflated;
+    payload.len = payload_size;
+    payload.pos = 0;
+
+    result = inf_text_filesystem_format_read_binary_segments(
+      &payload,
+      n_segments,
+      encoding,
+      user_table,
+      buffer,
+      error
+    );
+
+    g_free(inflated);
+#else
+    g_set_error_literal(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_UNSUPPORTED,
+      _("The file is compressed, but zlib support is not available")
+    );
+
+    result = FALSE;
+#endif
+  }
+  else
+  {
+    if(payload_size != reader.len - reader.pos)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      g_free(encoding);
+      return FALSE;
+    }
+
+    payload.data = reader.data + reader.pos;
+    payload.len = reader.len - reader.pos;
+    payload.pos = 0;
+
+    result = inf_text_filesystem_format_read_binary_segments(
+      &payload,
+      n_segments,
+      encoding,
+      user_table,
+      buffer,
+      error
+    );
+  }
+
+  g_free(encoding);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_writer_flush(InfTextFilesystemFormatWriter* writer,
+                                        gconstpointer data,
+                                        gsize len,
+                                        GError** error)
+{
+  int save_errno;
+
+  if(writer->stream == NULL)
+  {
+    g_byte_array_append(writer->memory, data, len);
+    return TRUE;
+  }
+
+  if(infd_filesystem_storage_stream_write(writer->stream, data, len) != len)
+  {
+    save_errno = errno;
+
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      g_strerror(save_errno)
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+static gboolean
+inf_text_filesystem_format_writer_deflate(InfTextFilesystemFormatWriter* wr,
+                                          int flush,
+                                          GError** error)
+{
+  int status;
+
+  do
+  {
+    wr->zstream.next_out = wr->zbuffer;
+    wr->zstream.avail_out = sizeof(wr->zbuffer);
+
+    status = deflate(&wr->zstream, flush);
+    g_assert(status != Z_STREAM_ERROR);
+
+    if(!inf_text_filesystem_format_writer_flush(
+         wr,
+         wr->zbuffer,
+         sizeof(wr->zbuffer) - wr->zstream.avail_out,
+         error))
+    {
+      return FALSE;
+    }
+  } while(wr->zstream.avail_out == 0);
+
+  return TRUE;
+}
+#endif
+
+static gboolean
+inf_text_filesystem_format_writer_write(InfTextFilesystemFormatWriter* writer,
+                                        gconstpointer data,
+                                        gsize len,
+                                        GError** error)
+{
+#ifdef LIBINFINITY_HAVE_ZLIB
+  if(writer->compressed)
+  {
+    writer->zstream.next_in = (Bytef*)data;
+    writer->zstream.avail_in = len;
+
+    return inf_text_filesystem_format_writer_deflate(
+      writer,
+      Z_NO_FLUSH,
+      error
+    );
+  }
+#endif
+
+  return inf_text_filesystem_format_writer_flush(writer, data, len, error);
+}
+
+static gboolean
+inf_text_filesystem_format_writer_write_uint32(
+  InfTextFilesystemFormatWriter* writer,
+  guint32 value,
+  GError** error)
+{
+  value = GUINT32_TO_LE(value);
+  return inf_text_filesystem_format_writer_write(writer, &value, 4, error);
+}
+
+static gboolean
+inf_text_filesystem_format_writer_write_uint64(
+  InfTextFilesystemFormatWriter* writer,
+  guint64 value,
+  GError** error)
+{
+  value = GUINT64_TO_LE(value);
+  return inf_text_filesystem_format_writer_write(writer, &value, 8, error);
+}
+
+static gboolean
+inf_text_filesystem_format_writer_write_string(
+  InfTextFilesystemFormatWriter* writer,
+  const gchar* str,
+  GError** error)
+{
+  gsize len;
+  len = strlen(str);
+
+  if(!inf_text_filesystem_format_writer_write_uint32(writer, len, error))
+    return FALSE;
+
+  return inf_text_filesystem_format_writer_write(writer, str, len, error);
+}
+
+static void
+inf_text_filesystem_format_write_binary_foreach_user_func(InfUser* user,
+                                                          gpointer user_data)
+{
+  InfTextFilesystemFormatBinaryWriteData* data;
+  data = (InfTextFilesystemFormatBinaryWriteData*)user_data;
+
+  if(g_hash_table_lookup(data->encountered_authors,
+                         GUINT_TO_POINTER(inf_user_get_id(user))) != NULL)
+  {
+    g_ptr_array_add(data->users, user);
+  }
+}
+
+static gboolean
+inf_text_filesystem_format_write_binary_header(
+  InfTextFilesystemFormatWriter* writer,
+  InfUserTable* user_table,
+  InfTextBuffer* buffer,
+  guint32 flags,
+  GError** error)
+{
+  InfTextFilesystemFormatBinaryWriteData data;
+  InfTextBufferIter* iter;
+  guint author;
+  guint32 n_segments;
+  guint64 payload_size;
+  union { guint64 bits; gdouble value; } hue;
+  InfUser* user;
+  guint i;
+  gboolean result;
+
+  /* The users and the size of the segment data need to be known before the
+   * segments themselves are written, so make a first pass over the buffer
+   * that does not touch the text. */
+  data.users = g_ptr_array_new();
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  n_segments = 0;
+  payload_size = 0;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+
+      ++n_segments;
+      payload_size += 12 + inf_text_buffer_iter_get_bytes(buffer, iter);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_write_binary_foreach_user_func,
+    &data
+  );
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  result =
+    inf_text_filesystem_format_writer_write(
+      writer,
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC,
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_LEN,
+      error
+    ) &&
+    inf_text_filesystem_format_writer_write_uint32(
+      writer,
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION,
+      error
+    ) &&
+    inf_text_filesystem_format_writer_write_uint32(writer, flags, error) &&
+    inf_text_filesystem_format_writer_write_string(
+      writer,
+      inf_text_buffer_get_encoding(buffer),
+      error
+    ) &&
+    inf_text_filesystem_format_writer_write_uint32(
+      writer,
+      data.users->len,
+      error
+    );
+
+  for(i = 0; result == TRUE && i < data.users->len; ++i)
+  {
+    user = INF_USER(g_ptr_array_index(data.users, i));
+    hue.value = inf_text_user_get_hue(INF_TEXT_USER(user));
+
+    result =
+      inf_text_filesystem_format_writer_write_uint32(
+        writer,
+        inf_user_get_id(user),
+        error
+      ) &&
+      inf_text_filesystem_format_writer_write_uint64(
+        writer,
+        hue.bits,
+        error
+      ) &&
+      inf_text_filesystem_format_writer_write_string(
+        writer,
+        inf_user_get_name(user),
+        error
+      );
+  }
+
+  g_ptr_array_free(data.users, TRUE);
+
+  if(result == FALSE)
+    return FALSE;
+
+  if(!inf_text_filesystem_format_writer_write_uint32(writer, n_segments,
+                                                     error))
+  {
+    return FALSE;
+  }
+
+  return inf_text_filesystem_format_writer_write_uint64(
+    writer,
+    payload_size,
+    error
+  );
+}
+
+static gboolean
+inf_text_filesystem_format_write_binary_segments(
+  InfTextFilesystemFormatWriter* writer,
+  InfTextBuffer* buffer,
+  GError** error)
+{
+  InfTextBufferIter* iter;
+  gchar* content;
+  gsize bytes;
+  gboolean result;
+
+  result = TRUE;
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      content = inf_text_buffer_iter_get_text(buffer, iter);
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      result =
+        inf_text_filesystem_format_writer_write_uint32(
+          writer,
+          inf_text_buffer_iter_get_author(buffer, iter),
+          error
+        ) &&
+        inf_text_filesystem_format_writer_write_uint32(
+          writer,
+          inf_text_buffer_iter_get_length(buffer, iter),
+          error
+        ) &&
+        inf_text_filesystem_format_writer_write_uint32(
+          writer,
+          bytes,
+          error
+        ) &&
+        inf_text_filesystem_format_writer_write(
+          writer,
+          content,
+          bytes,
+          error
+        );
+
+      g_free(content);
+    } while(result == TRUE && inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_write_binary_content(
+  InfTextFilesystemFormatWriter* writer,
+  InfUserTable* user_table,
+  InfTextBuffer* buffer,
+  gboolean compress,
+  GError** error)
+{
+  guint32 flags;
+  gboolean result;
+
+  flags = 0;
+#ifdef LIBINFINITY_HAVE_ZLIB
+  writer->compressed = FALSE;
+  if(compress)
+    flags |= INF_TEXT_FILESYSTEM_FORMAT_BINARY_FLAG_COMPRESSED;
+#endif
+
+  result = inf_text_filesystem_format_write_binary_header(
+    writer,
+    user_table,
+    buffer,
+    flags,
+    error
+  );
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  if(result == TRUE && compress)
+  {
+    memset(&writer->zstream, 0, sizeof(writer->zstream));
+    result = (deflateInit(&writer->zstream, Z_DEFAULT_COMPRESSION) == Z_OK);
+    g_assert(result == TRUE);
+    writer->compressed = TRUE;
+  }
+#endif
+
+  if(result == TRUE)
+  {
+    result = inf_text_filesystem_format_write_binary_segments(
+      writer,
+      buffer,
+      error
+    );
+  }
+
+#ifdef LIBINFINITY_HAVE_ZLIB
+  if(writer->compressed)
+  {
+    if(result == TRUE)
+    {
+      writer->zstream.next_in = NULL;
+      writer->zstream.avail_in = 0;
+
+      result = inf_text_filesystem_format_writer_deflate(
+        writer,
+        Z_FINISH,
+        error
+      );
+    }
+
+    deflateEnd(&writer->zstream);
+  }
+#endif
+
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_write_binary(InfdFilesystemStorage* storage,
+                                        const gchar* identifier,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        gboolean compress,
+                                        GError** error)
+{
+  InfTextFilesystemFormatWriter writer;
+  gboolean result;
+
+  writer.memory = NULL;
+  writer.stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    identifier,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(writer.stream == NULL)
+    return FALSE;
+
+  result = inf_text_filesystem_format_write_binary_content(
+    &writer,
+    user_table,
+    buffer,
+    compress,
+    error
+  );
+
+  if(result == TRUE &&
+     infd_filesystem_storage_stream_sync(writer.stream) != 0)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    result = FALSE;
+  }
+
+  if(infd_filesystem_storage_stream_close(writer.stream) != 0 && result)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    result = FALSE;
+  }
+
+  return result;
+}
+
+static guint32
+inf_text_filesystem_format_checksum(const guchar* data,
+                                    gsize len)
+{
+  guint32 hash;
+  gsize i;
+
+  /* 32 bit FNV-1a, which is enough to detect a record that was only
+   * partially written before the server went down. */
+  hash = 2166136261u;
+  for(i = 0; i < len; ++i)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static gboolean
+inf_text_filesystem_format_replay_user(InfTextFilesystemFormatReader* reader,
+                                       InfUserTable* user_table,
+                                       GError** error)
+{
+  guint32 id;
+  union { guint64 bits; gdouble value; } hue;
+  gchar* name;
+  gboolean result;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(reader, &id, error) ||
+     !inf_text_filesystem_format_reader_get_uint64(reader, &hue.bits, error))
+  {
+    return FALSE;
+  }
+
+  name = inf_text_filesystem_format_reader_get_string(reader, error);
+  if(name == NULL)
+    return FALSE;
+
+  /* Users are recorded whenever they first write into the document after a
+   * checkpoint, so they might be known already. */
+  result = TRUE;
+  if(inf_user_table_lookup_user_by_id(user_table, id) == NULL)
+  {
+    result = inf_text_filesystem_format_add_user(
+      user_table,
+      id,
+      name,
+      hue.value,
+      error
+    );
+  }
+
+  g_free(name);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_replay_insert(InfTextFilesystemFormatReader* reader,
+                                         InfUserTable* user_table,
+                                         InfTextBuffer* buffer,
+                                         GError** error)
+{
+  const gchar* encoding;
+  InfTextChunk* chunk;
+  guint32 pos;
+  guint32 n_segments;
+  guint32 i;
+
+  guint32 author;
+  guint32 chars;
+  guint32 bytes;
+  const guchar* text;
+  gchar* converted;
+  gsize converted_bytes;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(reader, &pos, error) ||
+     !inf_text_filesystem_format_reader_get_uint32(reader, &n_segments, error))
+  {
+    return FALSE;
+  }
+
+  if(pos > inf_text_buffer_get_length(buffer))
+  {
+    inf_text_filesystem_format_set_invalid_data_error(error);
+    return FALSE;
+  }
+
+  encoding = inf_text_buffer_get_encoding(buffer);
+  chunk = inf_text_chunk_new(encoding);
+
+  for(i = 0; i < n_segments; ++i)
+  {
+    if(!inf_text_filesystem_format_reader_get_uint32(reader, &author, error) ||
+       !inf_text_filesystem_format_reader_get_uint32(reader, &chars, error) ||
+       !inf_text_filesystem_format_reader_get_uint32(reader, &bytes, error) ||
+       !inf_text_filesystem_format_reader_get(reader, bytes, &text, error))
+    {
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    if(author != 0 &&
+       inf_user_table_lookup_user_by_id(user_table, author) == NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
+      );
+
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    if(!g_utf8_validate((const gchar*)text, bytes, NULL) ||
+       g_utf8_strlen((const gchar*)text, bytes) != chars)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    /* The journal stores text in UTF-8, as the XML format does */
+    if(strcmp(encoding, "UTF-8") == 0)
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        text,
+        bytes,
+        chars,
+        author
+      );
+    }
+    else
+    {
+      converted = g_convert(
+        (const gchar*)text,
+        bytes,
+        encoding,
+        "UTF-8",
+        NULL,
+        &converted_bytes,
+        error
+      );
+
+      if(converted == NULL)
+      {
+        inf_text_chunk_free(chunk);
+        return FALSE;
+      }
+
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        converted,
+        converted_bytes,
+        chars,
+        author
+      );
+
+      g_free(converted);
+    }
+  }
+
+  inf_text_buffer_insert_chunk(buffer, pos, chunk, NULL);
+  inf_text_chunk_free(chunk);
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_format_replay_erase(InfTextFilesystemFormatReader* reader,
+                                        InfTextBuffer* buffer,
+                                        GError** error)
+{
+  guint32 pos;
+  guint32 len;
+
+  if(!inf_text_filesystem_format_reader_get_uint32(reader, &pos, error) ||
+     !inf_text_filesystem_format_reader_get_uint32(reader, &len, error))
+  {
+    return FALSE;
+  }
+
+  if(pos > inf_text_buffer_get_length(buffer) ||
+     len > inf_text_buffer_get_length(buffer) - pos)
+  {
+    inf_text_filesystem_format_set_invalid_data_error(error);
+    return FALSE;
+  }
+
+  inf_text_buffer_erase_text(buffer, pos, len, NULL);
+  return TRUE;
+}
+
+/* Applies the records of a journal to the buffer. The tail of the journal
+ * can consist of a record which was only partially written when the server
+ * crashed. Replay stops there, and valid_len is set to the length of the
+ * part which was replayed. */
+static gboolean
+inf_text_filesystem_format_replay_journal(const guchar* data,
+                                          gsize len,
+                                          InfUserTable* user_table,
+                                          InfTextBuffer* buffer,
+                                          gsize* valid_len,
+                                          GError** error)
+{
+  InfTextFilesystemFormatReader reader;
+  InfTextFilesystemFormatReader record;
+  guint32 record_len;
+  guint32 checksum;
+  const guchar* type;
+  gboolean result;
+
+  reader.data = data;
+  reader.len = len;
+  reader.pos = 0;
+
+  while(reader.len - reader.pos >= 8)
+  {
+    inf_text_filesystem_format_reader_get_uint32(&reader, &record_len, NULL);
+    inf_text_filesystem_format_reader_get_uint32(&reader, &checksum, NULL);
+
+    if(record_len == 0 || reader.len - reader.pos < record_len)
+      break;
+
+    record.data = reader.data + reader.pos;
+    record.len = record_len;
+    record.pos = 0;
+
+    if(inf_text_filesystem_format_checksum(record.data, record.len) !=
+       checksum)
+    {
+      break;
+    }
+
+    inf_text_filesystem_format_reader_get(&record, 1, &type, NULL);
+
+    switch(*type)
+    {
+    case INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_USER:
+      result = inf_text_filesystem_format_replay_user(
+        &record,
+        user_table,
+        error
+      );
+
+      break;
+    case INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_INSERT:
+      result = inf_text_filesystem_format_replay_insert(
+        &record,
+        user_table,
+        buffer,
+        error
+      );
+
+      break;
+    case INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_ERASE:
+      result = inf_text_filesystem_format_replay_erase(
+        &record,
+        buffer,
+        error
+      );
+
+      break;
+    default:
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      result = FALSE;
+      break;
+    }
+
+    if(result == FALSE)
+      return FALSE;
+
+    if(record.pos != record.len)
+    {
+      inf_text_filesystem_format_set_invalid_data_error(error);
+      return FALSE;
+    }
+
+    reader.pos += record_len;
+    *valid_len = reader.pos;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_format_read_journal(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        GError** error)
+{
+  FILE* stream;
+  GError* local_error;
+  GMappedFile* mapped_file;
+  const guchar* contents;
+  gsize length;
+  gsize valid_len;
+  gboolean result;
+
+  local_error = NULL;
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+    path,
+    "r",
+    NULL,
+    &local_error
+  );
+
+  if(stream == NULL)
+  {
+    if(g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  mapped_file = g_mapped_file_new_from_fd(fileno(stream), FALSE, error);
+  infd_filesystem_storage_stream_close(stream);
+
+  if(mapped_file == NULL)
+    return FALSE;
+
+  contents = (const guchar*)g_mapped_file_get_contents(mapped_file);
+  length = g_mapped_file_get_length(mapped_file);
+  valid_len = 0;
+
+  result = inf_text_filesystem_format_replay_journal(
+    contents,
+    length,
+    user_table,
+    buffer,
+    &valid_len,
+    error
+  );
+
+  /* Cut off a partially written record, so that records appended later on
+   * are not hidden behind it. The valid part is written to a new file which
+   * then replaces the journal, so that a crash in between does not lose the
+   * records that were written completely. */
+  if(result == TRUE && valid_len < length)
+  {
+    stream = infd_filesystem_storage_open(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+      path,
+      "w",
+      NULL,
+      error
+    );
+
+    if(stream == NULL)
+    {
+      result = FALSE;
+    }
+    else
+    {
+      if(infd_filesystem_storage_stream_write(stream, contents, valid_len) !=
+         valid_len ||
+         infd_filesystem_storage_stream_sync(stream) != 0)
+      {
+        g_set_error_literal(
+          error,
+          G_FILE_ERROR,
+          g_file_error_from_errno(errno),
+          g_strerror(errno)
+        );
+
+        result = FALSE;
+      }
+
+      if(infd_filesystem_storage_stream_close(stream) != 0 && result)
+      {
+        g_set_error_literal(
+          error,
+          G_FILE_ERROR,
+          g_file_error_from_errno(errno),
+          g_strerror(errno)
+        );
+
+        result = FALSE;
+      }
+
+      if(result == TRUE)
+      {
+        result = infd_filesystem_storage_rename(
+          storage,
+          INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+          path,
+          INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+          error
+        );
+      }
+    }
+  }
+
+  g_mapped_file_unref(mapped_file);
+  return result;
+}
+
+/* A checkpoint is first written under the temporary identifier and then
+ * renamed to the "new" identifier once it is complete. Then the journal is
+ * removed, and finally the new checkpoint replaces the old one. If a "new"
+ * file exists, the server went down during the last two steps, and the
+ * sequence is completed here. */
+static gboolean
+inf_text_filesystem_format_recover(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   GError** error)
+{
+  FILE* stream;
+  GError* local_error;
+  gboolean result;
+
+  /* Do not complete a replacement that is being done in a worker thread,
+   * see inf_text_filesystem_format_write_async(). It holds the lock until
+   * the "new" file is gone again. */
+  infd_filesystem_storage_lock_files(storage);
+
+  local_error = NULL;
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_FORMAT_NEW_IDENTIFIER,
+    path,
+    "r",
+    NULL,
+    &local_error
+  );
+
+  if(stream == NULL)
+  {
+    infd_filesystem_storage_unlock_files(storage);
+
+    if(g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  infd_filesystem_storage_stream_close(stream);
+
+  result = infd_filesystem_storage_unlink(
+    storage,
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+    path,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_storage_rename(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_NEW_IDENTIFIER,
+      path,
+      INF_TEXT_FILESYSTEM_FORMAT_IDENTIFIER,
+      error
+    );
+  }
+
+  infd_filesystem_storage_unlock_files(storage);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_read_checkpoint(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           InfUserTable* user_table,
+                                           InfTextBuffer* buffer,
+                                           GError** error)
+{
+  FILE* stream;
+  gchar* full_path;
+  gchar* uri;
+  GMappedFile* mapped_file;
+  const guchar* contents;
+  gsize length;
+
+  xmlDocPtr doc;
+  xmlErrorPtr xmlerror;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  gboolean result;
+
+  /* TODO: Use a SAX parser for better performance */
+  full_path = NULL;
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    INF_TEXT_FILESYSTEM_FORMAT_IDENTIFIER,
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(full_path);
+    return FALSE;
+  }
+
+  /* Map the file to look at the first bytes without consuming the stream.
+   * Binary files are parsed directly from the mapping. */
+  mapped_file = g_mapped_file_new_from_fd(fileno(stream), FALSE, error);
+  if(mapped_file == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  contents = (const guchar*)g_mapped_file_get_contents(mapped_file);
+  length = g_mapped_file_get_length(mapped_file);
+
+  if(length >= INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_LEN &&
+     memcmp(contents, INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_LEN) == 0)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    g_free(full_path);
+
+    result = inf_text_filesystem_format_read_binary(
+      contents,
+      length,
+      user_table,
+      buffer,
+      error
+    );
+
+    g_mapped_file_unref(mapped_file);
+
+    if(result == FALSE)
+      g_prefix_error(error, _("Error processing file \"%s\": "), path);
+
+    return result;
+  }
+
+  g_mapped_file_unref(mapped_file);
+
+  uri = g_filename_to_uri(full_path, NULL, error);
+  g_free(full_path);
+
+  if(uri == NULL)
+    return FALSE;
+
+  doc = xmlReadIO(
+    inf_text_filesystem_format_read_read_func,
+    inf_text_filesystem_format_read_close_func,
+    stream,
+    uri,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  );
+
+  g_free(uri);
+
+  if(doc == NULL)
+  {
+    xmlerror = xmlGetLastError();
+
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      path,
+      xmlerror->line,
+      xmlerror->message
+    );
+
+    result = FALSE;
+  }
+  else
+  {
+    root = xmlDocGetRootElement(doc);
+    if(strcmp((const char*)root->name, "inf-text-session") != 0)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+        _("Error processing file \"%s\": %s"),
+        path,
+        _("The document is not a text session")
+      );
+
+      result = FALSE;
+    }
+    else
+    {
+      for(child = root->children; child != NULL; child = child->next)
+      {
+        if(child->type != XML_ELEMENT_NODE)
+          continue;
+
+        if(strcmp((const char*)child->name, "user") == 0)
+        {
+          if(!inf_text_filesystem_format_read_user(user_table, child, error))
+          {
+            g_prefix_error(error, _("Error processing file \"%s\": "), path);
+            result = FALSE;
+            break;
+          }
+        }
+        else if(strcmp((const char*)child->name, "buffer") == 0)
+        {
+          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
+                                                     child, error))
+          {
+            g_prefix_error(error, _("Error processing file \"%s\": "), path);
+            result = FALSE;
+            break;
+          }
+        }
+      }
+
+      if(child == NULL)
+        result = TRUE;
+    }
+
+    xmlFreeDoc(doc);
+  }
+
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_read:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() or
+ * inf_text_filesystem_format_write_with_flags() before. Whether the file is
+ * in the XML or in the binary format is detected automatically. The @user_table
+ * parameter should be an empty user table that will be used for the session,
+ * and the @buffer parameter should be an empty #InfTextBuffer, and the
+ * document will be written into this buffer. If the function succeeds, the
+ * user table and buffer can be used to create an #InfTextSession with
+ * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * If a journal has been recorded for the session with
+ * #InfTextFilesystemJournal, the changes in it are applied to the buffer
+ * after the last checkpoint has been read. A checkpoint whose writing was
+ * interrupted is completed or discarded first.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  if(!inf_text_filesystem_format_recover(storage, path, error))
+    return FALSE;
+
+  if(!inf_text_filesystem_format_read_checkpoint(storage, path, user_table,
+                                                 buffer, error))
+  {
+    return FALSE;
+  }
+
+  if(!inf_text_filesystem_format_read_journal(storage, path, user_table,
+                                              buffer, error))
+  {
+    g_prefix_error(error, _("Error processing journal of \"%s\": "), path);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static xmlDocPtr
+inf_text_filesystem_format_write_xml_doc(InfUserTable* user_table,
+                                         InfTextBuffer* buffer,
+                                         GError** error)
+{
+  InfTextBufferIter* iter;
+  xmlNodePtr buffer_node;
+  xmlNodePtr segment_node;
+
+  guint author;
+  gchar* content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+
+  xmlDocPtr doc;
+  gboolean is_utf8;
+
+  InfTextFilesystemFormatWriteData data;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+
+  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+      content = inf_text_buffer_iter_get_text(buffer, iter);
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+
+      segment_node = xmlNewChild(
+        buffer_node,
+        NULL,
+        (const xmlChar*)"segment",
+        NULL
+      );
+
+      inf_xml_util_set_attribute_uint(segment_node, "author", author);
+
+      if(is_utf8)
+      {
+        /* Buffer is UTF-8, no conversion necessary */
+        inf_xml_util_add_child_text(segment_node, content, bytes);
+        g_free(content);
+      }
+      else
+      {
+        /* Convert from buffer encoding to UTF-8 for storage */
+        converted = g_convert(
+          content,
+          bytes,
+          "UTF-8",
+          inf_text_buffer_get_encoding(buffer),
+          NULL,
+          &converted_bytes,
+          error
+        );
+
+        g_free(content);
+
+        if(converted == NULL)
+        {
+          xmlFreeNode(buffer_node);
+          xmlFreeNode(data.root);
+          g_hash_table_destroy(data.encountered_authors);
+          return NULL;
+        }
+
+        inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
+        g_free(converted);
+      }
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  /* After we wrote the buffer, now write the user table, but only for those
+   * users that have contributed to the document. The others we drop, to
+   * avoid cluttering the user table too much. */
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_write_foreach_user_func,
+    &data
+  );
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  /* Write the buffer after the users */
+  xmlAddChild(data.root, buffer_node);
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  xmlDocSetRootElement(doc, data.root);
+
+  return doc;
+}
+
+static gboolean
+inf_text_filesystem_format_write_xml(InfdFilesystemStorage* storage,
+                                     const gchar* identifier,
+                                     const gchar* path,
+                                     InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     GError** error)
+{
+  FILE* stream;
+  xmlDocPtr doc;
+  xmlErrorPtr xmlerror;
+
+  /* Open stream before exporting buffer to XML so possible errors are
+   * catched earlier. */
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    identifier,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  doc = inf_text_filesystem_format_write_xml_doc(user_table, buffer, error);
+  if(doc == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    return FALSE;
+  }
+
+  /* TODO: At this point, we should tell libxml2 to use
+   * infd_filesystem_storage_stream_write() instead of fwrite(),
+   * to prevent C runtime mixups. */
+  if(xmlDocFormatDump(stream, doc, 1) == -1)
+  {
+    xmlerror = xmlGetLastError();
+    infd_filesystem_storage_stream_close(stream);
+    xmlFreeDoc(doc);
+
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
+
+    return FALSE;
+  }
+
+  xmlFreeDoc(doc);
+
+  if(infd_filesystem_storage_stream_sync(stream) != 0)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    infd_filesystem_storage_stream_close(stream);
+    return FALSE;
+  }
+
+  if(infd_filesystem_storage_stream_close(stream) != 0)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static GBytes*
+inf_text_filesystem_format_serialize(InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     InfTextFilesystemFormatFlags flags,
+                                     GError** error)
+{
+  InfTextFilesystemFormatWriter writer;
+  xmlDocPtr doc;
+  xmlChar* xml;
+  int xml_len;
+  xmlErrorPtr xmlerror;
+  GBytes* bytes;
+
+  if(flags & INF_TEXT_FILESYSTEM_FORMAT_BINARY)
+  {
+    writer.stream = NULL;
+    writer.memory = g_byte_array_new();
+
+    if(!inf_text_filesystem_format_write_binary_content(
+         &writer,
+         user_table,
+         buffer,
+         (flags & INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED) != 0,
+         error))
+    {
+      g_byte_array_unref(writer.memory);
+      return NULL;
+    }
+
+    return g_byte_array_free_to_bytes(writer.memory);
+  }
+
+  doc = inf_text_filesystem_format_write_xml_doc(user_table, buffer, error);
+  if(doc == NULL)
+    return NULL;
+
+  xml = NULL;
+  xmlDocDumpFormatMemory(doc, &xml, &xml_len, 1);
+  xmlFreeDoc(doc);
+
+  if(xml == NULL)
+  {
+    xmlerror = xmlGetLastError();
+
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
+
+    return NULL;
+  }
+
+  bytes = g_bytes_new(xml, xml_len);
+  xmlFree(xml);
+
+  return bytes;
+}
+
+/* Replaces the stored document by the one written to the temporary file,
+ * and removes the journal, which the new version supersedes. See
+ * inf_text_filesystem_format_recover() for how an interrupted replacement
+ * is handled. */
+static gboolean
+inf_text_filesystem_format_replace(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   GError** error)
+{
+  gboolean result;
+
+  /* Listing the directory in another thread in the middle of this would
+   * show the document twice or not at all. */
+  infd_filesystem_storage_lock_files(storage);
+
+  result =
+    infd_filesystem_storage_rename(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+      path,
+      INF_TEXT_FILESYSTEM_FORMAT_NEW_IDENTIFIER,
+      error
+    ) &&
+    infd_filesystem_storage_unlink(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+      path,
+      error
+    ) &&
+    infd_filesystem_storage_rename(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_NEW_IDENTIFIER,
+      path,
+      INF_TEXT_FILESYSTEM_FORMAT_IDENTIFIER,
+      error
+    );
+
+  infd_filesystem_storage_unlock_files(storage);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_write_bytes(InfdFilesystemStorage* storage,
+                                       const gchar* path,
+                                       GBytes* bytes,
+                                       GError** error)
+{
+  FILE* stream;
+  gconstpointer data;
+  gsize len;
+  gboolean result;
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  data = g_bytes_get_data(bytes, &len);
+  result = TRUE;
+
+  if(infd_filesystem_storage_stream_write(stream, data, len) != len ||
+     infd_filesystem_storage_stream_sync(stream) != 0)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    result = FALSE;
+  }
+
+  if(infd_filesystem_storage_stream_close(stream) != 0 && result)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    result = FALSE;
+  }
+
+  if(result == FALSE)
+  {
+    infd_filesystem_storage_unlink(
+      storage,
+      INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+      path,
+      NULL
+    );
+
+    return FALSE;
+  }
+
+  return inf_text_filesystem_format_replace(storage, path, error);
+}
+
+static gboolean
+inf_text_filesystem_format_write_job_run(InfdStorage* storage,
+                                         gpointer run_data,
+                                         GError** error)
+{
+  InfTextFilesystemFormatWriteJob* job;
+  gboolean result;
+
+  job = (InfTextFilesystemFormatWriteJob*)run_data;
+  result = TRUE;
+
+  if(infd_filesystem_storage_lock_write(job->storage, job->path, job->serial))
+  {
+    result = inf_text_filesystem_format_write_bytes(
+      job->storage,
+      job->path,
+      job->bytes,
+      error
+    );
+  }
+
+  infd_filesystem_storage_end_write(job->storage, job->path);
+  job->ended = TRUE;
+
+  return result;
+}
+
+static void
+inf_text_filesystem_format_write_job_free(gpointer data)
+{
+  InfTextFilesystemFormatWriteJob* job;
+  job = (InfTextFilesystemFormatWriteJob*)data;
+
+  /* The request could not be started */
+  if(job->ended == FALSE)
+  {
+    infd_filesystem_storage_lock_write(job->storage, job->path, job->serial);
+    infd_filesystem_storage_end_write(job->storage, job->path);
+  }
+
+  g_bytes_unref(job->bytes);
+  g_free(job->path);
+  g_slice_free(InfTextFilesystemFormatWriteJob, job);
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * This function writes the session in the XML format. Use
+ * inf_text_filesystem_format_write_with_flags() to choose the format.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  return inf_text_filesystem_format_write_with_flags(
+    storage,
+    path,
+    user_table,
+    buffer,
+    0,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_format_write_with_flags:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @flags: A bitmask of #InfTextFilesystemFormatFlags.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path, like inf_text_filesystem_format_write(). If @flags contains
+ * %INF_TEXT_FILESYSTEM_FORMAT_BINARY, the session is written in the binary
+ * format. It stores the text in the encoding of @buffer, without building
+ * an XML tree in memory first, and is memory-mapped again by
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * The session is written to a temporary file first, which then replaces the
+ * previous version, so that an interrupted write does not destroy the
+ * document. A journal stored for @path is removed, because the new version
+ * supersedes it. Use inf_text_filesystem_journal_checkpoint() instead if a
+ * #InfTextFilesystemJournal is recording changes for @path.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write_with_flags(InfdFilesystemStorage* storage,
+                                            const gchar* path,
+                                            InfUserTable* user_table,
+                                            InfTextBuffer* buffer,
+                                            InfTextFilesystemFormatFlags flags,
+                                            GError** error)
+{
+  guint serial;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  /* Wait for a write of the document in a worker thread that is in
+   * progress, and make sure that writes which have not started yet do not
+   * replace the version written here, see
+   * inf_text_filesystem_format_write_async(). */
+  serial = infd_filesystem_storage_begin_write(storage, path);
+  result = TRUE;
+
+  if(infd_filesystem_storage_lock_write(storage, path, serial))
+  {
+    if(flags & INF_TEXT_FILESYSTEM_FORMAT_BINARY)
+    {
+      result = inf_text_filesystem_format_write_binary(
+        storage,
+        INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+        path,
+        user_table,
+        buffer,
+        (flags & INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED) != 0,
+        error
+      );
+    }
+    else
+    {
+      result = inf_text_filesystem_format_write_xml(
+        storage,
+        INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+        path,
+        user_table,
+        buffer,
+        error
+      );
+    }
+
+    if(result == FALSE)
+    {
+      infd_filesystem_storage_unlink(
+        storage,
+        INF_TEXT_FILESYSTEM_FORMAT_TMP_IDENTIFIER,
+        path,
+        NULL
+      );
+    }
+    else
+    {
+      result = inf_text_filesystem_format_replace(storage, path, error);
+    }
+  }
+
+  infd_filesystem_storage_end_write(storage, path);
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @flags: A bitmask of #InfTextFilesystemFormatFlags.
+ * @func: (scope async) (allow-none): Function to call when the session has
+ * been written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path like inf_text_filesystem_format_write_with_flags(), but without
+ * blocking the calling thread on the disk. The session is serialized into
+ * memory right away, so @user_table and @buffer can be changed as soon as
+ * the function returns. The file is then written and synced to the disk in
+ * the I/O thread pool with infd_storage_run_async(), and @func is called in
+ * the thread of @io once the new version is in place or writing it has
+ * failed.
+ *
+ * If the same document is written again before a write has finished, the
+ * most recent version wins: a write that has not started yet is dropped,
+ * and @func is called without error for it. This also holds for
+ * inf_text_filesystem_format_write_with_flags(), which waits for a write
+ * that is in progress, and for infd_storage_remove_node().
+ *
+ * The returned request can be cancelled with infd_storage_request_cancel().
+ * This only discards the result; the session is still written. If the
+ * session cannot be serialized or the write cannot be started, @error is
+ * set and %NULL is returned, and @func is not called.
+ *
+ * Returns: (transfer none): A #InfdStorageRequest, or %NULL on error.
+ */
+InfdStorageRequest*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextFilesystemFormatFlags flags,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  InfTextFilesystemFormatWriteJob* job;
+  GBytes* bytes;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  bytes = inf_text_filesystem_format_serialize(
+    user_table,
+    buffer,
+    flags,
+    error
+  );
+
+  if(bytes == NULL)
+    return NULL;
+
+  job = g_slice_new(InfTextFilesystemFormatWriteJob);
+  job->storage = storage;
+  job->path = g_strdup(path);
+  job->bytes = bytes;
+  job->serial = infd_filesystem_storage_begin_write(storage, path);
+  job->ended = FALSE;
+
+  return infd_storage_run_async(
+    INFD_STORAGE(storage),
+    io,
+    inf_text_filesystem_format_write_job_run,
+    job,
+    inf_text_filesystem_format_write_job_free,
+    func,
+    user_data,
+    error
+  );
+}
+
+static void
+inf_text_filesystem_journal_add_uint32(GByteArray* record,
+                                       guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  g_byte_array_append(record, (const guint8*)&value, 4);
+}
+
+static void
+inf_text_filesystem_journal_add_uint64(GByteArray* record,
+                                       guint64 value)
+{
+  value = GUINT64_TO_LE(value);
+  g_byte_array_append(record, (const guint8*)&value, 8);
+}
+
+static void
+inf_text_filesystem_journal_add_text(GByteArray* record,
+                                     gconstpointer text,
+                                     gsize bytes)
+{
+  inf_text_filesystem_journal_add_uint32(record, bytes);
+  g_byte_array_append(record, text, bytes);
+}
+
+static GByteArray*
+inf_text_filesystem_journal_record_new(guint8 type)
+{
+  GByteArray* record;
+  guint32 header[2];
+
+  /* Length and checksum are filled in when the record is appended */
+  header[0] = header[1] = 0;
+  record = g_byte_array_new();
+  g_byte_array_append(record, (const guint8*)header, 8);
+  g_byte_array_append(record, &type, 1);
+  return record;
+}
+
+static void
+inf_text_filesystem_journal_set_error(InfTextFilesystemJournal* journal,
+                                      int code)
+{
+  g_assert(journal->error == NULL);
+
+  g_set_error_literal(
+    &journal->error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+
+  if(journal->stream != NULL)
+  {
+    infd_filesystem_storage_stream_close(journal->stream);
+    journal->stream = NULL;
+  }
+
+  journal->uncommitted = FALSE;
+}
+
+static void
+inf_text_filesystem_journal_remove_commit_timeout(
+  InfTextFilesystemJournal* journal)
+{
+  if(journal->commit_timeout != NULL)
+  {
+    inf_io_remove_timeout(journal->io, journal->commit_timeout);
+    journal->commit_timeout = NULL;
+  }
+}
+
+/* Syncs the records appended since the last commit to the disk */
+static void
+inf_text_filesystem_journal_sync(InfTextFilesystemJournal* journal)
+{
+  inf_text_filesystem_journal_remove_commit_timeout(journal);
+
+  if(journal->error == NULL && journal->uncommitted == TRUE)
+  {
+    if(infd_filesystem_storage_stream_sync(journal->stream) != 0)
+      inf_text_filesystem_journal_set_error(journal, errno);
+    else
+      journal->uncommitted = FALSE;
+  }
+}
+
+static void
+inf_text_filesystem_journal_commit_timeout_func(gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  journal = (InfTextFilesystemJournal*)user_data;
+
+  journal->commit_timeout = NULL;
+  inf_text_filesystem_journal_sync(journal);
+}
+
+/* Appends the record to the journal and frees it. The record is handed to
+ * the operating system right away, so that it survives a crash of the
+ * server. It is synced to the disk, to survive a crash of the operating
+ * system as well, right away if sync_records is set, or with the next
+ * commit otherwise. */
+static void
+inf_text_filesystem_journal_append(InfTextFilesystemJournal* journal,
+                                   GByteArray* record)
+{
+  guint32 value;
+
+  if(journal->error == NULL && journal->stream == NULL)
+  {
+    journal->stream = infd_filesystem_storage_open(
+      journal->storage,
+      INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+      journal->path,
+      "a",
+      NULL,
+      &journal->error
+    );
+  }
+
+  if(journal->error == NULL)
+  {
+    value = GUINT32_TO_LE(record->len - 8);
+    memcpy(record->data, &value, 4);
+    value = GUINT32_TO_LE(
+      inf_text_filesystem_format_checksum(record->data + 8, record->len - 8)
+    );
+    memcpy(record->data + 4, &value, 4);
+
+    if(infd_filesystem_storage_stream_write(journal->stream, record->data,
+                                            record->len) != record->len ||
+       infd_filesystem_storage_stream_flush(journal->stream) != 0)
+    {
+      inf_text_filesystem_journal_set_error(journal, errno);
+    }
+    else
+    {
+      journal->size += record->len;
+      journal->uncommitted = TRUE;
+
+      if(journal->sync_records == TRUE)
+      {
+        inf_text_filesystem_journal_sync(journal);
+      }
+      else if(journal->io != NULL && journal->commit_timeout == NULL)
+      {
+        journal->commit_timeout = inf_io_add_timeout(
+          journal->io,
+          journal->commit_interval,
+          inf_text_filesystem_journal_commit_timeout_func,
+          journal,
+          NULL
+        );
+      }
+    }
+  }
 
-  return result;
+  g_byte_array_free(record, TRUE);
 }
 
-/**
- * inf_text_filesystem_format_write:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+static void
+inf_text_filesystem_journal_record_user(InfTextFilesystemJournal* journal,
+                                        guint id)
 {
-  InfTextBufferIter* iter;
-  xmlNodePtr buffer_node;
-  xmlNodePtr segment_node;
+  InfUser* user;
+  GByteArray* record;
+  const gchar* name;
+  union { guint64 bits; gdouble value; } hue;
 
-  guint author;
-  gchar* content;
-  gsize bytes;
-  gchar* converted;
-  gsize converted_bytes;
+  if(id == 0 ||
+     g_hash_table_lookup(journal->recorded_users, GUINT_TO_POINTER(id)))
+  {
+    return;
+  }
 
-  FILE* stream;
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  gboolean is_utf8;
+  user = inf_user_table_lookup_user_by_id(journal->user_table, id);
+  if(user == NULL)
+    return;
 
-  InfTextFilesystemFormatWriteData data;
+  name = inf_user_get_name(user);
+  hue.value = inf_text_user_get_hue(INF_TEXT_USER(user));
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  record = inf_text_filesystem_journal_record_new(
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_USER
+  );
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+  inf_text_filesystem_journal_add_uint32(record, id);
+  inf_text_filesystem_journal_add_uint64(record, hue.bits);
+  inf_text_filesystem_journal_add_text(record, name, strlen(name));
+  inf_text_filesystem_journal_append(journal, record);
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "w",
-    NULL,
-    error
+  g_hash_table_insert(
+    journal->recorded_users,
+    GUINT_TO_POINTER(id),
+    GUINT_TO_POINTER(id)
   );
+}
 
-  if(stream == NULL)
-    return FALSE;
+static void
+inf_text_filesystem_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextChunkIter iter;
+  GByteArray* record;
+  guint n_segments;
+  gboolean is_utf8;
+  gchar* converted;
+  gsize converted_bytes;
 
-  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
-  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  journal = (InfTextFilesystemJournal*)user_data;
+  if(journal->error != NULL)
+    return;
 
-  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  /* Make sure all authors of the inserted text can be restored */
+  n_segments = 0;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
   {
     do
     {
-      author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
-      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
-
-      /* TODO: Use g_hash_table_add with glib 2.32 */
-      g_hash_table_insert(
-        data.encountered_authors,
-        GUINT_TO_POINTER(author),
-        GUINT_TO_POINTER(author)
+      inf_text_filesystem_journal_record_user(
+        journal,
+        inf_text_chunk_iter_get_author(&iter)
       );
 
-      segment_node = xmlNewChild(
-        buffer_node,
-        NULL,
-        (const xmlChar*)"segment",
-        NULL
+      ++n_segments;
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  is_utf8 = (strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0);
+
+  record = inf_text_filesystem_journal_record_new(
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_INSERT
+  );
+
+  inf_text_filesystem_journal_add_uint32(record, pos);
+  inf_text_filesystem_journal_add_uint32(record, n_segments);
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      inf_text_filesystem_journal_add_uint32(
+        record,
+        inf_text_chunk_iter_get_author(&iter)
       );
 
-      inf_xml_util_set_attribute_uint(segment_node, "author", author);
+      inf_text_filesystem_journal_add_uint32(
+        record,
+        inf_text_chunk_iter_get_length(&iter)
+      );
 
       if(is_utf8)
       {
-        /* Buffer is UTF-8, no conversion necessary */
-        inf_xml_util_add_child_text(segment_node, content, bytes);
-        g_free(content);
+        inf_text_filesystem_journal_add_text(
+          record,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter)
+        );
       }
       else
       {
-        /* Convert from buffer encoding to UTF-8 for storage */
         converted = g_convert(
-          content,
-          bytes,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
           "UTF-8",
           inf_text_buffer_get_encoding(buffer),
           NULL,
           &converted_bytes,
-          error
+          &journal->error
         );
 
-        g_free(content);
-
         if(converted == NULL)
         {
-          xmlFreeNode(buffer_node);
-          xmlFreeNode(data.root);
-          g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
+          g_byte_array_free(record, TRUE);
+          return;
         }
 
-        inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
+        inf_text_filesystem_journal_add_text(
+          record,
+          converted,
+          converted_bytes
+        );
+
         g_free(converted);
       }
-    } while(inf_text_buffer_iter_next(buffer, iter));
+    } while(inf_text_chunk_iter_next(&iter));
+  }
 
-    inf_text_buffer_destroy_iter(buffer, iter);
+  inf_text_filesystem_journal_append(journal, record);
+}
+
+static void
+inf_text_filesystem_journal_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  GByteArray* record;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+  if(journal->error != NULL)
+    return;
+
+  record = inf_text_filesystem_journal_record_new(
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_ERASE
+  );
+
+  inf_text_filesystem_journal_add_uint32(record, pos);
+  inf_text_filesystem_journal_add_uint32(
+    record,
+    inf_text_chunk_get_length(chunk)
+  );
+
+  inf_text_filesystem_journal_append(journal, record);
+}
+
+/**
+ * inf_text_filesystem_journal_new:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the session.
+ * @user_table: The #InfUserTable of the session.
+ * @buffer: The #InfTextBuffer of the session.
+ *
+ * Creates a new #InfTextFilesystemJournal which appends every change made
+ * to @buffer to a journal next to the session at @path in @storage. Each
+ * change is written to the journal as it happens, so saving the session only
+ * requires to write a full checkpoint once the journal has grown large, with
+ * inf_text_filesystem_journal_checkpoint().
+ *
+ * Changes survive a crash of the server as soon as they are recorded, but
+ * are synced to the disk, to survive a crash of the operating system, only
+ * by inf_text_filesystem_journal_commit(). Use
+ * inf_text_filesystem_journal_set_commit_interval() to have them synced
+ * automatically.
+ *
+ * The content of @buffer must correspond to what is stored at @path, i.e.
+ * the journal should be created right after the session has been read with
+ * inf_text_filesystem_format_read() or written with
+ * inf_text_filesystem_format_write_with_flags().
+ * inf_text_filesystem_format_read() applies the journal when the session is
+ * read the next time.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal. Free with
+ * inf_text_filesystem_journal_free().
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer)
+{
+  InfTextFilesystemJournal* journal;
+  gchar* full_path;
+  GStatBuf stat_buf;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+
+  journal = g_slice_new(InfTextFilesystemJournal);
+  journal->storage = storage;
+  journal->path = g_strdup(path);
+  journal->user_table = user_table;
+  journal->buffer = buffer;
+  journal->stream = NULL;
+  journal->size = 0;
+  journal->recorded_users = g_hash_table_new(NULL, NULL);
+  journal->io = NULL;
+  journal->commit_interval = 0;
+  journal->sync_records = FALSE;
+  journal->uncommitted = FALSE;
+  journal->commit_timeout = NULL;
+  journal->error = NULL;
+
+  g_object_ref(storage);
+  g_object_ref(user_table);
+  g_object_ref(buffer);
+
+  /* The journal might not be empty if it has been replayed when reading the
+   * session. The file is opened only when the first change is recorded. */
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_FORMAT_JOURNAL_IDENTIFIER,
+    path,
+    NULL
+  );
+
+  if(full_path != NULL)
+  {
+    if(g_stat(full_path, &stat_buf) == 0)
+      journal->size = stat_buf.st_size;
+    g_free(full_path);
   }
 
-  /* After we wrote the buffer, now write the user table, but only for those
-   * users that have contributed to the document. The others we drop, to
-   * avoid cluttering the user table too much. */
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_filesystem_format_write_foreach_user_func,
-    &data
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
   );
 
-  g_hash_table_destroy(data.encountered_authors);
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
 
-  /* Write the buffer after the users */
-  xmlAddChild(data.root, buffer_node);
+  return journal;
+}
 
-  doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, data.root);
+/**
+ * inf_text_filesystem_journal_free:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Stops recording changes and releases all resources allocated by
+ * @journal. Changes that have not been committed yet are synced to the
+ * disk. The journal stays on disk, and is applied when the session is read
+ * the next time.
+ */
+void
+inf_text_filesystem_journal_free(InfTextFilesystemJournal* journal)
+{
+  g_return_if_fail(journal != NULL);
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  inf_text_filesystem_journal_sync(journal);
+
+  if(journal->stream != NULL)
+    infd_filesystem_storage_stream_close(journal->stream);
+  if(journal->error != NULL)
+    g_error_free(journal->error);
+  if(journal->io != NULL)
+    g_object_unref(journal->io);
+
+  g_hash_table_destroy(journal->recorded_users);
+  g_object_unref(journal->buffer);
+  g_object_unref(journal->user_table);
+  g_object_unref(journal->storage);
+  g_free(journal->path);
+
+  g_slice_free(InfTextFilesystemJournal, journal);
+}
+
+/**
+ * inf_text_filesystem_journal_set_commit_interval:
+ * @journal: A #InfTextFilesystemJournal.
+ * @io: (allow-none): A #InfIo to schedule commits, or %NULL.
+ * @interval: Time in milliseconds after which recorded changes are synced
+ * to the disk, or 0.
+ *
+ * Configures when recorded changes are synced to the disk. Syncing makes
+ * them survive a crash of the operating system or a power failure, but
+ * waits for the disk to write them, so it is done for a group of changes
+ * at once: if @io is not %NULL, changes are synced @interval milliseconds
+ * after the first one that has not been synced yet. If @io is %NULL, this
+ * only happens when inf_text_filesystem_journal_commit() is called, which
+ * is the default.
+ *
+ * If @interval is 0, every change is synced to the disk right away when it
+ * is recorded, and @io is not used. This makes each change durable as soon
+ * as it has been made, but is expensive if changes are made frequently.
+ */
+void
+inf_text_filesystem_journal_set_commit_interval(
+  InfTextFilesystemJournal* journal,
+  InfIo* io,
+  guint interval)
+{
+  g_return_if_fail(journal != NULL);
+  g_return_if_fail(io == NULL || INF_IS_IO(io));
+
+  inf_text_filesystem_journal_remove_commit_timeout(journal);
+
+  if(io != NULL)
+    g_object_ref(io);
+  if(journal->io != NULL)
+    g_object_unref(journal->io);
+
+  journal->io = io;
+  journal->commit_interval = interval;
+  journal->sync_records = (interval == 0);
+
+  /* Apply the new settings to changes that are not yet synced */
+  if(journal->uncommitted == TRUE)
   {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
+    if(journal->sync_records == TRUE)
+    {
+      inf_text_filesystem_journal_sync(journal);
+    }
+    else if(journal->io != NULL)
+    {
+      journal->commit_timeout = inf_io_add_timeout(
+        journal->io,
+        journal->commit_interval,
+        inf_text_filesystem_journal_commit_timeout_func,
+        journal,
+        NULL
+      );
+    }
+  }
+}
 
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
-    );
+/**
+ * inf_text_filesystem_journal_commit:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Syncs all changes recorded so far to the disk, so that they survive a
+ * crash of the operating system or a power failure. If this fails, or if
+ * recording a change has failed before, %FALSE is returned and @error is
+ * set, as with inf_text_filesystem_journal_check().
+ *
+ * Returns: %TRUE if all changes are on disk, or %FALSE otherwise.
+ */
+gboolean
+inf_text_filesystem_journal_commit(InfTextFilesystemJournal* journal,
+                                   GError** error)
+{
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  inf_text_filesystem_journal_sync(journal);
+  return inf_text_filesystem_journal_check(journal, error);
+}
+
+/**
+ * inf_text_filesystem_journal_get_size:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Returns the size of the journal on disk, in bytes. This can be used to
+ * decide when to write a new checkpoint.
+ *
+ * Returns: The size of the journal.
+ */
+guint64
+inf_text_filesystem_journal_get_size(InfTextFilesystemJournal* journal)
+{
+  g_return_val_if_fail(journal != NULL, 0);
+  return journal->size;
+}
+
+/**
+ * inf_text_filesystem_journal_check:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Checks whether all changes made to the buffer since the last checkpoint
+ * have been recorded. If recording a change failed, for example because the
+ * disk is full, then %FALSE is returned and @error is set. In that case, the
+ * session needs to be written with inf_text_filesystem_journal_checkpoint()
+ * to be stored completely.
+ *
+ * Returns: %TRUE if the journal is complete, or %FALSE otherwise.
+ */
+gboolean
+inf_text_filesystem_journal_check(InfTextFilesystemJournal* journal,
+                                  GError** error)
+{
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
+  if(journal->error != NULL)
+  {
+    g_propagate_error(error, g_error_copy(journal->error));
     return FALSE;
   }
 
-  infd_filesystem_storage_stream_close(stream);
-  xmlFreeDoc(doc);
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_journal_checkpoint:
+ * @journal: A #InfTextFilesystemJournal.
+ * @flags: A bitmask of #InfTextFilesystemFormatFlags.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the complete session with
+ * inf_text_filesystem_format_write_with_flags(), and starts a new, empty
+ * journal. If the function fails, %FALSE is returned and @error is set.
+ * In that case, no more changes are recorded until the next successful
+ * checkpoint, since the journal might no longer match the stored session.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_checkpoint(InfTextFilesystemJournal* journal,
+                                       InfTextFilesystemFormatFlags flags,
+                                       GError** error)
+{
+  GError* local_error;
+
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  /* The checkpoint is synced to the disk before the journal is removed, so
+   * there is no need to sync the journal itself. */
+  inf_text_filesystem_journal_remove_commit_timeout(journal);
+  journal->uncommitted = FALSE;
+
+  if(journal->stream != NULL)
+  {
+    infd_filesystem_storage_stream_close(journal->stream);
+    journal->stream = NULL;
+  }
+
+  local_error = NULL;
+  inf_text_filesystem_format_write_with_flags(
+    journal->storage,
+    journal->path,
+    journal->user_table,
+    journal->buffer,
+    flags,
+    &local_error
+  );
+
+  if(journal->error != NULL)
+  {
+    g_error_free(journal->error);
+    journal->error = NULL;
+  }
+
+  if(local_error != NULL)
+  {
+    journal->error = g_error_copy(local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  journal->size = 0;
+  g_hash_table_remove_all(journal->recorded_users);
   return TRUE;
 }
 
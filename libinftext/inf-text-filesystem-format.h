@@ -22,6 +22,8 @@
 
 #include <libinftext/inf-text-session.h>
 #include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <glib.h>
 
@@ -35,6 +37,11 @@ G_BEGIN_DECLS
  * session contains users with duplicate ID or duplicate name.
  * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER: A segment of the text
  * document is written by a user which does not exist.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_DATA: A file in the binary
+ * format is truncated or contains malformed data.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_UNSUPPORTED: A file in the binary format
+ * was written by a newer version, or it is compressed but zlib support is
+ * not available.
  *
  * Errors that can occur when reading a #InfTextSession from a
  * #InfdFilesystemStorage.
@@ -42,9 +49,38 @@ G_BEGIN_DECLS
 typedef enum _InfTextFilesystemFormatError {
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_DATA,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_UNSUPPORTED
 } InfTextFilesystemFormatError;
 
+/**
+ * InfTextFilesystemFormatFlags:
+ * @INF_TEXT_FILESYSTEM_FORMAT_BINARY: Write the document in the compact
+ * binary format instead of XML.
+ * @INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED: Compress the text of a document
+ * written in the binary format. This flag has no effect without
+ * %INF_TEXT_FILESYSTEM_FORMAT_BINARY, or if libinfinity was built without
+ * zlib support.
+ *
+ * Flags specifying how inf_text_filesystem_format_write_with_flags() stores
+ * a text session. inf_text_filesystem_format_read() detects the format
+ * automatically, so the flags can be changed without converting existing
+ * files.
+ */
+typedef enum _InfTextFilesystemFormatFlags {
+  INF_TEXT_FILESYSTEM_FORMAT_BINARY = 1 << 0,
+  INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED = 1 << 1
+} InfTextFilesystemFormatFlags;
+
+/**
+ * InfTextFilesystemJournal:
+ *
+ * #InfTextFilesystemJournal is an opaque data type. You should only access
+ * it via the public API functions.
+ */
+typedef struct _InfTextFilesystemJournal InfTextFilesystemJournal;
+
 gboolean
 inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
                                 const gchar* path,
@@ -59,6 +95,56 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
                                  InfTextBuffer* buffer,
                                  GError** error);
 
+gboolean
+inf_text_filesystem_format_write_with_flags(InfdFilesystemStorage* storage,
+                                            const gchar* path,
+                                            InfUserTable* user_table,
+                                            InfTextBuffer* buffer,
+                                            InfTextFilesystemFormatFlags flags,
+                                            GError** error);
+
+InfdStorageRequest*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextFilesystemFormatFlags flags,
+                                       InfdStorageFinishedFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer);
+
+void
+inf_text_filesystem_journal_free(InfTextFilesystemJournal* journal);
+
+void
+inf_text_filesystem_journal_set_commit_interval(
+  InfTextFilesystemJournal* journal,
+  InfIo* io,
+  guint interval);
+
+gboolean
+inf_text_filesystem_journal_commit(InfTextFilesystemJournal* journal,
+                                   GError** error);
+
+guint64
+inf_text_filesystem_journal_get_size(InfTextFilesystemJournal* journal);
+
+gboolean
+inf_text_filesystem_journal_check(InfTextFilesystemJournal* journal,
+                                  GError** error);
+
+gboolean
+inf_text_filesystem_journal_checkpoint(InfTextFilesystemJournal* journal,
+                                       InfTextFilesystemFormatFlags flags,
+                                       GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_FILESYSTEM_FORMAT_H__ */
@@ -34,6 +34,7 @@
  */
 
 #include <libinftext/inf-text-fixline-buffer.h>
+#include <libinftext/inf-text-buffer-private.h>
 #include <libinftext/inf-text-user.h>
 #include <libinftext/inf-text-move-operation.h>
 #include <libinfinity/common/inf-buffer.h>
@@ -1161,11 +1162,13 @@ inf_text_fixline_buffer_buffer_get_slice(InfTextBuffer* buffer,
   return chunk;
 }
 
+/* Inserts text into the buffer without correcting the number of trailing
+ * newlines in the base buffer afterwards */
 static void
-inf_text_fixline_buffer_buffer_insert_text(InfTextBuffer* buffer,
-                                           guint pos,
-                                           InfTextChunk* chunk,
-                                           InfUser* user)
+inf_text_fixline_buffer_insert_chunk(InfTextBuffer* buffer,
+                                     guint pos,
+                                     InfTextChunk* chunk,
+                                     InfUser* user)
 {
   InfTextFixlineBuffer* fixline_buffer;
   InfTextFixlineBufferPrivate* priv;
@@ -1257,16 +1260,15 @@ inf_text_fixline_buffer_buffer_insert_text(InfTextBuffer* buffer,
 
   /* Notify */
   inf_text_buffer_text_inserted(buffer, pos, chunk, user);
-
-  /* Keep the number of lines at the end fixed */
-  inf_text_fixline_buffer_fix_lines(fixline_buffer);
 }
 
+/* Erases text from the buffer without correcting the number of trailing
+ * newlines in the base buffer afterwards */
 static void
-inf_text_fixline_buffer_buffer_erase_text(InfTextBuffer* buffer,
-                                          guint pos,
-                                          guint len,
-                                          InfUser* user)
+inf_text_fixline_buffer_erase_range(InfTextBuffer* buffer,
+                                    guint pos,
+                                    guint len,
+                                    InfUser* user)
 {
   InfTextFixlineBuffer* fixline_buffer;
   InfTextFixlineBufferPrivate* priv;
@@ -1348,11 +1350,115 @@ inf_text_fixline_buffer_buffer_erase_text(InfTextBuffer* buffer,
   /* Notify */
   inf_text_buffer_text_erased(buffer, pos, erased_content, user);
   inf_text_chunk_free(erased_content);
+}
+
+static void
+inf_text_fixline_buffer_buffer_insert_text(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user)
+{
+  inf_text_fixline_buffer_insert_chunk(buffer, pos, chunk, user);
 
   /* Keep the number of lines at the end fixed */
+  inf_text_fixline_buffer_fix_lines(INF_TEXT_FIXLINE_BUFFER(buffer));
+}
+
+static void
+inf_text_fixline_buffer_buffer_erase_text(InfTextBuffer* buffer,
+                                          guint pos,
+                                          guint len,
+                                          InfUser* user)
+{
+  inf_text_fixline_buffer_erase_range(buffer, pos, len, user);
+
+  /* Keep the number of lines at the end fixed */
+  inf_text_fixline_buffer_fix_lines(INF_TEXT_FIXLINE_BUFFER(buffer));
+}
+
+static void
+inf_text_fixline_buffer_buffer_append(InfTextBuffer* buffer,
+                                      InfTextChunk* chunk,
+                                      InfUser* user)
+{
+  inf_text_fixline_buffer_insert_chunk(
+    buffer,
+    inf_text_fixline_buffer_get_length(buffer),
+    chunk,
+    user
+  );
+
+  /* Keep the number of lines at the end fixed */
+  inf_text_fixline_buffer_fix_lines(INF_TEXT_FIXLINE_BUFFER(buffer));
+}
+
+static void
+inf_text_fixline_buffer_buffer_clear(InfTextBuffer* buffer,
+                                     InfUser* user)
+{
+  InfTextFixlineBuffer* fixline_buffer;
+  InfTextFixlineBufferPrivate* priv;
+  InfTextChunk* erased_content;
+  guint len;
+
+  fixline_buffer = INF_TEXT_FIXLINE_BUFFER(buffer);
+  priv = INF_TEXT_FIXLINE_BUFFER_PRIVATE(fixline_buffer);
+
+  len = inf_text_fixline_buffer_get_length(buffer);
+  if(len == 0) return;
+
+  erased_content = inf_text_fixline_buffer_buffer_get_slice(buffer, 0, len);
+
+  inf_signal_handlers_block_by_func(
+    priv->buffer,
+    G_CALLBACK(inf_text_fixline_buffer_text_erased_cb),
+    fixline_buffer
+  );
+
+  inf_text_buffer_clear(priv->buffer, user);
+
+  inf_signal_handlers_unblock_by_func(
+    priv->buffer,
+    G_CALLBACK(inf_text_fixline_buffer_text_erased_cb),
+    fixline_buffer
+  );
+
+  g_free(priv->keep);
+  priv->keep = NULL;
+  priv->n_keep = 0;
+
+  /* Notify */
+  inf_text_buffer_text_erased(buffer, 0, erased_content, user);
+  inf_text_chunk_free(erased_content);
+
+  /* Re-add the trailing newlines to the base buffer */
   inf_text_fixline_buffer_fix_lines(fixline_buffer);
 }
 
+static void
+inf_text_fixline_buffer_buffer_apply_batch(InfTextBuffer* buffer,
+                                           const InfTextBufferEdit* edits,
+                                           guint n_edits,
+                                           InfUser* user)
+{
+  InfTextChunk* chunk;
+  guint pos;
+  guint len;
+
+  chunk = _inf_text_buffer_coalesce_edits(buffer, edits, n_edits, &pos, &len);
+
+  if(len > 0)
+    inf_text_fixline_buffer_erase_range(buffer, pos, len, user);
+
+  if(inf_text_chunk_get_length(chunk) > 0)
+    inf_text_fixline_buffer_insert_chunk(buffer, pos, chunk, user);
+
+  inf_text_chunk_free(chunk);
+
+  /* Correct the trailing newlines only once for the whole batch */
+  inf_text_fixline_buffer_fix_lines(INF_TEXT_FIXLINE_BUFFER(buffer));
+}
+
 static InfTextBufferIter*
 inf_text_fixline_buffer_buffer_create_begin_iter(InfTextBuffer* buffer)
 {
@@ -1797,6 +1903,9 @@ inf_text_fixline_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->iter_get_length = inf_text_fixline_buffer_buffer_iter_get_length;
   iface->iter_get_bytes = inf_text_fixline_buffer_buffer_iter_get_bytes;
   iface->iter_get_author = inf_text_fixline_buffer_buffer_iter_get_author;
+  iface->append = inf_text_fixline_buffer_buffer_append;
+  iface->clear = inf_text_fixline_buffer_buffer_clear;
+  iface->apply_batch = inf_text_fixline_buffer_buffer_apply_batch;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
 }
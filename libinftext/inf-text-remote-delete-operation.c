@@ -61,7 +61,7 @@ enum {
   PROP_LENGTH
 };
 
-#define INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_REMOTE_DELETE_OPERATION, InfTextRemoteDeleteOperationPrivate))
+#define INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(obj) ((InfTextRemoteDeleteOperationPrivate*)inf_text_remote_delete_operation_get_instance_private((InfTextRemoteDeleteOperation*)(obj)))
 
 static void inf_text_remote_delete_operation_operation_iface_init(InfAdoptedOperationInterface* iface);
 static void inf_text_remote_delete_operation_delete_operation_iface_init(InfTextDeleteOperationInterface* iface);
@@ -228,6 +228,24 @@ inf_text_remote_delete_operation_finalize(GObject* object)
   G_OBJECT_CLASS(inf_text_remote_delete_operation_parent_class)->finalize(object);
 }
 
+/* Sets position and length directly, without property dispatch. The caller
+ * is expected to fill in recon. */
+static GObject*
+inf_text_remote_delete_operation_create(guint position,
+                                        guint length)
+{
+  GObject* object;
+  InfTextRemoteDeleteOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_REMOTE_DELETE_OPERATION, NULL);
+  priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->length = length;
+
+  return object;
+}
+
 static void
 inf_text_remote_delete_operation_set_property(GObject* object,
                                               guint prop_id,
@@ -332,11 +350,9 @@ inf_text_remote_delete_operation_copy(InfAdoptedOperation* operation)
 
   priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", priv->position,
-    "length", priv->length,
-    NULL
+  result = inf_text_remote_delete_operation_create(
+    priv->position,
+    priv->length
   );
 
   result_priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(result);
@@ -522,11 +538,9 @@ inf_text_remote_delete_operation_transform_position(
   InfTextRemoteDeleteOperationPrivate* result_priv;
 
   priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(operation);
-  result = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", position,
-    "length", priv->length,
-    NULL
+  result = inf_text_remote_delete_operation_create(
+    position,
+    priv->length
   );
   result_priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(result);
 
@@ -566,11 +580,9 @@ inf_text_remote_delete_operation_transform_overlap(
     length
   );
 
-  result = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", position,
-    "length", priv->length - length,
-    NULL
+  result = inf_text_remote_delete_operation_create(
+    position,
+    priv->length - length
   );
 
   result_priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(result);
@@ -635,18 +647,14 @@ inf_text_remote_delete_operation_transform_split(
     }
   }
 
-  first_operation = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", priv->position,
-    "length", split_pos,
-    NULL
+  first_operation = inf_text_remote_delete_operation_create(
+    priv->position,
+    split_pos
   );
   
-  second_operation = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", priv->position + split_len,
-    "length", priv->length - split_pos,
-    NULL
+  second_operation = inf_text_remote_delete_operation_create(
+    priv->position + split_len,
+    priv->length - split_pos
   );
 
   result_priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(first_operation);
@@ -757,16 +765,9 @@ InfTextRemoteDeleteOperation*
 inf_text_remote_delete_operation_new(guint position,
                                      guint length)
 {
-  GObject* object;
-
-  object = g_object_new(
-    INF_TEXT_TYPE_REMOTE_DELETE_OPERATION,
-    "position", position,
-    "length", length,
-    NULL
+  return INF_TEXT_REMOTE_DELETE_OPERATION(
+    inf_text_remote_delete_operation_create(position, length)
   );
-
-  return INF_TEXT_REMOTE_DELETE_OPERATION(object);
 }
 
 /* vim:set et sw=2 ts=2: */
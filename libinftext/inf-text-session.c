@@ -28,6 +28,7 @@
 #include <libinftext/inf-text-user.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-utf8.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -47,6 +48,18 @@ struct _InfTextSessionLocalUser {
   InfIoTimeout* caret_timeout;
 };
 
+typedef struct _InfTextSessionSyncIter InfTextSessionSyncIter;
+struct _InfTextSessionSyncIter {
+  gpointer parent_iter; /* NULL when exhausted */
+
+  /* Copy of the buffer content at the beginning of the synchronization */
+  InfTextChunk* chunk;
+  InfTextChunkIter chunk_iter;
+  gboolean has_segment;
+  gsize offset; /* in bytes, into the current segment */
+  GIConv cd;
+};
+
 typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
@@ -139,6 +152,72 @@ inf_text_session_segment_to_xml(GIConv* cd,
   inf_xml_util_set_attribute_uint(xml, "author", author);
 }
 
+/* Returns the number of sync-segment messages that
+ * inf_text_session_segment_to_xml() creates for the given text. */
+static guint
+inf_text_session_segment_count(GIConv* cd,
+                               gconstpointer text,
+                               gsize bytes)
+{
+  gchar utf8_text[1024];
+  gsize result;
+  gsize bytes_left;
+  gchar* inbuf;
+  gchar* outbuf;
+  guint count;
+
+  inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
+  count = 0;
+
+  while(bytes > 0)
+  {
+    bytes_left = 1024;
+    outbuf = utf8_text;
+
+    result = g_iconv(*cd, &inbuf, &bytes, &outbuf, &bytes_left);
+    g_assert(result == 0 || errno == E2BIG);
+
+    ++ count;
+  }
+
+  return count;
+}
+
+/* Checks that text received from the network which is inserted into a
+ * UTF-8 buffer without conversion is valid UTF-8. Unlike
+ * g_utf8_validate(), this allows NUL characters, since they can be
+ * transmitted as <uchar> child elements. */
+static gboolean
+inf_text_session_validate_utf8(const gchar* text,
+                               gsize bytes,
+                               GError** error)
+{
+  const gchar* pos;
+  const gchar* end;
+
+  pos = text;
+  while(!inf_utf8_validate(pos, text + bytes - pos, &end))
+  {
+    if(*end != '\0')
+    {
+      g_set_error_literal(
+        error,
+        G_CONVERT_ERROR,
+        G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+        _("Invalid byte sequence in conversion input")
+      );
+
+      return FALSE;
+    }
+
+    pos = end + 1;
+  }
+
+  return TRUE;
+}
+
+/* If cd is NULL then the buffer is UTF-8 and the text is only validated
+ * instead of being converted. */
 static gpointer
 inf_text_session_segment_from_xml(GIConv* cd,
                                   xmlNodePtr xml,
@@ -158,6 +237,18 @@ inf_text_session_segment_from_xml(GIConv* cd,
   if(!utf8_text)
     return NULL;
 
+  if(cd == NULL)
+  {
+    if(!inf_text_session_validate_utf8(utf8_text, bytes_read, error))
+    {
+      g_free(utf8_text);
+      return NULL;
+    }
+
+    *bytes = bytes_read;
+    return utf8_text;
+  }
+
   text = g_convert_with_iconv(
     utf8_text,
     bytes_read,
@@ -1030,6 +1121,125 @@ inf_text_session_to_xml_sync(InfSession* session,
   g_iconv_close(cd);
 }
 
+static gpointer
+inf_text_session_sync_iter_new(InfSession* session,
+                               guint* n_messages)
+{
+  InfTextSessionSyncIter* iter;
+  InfTextBuffer* buffer;
+  InfTextChunkIter chunk_iter;
+  gboolean result;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  iter = g_slice_new(InfTextSessionSyncIter);
+
+  iter->parent_iter =
+    INF_SESSION_CLASS(inf_text_session_parent_class)->sync_iter_new(
+      session,
+      n_messages
+    );
+
+  /* This is cheap for InfTextDefaultBuffer since the chunk shares its
+   * content with the buffer until the buffer is modified. */
+  iter->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  iter->cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
+  iter->offset = 0;
+  iter->has_segment =
+    inf_text_chunk_iter_init_begin(iter->chunk, &iter->chunk_iter);
+
+  /* The number of messages needs to be announced in advance, so convert
+   * everything once without keeping the result. */
+  chunk_iter = iter->chunk_iter;
+  result = iter->has_segment;
+  while(result)
+  {
+    *n_messages += inf_text_session_segment_count(
+      &iter->cd,
+      inf_text_chunk_iter_get_text(&chunk_iter),
+      inf_text_chunk_iter_get_bytes(&chunk_iter)
+    );
+
+    result = inf_text_chunk_iter_next(&chunk_iter);
+  }
+
+  return iter;
+}
+
+static xmlNodePtr
+inf_text_session_sync_iter_next(InfSession* session,
+                                gpointer iter_)
+{
+  InfTextSessionSyncIter* iter;
+  InfSessionClass* parent_class;
+  xmlNodePtr xml;
+  gsize total_bytes;
+  gsize bytes_left;
+
+  iter = (InfTextSessionSyncIter*)iter_;
+  parent_class = INF_SESSION_CLASS(inf_text_session_parent_class);
+
+  if(iter->parent_iter != NULL)
+  {
+    xml = parent_class->sync_iter_next(session, iter->parent_iter);
+    if(xml != NULL) return xml;
+
+    parent_class->sync_iter_free(session, iter->parent_iter);
+    iter->parent_iter = NULL;
+  }
+
+  while(iter->has_segment)
+  {
+    total_bytes = inf_text_chunk_iter_get_bytes(&iter->chunk_iter);
+    if(iter->offset < total_bytes)
+    {
+      bytes_left = total_bytes - iter->offset;
+
+      xml = xmlNewNode(NULL, (const xmlChar*)"sync-segment");
+      inf_text_session_segment_to_xml(
+        &iter->cd,
+        xml,
+        (const gchar*)inf_text_chunk_iter_get_text(&iter->chunk_iter) +
+          iter->offset,
+        &bytes_left,
+        inf_text_chunk_iter_get_author(&iter->chunk_iter)
+      );
+
+      iter->offset = total_bytes - bytes_left;
+      return xml;
+    }
+
+    iter->has_segment = inf_text_chunk_iter_next(&iter->chunk_iter);
+    iter->offset = 0;
+  }
+
+  return NULL;
+}
+
+static void
+inf_text_session_sync_iter_free(InfSession* session,
+                                gpointer iter_)
+{
+  InfTextSessionSyncIter* iter;
+  iter = (InfTextSessionSyncIter*)iter_;
+
+  if(iter->parent_iter != NULL)
+  {
+    INF_SESSION_CLASS(inf_text_session_parent_class)->sync_iter_free(
+      session,
+      iter->parent_iter
+    );
+  }
+
+  g_iconv_close(iter->cd);
+  inf_text_chunk_free(iter->chunk);
+  g_slice_free(InfTextSessionSyncIter, iter);
+}
+
 static gboolean
 inf_text_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1048,18 +1258,34 @@ inf_text_session_process_xml_sync(InfSession* session,
   if(strcmp((const char*)xml->name, "sync-segment") == 0)
   {
     buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-    cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
 
-    text = inf_text_session_segment_from_xml(
-      &cd,
-      xml,
-      &length,
-      &bytes,
-      &author,
-      error
-    );
+    if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
+    {
+      text = inf_text_session_segment_from_xml(
+        NULL,
+        xml,
+        &length,
+        &bytes,
+        &author,
+        error
+      );
+    }
+    else
+    {
+      cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
+
+      text = inf_text_session_segment_from_xml(
+        &cd,
+        xml,
+        &length,
+        &bytes,
+        &author,
+        error
+      );
+
+      g_iconv_close(cd);
+    }
 
-    g_iconv_close(cd);
     if(text == NULL) return FALSE;
 
     if(author != 0)
@@ -1529,6 +1755,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
 
   xmlNodePtr child;
   GIConv cd;
+  gboolean is_utf8;
   guint author;
   gboolean cmp;
 
@@ -1561,18 +1788,32 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(!utf8_text)
       goto fail;
 
-    text = g_convert(
-      utf8_text,
-      in_bytes,
-      inf_text_buffer_get_encoding(buffer),
-      "UTF-8",
-      NULL,
-      &bytes,
-      error
-    );
+    if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
+    {
+      if(!inf_text_session_validate_utf8(utf8_text, in_bytes, error))
+      {
+        g_free(utf8_text);
+        goto fail;
+      }
+
+      text = utf8_text;
+      bytes = in_bytes;
+    }
+    else
+    {
+      text = g_convert(
+        utf8_text,
+        in_bytes,
+        inf_text_buffer_get_encoding(buffer),
+        "UTF-8",
+        NULL,
+        &bytes,
+        error
+      );
 
-    g_free(utf8_text);
-    if(text == NULL) goto fail;
+      g_free(utf8_text);
+      if(text == NULL) goto fail;
+    }
 
     chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
     inf_text_chunk_insert_text(chunk, 0, text, bytes, length, user_id);
@@ -1595,15 +1836,19 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(for_sync == TRUE)
     {
       chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
-      cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
-      g_assert(cd != (GIConv)(-1));
+      is_utf8 = strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0;
+      if(!is_utf8)
+      {
+        cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
+        g_assert(cd != (GIConv)(-1));
+      }
 
       for(child = op_xml->children; child != NULL; child = child->next)
       {
         if(strcmp((const char*)child->name, "segment") == 0)
         {
           text = inf_text_session_segment_from_xml(
-            &cd,
+            is_utf8 ? NULL : &cd,
             child,
             &length,
             &bytes,
@@ -1614,7 +1859,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
           if(text == NULL)
           {
             inf_text_chunk_free(chunk);
-            g_iconv_close(cd);
+            if(!is_utf8) g_iconv_close(cd);
             goto fail;
           }
           else
@@ -1637,7 +1882,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
         }
       }
 
-      g_iconv_close(cd);
+      if(!is_utf8) g_iconv_close(cd);
 
       operation = INF_ADOPTED_OPERATION(
         inf_text_default_delete_operation_new(pos, chunk)
@@ -1769,6 +2014,9 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
   object_class->get_property = inf_text_session_get_property;
 
   session_class->to_xml_sync = inf_text_session_to_xml_sync;
+  session_class->sync_iter_new = inf_text_session_sync_iter_new;
+  session_class->sync_iter_next = inf_text_session_sync_iter_next;
+  session_class->sync_iter_free = inf_text_session_sync_iter_free;
   session_class->process_xml_sync = inf_text_session_process_xml_sync;
   session_class->process_xml_run = inf_text_session_process_xml_run;
   session_class->get_xml_user_props = inf_text_session_get_xml_user_props;
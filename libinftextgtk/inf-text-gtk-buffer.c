@@ -53,6 +53,7 @@
 #include <libinftextgtk/inf-text-gtk-buffer.h>
 #include <libinftext/inf-text-buffer.h>
 
+#include <libinfinity/common/inf-utf8.h>
 #include <libinfinity/inf-signals.h>
 
 #include <string.h> /* for strlen() */
@@ -894,7 +895,7 @@ inf_text_gtk_buffer_insert_text_cb_before(GtkTextBuffer* gtk_buffer,
     0,
     text,
     len,
-    g_utf8_strlen(text, len),
+    inf_utf8_strlen(text, len),
     inf_user_get_id(INF_USER(priv->active_user))
   );
 
@@ -2148,6 +2149,9 @@ inf_text_gtk_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->iter_get_length = inf_text_gtk_buffer_buffer_iter_get_length;
   iface->iter_get_bytes = inf_text_gtk_buffer_buffer_iter_get_bytes;
   iface->iter_get_author = inf_text_gtk_buffer_buffer_iter_get_author;
+  iface->append = NULL;
+  iface->clear = NULL;
+  iface->apply_batch = NULL;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
 }
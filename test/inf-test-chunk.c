@@ -19,10 +19,59 @@
 
 #include <libinftext/inf-text-chunk.h>
 
+#include <string.h>
+
+/* Checks that the segments of chunk are written by the given authors, and
+ * that the offsets reported by the iterator are consistent with the
+ * segment lengths. */
+static void
+check_segments(InfTextChunk* chunk,
+               const char* text,
+               const guint* authors,
+               guint n_segments)
+{
+  InfTextChunkIter iter;
+  gchar* chunk_text;
+  gsize bytes;
+  guint offset;
+  guint i;
+
+  chunk_text = inf_text_chunk_get_text(chunk, &bytes);
+  g_assert(bytes == strlen(text));
+  g_assert(memcmp(chunk_text, text, bytes) == 0);
+  g_free(chunk_text);
+
+  offset = 0;
+  i = 0;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      g_assert(i < n_segments);
+      g_assert(inf_text_chunk_iter_get_author(&iter) == authors[i]);
+      g_assert(inf_text_chunk_iter_get_offset(&iter) == offset);
+
+      offset += inf_text_chunk_iter_get_length(&iter);
+      ++i;
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  g_assert(i == n_segments);
+  g_assert(offset == inf_text_chunk_get_length(chunk));
+}
+
 int main()
 {
+  static const guint authors1[] = { 1, 2, 1, 3 };
+  static const guint authors2[] = { 1, 2, 3 };
+  static const guint authors3[] = { 1, 3 };
+
   InfTextChunk* chunk;
   InfTextChunk* chunk2;
+  InfTextChunk* chunk3;
+  InfTextChunkIter iter;
+  guint i;
 
   chunk2 = inf_text_chunk_new("UTF-8");
 
@@ -35,5 +84,86 @@ int main()
   inf_text_chunk_free(chunk);
   inf_text_chunk_free(chunk2);
 
+  /* Splitting and merging of segments */
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, "aaaa", 4, 4, 1);
+  inf_text_chunk_insert_text(chunk, 2, "bb", 2, 2, 2);
+  inf_text_chunk_insert_text(chunk, 6, "c\xc3\xbc", 3, 2, 3);
+  check_segments(chunk, "aabbaac\xc3\xbc", authors1, 4);
+
+  inf_text_chunk_erase(chunk, 4, 2);
+  check_segments(chunk, "aabbc\xc3\xbc", authors2, 3);
+
+  chunk2 = inf_text_chunk_substring(chunk, 1, 4);
+  chunk3 = inf_text_chunk_copy(chunk);
+  g_assert(inf_text_chunk_equal(chunk, chunk3));
+
+  inf_text_chunk_erase(chunk, 2, 2);
+  check_segments(chunk, "aac\xc3\xbc", authors3, 2);
+
+  /* Modifying a chunk must not modify its copies */
+  check_segments(chunk3, "aabbc\xc3\xbc", authors2, 3);
+  inf_text_chunk_insert_text(chunk3, 1, "c", 1, 1, 3);
+  check_segments(chunk2, "abbc", authors2, 3);
+
+  inf_text_chunk_insert_chunk(chunk, 2, chunk2);
+  check_segments(chunk, "aaabbcc\xc3\xbc", authors2, 3);
+
+  inf_text_chunk_free(chunk);
+  inf_text_chunk_free(chunk2);
+  inf_text_chunk_free(chunk3);
+
+  /* Byte offsets in a variable-width encoding other than UTF-8. Each "a"
+   * is two bytes, each G clef (U+1D11E) four bytes in UTF-16. */
+  chunk = inf_text_chunk_new("UTF-16LE");
+  for(i = 0; i < 200; ++i)
+  {
+    if(i % 3 == 0)
+      inf_text_chunk_insert_text(chunk, i, "\x34\xd8\x1e\xdd", 4, 1, 1);
+    else
+      inf_text_chunk_insert_text(chunk, i, "a\0", 2, 1, 1);
+  }
+
+  chunk2 = inf_text_chunk_substring(chunk, 150, 50);
+  g_assert(inf_text_chunk_get_length(chunk2) == 50);
+  g_assert(inf_text_chunk_iter_init_begin(chunk2, &iter));
+  g_assert(inf_text_chunk_iter_get_bytes(&iter) == 17 * 4 + 33 * 2);
+  inf_text_chunk_free(chunk2);
+
+  inf_text_chunk_erase(chunk, 1, 198);
+  g_assert(inf_text_chunk_iter_init_begin(chunk, &iter));
+  g_assert(inf_text_chunk_iter_get_bytes(&iter) == 6);
+  inf_text_chunk_free(chunk);
+
+  /* In CP1258, a letter followed by a combining mark (0xEC is the combining
+   * acute accent) is a single character, so this is not a fixed-width
+   * encoding either. */
+  chunk = inf_text_chunk_new("CP1258");
+  for(i = 0; i < 200; ++i)
+  {
+    if(i % 3 == 0)
+      inf_text_chunk_insert_text(chunk, i, "a\xec", 2, 1, 1);
+    else
+      inf_text_chunk_insert_text(chunk, i, "b", 1, 1, 1);
+  }
+
+  chunk2 = inf_text_chunk_substring(chunk, 150, 50);
+  g_assert(inf_text_chunk_get_length(chunk2) == 50);
+  g_assert(inf_text_chunk_iter_init_begin(chunk2, &iter));
+  g_assert(inf_text_chunk_iter_get_bytes(&iter) == 17 * 2 + 33);
+  inf_text_chunk_free(chunk2);
+  inf_text_chunk_free(chunk);
+
+  /* Many segments, to exercise the tree balancing */
+  chunk = inf_text_chunk_new("UTF-8");
+  for(i = 0; i < 10000; ++i)
+    inf_text_chunk_insert_text(chunk, i / 2, "x", 1, 1, i);
+  g_assert(inf_text_chunk_get_length(chunk) == 10000);
+
+  for(i = 0; i < 5000; ++i)
+    inf_text_chunk_erase(chunk, (i * 7) % (10000 - i), 1);
+  g_assert(inf_text_chunk_get_length(chunk) == 5000);
+  inf_text_chunk_free(chunk);
+
   return 0;
 }
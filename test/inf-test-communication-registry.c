@@ -0,0 +1,506 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks how InfCommunicationRegistry packs messages into <group>
+ * containers: messages are held back for the coalesce time, messages queued
+ * while a container is being sent go out right after it, and containers are
+ * split at the maximum batch size. Also checks that a broadcast is
+ * serialized only once, even if it waits for the coalesce time. */
+
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-registry.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_COMMUNICATION_REGISTRY_COALESCE_TIME 20
+#define INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS 3
+
+/* A simulated connection which remembers the serialization of the last
+ * container sent, or NULL if it was sent without serialization */
+typedef struct _InfTestCommunicationRegistryConnection
+  InfTestCommunicationRegistryConnection;
+struct _InfTestCommunicationRegistryConnection {
+  InfSimulatedConnection parent;
+  GBytes* serialized;
+};
+
+typedef struct _InfTestCommunicationRegistryConnectionClass
+  InfTestCommunicationRegistryConnectionClass;
+struct _InfTestCommunicationRegistryConnectionClass {
+  InfSimulatedConnectionClass parent_class;
+};
+
+static GType
+inf_test_communication_registry_connection_get_type(void) G_GNUC_CONST;
+
+static void
+inf_test_communication_registry_connection_iface_init(
+  InfXmlConnectionInterface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(InfTestCommunicationRegistryConnection, inf_test_communication_registry_connection, INF_TYPE_SIMULATED_CONNECTION,
+  G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, inf_test_communication_registry_connection_iface_init))
+
+typedef struct _InfTestCommunicationRegistry InfTestCommunicationRegistry;
+struct _InfTestCommunicationRegistry {
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfCommunicationRegistry* registry;
+  InfCommunicationHostedGroup* group;
+  InfSimulatedConnection* local;
+  InfSimulatedConnection* remote;
+
+  /* Number of messages in each container received by remote */
+  GString* received;
+
+  /* Members of the group "broadcast" */
+  InfTestCommunicationRegistryConnection*
+    members[INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS];
+  InfSimulatedConnection* remotes[INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS];
+  InfCommunicationHostedGroup* broadcast;
+};
+
+static void
+inf_test_communication_registry_connection_send(InfXmlConnection* connection,
+                                                xmlNodePtr xml)
+{
+  InfTestCommunicationRegistryConnection* test_connection;
+  InfXmlConnectionInterface* parent_iface;
+
+  test_connection = (InfTestCommunicationRegistryConnection*)connection;
+
+  if(test_connection->serialized != NULL)
+    g_bytes_unref(test_connection->serialized);
+  test_connection->serialized = NULL;
+
+  parent_iface = g_type_interface_peek_parent(
+    INF_XML_CONNECTION_GET_IFACE(connection)
+  );
+
+  parent_iface->send(connection, xml);
+}
+
+static void
+inf_test_communication_registry_connection_send_serialized(
+  InfXmlConnection* connection,
+  xmlNodePtr xml,
+  GBytes* serialized)
+{
+  InfTestCommunicationRegistryConnection* test_connection;
+  InfXmlConnectionInterface* parent_iface;
+  GBytes* expected;
+
+  test_connection = (InfTestCommunicationRegistryConnection*)connection;
+
+  expected = inf_xml_util_serialize(xml);
+  g_assert(g_bytes_equal(expected, serialized));
+  g_bytes_unref(expected);
+
+  if(test_connection->serialized != NULL)
+    g_bytes_unref(test_connection->serialized);
+  test_connection->serialized = g_bytes_ref(serialized);
+
+  parent_iface = g_type_interface_peek_parent(
+    INF_XML_CONNECTION_GET_IFACE(connection)
+  );
+
+  parent_iface->send(connection, xml);
+}
+
+static void
+inf_test_communication_registry_connection_finalize(GObject* object)
+{
+  InfTestCommunicationRegistryConnection* test_connection;
+  test_connection = (InfTestCommunicationRegistryConnection*)object;
+
+  if(test_connection->serialized != NULL)
+    g_bytes_unref(test_connection->serialized);
+
+  G_OBJECT_CLASS(
+    inf_test_communication_registry_connection_parent_class
+  )->finalize(object);
+}
+
+static void
+inf_test_communication_registry_connection_init(
+  InfTestCommunicationRegistryConnection* connection)
+{
+  connection->serialized = NULL;
+}
+
+static void
+inf_test_communication_registry_connection_class_init(
+  InfTestCommunicationRegistryConnectionClass* connection_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(connection_class);
+
+  object_class->finalize = inf_test_communication_registry_connection_finalize;
+}
+
+static void
+inf_test_communication_registry_connection_iface_init(
+  InfXmlConnectionInterface* iface)
+{
+  /* The other functions are inherited from InfSimulatedConnection */
+  iface->send = inf_test_communication_registry_connection_send;
+  iface->send_serialized =
+    inf_test_communication_registry_connection_send_serialized;
+}
+
+static void
+inf_test_communication_registry_received_cb(InfXmlConnection* connection,
+                                            xmlNodePtr xml,
+                                            gpointer user_data)
+{
+  InfTestCommunicationRegistry* test;
+  xmlNodePtr child;
+  guint count;
+
+  test = (InfTestCommunicationRegistry*)user_data;
+
+  g_assert(strcmp((const char*)xml->name, "group") == 0);
+
+  count = 0;
+  for(child = xml->children; child != NULL; child = child->next)
+    ++count;
+
+  g_assert(count > 0 && count < 10);
+  g_string_append_c(test->received, '0' + count);
+}
+
+/* Sends a message whose estimated size is 27 bytes plus text_len */
+static void
+inf_test_communication_registry_send(InfTestCommunicationRegistry* test,
+                                     gsize text_len)
+{
+  xmlNodePtr xml;
+  gchar* text;
+
+  text = g_malloc(text_len + 1);
+  memset(text, 'x', text_len);
+  text[text_len] = '\0';
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"message");
+  xmlNewProp(xml, (const xmlChar*)"text", (const xmlChar*)text);
+  g_free(text);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(test->group),
+    INF_XML_CONNECTION(test->local),
+    xml
+  );
+}
+
+/* Lets the remote side receive everything that has been sent so far, and
+ * checks the sizes of the containers received */
+static void
+inf_test_communication_registry_check(InfTestCommunicationRegistry* test,
+                                      const gchar* expected)
+{
+  inf_simulated_connection_flush(test->local);
+
+  if(strcmp(test->received->str, expected) != 0)
+  {
+    fprintf(
+      stderr,
+      "Expected containers \"%s\", but received \"%s\"\n",
+      expected,
+      test->received->str
+    );
+
+    g_assert_not_reached();
+  }
+
+  g_string_truncate(test->received, 0);
+}
+
+static void
+inf_test_communication_registry_broadcast(InfTestCommunicationRegistry* test)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"message");
+
+  inf_communication_group_send_group_message(
+    INF_COMMUNICATION_GROUP(test->broadcast),
+    xml
+  );
+}
+
+static void
+inf_test_communication_registry_init(InfTestCommunicationRegistry* test)
+{
+  guint i;
+
+  test->io = inf_standalone_io_new();
+  test->manager = inf_communication_manager_new();
+  test->registry = inf_communication_manager_get_registry(test->manager);
+  test->received = g_string_new(NULL);
+
+  g_object_set(
+    G_OBJECT(test->registry),
+    "io", test->io,
+    "coalesce-time", INF_TEST_COMMUNICATION_REGISTRY_COALESCE_TIME,
+    "max-batch-size", 2500,
+    NULL
+  );
+
+  /* Messages stay in flight until inf_simulated_connection_flush() */
+  test->local = inf_simulated_connection_new();
+  test->remote = inf_simulated_connection_new();
+  inf_simulated_connection_connect(test->local, test->remote);
+  inf_simulated_connection_set_mode(
+    test->local,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->remote),
+    "received",
+    G_CALLBACK(inf_test_communication_registry_received_cb),
+    test
+  );
+
+  test->group =
+    inf_communication_manager_open_group(test->manager, "test", NULL);
+  inf_communication_hosted_group_add_member(
+    test->group,
+    INF_XML_CONNECTION(test->local)
+  );
+
+  test->broadcast =
+    inf_communication_manager_open_group(test->manager, "broadcast", NULL);
+
+  for(i = 0; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+  {
+    test->members[i] = g_object_new(
+      inf_test_communication_registry_connection_get_type(),
+      NULL
+    );
+
+    test->remotes[i] = inf_simulated_connection_new();
+
+    inf_simulated_connection_connect(
+      INF_SIMULATED_CONNECTION(test->members[i]),
+      test->remotes[i]
+    );
+
+    inf_simulated_connection_set_mode(
+      INF_SIMULATED_CONNECTION(test->members[i]),
+      INF_SIMULATED_CONNECTION_DELAYED
+    );
+
+    inf_communication_hosted_group_add_member(
+      test->broadcast,
+      INF_XML_CONNECTION(test->members[i])
+    );
+  }
+}
+
+static void
+inf_test_communication_registry_finalize(InfTestCommunicationRegistry* test)
+{
+  guint i;
+
+  for(i = 0; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+  {
+    inf_communication_hosted_group_remove_member(
+      test->broadcast,
+      INF_XML_CONNECTION(test->members[i])
+    );
+
+    inf_xml_connection_close(INF_XML_CONNECTION(test->members[i]));
+    g_object_unref(test->members[i]);
+    g_object_unref(test->remotes[i]);
+  }
+
+  g_object_unref(test->broadcast);
+
+  inf_communication_hosted_group_remove_member(
+    test->group,
+    INF_XML_CONNECTION(test->local)
+  );
+
+  g_object_unref(test->group);
+  inf_xml_connection_close(INF_XML_CONNECTION(test->local));
+  g_object_unref(test->local);
+  g_object_unref(test->remote);
+  g_object_unref(test->manager);
+  g_object_unref(test->io);
+  g_string_free(test->received, TRUE);
+}
+
+static void
+inf_test_communication_registry_coalesce(InfTestCommunicationRegistry* test)
+{
+  GTimer* timer;
+  gdouble elapsed;
+
+  /* Messages for an idle connection wait for the coalesce time, and then
+   * go out in a single container. */
+  timer = g_timer_new();
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_check(test, "");
+
+  inf_standalone_io_iteration(test->io);
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  g_assert(elapsed * 1000 >= INF_TEST_COMMUNICATION_REGISTRY_COALESCE_TIME);
+  inf_test_communication_registry_check(test, "3");
+
+  /* Messages queued while a container is in flight are sent as soon as it
+   * has been sent, without waiting again. */
+  inf_test_communication_registry_send(test, 10);
+  inf_standalone_io_iteration(test->io);
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_check(test, "12");
+
+  /* Nothing is left for the coalesce timeout to send */
+  inf_standalone_io_iteration_timeout(
+    test->io,
+    2 * INF_TEST_COMMUNICATION_REGISTRY_COALESCE_TIME
+  );
+
+  inf_test_communication_registry_check(test, "");
+
+  /* Flushing sends queued messages right away */
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_send(test, 10);
+  inf_communication_registry_flush(
+    test->registry,
+    INF_COMMUNICATION_GROUP(test->group),
+    INF_XML_CONNECTION(test->local)
+  );
+
+  inf_test_communication_registry_check(test, "2");
+
+  /* Also when flushing all members of the group */
+  inf_test_communication_registry_send(test, 10);
+  inf_communication_group_flush(INF_COMMUNICATION_GROUP(test->group), NULL);
+  inf_test_communication_registry_check(test, "1");
+}
+
+static void
+inf_test_communication_registry_split(InfTestCommunicationRegistry* test)
+{
+  /* Each message is estimated at 1027 bytes, so two of them fit into the
+   * batch size of 2500 bytes, but three do not. Once three messages are
+   * queued, they are sent without waiting for the coalesce time. */
+  inf_test_communication_registry_send(test, 1000);
+  inf_test_communication_registry_send(test, 1000);
+  inf_test_communication_registry_send(test, 1000);
+  inf_test_communication_registry_send(test, 1000);
+  inf_test_communication_registry_send(test, 1000);
+  inf_test_communication_registry_check(test, "221");
+
+  /* A message larger than the batch size is sent on its own */
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_send(test, 4000);
+  inf_test_communication_registry_send(test, 10);
+  inf_test_communication_registry_check(test, "111");
+}
+
+static void
+inf_test_communication_registry_serialize(InfTestCommunicationRegistry* test)
+{
+  GBytes* serialized;
+  guint i;
+
+  /* Both broadcasts wait for the coalesce time and then go out in one
+   * container, which is serialized once for all members. */
+  inf_test_communication_registry_broadcast(test);
+  inf_test_communication_registry_broadcast(test);
+
+  for(i = 0; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+    g_assert(test->members[i]->serialized == NULL);
+
+  inf_standalone_io_iteration(test->io);
+  serialized = test->members[0]->serialized;
+
+  for(i = 0; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+  {
+    g_assert(test->members[i]->serialized != NULL);
+    g_assert(test->members[i]->serialized == test->members[0]->serialized);
+
+    inf_simulated_connection_flush(
+      INF_SIMULATED_CONNECTION(test->members[i])
+    );
+  }
+
+  /* A message sent to only one of the members ends up in the same container
+   * as the broadcast, so this container is serialized separately. */
+  inf_test_communication_registry_broadcast(test);
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(test->broadcast),
+    INF_XML_CONNECTION(test->members[0]),
+    xmlNewNode(NULL, (const xmlChar*)"message")
+  );
+
+  inf_standalone_io_iteration(test->io);
+
+  g_assert(test->members[0]->serialized == NULL);
+  for(i = 1; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+  {
+    g_assert(test->members[i]->serialized != NULL);
+    g_assert(test->members[i]->serialized != serialized);
+    g_assert(test->members[i]->serialized == test->members[1]->serialized);
+  }
+
+  for(i = 0; i < INF_TEST_COMMUNICATION_REGISTRY_N_MEMBERS; ++i)
+  {
+    inf_simulated_connection_flush(
+      INF_SIMULATED_CONNECTION(test->members[i])
+    );
+  }
+}
+
+int main()
+{
+  InfTestCommunicationRegistry test;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_communication_registry_init(&test);
+  inf_test_communication_registry_coalesce(&test);
+  inf_test_communication_registry_split(&test);
+  inf_test_communication_registry_serialize(&test);
+  inf_test_communication_registry_finalize(&test);
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,617 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks that InfdDirectory explores subdirectories in the background:
+ * the exploration finishes once the storage has been read, clients that
+ * explore a node while it is being read wait for the same result, removing
+ * the node fails the exploration, and replacing the storage restarts it
+ * with the new storage. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Maximum number of main loop iterations, with a timeout of 100ms each,
+ * to wait for an exploration to finish */
+#define INF_TEST_DIRECTORY_EXPLORE_MAX_ITERATIONS 100
+
+typedef struct _InfTestDirectoryExplore InfTestDirectoryExplore;
+struct _InfTestDirectoryExplore {
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+
+  gchar* root;
+  InfdFilesystemStorage* storage;
+  InfdDirectory* directory;
+
+  /* Number of explorations started in directory */
+  guint n_begin;
+};
+
+typedef struct _InfTestDirectoryExploreResult InfTestDirectoryExploreResult;
+struct _InfTestDirectoryExploreResult {
+  guint n_finished;
+  GError* error;
+};
+
+typedef struct _InfTestDirectoryExploreClient InfTestDirectoryExploreClient;
+struct _InfTestDirectoryExploreClient {
+  /* local is the server's end of the connection, remote the client's */
+  InfSimulatedConnection* local;
+  InfSimulatedConnection* remote;
+
+  InfCommunicationManager* manager;
+  InfcBrowser* browser;
+};
+
+/* Creates a temporary directory with the given subdirectories, and a
+ * storage for it */
+static InfdFilesystemStorage*
+inf_test_directory_explore_create_storage(const gchar* const* dirs,
+                                          gchar** root)
+{
+  GError* error;
+  gchar* path;
+
+  error = NULL;
+  *root = g_dir_make_tmp("inf-test-directory-explore-XXXXXX", &error);
+  if(*root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  for(; *dirs != NULL; ++dirs)
+  {
+    path = g_build_filename(*root, *dirs, NULL);
+    g_assert(g_mkdir_with_parents(path, 0755) == 0);
+    g_free(path);
+  }
+
+  return infd_filesystem_storage_new(*root);
+}
+
+static void
+inf_test_directory_explore_begin_request_cb(InfBrowser* browser,
+                                            const InfBrowserIter* iter,
+                                            InfRequest* request,
+                                            gpointer user_data)
+{
+  InfTestDirectoryExplore* test;
+  test = (InfTestDirectoryExplore*)user_data;
+
+  ++test->n_begin;
+}
+
+static void
+inf_test_directory_explore_init(InfTestDirectoryExplore* test)
+{
+  static const gchar* const DIRS[] = { "a", "b", "sub/x", "sub/y", NULL };
+
+  test->io = inf_standalone_io_new();
+  test->manager = inf_communication_manager_new();
+  test->storage = inf_test_directory_explore_create_storage(DIRS, &test->root);
+  test->n_begin = 0;
+
+  test->directory = infd_directory_new(
+    INF_IO(test->io),
+    INFD_STORAGE(test->storage),
+    test->manager
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->directory),
+    "begin-request::explore-node",
+    G_CALLBACK(inf_test_directory_explore_begin_request_cb),
+    test
+  );
+}
+
+static void
+inf_test_directory_explore_finalize(InfTestDirectoryExplore* test)
+{
+  g_object_unref(test->directory);
+  g_object_unref(test->storage);
+  g_object_unref(test->manager);
+  g_object_unref(test->io);
+
+  g_assert(inf_file_util_delete(test->root, NULL) == TRUE);
+  g_free(test->root);
+}
+
+static void
+inf_test_directory_explore_finished_cb(InfRequest* request,
+                                       const InfRequestResult* result,
+                                       const GError* error,
+                                       gpointer user_data)
+{
+  InfTestDirectoryExploreResult* explore_result;
+  explore_result = (InfTestDirectoryExploreResult*)user_data;
+
+  ++explore_result->n_finished;
+  if(error != NULL && explore_result->error == NULL)
+    explore_result->error = g_error_copy(error);
+}
+
+/* Runs the main loop until count has reached the given value */
+static void
+inf_test_directory_explore_run(InfTestDirectoryExplore* test,
+                               const guint* count,
+                               guint value)
+{
+  guint i;
+
+  for(i = 0;
+      i < INF_TEST_DIRECTORY_EXPLORE_MAX_ITERATIONS && *count < value;
+      ++i)
+  {
+    inf_standalone_io_iteration_timeout(test->io, 100);
+  }
+
+  g_assert(*count == value);
+}
+
+/* Runs the main loop for a while, for results that should not arrive */
+static void
+inf_test_directory_explore_idle(InfTestDirectoryExplore* test)
+{
+  guint i;
+
+  for(i = 0; i < 5; ++i)
+    inf_standalone_io_iteration_timeout(test->io, 100);
+}
+
+static gint
+inf_test_directory_explore_compare_names(gconstpointer first,
+                                         gconstpointer second)
+{
+  return strcmp(*(const gchar* const*)first, *(const gchar* const*)second);
+}
+
+/* Checks that the node at iter has exactly the given children, which must
+ * be sorted */
+static void
+inf_test_directory_explore_check_children(InfBrowser* browser,
+                                          const InfBrowserIter* iter,
+                                          const gchar* const* names)
+{
+  InfBrowserIter child;
+  GPtrArray* children;
+  gboolean result;
+  guint i;
+
+  g_assert(inf_browser_get_explored(browser, iter) == TRUE);
+
+  children = g_ptr_array_new();
+  child = *iter;
+
+  for(result = inf_browser_get_child(browser, &child);
+      result == TRUE;
+      result = inf_browser_get_next(browser, &child))
+  {
+    g_ptr_array_add(
+      children,
+      (gpointer)inf_browser_get_node_name(browser, &child)
+    );
+  }
+
+  g_ptr_array_sort(children, inf_test_directory_explore_compare_names);
+
+  for(i = 0; names[i] != NULL; ++i)
+  {
+    g_assert(i < children->len);
+    g_assert(strcmp(g_ptr_array_index(children, i), names[i]) == 0);
+  }
+
+  g_assert(i == children->len);
+  g_ptr_array_free(children, TRUE);
+}
+
+/* Returns the child of the node at iter with the given name */
+static void
+inf_test_directory_explore_get_child(InfBrowser* browser,
+                                     InfBrowserIter* iter,
+                                     const gchar* name)
+{
+  gboolean result;
+
+  for(result = inf_browser_get_child(browser, iter);
+      result == TRUE;
+      result = inf_browser_get_next(browser, iter))
+  {
+    if(strcmp(inf_browser_get_node_name(browser, iter), name) == 0)
+      return;
+  }
+
+  g_assert_not_reached();
+}
+
+static void
+inf_test_directory_explore_client_init(InfTestDirectoryExploreClient* client,
+                                       InfTestDirectoryExplore* test)
+{
+  InfBrowserStatus status;
+  guint i;
+
+  client->local = inf_simulated_connection_new_with_io(INF_IO(test->io));
+  client->remote = inf_simulated_connection_new_with_io(INF_IO(test->io));
+  inf_simulated_connection_connect(client->local, client->remote);
+
+  inf_simulated_connection_set_mode(
+    client->local,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->remote,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  client->manager = inf_communication_manager_new();
+  client->browser = infc_browser_new(
+    INF_IO(test->io),
+    client->manager,
+    INF_XML_CONNECTION(client->remote)
+  );
+
+  g_assert(
+    infd_directory_add_connection(
+      test->directory,
+      INF_XML_CONNECTION(client->local)
+    ) == TRUE
+  );
+
+  /* Wait for the welcome message */
+  status = INF_BROWSER_OPENING;
+  for(i = 0;
+      i < INF_TEST_DIRECTORY_EXPLORE_MAX_ITERATIONS &&
+      status != INF_BROWSER_OPEN;
+      ++i)
+  {
+    inf_standalone_io_iteration_timeout(test->io, 100);
+    g_object_get(G_OBJECT(client->browser), "status", &status, NULL);
+  }
+
+  g_assert(status == INF_BROWSER_OPEN);
+}
+
+static void
+inf_test_directory_explore_client_finalize(
+  InfTestDirectoryExploreClient* client)
+{
+  InfXmlConnectionStatus status;
+
+  g_object_get(G_OBJECT(client->remote), "status", &status, NULL);
+  if(status == INF_XML_CONNECTION_OPEN)
+    inf_xml_connection_close(INF_XML_CONNECTION(client->remote));
+
+  g_object_unref(client->browser);
+  g_object_unref(client->manager);
+  g_object_unref(client->local);
+  g_object_unref(client->remote);
+}
+
+static void
+inf_test_directory_explore_async(void)
+{
+  static const gchar* const CHILDREN[] = { "a", "b", "sub", NULL };
+  static const gchar* const SUB_CHILDREN[] = { "x", "y", NULL };
+
+  InfTestDirectoryExplore test;
+  InfTestDirectoryExploreResult result;
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfRequest* request;
+
+  inf_test_directory_explore_init(&test);
+  browser = INF_BROWSER(test.directory);
+  inf_browser_get_root(browser, &iter);
+
+  result.n_finished = 0;
+  result.error = NULL;
+
+  request = inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  /* The storage is read in the background */
+  g_assert(request != NULL);
+  g_assert(result.n_finished == 0);
+  g_assert(inf_browser_get_explored(browser, &iter) == FALSE);
+  g_assert(
+    inf_browser_get_pending_request(browser, &iter, "explore-node") ==
+    request
+  );
+
+  inf_test_directory_explore_run(&test, &result.n_finished, 1);
+  g_assert(result.error == NULL);
+
+  g_assert(
+    inf_browser_get_pending_request(browser, &iter, "explore-node") == NULL
+  );
+
+  inf_test_directory_explore_check_children(browser, &iter, CHILDREN);
+
+  /* Explore a subdirectory as well */
+  inf_test_directory_explore_get_child(browser, &iter, "sub");
+
+  request = inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  g_assert(request != NULL);
+  inf_test_directory_explore_run(&test, &result.n_finished, 2);
+  g_assert(result.error == NULL);
+
+  inf_test_directory_explore_check_children(browser, &iter, SUB_CHILDREN);
+
+  g_assert(test.n_begin == 2);
+  inf_test_directory_explore_finalize(&test);
+}
+
+static void
+inf_test_directory_explore_join(void)
+{
+  static const gchar* const CHILDREN[] = { "a", "b", "sub", NULL };
+
+  InfTestDirectoryExplore test;
+  InfTestDirectoryExploreClient clients[3];
+  InfTestDirectoryExploreResult result;
+  InfBrowserIter iter;
+  InfRequest* request;
+  guint i;
+
+  inf_test_directory_explore_init(&test);
+
+  result.n_finished = 0;
+  result.error = NULL;
+
+  for(i = 0; i < G_N_ELEMENTS(clients); ++i)
+    inf_test_directory_explore_client_init(&clients[i], &test);
+
+  for(i = 0; i < G_N_ELEMENTS(clients); ++i)
+  {
+    inf_browser_get_root(INF_BROWSER(clients[i].browser), &iter);
+
+    request = inf_browser_explore(
+      INF_BROWSER(clients[i].browser),
+      &iter,
+      inf_test_directory_explore_finished_cb,
+      &result
+    );
+
+    g_assert(request != NULL);
+  }
+
+  /* Deliver the explore requests of all clients at once, before the
+   * storage has been read */
+  for(i = 0; i < G_N_ELEMENTS(clients); ++i)
+    inf_simulated_connection_flush(clients[i].remote);
+
+  g_assert(result.n_finished == 0);
+
+  inf_test_directory_explore_run(
+    &test,
+    &result.n_finished,
+    G_N_ELEMENTS(clients)
+  );
+
+  g_assert(result.error == NULL);
+
+  /* The storage has been read only once for all of them */
+  g_assert(test.n_begin == 1);
+
+  inf_browser_get_root(INF_BROWSER(test.directory), &iter);
+  inf_test_directory_explore_check_children(
+    INF_BROWSER(test.directory),
+    &iter,
+    CHILDREN
+  );
+
+  for(i = 0; i < G_N_ELEMENTS(clients); ++i)
+  {
+    inf_browser_get_root(INF_BROWSER(clients[i].browser), &iter);
+    inf_test_directory_explore_check_children(
+      INF_BROWSER(clients[i].browser),
+      &iter,
+      CHILDREN
+    );
+
+    inf_test_directory_explore_client_finalize(&clients[i]);
+  }
+
+  inf_test_directory_explore_finalize(&test);
+}
+
+static void
+inf_test_directory_explore_remove(void)
+{
+  static const gchar* const CHILDREN[] = { "a", "b", NULL };
+
+  InfTestDirectoryExplore test;
+  InfTestDirectoryExploreResult result;
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfRequest* request;
+
+  inf_test_directory_explore_init(&test);
+  browser = INF_BROWSER(test.directory);
+  inf_browser_get_root(browser, &iter);
+
+  result.n_finished = 0;
+  result.error = NULL;
+
+  inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  inf_test_directory_explore_run(&test, &result.n_finished, 1);
+  g_assert(result.error == NULL);
+
+  inf_test_directory_explore_get_child(browser, &iter, "sub");
+
+  request = inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  g_assert(request != NULL);
+
+  /* Removing the node fails the exploration right away */
+  inf_browser_remove_node(browser, &iter, NULL, NULL);
+
+  g_assert(result.n_finished == 2);
+  g_assert(
+    g_error_matches(
+      result.error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_NODE
+    )
+  );
+
+  g_error_free(result.error);
+  result.error = NULL;
+
+  /* The result of the storage read that was in progress is discarded */
+  inf_test_directory_explore_idle(&test);
+  g_assert(result.n_finished == 2);
+
+  inf_browser_get_root(browser, &iter);
+  inf_test_directory_explore_check_children(browser, &iter, CHILDREN);
+
+  inf_test_directory_explore_finalize(&test);
+}
+
+static void
+inf_test_directory_explore_replace_storage(void)
+{
+  static const gchar* const DIRS[] = { "c", "d/z", NULL };
+  static const gchar* const CHILDREN[] = { "c", "d", NULL };
+
+  InfTestDirectoryExplore test;
+  InfTestDirectoryExploreResult result;
+  InfdFilesystemStorage* storage;
+  gchar* root;
+  InfBrowser* browser;
+  InfBrowserIter iter;
+
+  inf_test_directory_explore_init(&test);
+  browser = INF_BROWSER(test.directory);
+  inf_browser_get_root(browser, &iter);
+
+  storage = inf_test_directory_explore_create_storage(DIRS, &root);
+
+  result.n_finished = 0;
+  result.error = NULL;
+
+  inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  /* The exploration restarts with the new storage, and what has been read
+   * from the old one is discarded */
+  g_object_set(G_OBJECT(test.directory), "storage", storage, NULL);
+
+  inf_test_directory_explore_run(&test, &result.n_finished, 1);
+  g_assert(result.error == NULL);
+  g_assert(test.n_begin == 1);
+
+  inf_test_directory_explore_check_children(browser, &iter, CHILDREN);
+
+  /* Without storage, the exploration cannot be restarted */
+  inf_test_directory_explore_get_child(browser, &iter, "d");
+
+  inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    &result
+  );
+
+  g_object_set(G_OBJECT(test.directory), "storage", NULL, NULL);
+
+  g_assert(result.n_finished == 2);
+  g_assert(
+    g_error_matches(
+      result.error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE
+    )
+  );
+
+  g_error_free(result.error);
+
+  inf_test_directory_explore_idle(&test);
+  g_assert(result.n_finished == 2);
+
+  g_object_unref(storage);
+  g_assert(inf_file_util_delete(root, NULL) == TRUE);
+  g_free(root);
+
+  inf_test_directory_explore_finalize(&test);
+}
+
+int main()
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_directory_explore_async();
+  inf_test_directory_explore_join();
+  inf_test_directory_explore_remove();
+  inf_test_directory_explore_replace_storage();
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,163 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinfinity/adopted/inf-adopted-request-log.h>
+#include <libinfinity/adopted/inf-adopted-no-operation.h>
+
+/* Creates a do request of user 1 at the state 1:n;2:m */
+static InfAdoptedRequest*
+make_request(guint n,
+             guint m)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+
+  vector = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vector, 1, n);
+  inf_adopted_state_vector_set(vector, 2, m);
+
+  operation = INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
+  request = inf_adopted_request_new_do(vector, 1, operation, 0);
+
+  g_object_unref(operation);
+  inf_adopted_state_vector_free(vector);
+  return request;
+}
+
+/* Checks whether request can be found in the cache of log */
+static void
+check_cached(InfAdoptedRequestLog* log,
+             InfAdoptedRequest* request,
+             gboolean cached)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequest* found;
+
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_request_get_vector(request)
+  );
+
+  found = inf_adopted_request_log_lookup_cached_request(log, vector);
+  inf_adopted_state_vector_free(vector);
+
+  if(cached)
+    g_assert(found == request);
+  else
+    g_assert(found == NULL);
+}
+
+static void
+check_stats(InfAdoptedRequestLog* log,
+            guint hits,
+            guint misses,
+            guint evictions)
+{
+  guint log_hits;
+  guint log_misses;
+  guint log_evictions;
+
+  inf_adopted_request_log_get_cache_stats(
+    log,
+    &log_hits,
+    &log_misses,
+    &log_evictions
+  );
+
+  g_assert(log_hits == hits);
+  g_assert(log_misses == misses);
+  g_assert(log_evictions == evictions);
+}
+
+int main()
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* cached[6];
+  InfAdoptedRequest* request;
+  guint i;
+
+  log = inf_adopted_request_log_new(1);
+  g_assert(inf_adopted_request_log_get_max_cache_size(log) == G_MAXUINT);
+  inf_adopted_request_log_set_max_cache_size(log, 4);
+
+  for(i = 0; i < 4; ++i)
+  {
+    cached[i] = make_request(i, 1);
+    inf_adopted_request_log_add_cached_request(log, cached[i]);
+  }
+
+  cached[4] = make_request(3, 2);
+  cached[5] = make_request(4, 2);
+  check_stats(log, 0, 0, 0);
+
+  /* Using 0 makes 1 the least recently used entry */
+  check_cached(log, cached[0], TRUE);
+  check_cached(log, cached[5], FALSE);
+  check_stats(log, 1, 1, 0);
+
+  inf_adopted_request_log_add_cached_request(log, cached[4]);
+  check_stats(log, 1, 1, 1);
+  check_cached(log, cached[1], FALSE);
+  check_stats(log, 1, 2, 1);
+
+  /* Most recently used first: 2, 4, 0, 3 */
+  check_cached(log, cached[2], TRUE);
+  check_stats(log, 2, 2, 1);
+
+  /* Shrinking the cache evicts the least recently used entries */
+  inf_adopted_request_log_set_max_cache_size(log, 2);
+  check_stats(log, 2, 2, 3);
+  check_cached(log, cached[3], FALSE);
+  check_cached(log, cached[0], FALSE);
+  check_cached(log, cached[4], TRUE);
+  check_cached(log, cached[2], TRUE);
+  check_stats(log, 4, 4, 3);
+
+  /* Removing requests from the log drops their cached translations, but
+   * these do not count as evictions */
+  inf_adopted_request_log_set_max_cache_size(log, G_MAXUINT);
+  for(i = 0; i < 5; ++i)
+  {
+    request = make_request(i, 0);
+    inf_adopted_request_log_add_request(log, request);
+    g_object_unref(request);
+  }
+
+  inf_adopted_request_log_remove_requests(log, 3);
+  check_cached(log, cached[2], FALSE);
+  check_cached(log, cached[4], TRUE);
+  check_stats(log, 5, 5, 3);
+
+  /* A size of 0 disables the cache */
+  inf_adopted_request_log_set_max_cache_size(log, 0);
+  check_stats(log, 5, 5, 4);
+  check_cached(log, cached[4], FALSE);
+  inf_adopted_request_log_add_cached_request(log, cached[5]);
+  check_cached(log, cached[5], FALSE);
+  check_stats(log, 5, 7, 4);
+
+  g_object_unref(log);
+
+  for(i = 0; i < 6; ++i)
+    g_object_unref(cached[i]);
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,839 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks synchronization of a text session whose messages are only created
+ * when the connection is ready to send them: the client ends up with the
+ * state from when the synchronization began plus everything that happened
+ * afterwards, even if the session is edited while the synchronization is
+ * being sent, and closing the connection, cancelling the synchronization or
+ * removing the connection from the group half-way through is handled.
+ * Synchronizations that begin shortly after another one share its state
+ * and catch up with what happened in the meanwhile, unless too many
+ * messages or too much time went by. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-registry.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Small enough for the synchronizations below to need many containers */
+#define INF_TEST_SESSION_SYNC_BATCH_SIZE 1024
+
+/* Limits for sharing a synchronization, as defined in inf-session.c */
+#define INF_TEST_SESSION_SYNC_SHARE_TIME (2 * G_USEC_PER_SEC)
+#define INF_TEST_SESSION_SYNC_SHARE_MAX_DELTA 1024
+
+typedef struct _InfTestSessionSync InfTestSessionSync;
+struct _InfTestSessionSync {
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  /* Local users of session, owned by its user table */
+  InfUser* users[2];
+  guint n_edits;
+};
+
+typedef struct _InfTestSessionSyncClient InfTestSessionSyncClient;
+typedef void(*InfTestSessionSyncAction)(InfTestSessionSyncClient* client);
+
+struct _InfTestSessionSyncClient {
+  InfTestSessionSync* test;
+
+  /* local is the server's end of the connection, remote the client's */
+  InfSimulatedConnection* local;
+  InfSimulatedConnection* remote;
+
+  InfCommunicationManager* manager;
+  InfCommunicationJoinedGroup* group;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  guint containers; /* containers received */
+  guint n_messages; /* num-messages of <sync-begin/> */
+  guint synced_length; /* buffer length when synchronization completed */
+  gboolean complete;
+  gboolean failed;
+  gboolean server_complete;
+  gboolean server_failed;
+
+  /* Run after the given number of containers has been received */
+  guint action_at;
+  InfTestSessionSyncAction action;
+  gpointer action_data;
+};
+
+static void
+inf_test_session_sync_init(InfTestSessionSync* test)
+{
+  InfUserTable* user_table;
+  InfUser* user;
+  gchar* name;
+  guint i;
+
+  test->io = inf_standalone_io_new();
+  test->manager = inf_communication_manager_new();
+  test->n_edits = 0;
+
+  g_object_set(
+    G_OBJECT(inf_communication_manager_get_registry(test->manager)),
+    "max-batch-size", INF_TEST_SESSION_SYNC_BATCH_SIZE,
+    NULL
+  );
+
+  test->group = inf_communication_manager_open_group(
+    test->manager,
+    "InfTestSessionSync",
+    NULL
+  );
+
+  user_table = inf_user_table_new();
+  for(i = 0; i < 2; ++i)
+  {
+    name = g_strdup_printf("User_%u", i + 1);
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i + 1,
+        "name", name,
+        "status", INF_USER_ACTIVE,
+        "flags", INF_USER_LOCAL,
+        NULL
+      )
+    );
+
+    g_free(name);
+    inf_user_table_add_user(user_table, user);
+    test->users[i] = user;
+    g_object_unref(user);
+  }
+
+  test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  test->session = inf_text_session_new_with_user_table(
+    test->manager,
+    test->buffer,
+    INF_IO(test->io),
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+
+  inf_session_set_subscription_group(
+    INF_SESSION(test->session),
+    INF_COMMUNICATION_GROUP(test->group)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->group),
+    INF_COMMUNICATION_OBJECT(test->session)
+  );
+}
+
+static void
+inf_test_session_sync_finalize(InfTestSessionSync* test)
+{
+  g_object_unref(test->session);
+  g_object_unref(test->buffer);
+  g_object_unref(test->group);
+  g_object_unref(test->manager);
+  g_object_unref(test->io);
+}
+
+/* Appends n lines to the document, alternating between the two users so
+ * that every line becomes a segment of its own. */
+static void
+inf_test_session_sync_edit(InfTestSessionSync* test,
+                           guint n)
+{
+  gchar text[64];
+  guint len;
+  guint i;
+
+  for(i = 0; i < n; ++i)
+  {
+    len = g_snprintf(text, sizeof(text), "Line %u\n", test->n_edits);
+
+    inf_text_buffer_insert_text(
+      test->buffer,
+      inf_text_buffer_get_length(test->buffer),
+      text,
+      len,
+      len,
+      test->users[test->n_edits % 2]
+    );
+
+    ++test->n_edits;
+  }
+}
+
+static gboolean
+inf_test_session_sync_is_open(InfSimulatedConnection* connection)
+{
+  InfXmlConnectionStatus status;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+  return status == INF_XML_CONNECTION_OPEN;
+}
+
+static void
+inf_test_session_sync_received_cb(InfXmlConnection* connection,
+                                  xmlNodePtr xml,
+                                  gpointer user_data)
+{
+  InfTestSessionSyncClient* client;
+  xmlNodePtr child;
+  gboolean result;
+
+  client = (InfTestSessionSyncClient*)user_data;
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(strcmp((const char*)child->name, "sync-begin") == 0)
+    {
+      result = inf_xml_util_get_attribute_uint_required(
+        child,
+        "num-messages",
+        &client->n_messages,
+        NULL
+      );
+
+      g_assert(result == TRUE);
+    }
+  }
+
+  ++client->containers;
+  if(client->action != NULL && client->containers == client->action_at)
+    client->action(client);
+}
+
+static void
+inf_test_session_sync_complete_cb(InfSession* session,
+                                  InfXmlConnection* connection,
+                                  gpointer user_data)
+{
+  InfTestSessionSyncClient* client;
+  client = (InfTestSessionSyncClient*)user_data;
+
+  if(session == INF_SESSION(client->session))
+  {
+    client->complete = TRUE;
+    client->synced_length = inf_text_buffer_get_length(client->buffer);
+  }
+  else if(connection == INF_XML_CONNECTION(client->local))
+  {
+    client->server_complete = TRUE;
+  }
+}
+
+static void
+inf_test_session_sync_failed_cb(InfSession* session,
+                                InfXmlConnection* connection,
+                                const GError* error,
+                                gpointer user_data)
+{
+  InfTestSessionSyncClient* client;
+  client = (InfTestSessionSyncClient*)user_data;
+
+  if(session == INF_SESSION(client->session))
+    client->failed = TRUE;
+  else if(connection == INF_XML_CONNECTION(client->local))
+    client->server_failed = TRUE;
+}
+
+/* Connects a new client to the server and creates its session, waiting to
+ * be synchronized. */
+static void
+inf_test_session_sync_client_init(InfTestSessionSyncClient* client,
+                                  InfTestSessionSync* test)
+{
+  client->test = test;
+  client->containers = 0;
+  client->n_messages = 0;
+  client->synced_length = 0;
+  client->complete = FALSE;
+  client->failed = FALSE;
+  client->server_complete = FALSE;
+  client->server_failed = FALSE;
+  client->action_at = 0;
+  client->action = NULL;
+  client->action_data = NULL;
+
+  client->local = inf_simulated_connection_new();
+  client->remote = inf_simulated_connection_new();
+  inf_simulated_connection_connect(client->local, client->remote);
+
+  inf_simulated_connection_set_mode(
+    client->local,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->remote,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_communication_hosted_group_add_member(
+    test->group,
+    INF_XML_CONNECTION(client->local)
+  );
+
+  client->manager = inf_communication_manager_new();
+  client->group = inf_communication_manager_join_group(
+    client->manager,
+    "InfTestSessionSync",
+    INF_XML_CONNECTION(client->remote),
+    "central"
+  );
+
+  /* Connected after the registry, so that the container has been processed
+   * by the time the action runs */
+  g_signal_connect_after(
+    G_OBJECT(client->remote),
+    "received",
+    G_CALLBACK(inf_test_session_sync_received_cb),
+    client
+  );
+
+  client->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  client->session = inf_text_session_new(
+    client->manager,
+    client->buffer,
+    INF_IO(test->io),
+    INF_SESSION_SYNCHRONIZING,
+    INF_COMMUNICATION_GROUP(client->group),
+    INF_XML_CONNECTION(client->remote)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(client->group),
+    INF_COMMUNICATION_OBJECT(client->session)
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->session),
+    "synchronization-complete",
+    G_CALLBACK(inf_test_session_sync_complete_cb),
+    client
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->session),
+    "synchronization-failed",
+    G_CALLBACK(inf_test_session_sync_failed_cb),
+    client
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->session),
+    "synchronization-complete",
+    G_CALLBACK(inf_test_session_sync_complete_cb),
+    client
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->session),
+    "synchronization-failed",
+    G_CALLBACK(inf_test_session_sync_failed_cb),
+    client
+  );
+}
+
+static void
+inf_test_session_sync_client_finalize(InfTestSessionSyncClient* client)
+{
+  if(inf_test_session_sync_is_open(client->local))
+    inf_xml_connection_close(INF_XML_CONNECTION(client->local));
+
+  g_signal_handlers_disconnect_by_data(
+    G_OBJECT(client->test->session),
+    client
+  );
+
+  g_object_unref(client->session);
+  g_object_unref(client->buffer);
+  g_object_unref(client->group);
+  g_object_unref(client->manager);
+  g_object_unref(client->local);
+  g_object_unref(client->remote);
+}
+
+static void
+inf_test_session_sync_client_start(InfTestSessionSyncClient* client)
+{
+  inf_session_synchronize_to(
+    INF_SESSION(client->test->session),
+    INF_COMMUNICATION_GROUP(client->test->group),
+    INF_XML_CONNECTION(client->local)
+  );
+}
+
+/* Delivers everything the server has sent to the client, and the client's
+ * replies to the server. */
+static void
+inf_test_session_sync_client_run(InfTestSessionSyncClient* client)
+{
+  if(inf_test_session_sync_is_open(client->local))
+    inf_simulated_connection_flush(client->local);
+  if(inf_test_session_sync_is_open(client->remote))
+    inf_simulated_connection_flush(client->remote);
+}
+
+static void
+inf_test_session_sync_count_users_func(InfUser* user,
+                                       gpointer user_data)
+{
+  ++*(guint*)user_data;
+}
+
+static guint
+inf_test_session_sync_count_users(InfTextSession* session)
+{
+  guint count;
+  count = 0;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_test_session_sync_count_users_func,
+    &count
+  );
+
+  return count;
+}
+
+/* Checks that the client has the same document, with the same authors, the
+ * same users and the same state as the server. */
+static void
+inf_test_session_sync_client_check(InfTestSessionSyncClient* client)
+{
+  InfTextChunk* server_chunk;
+  InfTextChunk* client_chunk;
+  InfAdoptedAlgorithm* server_algorithm;
+  InfAdoptedAlgorithm* client_algorithm;
+
+  g_assert(
+    inf_session_get_status(INF_SESSION(client->session)) ==
+    INF_SESSION_RUNNING
+  );
+
+  server_chunk = inf_text_buffer_get_slice(
+    client->test->buffer,
+    0,
+    inf_text_buffer_get_length(client->test->buffer)
+  );
+
+  client_chunk = inf_text_buffer_get_slice(
+    client->buffer,
+    0,
+    inf_text_buffer_get_length(client->buffer)
+  );
+
+  g_assert(inf_text_chunk_equal(server_chunk, client_chunk));
+
+  inf_text_chunk_free(server_chunk);
+  inf_text_chunk_free(client_chunk);
+
+  g_assert(
+    inf_test_session_sync_count_users(client->session) ==
+    inf_test_session_sync_count_users(client->test->session)
+  );
+
+  server_algorithm = inf_adopted_session_get_algorithm(
+    INF_ADOPTED_SESSION(client->test->session)
+  );
+
+  client_algorithm = inf_adopted_session_get_algorithm(
+    INF_ADOPTED_SESSION(client->session)
+  );
+
+  g_assert(
+    inf_adopted_state_vector_compare(
+      inf_adopted_algorithm_get_current(server_algorithm),
+      inf_adopted_algorithm_get_current(client_algorithm)
+    ) == 0
+  );
+}
+
+/* A synchronization larger than the batch size arrives in several
+ * containers. */
+static void
+inf_test_session_sync_streamed(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient client;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+
+  inf_test_session_sync_client_init(&client, &test);
+  inf_test_session_sync_client_start(&client);
+  inf_test_session_sync_client_run(&client);
+
+  g_assert(client.complete && client.server_complete);
+  g_assert(!client.failed && !client.server_failed);
+  g_assert(client.n_messages > 200);
+  g_assert(client.containers > 5);
+  g_assert(client.synced_length == inf_text_buffer_get_length(test.buffer));
+  inf_test_session_sync_client_check(&client);
+
+  inf_test_session_sync_client_finalize(&client);
+  inf_test_session_sync_finalize(&test);
+}
+
+static void
+inf_test_session_sync_edit_action(InfTestSessionSyncClient* client)
+{
+  inf_test_session_sync_edit(client->test, 20);
+}
+
+/* Edits made while the synchronization is being sent are not part of it,
+ * but reach the client right after it. */
+static void
+inf_test_session_sync_edit_during_sync(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient client;
+  guint length;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+  length = inf_text_buffer_get_length(test.buffer);
+
+  inf_test_session_sync_client_init(&client, &test);
+  client.action_at = 3;
+  client.action = inf_test_session_sync_edit_action;
+
+  inf_test_session_sync_client_start(&client);
+  inf_test_session_sync_client_run(&client);
+
+  g_assert(client.complete && client.server_complete);
+  g_assert(client.synced_length == length);
+  g_assert(inf_text_buffer_get_length(test.buffer) > length);
+  inf_test_session_sync_client_check(&client);
+
+  inf_test_session_sync_client_finalize(&client);
+  inf_test_session_sync_finalize(&test);
+}
+
+/* Closing the connection with the synchronization only partly sent
+ * discards the rest of it. */
+static void
+inf_test_session_sync_close(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient client;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+
+  inf_test_session_sync_client_init(&client, &test);
+  inf_test_session_sync_client_start(&client);
+
+  /* Only the first container has been sent at this point */
+  inf_xml_connection_close(INF_XML_CONNECTION(client.local));
+
+  g_assert(client.failed && client.server_failed);
+  g_assert(!client.complete && !client.server_complete);
+  g_assert(client.containers == 0);
+  g_assert(
+    inf_session_get_synchronization_status(
+      INF_SESSION(test.session),
+      INF_XML_CONNECTION(client.local)
+    ) == INF_SESSION_SYNC_NONE
+  );
+
+  /* The session stays usable */
+  inf_test_session_sync_edit(&test, 10);
+
+  inf_test_session_sync_client_finalize(&client);
+  inf_test_session_sync_finalize(&test);
+}
+
+static void
+inf_test_session_sync_cancel_action(InfTestSessionSyncClient* client)
+{
+  inf_session_cancel_synchronization(
+    INF_SESSION(client->test->session),
+    INF_XML_CONNECTION(client->local)
+  );
+}
+
+/* Cancelling drops the messages not yet sent, and the client learns about
+ * the cancellation right after the container that was in flight. */
+static void
+inf_test_session_sync_cancel(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient client;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+
+  inf_test_session_sync_client_init(&client, &test);
+  client.action_at = 3;
+  client.action = inf_test_session_sync_cancel_action;
+
+  inf_test_session_sync_client_start(&client);
+  inf_test_session_sync_client_run(&client);
+
+  g_assert(client.failed && client.server_failed);
+  g_assert(!client.complete && !client.server_complete);
+  g_assert(client.containers == 5);
+  g_assert(
+    inf_session_get_status(INF_SESSION(client.session)) == INF_SESSION_CLOSED
+  );
+
+  inf_test_session_sync_client_finalize(&client);
+  inf_test_session_sync_finalize(&test);
+}
+
+static void
+inf_test_session_sync_remove_action(InfTestSessionSyncClient* client)
+{
+  inf_communication_hosted_group_remove_member(
+    client->test->group,
+    INF_XML_CONNECTION(client->local)
+  );
+}
+
+/* Removing the connection from the group still sends everything that was
+ * scheduled for it, including the rest of the synchronization. */
+static void
+inf_test_session_sync_remove_member(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient client;
+  InfCommunicationHostedGroup* other;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+
+  inf_test_session_sync_client_init(&client, &test);
+
+  /* Like the directory's group in infinoted, this keeps the connection
+   * known to the registry after it left the session's group. */
+  other = inf_communication_manager_open_group(
+    test.manager,
+    "InfTestSessionSyncOther",
+    NULL
+  );
+
+  inf_communication_hosted_group_add_member(
+    other,
+    INF_XML_CONNECTION(client.local)
+  );
+
+  client.action_at = 3;
+  client.action = inf_test_session_sync_remove_action;
+
+  inf_test_session_sync_client_start(&client);
+
+  /* The server cannot receive the acknowledgement anymore, since the
+   * connection is no longer in the group, so only deliver to the client. */
+  inf_simulated_connection_flush(client.local);
+
+  g_assert(client.complete && !client.failed);
+  inf_test_session_sync_client_check(&client);
+
+  inf_test_session_sync_client_finalize(&client);
+  g_assert(client.server_failed && !client.server_complete);
+
+  g_object_unref(other);
+  inf_test_session_sync_finalize(&test);
+}
+
+static void
+inf_test_session_sync_join_action(InfTestSessionSyncClient* client)
+{
+  InfTestSessionSyncClient* late;
+  late = (InfTestSessionSyncClient*)client->action_data;
+
+  inf_test_session_sync_edit(client->test, 30);
+  inf_test_session_sync_client_init(late, client->test);
+  inf_test_session_sync_client_start(late);
+  inf_test_session_sync_edit(client->test, 10);
+}
+
+/* A client that joins while another one is still being synchronized gets
+ * the same state, followed by the edits it missed. */
+static void
+inf_test_session_sync_share(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient first;
+  InfTestSessionSyncClient late;
+  guint length;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+  length = inf_text_buffer_get_length(test.buffer);
+
+  inf_test_session_sync_client_init(&first, &test);
+  first.action_at = 3;
+  first.action = inf_test_session_sync_join_action;
+  first.action_data = &late;
+
+  inf_test_session_sync_client_start(&first);
+  inf_test_session_sync_client_run(&first);
+
+  g_assert(first.containers > 3);
+  inf_test_session_sync_client_run(&late);
+
+  g_assert(first.complete && first.server_complete);
+  g_assert(late.complete && late.server_complete);
+
+  g_assert(late.n_messages == first.n_messages);
+  g_assert(first.synced_length == length);
+  g_assert(late.synced_length == length);
+
+  inf_test_session_sync_client_check(&first);
+  inf_test_session_sync_client_check(&late);
+
+  inf_test_session_sync_client_finalize(&late);
+  inf_test_session_sync_client_finalize(&first);
+  inf_test_session_sync_finalize(&test);
+}
+
+/* Once more messages have been sent after the state was taken than a late
+ * client would need to catch up with, it gets the current state instead. */
+static void
+inf_test_session_sync_share_max_delta(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient first;
+  InfTestSessionSyncClient shared;
+  InfTestSessionSyncClient fresh;
+  guint length;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+  length = inf_text_buffer_get_length(test.buffer);
+
+  inf_test_session_sync_client_init(&first, &test);
+  inf_test_session_sync_client_start(&first);
+
+  /* Exactly as many messages as can be caught up with */
+  inf_test_session_sync_edit(&test, INF_TEST_SESSION_SYNC_SHARE_MAX_DELTA);
+  inf_test_session_sync_client_init(&shared, &test);
+  inf_test_session_sync_client_start(&shared);
+
+  inf_test_session_sync_edit(&test, 1);
+  inf_test_session_sync_client_init(&fresh, &test);
+  inf_test_session_sync_client_start(&fresh);
+
+  inf_test_session_sync_client_run(&first);
+  inf_test_session_sync_client_run(&shared);
+  inf_test_session_sync_client_run(&fresh);
+
+  g_assert(first.complete && shared.complete && fresh.complete);
+  g_assert(shared.n_messages == first.n_messages);
+  g_assert(fresh.n_messages > first.n_messages);
+
+  g_assert(first.synced_length == length);
+  g_assert(shared.synced_length == length);
+  g_assert(fresh.synced_length == inf_text_buffer_get_length(test.buffer));
+
+  inf_test_session_sync_client_check(&first);
+  inf_test_session_sync_client_check(&shared);
+  inf_test_session_sync_client_check(&fresh);
+
+  inf_test_session_sync_client_finalize(&fresh);
+  inf_test_session_sync_client_finalize(&shared);
+  inf_test_session_sync_client_finalize(&first);
+  inf_test_session_sync_finalize(&test);
+}
+
+/* A client joining later than the share time gets the current state. */
+static void
+inf_test_session_sync_share_expired(void)
+{
+  InfTestSessionSync test;
+  InfTestSessionSyncClient first;
+  InfTestSessionSyncClient late;
+
+  inf_test_session_sync_init(&test);
+  inf_test_session_sync_edit(&test, 200);
+
+  inf_test_session_sync_client_init(&first, &test);
+  inf_test_session_sync_client_start(&first);
+
+  inf_test_session_sync_edit(&test, 10);
+  g_usleep(INF_TEST_SESSION_SYNC_SHARE_TIME + G_USEC_PER_SEC / 10);
+
+  inf_test_session_sync_client_init(&late, &test);
+  inf_test_session_sync_client_start(&late);
+
+  inf_test_session_sync_client_run(&first);
+  inf_test_session_sync_client_run(&late);
+
+  g_assert(first.complete && late.complete);
+  g_assert(late.n_messages > first.n_messages);
+  g_assert(late.synced_length == inf_text_buffer_get_length(test.buffer));
+
+  inf_test_session_sync_client_check(&first);
+  inf_test_session_sync_client_check(&late);
+
+  inf_test_session_sync_client_finalize(&late);
+  inf_test_session_sync_client_finalize(&first);
+  inf_test_session_sync_finalize(&test);
+}
+
+int main()
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_session_sync_streamed();
+  inf_test_session_sync_edit_during_sync();
+  inf_test_session_sync_close();
+  inf_test_session_sync_cancel();
+  inf_test_session_sync_remove_member();
+  inf_test_session_sync_share();
+  inf_test_session_sync_share_max_delta();
+  inf_test_session_sync_share_expired();
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,308 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks that InfStandaloneIo runs timeouts in order of expiration, and that
+ * watches and timeouts can be removed from inside callbacks, including while
+ * other events of the same poll round are still pending. */
+
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct _InfTestStandaloneIoTimeouts InfTestStandaloneIoTimeouts;
+struct _InfTestStandaloneIoTimeouts {
+  InfStandaloneIo* io;
+  GString* order;
+  InfIoTimeout* victim;
+  guint victim_notified;
+};
+
+typedef struct _InfTestStandaloneIoTimeout InfTestStandaloneIoTimeout;
+struct _InfTestStandaloneIoTimeout {
+  InfTestStandaloneIoTimeouts* test;
+  gchar name;
+};
+
+typedef struct _InfTestStandaloneIoWatch InfTestStandaloneIoWatch;
+struct _InfTestStandaloneIoWatch {
+  InfStandaloneIo* io;
+  InfNativeSocket fds[2];
+  InfIoWatch* watch;
+  guint calls;
+  guint notified;
+  gboolean in_callback;
+  /* The watch to remove when this one's callback runs */
+  InfTestStandaloneIoWatch* remove;
+};
+
+static void
+inf_test_standalone_io_timeout_notify(gpointer user_data)
+{
+  g_slice_free(InfTestStandaloneIoTimeout, user_data);
+}
+
+static void
+inf_test_standalone_io_victim_notify(gpointer user_data)
+{
+  ++((InfTestStandaloneIoTimeouts*)user_data)->victim_notified;
+}
+
+static void
+inf_test_standalone_io_victim_func(gpointer user_data)
+{
+  /* This timeout is removed before it elapses */
+  g_assert_not_reached();
+}
+
+static InfIoTimeout*
+inf_test_standalone_io_add_timeout(InfTestStandaloneIoTimeouts* test,
+                                   guint msecs,
+                                   gchar name);
+
+static void
+inf_test_standalone_io_timeout_func(gpointer user_data)
+{
+  InfTestStandaloneIoTimeout* timeout;
+  timeout = (InfTestStandaloneIoTimeout*)user_data;
+
+  g_string_append_c(timeout->test->order, timeout->name);
+
+  switch(timeout->name)
+  {
+  case 'b':
+    /* Remove a timeout that has not elapsed yet */
+    inf_io_remove_timeout(INF_IO(timeout->test->io), timeout->test->victim);
+    g_assert(timeout->test->victim_notified == 1);
+    timeout->test->victim = NULL;
+    break;
+  case 'c':
+    /* A timeout added from inside a callback runs before later ones */
+    inf_test_standalone_io_add_timeout(timeout->test, 0, 'd');
+    break;
+  case 'f':
+    inf_standalone_io_loop_quit(timeout->test->io);
+    break;
+  }
+}
+
+static InfIoTimeout*
+inf_test_standalone_io_add_timeout(InfTestStandaloneIoTimeouts* test,
+                                   guint msecs,
+                                   gchar name)
+{
+  InfTestStandaloneIoTimeout* timeout;
+
+  timeout = g_slice_new(InfTestStandaloneIoTimeout);
+  timeout->test = test;
+  timeout->name = name;
+
+  return inf_io_add_timeout(
+    INF_IO(test->io),
+    msecs,
+    inf_test_standalone_io_timeout_func,
+    timeout,
+    inf_test_standalone_io_timeout_notify
+  );
+}
+
+static void
+inf_test_standalone_io_timeouts(void)
+{
+  InfTestStandaloneIoTimeouts test;
+
+  test.io = inf_standalone_io_new();
+  test.order = g_string_new(NULL);
+  test.victim_notified = 0;
+
+  /* Added out of order on purpose */
+  inf_test_standalone_io_add_timeout(&test, 60, 'f');
+  inf_test_standalone_io_add_timeout(&test, 20, 'c');
+  inf_test_standalone_io_add_timeout(&test, 40, 'e');
+  inf_test_standalone_io_add_timeout(&test, 0, 'a');
+  inf_test_standalone_io_add_timeout(&test, 10, 'b');
+
+  test.victim = inf_io_add_timeout(
+    INF_IO(test.io),
+    50,
+    inf_test_standalone_io_victim_func,
+    &test,
+    inf_test_standalone_io_victim_notify
+  );
+
+  inf_standalone_io_loop(test.io);
+
+  g_assert(strcmp(test.order->str, "abcdef") == 0);
+  g_assert(test.victim == NULL);
+  g_assert(test.victim_notified == 1);
+
+  g_string_free(test.order, TRUE);
+  g_object_unref(test.io);
+}
+
+static void
+inf_test_standalone_io_watch_notify(gpointer user_data)
+{
+  InfTestStandaloneIoWatch* watch;
+  watch = (InfTestStandaloneIoWatch*)user_data;
+
+  /* The user data must stay alive while the callback runs */
+  g_assert(!watch->in_callback);
+  ++watch->notified;
+}
+
+static void
+inf_test_standalone_io_watch_func(InfNativeSocket* socket,
+                                  InfIoEvent event,
+                                  gpointer user_data)
+{
+  InfTestStandaloneIoWatch* watch;
+  watch = (InfTestStandaloneIoWatch*)user_data;
+
+  g_assert(event & INF_IO_INCOMING);
+  g_assert(watch->notified == 0);
+
+  watch->in_callback = TRUE;
+  ++watch->calls;
+
+  /* The data is not read, so a level-triggered watch keeps firing until it
+   * is removed. */
+  inf_io_remove_watch(INF_IO(watch->io), watch->remove->watch);
+  g_assert(watch->remove == watch || watch->remove->notified == 1);
+  watch->in_callback = FALSE;
+}
+
+static void
+inf_test_standalone_io_watch_init(InfTestStandaloneIoWatch* watch,
+                                  InfStandaloneIo* io)
+{
+  int ret;
+
+  ret = pipe(watch->fds);
+  g_assert(ret == 0);
+
+  watch->io = io;
+  watch->calls = 0;
+  watch->notified = 0;
+  watch->in_callback = FALSE;
+  watch->remove = watch;
+
+  watch->watch = inf_io_add_watch(
+    INF_IO(io),
+    &watch->fds[0],
+    INF_IO_INCOMING,
+    inf_test_standalone_io_watch_func,
+    watch,
+    inf_test_standalone_io_watch_notify
+  );
+
+  /* Make the watch ready */
+  ret = write(watch->fds[1], "x", 1);
+  g_assert(ret == 1);
+}
+
+static void
+inf_test_standalone_io_watch_finalize(InfTestStandaloneIoWatch* watch)
+{
+  close(watch->fds[0]);
+  close(watch->fds[1]);
+}
+
+static void
+inf_test_standalone_io_watches(void)
+{
+  InfStandaloneIo* io;
+  InfTestStandaloneIoWatch first;
+  InfTestStandaloneIoWatch second;
+  InfTestStandaloneIoWatch* fired;
+  InfTestStandaloneIoWatch* other;
+  guint i;
+
+  io = inf_standalone_io_new();
+
+  /* A watch that removes itself from its callback runs once, and is freed
+   * after the callback has returned. */
+  inf_test_standalone_io_watch_init(&first, io);
+  for(i = 0; i < 5; ++i)
+    inf_standalone_io_iteration_timeout(io, 10);
+
+  g_assert(first.calls == 1);
+  g_assert(first.notified == 1);
+  inf_test_standalone_io_watch_finalize(&first);
+
+  /* Two watches become ready in the same poll round. Whichever runs first
+   * removes the other one, whose pending event must then be dropped. */
+  inf_test_standalone_io_watch_init(&first, io);
+  inf_test_standalone_io_watch_init(&second, io);
+  first.remove = &second;
+  second.remove = &first;
+
+  inf_standalone_io_iteration_timeout(io, 10);
+  g_assert(first.calls + second.calls == 1);
+
+  if(first.calls == 1)
+  {
+    fired = &first;
+    other = &second;
+  }
+  else
+  {
+    fired = &second;
+    other = &first;
+  }
+
+  g_assert(other->notified == 1);
+  g_assert(fired->notified == 0);
+
+  /* The remaining watch now removes itself */
+  fired->remove = fired;
+  for(i = 0; i < 5; ++i)
+    inf_standalone_io_iteration_timeout(io, 10);
+
+  g_assert(fired->calls == 2);
+  g_assert(fired->notified == 1);
+  g_assert(other->calls == 0);
+
+  inf_test_standalone_io_watch_finalize(&first);
+  inf_test_standalone_io_watch_finalize(&second);
+  g_object_unref(io);
+}
+
+int main()
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_standalone_io_timeouts();
+  inf_test_standalone_io_watches();
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -19,6 +19,7 @@
 
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-user.h>
+#include <stdlib.h>
 #include <string.h>
 
 static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
@@ -127,6 +128,134 @@ static void l_test() {
   apply(free, (vec_));
 }
 
+/* Reference implementations of the component-wise operations, using one
+ * lookup per component. */
+static guint naive_ids[64];
+static guint naive_n_ids;
+
+static InfAdoptedStateVector* naive_combine(InfAdoptedStateVector* first,
+                                            InfAdoptedStateVector* second,
+                                            gboolean max) {
+  InfAdoptedStateVector* result;
+  guint i, a, b;
+
+  result = inf_adopted_state_vector_new();
+  for (i = 0; i < naive_n_ids; ++i) {
+    a = inf_adopted_state_vector_get(first, naive_ids[i]);
+    b = inf_adopted_state_vector_get(second, naive_ids[i]);
+    inf_adopted_state_vector_set(result, naive_ids[i],
+                                 max ? MAX(a, b) : MIN(a, b));
+  }
+
+  return result;
+}
+
+static InfAdoptedStateVector* random_vector(guint n_users) {
+  InfAdoptedStateVector* vec;
+  guint i;
+
+  vec = inf_adopted_state_vector_new();
+  for (i = 0; i < n_users; ++i)
+    if (rand() % 3 != 0)
+      apply(set, (vec, naive_ids[i], rand() % 4));
+  return vec;
+}
+
+static void algebra_test() {
+  InfAdoptedStateVector* first, * second, * result, * expected;
+  guint i, j, n_users, diff;
+
+  for (i = 0; i < G_N_ELEMENTS(naive_ids); ++i)
+    naive_ids[i] = 1 + i * 3;
+
+  for (i = 0; i < 2000; ++i) {
+    n_users = 1 + rand() % 12;
+    naive_n_ids = n_users;
+
+    first = random_vector(n_users);
+    second = random_vector(n_users);
+
+    result = apply(least_common_successor, (first, second));
+    expected = naive_combine(first, second, TRUE);
+    g_assert(apply(compare, (result, expected)) == 0);
+    g_assert(apply(causally_before, (first, result)));
+    g_assert(apply(causally_before, (second, result)));
+    apply(free, (expected));
+
+    diff = 0;
+    for (j = 0; j < n_users; ++j)
+      diff += apply(get, (result, naive_ids[j])) -
+              apply(get, (first, naive_ids[j]));
+    g_assert(apply(vdiff, (first, result)) == diff);
+    apply(free, (result));
+
+    result = apply(least_common_predecessor, (first, second));
+    expected = naive_combine(first, second, FALSE);
+    g_assert(apply(compare, (result, expected)) == 0);
+    g_assert(apply(causally_before, (result, first)));
+    g_assert(apply(causally_before, (result, second)));
+    apply(free, (expected));
+    apply(free, (result));
+
+    /* In-place variants. The hash of first is computed before, so that a
+     * stale cached hash would be noticed. */
+    apply(hash, (first));
+    expected = naive_combine(first, second, TRUE);
+    apply(max, (first, second));
+    g_assert(apply(compare, (first, expected)) == 0);
+    g_assert(apply(hash, (first)) == apply(hash, (expected)));
+    apply(free, (expected));
+
+    expected = naive_combine(first, second, FALSE);
+    apply(min, (first, second));
+    g_assert(apply(compare, (first, expected)) == 0);
+    g_assert(apply(hash, (first)) == apply(hash, (expected)));
+    apply(free, (expected));
+
+    apply(free, (first));
+    apply(free, (second));
+  }
+
+  printf("ok!\n");
+}
+
+/* Measures the merge-based operations against per-component lookups. Only
+ * run when an iteration count is given on the command line. */
+static void benchmark(guint iterations) {
+  InfAdoptedStateVector* first, * second, * result;
+  guint n_users[] = { 2, 4, 16, 64 };
+  gint64 naive_time, merge_time, start;
+  guint i, k;
+
+  for (k = 0; k < G_N_ELEMENTS(n_users); ++k) {
+    naive_n_ids = n_users[k];
+    first = random_vector(n_users[k]);
+    second = random_vector(n_users[k]);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < iterations; ++i) {
+      result = naive_combine(first, second, TRUE);
+      apply(free, (result));
+    }
+    naive_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < iterations; ++i) {
+      result = apply(least_common_successor, (first, second));
+      apply(free, (result));
+    }
+    merge_time = g_get_monotonic_time() - start;
+
+    printf("%2u users: lookup %8.1f ns/op, merge %8.1f ns/op\n",
+           n_users[k],
+           naive_time * 1000.0 / iterations,
+           merge_time * 1000.0 / iterations);
+
+    apply(free, (first));
+    apply(free, (second));
+  }
+}
+
 int main(int argc, char* argv[])
 {
   guint users[2];
@@ -153,11 +282,26 @@ int main(int argc, char* argv[])
   inf_adopted_state_vector_add(vec, users[1], 3);
   g_assert(inf_adopted_state_vector_get(vec, users[1]) == 3);
 
+  inf_adopted_state_vector_hash(vec);
   inf_adopted_state_vector_set(vec, users[1], 5);
   g_assert(inf_adopted_state_vector_get(vec, users[1]) == 5);
 
+  /* The cached hash must have been updated by the change */
+  vec2 = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vec2, users[0], 6);
+  inf_adopted_state_vector_set(vec2, users[1], 5);
+  g_assert(
+    inf_adopted_state_vector_hash(vec) == inf_adopted_state_vector_hash(vec2)
+  );
+  inf_adopted_state_vector_free(vec2);
+
   inf_adopted_state_vector_free(vec);
   l_test();
+  algebra_test();
+
+  if (argc > 1)
+    benchmark(strtoul(argv[1], NULL, 10));
+
   return 0;
 }
 
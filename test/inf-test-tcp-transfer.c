@@ -0,0 +1,405 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Transfers data between two InfTcpConnections over the loopback interface
+ * and checks that the receiving side honors its receive buffer size and
+ * receive budget, that the sending side reports partial writes in order and
+ * notifies its watermarks, and that the data arrives completely and in
+ * order. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+
+#define INF_TEST_TCP_TRANSFER_BUFFER_SIZE 1024
+#define INF_TEST_TCP_TRANSFER_BUDGET 4096
+#define INF_TEST_TCP_TRANSFER_HIGH_WATERMARK (64 * 1024)
+#define INF_TEST_TCP_TRANSFER_LOW_WATERMARK (16 * 1024)
+
+typedef struct _InfTestTcpTransfer InfTestTcpTransfer;
+struct _InfTestTcpTransfer {
+  InfStandaloneIo* io;
+  InfdTcpServer* server;
+  InfTcpConnection* client;
+  InfTcpConnection* accepted;
+
+  gsize received;
+  gsize iteration_received;
+  gsize max_iteration_received;
+
+  gsize sent;
+  guint sent_signals;
+  gboolean send_queue_full;
+  guint send_queue_full_changes;
+};
+
+static guchar
+inf_test_tcp_transfer_pattern(gsize offset)
+{
+  return (guchar)(offset % 251);
+}
+
+static gboolean
+inf_test_tcp_transfer_check(gconstpointer data,
+                            gsize len,
+                            gsize offset)
+{
+  const guchar* bytes;
+  gsize i;
+
+  bytes = (const guchar*)data;
+  for(i = 0; i < len; ++i)
+    if(bytes[i] != inf_test_tcp_transfer_pattern(offset + i))
+      return FALSE;
+
+  return TRUE;
+}
+
+static void
+inf_test_tcp_transfer_fill(guchar* data,
+                           gsize len,
+                           gsize offset)
+{
+  gsize i;
+  for(i = 0; i < len; ++i)
+    data[i] = inf_test_tcp_transfer_pattern(offset + i);
+}
+
+static void
+inf_test_tcp_transfer_error_cb(InfTcpConnection* connection,
+                               const GError* error,
+                               gpointer user_data)
+{
+  fprintf(stderr, "Connection error: %s\n", error->message);
+  g_assert_not_reached();
+}
+
+static void
+inf_test_tcp_transfer_received_cb(InfTcpConnection* connection,
+                                  gconstpointer data,
+                                  guint len,
+                                  gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  test = (InfTestTcpTransfer*)user_data;
+
+  g_assert(len <= INF_TEST_TCP_TRANSFER_BUFFER_SIZE);
+  g_assert(inf_test_tcp_transfer_check(data, len, test->received));
+
+  test->received += len;
+  test->iteration_received += len;
+}
+
+static void
+inf_test_tcp_transfer_sent_cb(InfTcpConnection* connection,
+                              gconstpointer data,
+                              guint len,
+                              gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  test = (InfTestTcpTransfer*)user_data;
+
+  /* Partially sent buffers must be reported piece by piece, in order */
+  g_assert(len > 0);
+  g_assert(inf_test_tcp_transfer_check(data, len, test->sent));
+
+  test->sent += len;
+  ++test->sent_signals;
+}
+
+static void
+inf_test_tcp_transfer_notify_send_queue_full_cb(GObject* object,
+                                                GParamSpec* pspec,
+                                                gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  gboolean full;
+  guint size;
+
+  test = (InfTestTcpTransfer*)user_data;
+
+  g_object_get(
+    object,
+    "send-queue-full", &full,
+    "send-queue-size", &size,
+    NULL
+  );
+
+  g_assert(full != test->send_queue_full);
+  if(full)
+    g_assert(size > INF_TEST_TCP_TRANSFER_HIGH_WATERMARK);
+  else
+    g_assert(size <= INF_TEST_TCP_TRANSFER_LOW_WATERMARK);
+
+  test->send_queue_full = full;
+  ++test->send_queue_full_changes;
+}
+
+static void
+inf_test_tcp_transfer_new_connection_cb(InfdTcpServer* server,
+                                        InfTcpConnection* connection,
+                                        gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  test = (InfTestTcpTransfer*)user_data;
+
+  g_assert(test->accepted == NULL);
+  test->accepted = connection;
+  g_object_ref(connection);
+
+  g_object_set(
+    G_OBJECT(connection),
+    "receive-buffer-size", INF_TEST_TCP_TRANSFER_BUFFER_SIZE,
+    "receive-budget", INF_TEST_TCP_TRANSFER_BUDGET,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_tcp_transfer_received_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "error",
+    G_CALLBACK(inf_test_tcp_transfer_error_cb),
+    test
+  );
+}
+
+static void
+inf_test_tcp_transfer_connect(InfTestTcpTransfer* test)
+{
+  InfIpAddress* address;
+  guint port;
+  InfTcpConnectionStatus status;
+  GError* error;
+
+  test->io = inf_standalone_io_new();
+  test->accepted = NULL;
+  test->received = 0;
+  test->max_iteration_received = 0;
+  test->sent = 0;
+  test->sent_signals = 0;
+  test->send_queue_full = FALSE;
+  test->send_queue_full_changes = 0;
+
+  address = inf_ip_address_new_loopback4();
+
+  test->server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test->io,
+    "local-address", address,
+    "local-port", 0,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->server),
+    "new-connection",
+    G_CALLBACK(inf_test_tcp_transfer_new_connection_cb),
+    test
+  );
+
+  error = NULL;
+  if(!infd_tcp_server_open(test->server, &error))
+  {
+    fprintf(stderr, "Failed to open server: %s\n", error->message);
+    g_assert_not_reached();
+  }
+
+  g_object_get(G_OBJECT(test->server), "local-port", &port, NULL);
+
+  test->client =
+    inf_tcp_connection_new_and_open(INF_IO(test->io), address, port, &error);
+  if(test->client == NULL)
+  {
+    fprintf(stderr, "Failed to connect: %s\n", error->message);
+    g_assert_not_reached();
+  }
+
+  g_signal_connect(
+    G_OBJECT(test->client),
+    "error",
+    G_CALLBACK(inf_test_tcp_transfer_error_cb),
+    test
+  );
+
+  inf_ip_address_free(address);
+
+  do
+  {
+    inf_standalone_io_iteration(test->io);
+    g_object_get(G_OBJECT(test->client), "status", &status, NULL);
+  } while(test->accepted == NULL || status != INF_TCP_CONNECTION_CONNECTED);
+}
+
+static void
+inf_test_tcp_transfer_disconnect(InfTestTcpTransfer* test)
+{
+  inf_tcp_connection_close(test->client);
+  inf_tcp_connection_close(test->accepted);
+  infd_tcp_server_close(test->server);
+
+  g_object_unref(test->client);
+  g_object_unref(test->accepted);
+  g_object_unref(test->server);
+  g_object_unref(test->io);
+}
+
+/* Runs the main loop until total bytes have been received, and checks
+ * that no single I/O event read more than the receive budget. */
+static void
+inf_test_tcp_transfer_receive(InfTestTcpTransfer* test,
+                              gsize total)
+{
+  while(test->received < total)
+  {
+    test->iteration_received = 0;
+    inf_standalone_io_iteration(test->io);
+
+    g_assert(test->iteration_received <= INF_TEST_TCP_TRANSFER_BUDGET);
+    test->max_iteration_received =
+      MAX(test->max_iteration_received, test->iteration_received);
+  }
+
+  g_assert(test->received == total);
+}
+
+static void
+inf_test_tcp_transfer_budget(void)
+{
+  InfTestTcpTransfer test;
+  guchar* data;
+  gsize total;
+
+  inf_test_tcp_transfer_connect(&test);
+
+  total = 1024 * 1024;
+  data = g_malloc(total);
+  inf_test_tcp_transfer_fill(data, total, 0);
+
+  inf_tcp_connection_send(test.client, data, total);
+  g_free(data);
+
+  inf_test_tcp_transfer_receive(&test, total);
+
+  /* With a megabyte waiting on the socket, reads stop at the budget, which
+   * is a multiple of the buffer size */
+  g_assert(test.max_iteration_received == INF_TEST_TCP_TRANSFER_BUDGET);
+
+  inf_test_tcp_transfer_disconnect(&test);
+}
+
+static void
+inf_test_tcp_transfer_queue(void)
+{
+  InfTestTcpTransfer test;
+  guchar small[61];
+  guchar* data;
+  GBytes* bytes;
+  gsize total;
+  gsize size;
+  guint queue_size;
+  guint i;
+
+  inf_test_tcp_transfer_connect(&test);
+
+  g_object_set(
+    G_OBJECT(test.client),
+    "high-watermark", INF_TEST_TCP_TRANSFER_HIGH_WATERMARK,
+    "low-watermark", INF_TEST_TCP_TRANSFER_LOW_WATERMARK,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "sent",
+    G_CALLBACK(inf_test_tcp_transfer_sent_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "notify::send-queue-full",
+    G_CALLBACK(inf_test_tcp_transfer_notify_send_queue_full_cb),
+    &test
+  );
+
+  /* More than the socket buffers on both sides can take, so that most of
+   * it stays queued by reference. */
+  size = 32 * 1024 * 1024;
+  data = g_malloc(size);
+  inf_test_tcp_transfer_fill(data, size, 0);
+  bytes = g_bytes_new_take(data, size);
+  inf_tcp_connection_send_bytes(test.client, bytes);
+  g_bytes_unref(bytes);
+  total = size;
+
+  g_assert(test.send_queue_full == TRUE);
+  g_assert(test.send_queue_full_changes == 1);
+
+  /* Small writes behind the queued buffer are copied, so the caller can
+   * reuse its buffer right away. */
+  for(i = 0; i < 256; ++i)
+  {
+    inf_test_tcp_transfer_fill(small, sizeof(small), total);
+    inf_tcp_connection_send(test.client, small, sizeof(small));
+    total += sizeof(small);
+  }
+
+  inf_test_tcp_transfer_receive(&test, total);
+
+  g_assert(test.sent == total);
+  g_assert(test.sent_signals > 1);
+
+  g_object_get(G_OBJECT(test.client), "send-queue-size", &queue_size, NULL);
+  g_assert(queue_size == 0);
+  g_assert(test.send_queue_full == FALSE);
+  g_assert(test.send_queue_full_changes == 2);
+
+  inf_test_tcp_transfer_disconnect(&test);
+}
+
+int main()
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_tcp_transfer_budget();
+  inf_test_tcp_transfer_queue();
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
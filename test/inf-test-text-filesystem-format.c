@@ -0,0 +1,1524 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks that text sessions written to a InfdFilesystemStorage read back
+ * unchanged, in the XML and in the binary format, compressed or not, also
+ * when converting between the formats, and that malformed binary files are
+ * rejected. Also checks that changes recorded by InfTextFilesystemJournal
+ * are applied when reading the session, including after a crash while
+ * appending to the journal or while writing a new version of the session,
+ * and that they are synced to the disk in groups. Finally checks that
+ * sessions written in the background end up on disk in order. */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH "/document"
+
+/* Offsets of the version and flags in the binary format */
+#define INF_TEST_TEXT_FILESYSTEM_FORMAT_VERSION_OFFSET 8
+#define INF_TEST_TEXT_FILESYSTEM_FORMAT_FLAGS_OFFSET 12
+
+typedef struct _InfTestTextFilesystemFormat InfTestTextFilesystemFormat;
+struct _InfTestTextFilesystemFormat {
+  gchar* root;
+  InfdFilesystemStorage* storage;
+
+  /* The document that is written */
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+};
+
+static GQuark
+inf_test_text_filesystem_format_error_quark(void)
+{
+  return g_quark_from_static_string("INF_TEXT_FILESYSTEM_FORMAT_ERROR");
+}
+
+static void
+inf_test_text_filesystem_format_append(InfTextBuffer* buffer,
+                                       InfUserTable* user_table,
+                                       guint author,
+                                       const gchar* text)
+{
+  InfUser* user;
+
+  user = NULL;
+  if(author != 0)
+    user = inf_user_table_lookup_user_by_id(user_table, author);
+
+  inf_text_buffer_insert_text(
+    buffer,
+    inf_text_buffer_get_length(buffer),
+    text,
+    strlen(text),
+    g_utf8_strlen(text, -1),
+    user
+  );
+}
+
+static void
+inf_test_text_filesystem_format_init(InfTestTextFilesystemFormat* test)
+{
+  GError* error;
+  InfUser* user;
+  gchar* text;
+  guint i;
+
+  error = NULL;
+  test->root = g_dir_make_tmp("inf-test-text-filesystem-format-XXXXXX", &error);
+  if(test->root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  test->storage = infd_filesystem_storage_new(test->root);
+  test->user_table = inf_user_table_new();
+
+  for(i = 1; i <= 2; ++i)
+  {
+    text = g_strdup_printf("User_%u", i);
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", text,
+        "hue", 0.25 * i,
+        NULL
+      )
+    );
+
+    g_free(text);
+    inf_user_table_add_user(test->user_table, user);
+    g_object_unref(user);
+  }
+
+  /* Segments by both users and without author, with text outside of ASCII,
+   * and long enough for the compressed data to need several buffers. */
+  test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  inf_test_text_filesystem_format_append(
+    test->buffer,
+    test->user_table,
+    1,
+    "Hello World, "
+  );
+
+  inf_test_text_filesystem_format_append(
+    test->buffer,
+    test->user_table,
+    2,
+    "gr\xc3\xbc\xc3\x9f" "e aus "
+  );
+
+  inf_test_text_filesystem_format_append(
+    test->buffer,
+    test->user_table,
+    0,
+    "\xe6\x97\xa5\xe6\x9c\xac\n"
+  );
+
+  for(i = 0; i < 2000; ++i)
+  {
+    text = g_strdup_printf("Line %u\n", i);
+
+    inf_test_text_filesystem_format_append(
+      test->buffer,
+      test->user_table,
+      i % 3,
+      text
+    );
+
+    g_free(text);
+  }
+}
+
+static void
+inf_test_text_filesystem_format_finalize(InfTestTextFilesystemFormat* test)
+{
+  GDir* dir;
+  const gchar* name;
+  gchar* path;
+
+  g_object_unref(test->buffer);
+  g_object_unref(test->user_table);
+  g_object_unref(test->storage);
+
+  dir = g_dir_open(test->root, 0, NULL);
+  g_assert(dir != NULL);
+
+  while( (name = g_dir_read_name(dir)) != NULL)
+  {
+    path = g_build_filename(test->root, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+
+  g_dir_close(dir);
+  g_rmdir(test->root);
+  g_free(test->root);
+}
+
+static gchar*
+inf_test_text_filesystem_format_get_file(InfTestTextFilesystemFormat* test,
+                                         const gchar* identifier)
+{
+  gchar* path;
+
+  path = infd_filesystem_storage_get_path(
+    test->storage,
+    identifier,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    NULL
+  );
+
+  g_assert(path != NULL);
+  return path;
+}
+
+static void
+inf_test_text_filesystem_format_write(InfTestTextFilesystemFormat* test,
+                                      InfUserTable* user_table,
+                                      InfTextBuffer* buffer,
+                                      InfTextFilesystemFormatFlags flags)
+{
+  GError* error;
+  gboolean result;
+
+  error = NULL;
+  result = inf_text_filesystem_format_write_with_flags(
+    test->storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    user_table,
+    buffer,
+    flags,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+}
+
+/* Checks that user_table and buffer contain the test document */
+static void
+inf_test_text_filesystem_format_check(InfTestTextFilesystemFormat* test,
+                                      InfUserTable* user_table,
+                                      InfTextBuffer* buffer)
+{
+  InfTextChunk* expected;
+  InfTextChunk* chunk;
+  InfUser* expected_user;
+  InfUser* user;
+  guint i;
+
+  expected = inf_text_buffer_get_slice(
+    test->buffer,
+    0,
+    inf_text_buffer_get_length(test->buffer)
+  );
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  g_assert(inf_text_chunk_equal(expected, chunk));
+
+  inf_text_chunk_free(expected);
+  inf_text_chunk_free(chunk);
+
+  for(i = 1; i <= 2; ++i)
+  {
+    expected_user = inf_user_table_lookup_user_by_id(test->user_table, i);
+    user = inf_user_table_lookup_user_by_id(user_table, i);
+
+    g_assert(user != NULL);
+    g_assert(
+      strcmp(inf_user_get_name(user), inf_user_get_name(expected_user)) == 0
+    );
+
+    g_assert(
+      fabs(
+        inf_text_user_get_hue(INF_TEXT_USER(user)) -
+        inf_text_user_get_hue(INF_TEXT_USER(expected_user))
+      ) < 1e-6
+    );
+  }
+}
+
+/* Reads the document from the storage. On success, the new user table and
+ * buffer are returned, otherwise error is set. */
+static gboolean
+inf_test_text_filesystem_format_read(InfTestTextFilesystemFormat* test,
+                                     InfUserTable** user_table,
+                                     InfTextBuffer** buffer,
+                                     GError** error)
+{
+  gboolean result;
+
+  *user_table = inf_user_table_new();
+  *buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    test->storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    *user_table,
+    *buffer,
+    error
+  );
+
+  if(result == FALSE)
+  {
+    g_object_unref(*user_table);
+    g_object_unref(*buffer);
+    *user_table = NULL;
+    *buffer = NULL;
+  }
+
+  return result;
+}
+
+/* Reads the document and checks that it is the test document */
+static void
+inf_test_text_filesystem_format_read_check(InfTestTextFilesystemFormat* test)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+
+  error = NULL;
+  if(!inf_test_text_filesystem_format_read(test, &user_table, &buffer,
+                                           &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  inf_test_text_filesystem_format_check(test, user_table, buffer);
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+}
+
+/* Returns whether the stored document is in the binary format */
+static gboolean
+inf_test_text_filesystem_format_is_binary(InfTestTextFilesystemFormat* test)
+{
+  gchar* path;
+  gchar* contents;
+  gsize length;
+  gboolean result;
+
+  path = inf_test_text_filesystem_format_get_file(test, "InfText");
+  result = g_file_get_contents(path, &contents, &length, NULL);
+  g_assert(result == TRUE);
+  g_free(path);
+
+  result = length >= 8 && memcmp(contents, "\211InfText", 8) == 0;
+  g_free(contents);
+  return result;
+}
+
+/* Returns the size of the file stored with identifier, or -1 if there is no
+ * such file */
+static gint64
+inf_test_text_filesystem_format_get_file_size(InfTestTextFilesystemFormat* test,
+                                              const gchar* identifier)
+{
+  GStatBuf stat_buf;
+  gchar* path;
+  int result;
+
+  path = inf_test_text_filesystem_format_get_file(test, identifier);
+  result = g_stat(path, &stat_buf);
+  g_free(path);
+
+  if(result == -1)
+    return -1;
+
+  return stat_buf.st_size;
+}
+
+static void
+inf_test_text_filesystem_format_truncate(InfTestTextFilesystemFormat* test,
+                                         const gchar* identifier,
+                                         gsize length)
+{
+  gchar* path;
+  gchar* contents;
+  gsize file_length;
+  gboolean result;
+
+  path = inf_test_text_filesystem_format_get_file(test, identifier);
+  result = g_file_get_contents(path, &contents, &file_length, NULL);
+  g_assert(result == TRUE);
+  g_assert(length <= file_length);
+
+  result = g_file_set_contents(path, contents, length, NULL);
+  g_assert(result == TRUE);
+
+  g_free(contents);
+  g_free(path);
+}
+
+static void
+inf_test_text_filesystem_format_round_trip(void)
+{
+  InfTestTextFilesystemFormat test;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    0
+  );
+
+  g_assert(!inf_test_text_filesystem_format_is_binary(&test));
+  inf_test_text_filesystem_format_read_check(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  g_assert(inf_test_text_filesystem_format_is_binary(&test));
+  inf_test_text_filesystem_format_read_check(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY | INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED
+  );
+
+  g_assert(inf_test_text_filesystem_format_is_binary(&test));
+  inf_test_text_filesystem_format_read_check(&test);
+
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+/* Converts the document from XML to binary and back by reading it and
+ * writing what was read with different flags */
+static void
+inf_test_text_filesystem_format_convert(void)
+{
+  static const InfTextFilesystemFormatFlags FLAGS[] = {
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY | INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+    0
+  };
+
+  InfTestTextFilesystemFormat test;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  gboolean result;
+  guint i;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    0
+  );
+
+  for(i = 0; i < G_N_ELEMENTS(FLAGS); ++i)
+  {
+    result = inf_test_text_filesystem_format_read(
+      &test,
+      &user_table,
+      &buffer,
+      NULL
+    );
+
+    g_assert(result == TRUE);
+    inf_test_text_filesystem_format_check(&test, user_table, buffer);
+
+    inf_test_text_filesystem_format_write(&test, user_table, buffer, FLAGS[i]);
+    g_assert(
+      inf_test_text_filesystem_format_is_binary(&test) ==
+      ((FLAGS[i] & INF_TEXT_FILESYSTEM_FORMAT_BINARY) != 0)
+    );
+
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+  }
+
+  inf_test_text_filesystem_format_read_check(&test);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+static guint32
+inf_test_text_filesystem_format_get_uint32(const gchar* data,
+                                           gsize offset)
+{
+  guint32 value;
+  memcpy(&value, data + offset, 4);
+  return GUINT32_FROM_LE(value);
+}
+
+static void
+inf_test_text_filesystem_format_set_uint32(gchar* data,
+                                           gsize offset,
+                                           guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  memcpy(data + offset, &value, 4);
+}
+
+static guint64
+inf_test_text_filesystem_format_get_uint64(const gchar* data,
+                                           gsize offset)
+{
+  guint64 value;
+  memcpy(&value, data + offset, 8);
+  return GUINT64_FROM_LE(value);
+}
+
+static void
+inf_test_text_filesystem_format_set_uint64(gchar* data,
+                                           gsize offset,
+                                           guint64 value)
+{
+  value = GUINT64_TO_LE(value);
+  memcpy(data + offset, &value, 8);
+}
+
+/* Returns the offset of the segment data of a file in the binary format,
+ * which follows the guint64 size of the segment data. */
+static gsize
+inf_test_text_filesystem_format_get_payload_offset(const gchar* data)
+{
+  gsize offset;
+  guint32 n_users;
+  guint32 i;
+
+  /* magic, version, flags, encoding */
+  offset = 16;
+  offset += 4 + inf_test_text_filesystem_format_get_uint32(data, offset);
+
+  n_users = inf_test_text_filesystem_format_get_uint32(data, offset);
+  offset += 4;
+
+  /* ID, hue, name */
+  for(i = 0; i < n_users; ++i)
+  {
+    offset += 16;
+    offset += inf_test_text_filesystem_format_get_uint32(data, offset - 4);
+  }
+
+  /* number of segments, size of segment data */
+  return offset + 12;
+}
+
+typedef void(*InfTestTextFilesystemFormatCorruptFunc)(gchar* data,
+                                                      gsize* length);
+
+/* Writes the test document in the binary format, modifies the file with
+ * func and checks that reading it fails with the given error. Returns FALSE
+ * if the file could not be written with the given flags. */
+static gboolean
+inf_test_text_filesystem_format_corrupt(InfTextFilesystemFormatFlags flags,
+                                        InfTestTextFilesystemFormatCorruptFunc
+                                          func,
+                                        GQuark domain,
+                                        gint code)
+{
+  InfTestTextFilesystemFormat test;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+  gchar* path;
+  gchar* contents;
+  gsize length;
+  guint32 file_flags;
+  gboolean result;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY | flags
+  );
+
+  path = inf_test_text_filesystem_format_get_file(&test, "InfText");
+  result = g_file_get_contents(path, &contents, &length, NULL);
+  g_assert(result == TRUE);
+
+  /* Without zlib, the document is stored uncompressed */
+  file_flags = inf_test_text_filesystem_format_get_uint32(
+    contents,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_FLAGS_OFFSET
+  );
+
+  if((flags & INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED) != 0 &&
+     (file_flags & 1) == 0)
+  {
+    g_free(contents);
+    g_free(path);
+    inf_test_text_filesystem_format_finalize(&test);
+    return FALSE;
+  }
+
+  func(contents, &length);
+  result = g_file_set_contents(path, contents, length, NULL);
+  g_assert(result == TRUE);
+
+  g_free(contents);
+  g_free(path);
+
+  error = NULL;
+  result = inf_test_text_filesystem_format_read(
+    &test,
+    &user_table,
+    &buffer,
+    &error
+  );
+
+  g_assert(result == FALSE);
+  if(domain != 0 && !g_error_matches(error, domain, code))
+  {
+    fprintf(stderr, "Unexpected error: %s\n", error->message);
+    g_assert_not_reached();
+  }
+
+  g_error_free(error);
+  inf_test_text_filesystem_format_finalize(&test);
+  return TRUE;
+}
+
+static void
+inf_test_text_filesystem_format_bad_magic(gchar* data,
+                                          gsize* length)
+{
+  data[1] = 'X';
+}
+
+static void
+inf_test_text_filesystem_format_bad_version(gchar* data,
+                                            gsize* length)
+{
+  inf_test_text_filesystem_format_set_uint32(
+    data,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_VERSION_OFFSET,
+    2
+  );
+}
+
+static void
+inf_test_text_filesystem_format_truncate_header(gchar* data,
+                                                gsize* length)
+{
+  /* In the middle of the size of the segment data */
+  *length = inf_test_text_filesystem_format_get_payload_offset(data) - 4;
+}
+
+static void
+inf_test_text_filesystem_format_truncate_user(gchar* data,
+                                              gsize* length)
+{
+  /* Within the first user's name, which follows the encoding "UTF-8" */
+  *length = 16 + 4 + 5 + 4 + 4 + 8 + 4 + 2;
+}
+
+static void
+inf_test_text_filesystem_format_truncate_file(gchar* data,
+                                              gsize* length)
+{
+  *length -= 1;
+}
+
+static void
+inf_test_text_filesystem_format_truncate_segment(gchar* data,
+                                                 gsize* length)
+{
+  gsize offset;
+  guint64 size;
+
+  /* Also announce the shorter segment data, so that the last segment
+   * itself turns out to be truncated. */
+  offset = inf_test_text_filesystem_format_get_payload_offset(data) - 8;
+  size = inf_test_text_filesystem_format_get_uint64(data, offset);
+  inf_test_text_filesystem_format_set_uint64(data, offset, size - 1);
+
+  *length -= 1;
+}
+
+static void
+inf_test_text_filesystem_format_invalid_utf8(gchar* data,
+                                             gsize* length)
+{
+  gsize i;
+
+  for(i = 0; i + 5 <= *length; ++i)
+  {
+    if(memcmp(data + i, "Hello", 5) == 0)
+    {
+      data[i] = '\xff';
+      return;
+    }
+  }
+
+  g_assert_not_reached();
+}
+
+static void
+inf_test_text_filesystem_format_wrong_chars(gchar* data,
+                                            gsize* length)
+{
+  gsize offset;
+  guint32 chars;
+
+  /* Pretend the text is in another single-byte encoding whose name has the
+   * same length, so that it is not checked as UTF-8, and announce one more
+   * character for the first segment than there is. */
+  g_assert(memcmp(data + 20, "UTF-8", 5) == 0);
+  memcpy(data + 20, "CP850", 5);
+
+  offset = inf_test_text_filesystem_format_get_payload_offset(data) + 4;
+  chars = inf_test_text_filesystem_format_get_uint32(data, offset);
+  inf_test_text_filesystem_format_set_uint32(data, offset, chars + 1);
+}
+
+static void
+inf_test_text_filesystem_format_payload_larger(gchar* data,
+                                               gsize* length)
+{
+  gsize offset;
+  guint64 size;
+
+  offset = inf_test_text_filesystem_format_get_payload_offset(data) - 8;
+  size = inf_test_text_filesystem_format_get_uint64(data, offset);
+  inf_test_text_filesystem_format_set_uint64(data, offset, size + 1);
+}
+
+static void
+inf_test_text_filesystem_format_payload_smaller(gchar* data,
+                                                gsize* length)
+{
+  gsize offset;
+  guint64 size;
+
+  offset = inf_test_text_filesystem_format_get_payload_offset(data) - 8;
+  size = inf_test_text_filesystem_format_get_uint64(data, offset);
+  inf_test_text_filesystem_format_set_uint64(data, offset, size - 1);
+}
+
+static void
+inf_test_text_filesystem_format_trailing_data(gchar* data,
+                                              gsize* length)
+{
+  /* The buffer returned by g_file_get_contents() has room for the
+   * terminating NUL byte. */
+  data[*length] = 'x';
+  *length += 1;
+}
+
+static void
+inf_test_text_filesystem_format_invalid(void)
+{
+  GQuark domain;
+  gint code;
+  gboolean result;
+
+  domain = inf_test_text_filesystem_format_error_quark();
+  code = INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_DATA;
+
+  /* Without the magic the file is parsed as XML, which fails as well */
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_bad_magic,
+    0,
+    0
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_bad_version,
+    domain,
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_UNSUPPORTED
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_truncate_header,
+    domain,
+    code
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_truncate_user,
+    domain,
+    code
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_truncate_file,
+    domain,
+    code
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_truncate_segment,
+    domain,
+    code
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_invalid_utf8,
+    domain,
+    code
+  );
+
+  inf_test_text_filesystem_format_corrupt(
+    0,
+    inf_test_text_filesystem_format_wrong_chars,
+    domain,
+    code
+  );
+
+  /* The inflated data does not match the announced size, or the file
+   * continues after the compressed data. Skipped without zlib. */
+  result = inf_test_text_filesystem_format_corrupt(
+    INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+    inf_test_text_filesystem_format_payload_larger,
+    domain,
+    code
+  );
+
+  if(result == TRUE)
+  {
+    inf_test_text_filesystem_format_corrupt(
+      INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+      inf_test_text_filesystem_format_payload_smaller,
+      domain,
+      code
+    );
+
+    inf_test_text_filesystem_format_corrupt(
+      INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+      inf_test_text_filesystem_format_truncate_file,
+      domain,
+      code
+    );
+
+    inf_test_text_filesystem_format_corrupt(
+      INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+      inf_test_text_filesystem_format_trailing_data,
+      domain,
+      code
+    );
+  }
+}
+
+/* Makes some changes to the test document: an insertion by each user,
+ * including a user that is not stored in the document yet, and an
+ * erasure. */
+static void
+inf_test_text_filesystem_format_edit(InfTestTextFilesystemFormat* test,
+                                     guint n)
+{
+  InfUser* user;
+  gchar* text;
+
+  if(inf_user_table_lookup_user_by_id(test->user_table, 3) == NULL)
+  {
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", 3,
+        "name", "User_3",
+        "hue", 0.5,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(test->user_table, user);
+    g_object_unref(user);
+  }
+
+  text = g_strdup_printf("Edit %u\n", n);
+
+  inf_text_buffer_insert_text(
+    test->buffer,
+    n,
+    text,
+    strlen(text),
+    g_utf8_strlen(text, -1),
+    inf_user_table_lookup_user_by_id(test->user_table, 1 + n % 3)
+  );
+
+  g_free(text);
+
+  inf_text_buffer_erase_text(test->buffer, 2 * n + 20, 5, NULL);
+}
+
+/* Reads the document and checks that it has the same content as buffer */
+static void
+inf_test_text_filesystem_format_read_check_chunk(
+  InfTestTextFilesystemFormat* test,
+  InfTextChunk* expected)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  gboolean result;
+
+  result = inf_test_text_filesystem_format_read(
+    test,
+    &user_table,
+    &buffer,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+  g_assert(inf_user_table_lookup_user_by_id(user_table, 3) != NULL);
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  g_assert(inf_text_chunk_equal(expected, chunk));
+  inf_text_chunk_free(chunk);
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+}
+
+static InfTextChunk*
+inf_test_text_filesystem_format_get_chunk(InfTestTextFilesystemFormat* test)
+{
+  return inf_text_buffer_get_slice(
+    test->buffer,
+    0,
+    inf_text_buffer_get_length(test->buffer)
+  );
+}
+
+static void
+inf_test_text_filesystem_format_journal_round_trip(void)
+{
+  InfTestTextFilesystemFormat test;
+  InfTextFilesystemJournal* journal;
+  InfTextChunk* expected;
+  guint i;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer
+  );
+
+  for(i = 0; i < 10; ++i)
+    inf_test_text_filesystem_format_edit(&test, i);
+
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+  g_assert(inf_text_filesystem_journal_get_size(journal) > 0);
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.journal") ==
+    (gint64)inf_text_filesystem_journal_get_size(journal)
+  );
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  /* Writing a checkpoint removes the journal, and new changes are recorded
+   * in a new one. */
+  g_assert(
+    inf_text_filesystem_journal_checkpoint(
+      journal,
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY |
+      INF_TEXT_FILESYSTEM_FORMAT_COMPRESSED,
+      NULL
+    ) == TRUE
+  );
+
+  g_assert(inf_text_filesystem_journal_get_size(journal) == 0);
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.journal") ==
+    -1
+  );
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  inf_test_text_filesystem_format_edit(&test, 10);
+  g_assert(inf_text_filesystem_journal_get_size(journal) > 0);
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  inf_text_filesystem_journal_free(journal);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+/* The last record of the journal is damaged, as if the server crashed while
+ * appending it. The records before are replayed, the journal is cut down to
+ * them, and records appended afterwards are replayed as well. */
+static void
+inf_test_text_filesystem_format_journal_damaged(gboolean truncate)
+{
+  InfTestTextFilesystemFormat test;
+  InfTextFilesystemJournal* journal;
+  InfTextChunk* expected;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  guint64 valid_size;
+  gchar* path;
+  gchar* contents;
+  gsize length;
+  gboolean result;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer
+  );
+
+  inf_test_text_filesystem_format_edit(&test, 1);
+  inf_test_text_filesystem_format_edit(&test, 2);
+  valid_size = inf_text_filesystem_journal_get_size(journal);
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+
+  /* By a user that has been recorded already, so that this is a single
+   * record */
+  inf_text_buffer_insert_text(
+    test.buffer,
+    0,
+    "Lost",
+    4,
+    4,
+    inf_user_table_lookup_user_by_id(test.user_table, 2)
+  );
+
+  inf_text_filesystem_journal_free(journal);
+
+  if(truncate)
+  {
+    inf_test_text_filesystem_format_truncate(
+      &test,
+      "InfText.journal",
+      valid_size + 10
+    );
+  }
+  else
+  {
+    path = inf_test_text_filesystem_format_get_file(&test, "InfText.journal");
+    result = g_file_get_contents(path, &contents, &length, NULL);
+    g_assert(result == TRUE);
+
+    /* Breaks the checksum of the last record */
+    contents[length - 1] ^= 0xff;
+    result = g_file_set_contents(path, contents, length, NULL);
+    g_assert(result == TRUE);
+
+    g_free(contents);
+    g_free(path);
+  }
+
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.journal") ==
+    (gint64)valid_size
+  );
+
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.tmp") == -1
+  );
+
+  /* Continue recording on what has been read */
+  result = inf_test_text_filesystem_format_read(
+    &test,
+    &user_table,
+    &buffer,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    user_table,
+    buffer
+  );
+
+  g_assert(inf_text_filesystem_journal_get_size(journal) == valid_size);
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    "Kept",
+    4,
+    4,
+    inf_user_table_lookup_user_by_id(user_table, 2)
+  );
+
+  inf_text_filesystem_journal_free(journal);
+
+  expected = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+/* Moves a new version of the test document into place under the "new"
+ * identifier, as if the server went down while writing it */
+static void
+inf_test_text_filesystem_format_leave_new(InfTestTextFilesystemFormat* test)
+{
+  gchar* path;
+  gchar* new_path;
+  gboolean result;
+
+  result = inf_text_filesystem_format_write_with_flags(
+    test->storage,
+    "/other",
+    test->user_table,
+    test->buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+
+  path = infd_filesystem_storage_get_path(
+    test->storage,
+    "InfText",
+    "/other",
+    NULL
+  );
+
+  new_path = inf_test_text_filesystem_format_get_file(test, "InfText.new");
+  g_assert(g_rename(path, new_path) == 0);
+
+  g_free(path);
+  g_free(new_path);
+}
+
+static void
+inf_test_text_filesystem_format_journal_leftover_new(void)
+{
+  InfTestTextFilesystemFormat test;
+  InfTextFilesystemJournal* journal;
+  InfTextChunk* expected;
+  GSList* list;
+  InfdStorageNode* node;
+  gchar* path;
+  gboolean result;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    0
+  );
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer
+  );
+
+  inf_test_text_filesystem_format_edit(&test, 2);
+  inf_text_filesystem_journal_free(journal);
+
+  /* The new version already contains the changes in the journal, so the
+   * journal must not be replayed on top of it. */
+  inf_test_text_filesystem_format_leave_new(&test);
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+
+  g_assert(inf_test_text_filesystem_format_is_binary(&test));
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.new") == -1
+  );
+
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.journal") ==
+    -1
+  );
+
+  /* A document whose first version was being written only exists under
+   * the "new" identifier. It is still listed, and can be read and
+   * removed. */
+  inf_test_text_filesystem_format_leave_new(&test);
+
+  path = inf_test_text_filesystem_format_get_file(&test, "InfText");
+  g_assert(g_unlink(path) == 0);
+  g_free(path);
+
+  list = infd_storage_read_subdirectory(INFD_STORAGE(test.storage), "/", NULL);
+  g_assert(list != NULL && list->next == NULL);
+
+  node = (InfdStorageNode*)list->data;
+  g_assert(node->type == INFD_STORAGE_NODE_NOTE);
+  g_assert(strcmp(node->name, "document") == 0);
+  g_assert(strcmp(node->identifier, "InfText") == 0);
+  infd_storage_node_list_free(list);
+
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  inf_test_text_filesystem_format_leave_new(&test);
+  result = infd_storage_remove_node(
+    INFD_STORAGE(test.storage),
+    "InfText",
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText") == -1
+  );
+
+  g_assert(
+    inf_test_text_filesystem_format_get_file_size(&test, "InfText.new") == -1
+  );
+
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+/* Changes are on disk as soon as they are recorded, and synced after the
+ * commit interval, by an explicit commit, or one by one if requested. */
+static void
+inf_test_text_filesystem_format_journal_commit(void)
+{
+  InfTestTextFilesystemFormat test;
+  InfTextFilesystemJournal* journal;
+  InfStandaloneIo* io;
+  InfTextChunk* expected;
+  GTimer* timer;
+
+  inf_test_text_filesystem_format_init(&test);
+  io = inf_standalone_io_new();
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer
+  );
+
+  inf_text_filesystem_journal_set_commit_interval(
+    journal,
+    INF_IO(io),
+    20
+  );
+
+  /* The changes can be read back before they are synced */
+  timer = g_timer_new();
+  inf_test_text_filesystem_format_edit(&test, 0);
+  inf_test_text_filesystem_format_edit(&test, 1);
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  /* A single commit syncs both of them */
+  inf_standalone_io_iteration(io);
+  g_assert(g_timer_elapsed(timer, NULL) * 1000 >= 20);
+  g_timer_destroy(timer);
+
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+
+  inf_test_text_filesystem_format_edit(&test, 2);
+  g_assert(inf_text_filesystem_journal_commit(journal, NULL) == TRUE);
+
+  /* Each change is synced as it is recorded */
+  inf_text_filesystem_journal_set_commit_interval(journal, NULL, 0);
+  inf_test_text_filesystem_format_edit(&test, 3);
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  inf_text_filesystem_journal_free(journal);
+  g_object_unref(io);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+/* Recording a change fails, which is reported by
+ * inf_text_filesystem_journal_check() until a checkpoint is written. */
+static void
+inf_test_text_filesystem_format_journal_error(void)
+{
+  InfTestTextFilesystemFormat test;
+  InfTextFilesystemJournal* journal;
+  InfTextChunk* expected;
+  GError* error;
+  gchar* path;
+  gboolean result;
+
+  inf_test_text_filesystem_format_init(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  /* A directory in place of the journal cannot be appended to */
+  path = inf_test_text_filesystem_format_get_file(&test, "InfText.journal");
+  g_assert(g_mkdir(path, 0755) == 0);
+
+  journal = inf_text_filesystem_journal_new(
+    test.storage,
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer
+  );
+
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+  inf_test_text_filesystem_format_edit(&test, 0);
+
+  error = NULL;
+  result = inf_text_filesystem_journal_check(journal, &error);
+  g_assert(result == FALSE);
+  g_assert(error != NULL && error->domain == G_FILE_ERROR);
+  g_error_free(error);
+
+  /* Further changes are not recorded, and the error stays */
+  inf_test_text_filesystem_format_edit(&test, 1);
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == FALSE);
+
+  g_assert(g_rmdir(path) == 0);
+  g_free(path);
+
+  result = inf_text_filesystem_journal_checkpoint(
+    journal,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+
+  inf_test_text_filesystem_format_edit(&test, 2);
+  g_assert(inf_text_filesystem_journal_check(journal, NULL) == TRUE);
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  inf_text_filesystem_journal_free(journal);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+static void
+inf_test_text_filesystem_format_write_async_finished_func(
+  InfdStorage* storage,
+  const GError* error,
+  gpointer user_data)
+{
+  guint* n_finished;
+  n_finished = (guint*)user_data;
+
+  g_assert(error == NULL);
+  ++*n_finished;
+}
+
+/* Sessions written in the I/O thread pool are serialized right away, and
+ * a newer version is never replaced by an older one that is written later,
+ * also when writing synchronously. */
+static void
+inf_test_text_filesystem_format_write_async(void)
+{
+  InfTestTextFilesystemFormat test;
+  InfStandaloneIo* io;
+  InfdStorageRequest* request;
+  InfTextChunk* expected;
+  guint n_finished;
+  guint i;
+
+  inf_test_text_filesystem_format_init(&test);
+  io = inf_standalone_io_new();
+  n_finished = 0;
+
+  /* More writes than the pool runs at the same time */
+  for(i = 0; i < 8; ++i)
+  {
+    inf_test_text_filesystem_format_edit(&test, i);
+
+    request = inf_text_filesystem_format_write_async(
+      test.storage,
+      INF_IO(io),
+      INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+      test.user_table,
+      test.buffer,
+      (i % 2 == 0) ? INF_TEXT_FILESYSTEM_FORMAT_BINARY : 0,
+      inf_test_text_filesystem_format_write_async_finished_func,
+      &n_finished,
+      NULL
+    );
+
+    g_assert(request != NULL);
+  }
+
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+  inf_test_text_filesystem_format_edit(&test, 8);
+
+  while(n_finished < 8)
+    inf_standalone_io_iteration(io);
+
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  request = inf_text_filesystem_format_write_async(
+    test.storage,
+    INF_IO(io),
+    INF_TEST_TEXT_FILESYSTEM_FORMAT_PATH,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    inf_test_text_filesystem_format_write_async_finished_func,
+    &n_finished,
+    NULL
+  );
+
+  g_assert(request != NULL);
+
+  inf_test_text_filesystem_format_edit(&test, 9);
+  expected = inf_test_text_filesystem_format_get_chunk(&test);
+
+  inf_test_text_filesystem_format_write(
+    &test,
+    test.user_table,
+    test.buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY
+  );
+
+  while(n_finished < 9)
+    inf_standalone_io_iteration(io);
+
+  inf_test_text_filesystem_format_read_check_chunk(&test, expected);
+  inf_text_chunk_free(expected);
+
+  g_object_unref(io);
+  inf_test_text_filesystem_format_finalize(&test);
+}
+
+int main()
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  inf_test_text_filesystem_format_round_trip();
+  inf_test_text_filesystem_format_convert();
+  inf_test_text_filesystem_format_invalid();
+  inf_test_text_filesystem_format_journal_round_trip();
+  inf_test_text_filesystem_format_journal_damaged(TRUE);
+  inf_test_text_filesystem_format_journal_damaged(FALSE);
+  inf_test_text_filesystem_format_journal_leftover_new();
+  inf_test_text_filesystem_format_journal_commit();
+  inf_test_text_filesystem_format_journal_error();
+  inf_test_text_filesystem_format_write_async();
+
+  inf_deinit();
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
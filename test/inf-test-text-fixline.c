@@ -31,7 +31,9 @@ typedef enum _InfTestTextFixlineTarget {
 typedef enum _InfTestTextFixlineOperation {
   OP_NONE,
   OP_INS,
-  OP_DEL
+  OP_DEL,
+  OP_CLR,
+  OP_REP
 } InfTestTextFixlineOperation;
 
 typedef struct _InfTestTextFixlineTest {
@@ -51,6 +53,8 @@ typedef struct _InfTestTextFixlineTest {
 #define MKBASEDLOP(pos,len) OP_DEL,TG_BASE,pos,GUINT_TO_POINTER(len)
 #define MKBUFINOP(pos,text) OP_INS,TG_BUF,pos,text
 #define MKBUFDLOP(pos,len) OP_DEL,TG_BUF,pos,GUINT_TO_POINTER(len)
+#define MKBUFCLOP() OP_CLR,TG_BUF,0,NULL
+#define MKBUFRPOP(pos,text) OP_REP,TG_BUF,pos,text
 
 static gboolean
 check_buffer(InfTextBuffer* buffer,
@@ -91,6 +95,124 @@ check_buffer(InfTextBuffer* buffer,
   return result;
 }
 
+static void
+count_signal_cb(InfTextBuffer* buffer,
+                guint pos,
+                InfTextChunk* chunk,
+                InfUser* user,
+                gpointer user_data)
+{
+  ++*(guint*)user_data;
+}
+
+/* Replaces the character at pos by text, as a batch of two edits */
+static void
+replace_text(InfTextBuffer* buffer,
+             guint pos,
+             const gchar* text)
+{
+  InfTextBufferEdit edits[2];
+  InfTextChunk* chunk;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, text, strlen(text), strlen(text), 0);
+
+  edits[0].pos = pos;
+  edits[0].len = 1;
+  edits[0].chunk = NULL;
+  edits[1].pos = pos;
+  edits[1].len = 0;
+  edits[1].chunk = chunk;
+
+  inf_text_buffer_apply_batch(buffer, edits, 2, NULL);
+  inf_text_chunk_free(chunk);
+}
+
+static gboolean
+test_batch(void)
+{
+  InfTextBuffer* buffer;
+  InfTextChunk* chunks[3];
+  InfTextBufferEdit edits[4];
+  guint n_signals;
+  guint i;
+  gboolean result;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  for(i = 0; i < 3; ++i)
+    chunks[i] = inf_text_chunk_new("UTF-8");
+
+  inf_text_chunk_insert_text(chunks[0], 0, "Hello ", 6, 6, 1);
+  inf_text_chunk_insert_text(chunks[1], 0, "World", 5, 5, 2);
+  inf_text_chunk_insert_text(chunks[2], 0, "!", 1, 1, 3);
+
+  inf_text_buffer_append(buffer, chunks[0], NULL);
+  inf_text_buffer_append(buffer, chunks[1], NULL);
+  if(!check_buffer(buffer, "Hello World", "Append"))
+  {
+    result = FALSE;
+    goto out;
+  }
+
+  n_signals = 0;
+  g_signal_connect(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(count_signal_cb),
+    &n_signals
+  );
+
+  g_signal_connect(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(count_signal_cb),
+    &n_signals
+  );
+
+  /* "Hello World" -> "World!Hello" */
+  edits[0].pos = 0;
+  edits[0].len = 6;
+  edits[0].chunk = NULL;
+  edits[1].pos = 5;
+  edits[1].len = 0;
+  edits[1].chunk = chunks[0];
+  edits[2].pos = 10;
+  edits[2].len = 1;
+  edits[2].chunk = NULL;
+  edits[3].pos = 5;
+  edits[3].len = 0;
+  edits[3].chunk = chunks[2];
+
+  inf_text_buffer_apply_batch(buffer, edits, 4, NULL);
+  if(!check_buffer(buffer, "World!Hello", "Batch"))
+  {
+    result = FALSE;
+    goto out;
+  }
+
+  if(n_signals != 2)
+  {
+    printf("Batch emitted %u signals instead of 2\n", n_signals);
+    result = FALSE;
+    goto out;
+  }
+
+  n_signals = 0;
+  inf_text_buffer_clear(buffer, NULL);
+  if(!check_buffer(buffer, "", "Clear") || n_signals != 1)
+  {
+    result = FALSE;
+    goto out;
+  }
+
+  result = TRUE;
+out:
+  for(i = 0; i < 3; ++i)
+    inf_text_chunk_free(chunks[i]);
+  g_object_unref(buffer);
+  return result;
+}
+
 static gboolean
 test_fixline(const gchar* initial_buffer_content,
              const gchar* initial_base_content,
@@ -175,6 +297,18 @@ test_fixline(const gchar* initial_buffer_content,
     else if(target == TG_BUF)
       inf_text_buffer_erase_text(buffer, pos, GPOINTER_TO_UINT(text), 0);
     break;
+  case OP_CLR:
+    if(target == TG_BASE)
+      inf_text_buffer_clear(base, NULL);
+    else if(target == TG_BUF)
+      inf_text_buffer_clear(buffer, NULL);
+    break;
+  case OP_REP:
+    if(target == TG_BASE)
+      replace_text(base, pos, text);
+    else if(target == TG_BUF)
+      replace_text(buffer, pos, text);
+    break;
   default:
     g_assert_not_reached();
     break;
@@ -294,6 +428,15 @@ int main()
     { "\n\n\n\nA", "\n\n\n\nA\n\n", 2, MKBUFDLOP(2, 2), "\n\nA", "\n\nA\n\n" },
     { "\n\n\n\nA", "\n\n\n\nA\n\n", 2, MKBUFDLOP(2, 3), "\n\n", "\n\n" },
     { "\n\n\n\nA", "\n\n\n\nA\n\n", 2, MKBUFDLOP(3, 2), "\n\n\n", "\n\n" },
+
+    /* 52: */
+    { "\nA\n", "\nA\n\n", 2, MKBUFCLOP(), "", "\n\n" },
+    { "\n\n\n\nA", "\n\n\n\nA\n\n", 2, MKBUFCLOP(), "", "\n\n" },
+    { "\n\n\n\n", "\n\n", 2, MKBUFCLOP(), "", "\n\n" },
+
+    { "\nA\n", "\nA\n\n", 2, MKBUFRPOP(1, "B"), "\nB\n", "\nB\n\n" },
+    { "\nA\n", "\nA\n\n", 2, MKBUFRPOP(1, "\n"), "\n\n\n", "\n\n" },
+    { "\n\n\n\nA", "\n\n\n\nA\n\n", 2, MKBUFRPOP(4, "BC"), "\n\n\n\nBC", "\n\n\n\nBC\n\n" },
   };
 
   guint i;
@@ -306,6 +449,11 @@ int main()
     printf("OK\n");
   }
 
+  printf("Batch test... ");
+  if(!test_batch())
+    return 1;
+  printf("OK\n");
+
   return 0;
 }
 
@@ -39,19 +39,35 @@ typedef struct {
   guint total;
   guint passed;
   gdouble time;
+  guint transforms;
+  guint memo_transforms;
 } test_result;
 
+static void
+end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                       InfAdoptedUser* user,
+                       InfAdoptedRequest* request,
+                       InfAdoptedRequest* translated,
+                       const GError* error,
+                       gpointer user_data)
+{
+  *(guint*)user_data += inf_adopted_algorithm_get_transform_count(algorithm);
+}
+
 static gboolean
 perform_single_test(InfTextChunk* initial,
                     InfTextChunk* final,
                     GSList* users,
                     GSList* requests,
-                    gdouble* time)
+                    gboolean memoize,
+                    gdouble* time,
+                    guint* transforms)
 {
   InfTextBuffer* buffer;
   InfCommunicationManager* manager;
   InfIo* io;
   InfTextSession* session;
+  InfAdoptedAlgorithm* algorithm;
 
   InfUserTable* user_table;
   InfTextUser* user;
@@ -110,6 +126,17 @@ perform_single_test(InfTextChunk* initial,
   g_object_unref(G_OBJECT(manager));
   g_object_unref(G_OBJECT(user_table));
 
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+  g_object_set(G_OBJECT(algorithm), "memoize-translations", memoize, NULL);
+
+  *transforms = 0;
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "end-execute-request",
+    G_CALLBACK(end_execute_request_cb),
+    transforms
+  );
+
   timer = g_timer_new();
   for(item = requests; item != NULL; item = item->next)
   {
@@ -155,7 +182,9 @@ perform_test(InfTextChunk* initial,
              GSList* users,
              GSList* requests,
              GRand* rand,
-             gdouble* time)
+             gdouble* time,
+             guint* transforms,
+             guint* memo_transforms)
 {
   GSList* permutation;
   GSList* item;
@@ -167,6 +196,8 @@ perform_test(InfTextChunk* initial,
   gpointer temp;
   gboolean retval;
   gdouble local_time;
+  guint local_transforms;
+  guint local_memo_transforms;
 
   guint user;
   guint user2;
@@ -201,6 +232,8 @@ perform_test(InfTextChunk* initial,
   inf_adopted_state_vector_free(v);
 
   *time = 0.0;
+  *transforms = 0;
+  *memo_transforms = 0;
   for(i = 0; i < NUM_PERMUTATIONS; ++ i)
   {
     dist = 0;
@@ -254,12 +287,43 @@ perform_test(InfTextChunk* initial,
       final,
       users,
       permutation,
-      &local_time
+      FALSE,
+      &local_time,
+      &local_transforms
     );
 
     if(!retval) break;
+    *time += local_time;
+
+    /* Memoized translations must give the same result, and can only save
+     * transformations, never add any. */
+    retval = perform_single_test(
+      initial,
+      final,
+      users,
+      permutation,
+      TRUE,
+      &local_time,
+      &local_memo_transforms
+    );
 
+    if(!retval) break;
     *time += local_time;
+
+    if(local_memo_transforms > local_transforms)
+    {
+      printf(
+        "(%u transformations with memoization vs. %u without) ",
+        local_memo_transforms,
+        local_transforms
+      );
+
+      retval = FALSE;
+      break;
+    }
+
+    *transforms += local_transforms;
+    *memo_transforms += local_memo_transforms;
   }
 
   g_slist_free(permutation);
@@ -283,6 +347,8 @@ foreach_test_func(const gchar* testfile,
   gboolean retval;
 
   gdouble local_time;
+  guint transforms;
+  guint memo_transforms;
 
   /* Only process XML files, not the Makefiles or other stuff */
   if(!g_str_has_suffix(testfile, ".xml"))
@@ -368,14 +434,24 @@ foreach_test_func(const gchar* testfile,
         users,
         requests,
         result->rand,
-        &local_time
+        &local_time,
+        &transforms,
+        &memo_transforms
       );
       
       if(retval == TRUE)
       {
         ++ result->passed;
-        printf("OK (%g secs)\n", local_time);
+        printf(
+          "OK (%g secs, %u/%u transformations)\n",
+          local_time,
+          memo_transforms,
+          transforms
+        );
+
         result->time += local_time;
+        result->transforms += transforms;
+        result->memo_transforms += memo_transforms;
       }
       else
       {
@@ -433,6 +509,8 @@ int main(int argc, char* argv[])
   result.total = 0;
   result.passed = 0;
   result.time = 0.0;
+  result.transforms = 0;
+  result.memo_transforms = 0;
 
   timer = g_timer_new();
   retval = inf_test_util_dir_foreach(
@@ -459,9 +537,19 @@ int main(int argc, char* argv[])
     result.passed, result.total, elapsed, result.time
   );
 
+  printf(
+    "%u transformations with memoized translations, %u without\n",
+    result.memo_transforms, result.transforms
+  );
+
   if(result.passed < result.total)
     return -1;
 
+  /* The test sessions contain concurrent requests that need the same
+   * intermediate translation more than once while being executed */
+  if(result.memo_transforms >= result.transforms)
+    return -1;
+
   return 0;
 }
 
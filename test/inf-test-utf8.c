@@ -0,0 +1,302 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Compares the UTF-8 functions in inf-utf8.h with their GLib counterparts.
+ * All functions are checked on short inputs at every alignment, so that
+ * texts shorter than one SIMD block, unaligned tails and multi-byte
+ * characters crossing block boundaries are covered. If a document size in
+ * megabytes is given on the command line, the speed of both is measured on
+ * large documents as well. Set the LIBINFINITY_DISABLE_SIMD environment
+ * variable to test the portable implementation. */
+
+#include <libinfinity/common/inf-utf8.h>
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _InfTestUtf8Document InfTestUtf8Document;
+struct _InfTestUtf8Document {
+  const gchar* name;
+  const gchar* sample;
+};
+
+static const InfTestUtf8Document INF_TEST_UTF8_DOCUMENTS[] = {
+  { "ascii", "The quick brown fox jumps over the lazy dog.\n" },
+  { "latin", "Falsches \xc3\x9c" "ben von Xylophonmusik qu\xc3\xa4lt "
+             "jeden gr\xc3\xb6\xc3\x9f" "eren Zwerg.\n" },
+  { "cjk", "\xe8\x87\xaa\xe7\x94\xb1\xe3\x81\xa8\xe5\xb9\xb3\xe7\xad\x89"
+           "\xe3\x81\xae\xe6\x96\x87\xe6\x9b\xb8\xe3\x80\x82\n" },
+  { "emoji", "ok \xf0\x9f\x98\x80 fine \xf0\x9f\x91\x8d\n" }
+};
+
+static gchar*
+inf_test_utf8_make_document(const gchar* sample,
+                            gsize size,
+                            gsize* bytes)
+{
+  GString* str;
+  gsize sample_len;
+
+  sample_len = strlen(sample);
+  str = g_string_sized_new(size + sample_len);
+  while(str->len < size)
+    g_string_append_len(str, sample, sample_len);
+
+  *bytes = str->len;
+  return g_string_free(str, FALSE);
+}
+
+/* Checks all functions on text against GLib */
+static void
+inf_test_utf8_check(const gchar* text,
+                    gsize bytes)
+{
+  const gchar* glib_end;
+  const gchar* inf_end;
+  gboolean glib_valid;
+  gboolean inf_valid;
+  glong chars;
+  gsize offset;
+
+  glib_valid = g_utf8_validate(text, bytes, &glib_end);
+  inf_valid = inf_utf8_validate(text, bytes, &inf_end);
+
+  g_assert(glib_valid == inf_valid);
+  g_assert(glib_end == inf_end);
+
+  if(glib_valid)
+  {
+    chars = g_utf8_strlen(text, bytes);
+    g_assert(inf_utf8_strlen(text, bytes) == (gsize)chars);
+
+    for(offset = 0; offset <= (gsize)chars; ++offset)
+    {
+      g_assert(
+        text + inf_utf8_offset_to_index(text, bytes, offset) ==
+        g_utf8_offset_to_pointer(text, offset)
+      );
+    }
+  }
+}
+
+/* The SIMD implementations work on blocks of 16 or 32 bytes. Check every
+ * length up to a few blocks, starting at every alignment, with a prefix of
+ * ASCII characters that moves the multi-byte characters of the sample
+ * across the block boundaries. */
+static void
+inf_test_utf8_check_blocks(const gchar* sample)
+{
+  gchar* storage;
+  gchar* text;
+  gsize sample_len;
+  gsize align;
+  gsize prefix;
+  gsize bytes;
+  gsize pos;
+
+  sample_len = strlen(sample);
+  storage = g_malloc(3 + 96 + sample_len);
+
+  for(align = 0; align < 4; ++align)
+  {
+    text = storage + align;
+
+    for(prefix = 0; prefix < 40; ++prefix)
+    {
+      memset(text, 'a', prefix);
+      memcpy(text + prefix, sample, sample_len);
+
+      /* Includes lengths that cut a multi-byte character in half */
+      for(bytes = 0; bytes <= prefix + sample_len; ++bytes)
+        inf_test_utf8_check(text, bytes);
+
+      /* A stray continuation byte and a truncated character at every
+       * position of the sample */
+      for(pos = prefix; pos < prefix + sample_len; ++pos)
+      {
+        text[pos] = '\x80';
+        inf_test_utf8_check(text, prefix + sample_len);
+        text[pos] = '\xe2';
+        inf_test_utf8_check(text, prefix + sample_len);
+        text[pos] = sample[pos - prefix];
+      }
+    }
+  }
+
+  g_free(storage);
+}
+
+static void
+inf_test_utf8_report(const gchar* what,
+                     gsize bytes,
+                     guint iterations,
+                     gint64 glib_time,
+                     gint64 inf_time)
+{
+  gdouble mb;
+
+  mb = (gdouble)bytes * iterations / (1024.0 * 1024.0);
+
+  printf(
+    "  %-18s glib %8.1f MB/s   inf %8.1f MB/s   (x%.1f)\n",
+    what,
+    mb / (MAX(glib_time, 1) / 1e6),
+    mb / (MAX(inf_time, 1) / 1e6),
+    (gdouble)MAX(glib_time, 1) / MAX(inf_time, 1)
+  );
+}
+
+static void
+inf_test_utf8_run(const InfTestUtf8Document* doc,
+                  gsize size,
+                  guint iterations)
+{
+  gchar* text;
+  gsize bytes;
+  glong glib_chars;
+  gsize inf_chars;
+  gsize offsets[8];
+  gsize glib_sum;
+  gsize inf_sum;
+  const gchar* end;
+  gint64 begin;
+  gint64 glib_time;
+  gint64 inf_time;
+  guint i;
+  guint j;
+
+  text = inf_test_utf8_make_document(doc->sample, size, &bytes);
+  printf("%s (%lu bytes)\n", doc->name, (unsigned long)bytes);
+
+  /* Character count */
+  glib_chars = 0;
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    glib_chars += g_utf8_strlen(text, bytes);
+  glib_time = g_get_monotonic_time() - begin;
+
+  inf_chars = 0;
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    inf_chars += inf_utf8_strlen(text, bytes);
+  inf_time = g_get_monotonic_time() - begin;
+
+  g_assert((gsize)glib_chars == inf_chars);
+  inf_test_utf8_report("strlen", bytes, iterations, glib_time, inf_time);
+
+  /* Offset to byte index, at eight positions spread over the document */
+  inf_chars /= iterations;
+  for(j = 0; j < G_N_ELEMENTS(offsets); ++j)
+  {
+    offsets[j] = inf_chars * (j + 1) / G_N_ELEMENTS(offsets);
+    g_assert(
+      text + inf_utf8_offset_to_index(text, bytes, offsets[j]) ==
+      g_utf8_offset_to_pointer(text, offsets[j])
+    );
+  }
+
+  glib_sum = 0;
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    for(j = 0; j < G_N_ELEMENTS(offsets); ++j)
+      glib_sum += g_utf8_offset_to_pointer(text, offsets[j]) - text;
+  glib_time = g_get_monotonic_time() - begin;
+
+  inf_sum = 0;
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    for(j = 0; j < G_N_ELEMENTS(offsets); ++j)
+      inf_sum += inf_utf8_offset_to_index(text, bytes, offsets[j]);
+  inf_time = g_get_monotonic_time() - begin;
+
+  g_assert(glib_sum == inf_sum);
+
+  /* Each iteration scans 4.5 times the document on average */
+  inf_test_utf8_report(
+    "offset_to_index",
+    bytes * 9 / 2,
+    iterations,
+    glib_time,
+    inf_time
+  );
+
+  /* Validation */
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    g_assert(g_utf8_validate(text, bytes, NULL));
+  glib_time = g_get_monotonic_time() - begin;
+
+  begin = g_get_monotonic_time();
+  for(i = 0; i < iterations; ++i)
+    g_assert(inf_utf8_validate(text, bytes, &end) && end == text + bytes);
+  inf_time = g_get_monotonic_time() - begin;
+
+  inf_test_utf8_report("validate", bytes, iterations, glib_time, inf_time);
+
+  /* An invalid byte near the end must be found */
+  text[bytes - 2] = '\xff';
+  g_assert(!inf_utf8_validate(text, bytes, &end));
+  g_assert(!g_utf8_validate(text, bytes, NULL));
+  g_assert(end <= text + bytes - 2);
+
+  g_free(text);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  gsize size;
+  guint iterations;
+  guint i;
+
+  size = 0;
+  iterations = 10;
+
+  if(argc > 1) size = strtoul(argv[1], NULL, 10);
+  if(argc > 2) iterations = strtoul(argv[2], NULL, 10);
+
+  if( (argc > 1 && size == 0) || iterations == 0)
+  {
+    fprintf(stderr, "Usage: %s [megabytes] [iterations]\n", argv[0]);
+    return -1;
+  }
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_UTF8_DOCUMENTS); ++i)
+    inf_test_utf8_check_blocks(INF_TEST_UTF8_DOCUMENTS[i].sample);
+
+  /* The benchmark is only run on request, so that make check stays fast */
+  if(size == 0)
+    return 0;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_UTF8_DOCUMENTS); ++i)
+  {
+    inf_test_utf8_run(
+      &INF_TEST_UTF8_DOCUMENTS[i],
+      size * 1024 * 1024,
+      iterations
+    );
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */